@@ -0,0 +1,176 @@
+// MIT License
+//
+// Copyright(c) 2023 Lev Faynshteyn
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+
+#ifndef FILE_MIME_BASIC_DETECTOR_H
+#define FILE_MIME_BASIC_DETECTOR_H
+
+#include "file_mime/file_mime.h"
+
+namespace file_mime {
+inline namespace FILE_MIME_ABI_NAMESPACE {
+
+	namespace detail {
+
+		template <std::size_t N>
+		[[nodiscard]] constexpr auto count_selected_signatures(const std::array<magic_signature, N>& signatures, const mime_set formats) -> std::size_t {
+			auto count = std::size_t{ 0 };
+			for (const auto& signature : signatures) {
+				count += contains(formats, signature.id) ? 1 : 0;
+			}
+			return count;
+		}
+
+		// The signatures of the #formats, in the registry order (so the ones of the same mime type stay next to each other).
+		template <std::size_t M, std::size_t N>
+		[[nodiscard]] constexpr auto make_selected_signatures(const std::array<magic_signature, N>& signatures, const mime_set formats) -> std::array<magic_signature, M> {
+			auto selected = std::array<magic_signature, M>{};
+			auto count = std::size_t{ 0 };
+			for (const auto& signature : signatures) {
+				if (contains(formats, signature.id)) {
+					selected[count++] = signature;
+				}
+			}
+			return selected;
+		}
+
+		// The first byte of every signature at the start of the file, packed so that the candidates of a header are found with a scan of a few bytes.
+		template <std::size_t N>
+		[[nodiscard]] constexpr auto make_first_bytes(const std::array<magic_signature, N>& signatures) -> std::array<std::uint8_t, N> {
+			auto first_bytes = std::array<std::uint8_t, N>{};
+			for (auto i = std::size_t{ 0 }; i < N; ++i) {
+				first_bytes[i] = signatures[i].pattern[0];
+			}
+			return first_bytes;
+		}
+
+		// A bit per byte value that starts one of the signatures, so that most of the headers are ruled out with a single load.
+		template <std::size_t N>
+		[[nodiscard]] constexpr auto make_first_byte_set(const std::array<magic_signature, N>& signatures) -> std::array<std::uint64_t, 4> {
+			auto set = std::array<std::uint64_t, 4>{};
+			for (const auto& signature : signatures) {
+				set[signature.pattern[0] >> 6] |= std::uint64_t{ 1 } << (signature.pattern[0] & 63);
+			}
+			return set;
+		}
+
+		// The look-up tables of a subset of the registry, derived at compile time like the ones of the whole registry.
+		// Keyed on the set rather than on the mime ids, so that the detectors of the same formats listed in a different order share them.
+		template <mime_set formats>
+		struct subset_tables {
+			static constexpr auto signatures = make_selected_signatures<count_selected_signatures(magic_signatures, formats)>(magic_signatures, formats);
+			static constexpr auto anchored = make_anchored_signatures<count_anchored_signatures(signatures)>(signatures);
+			static constexpr auto offsets = make_offset_signatures<signatures.size() - anchored.size()>(signatures);
+			static constexpr auto first_bytes = make_first_bytes(anchored);
+			static constexpr auto first_byte_set = make_first_byte_set(anchored);
+			static constexpr auto mime_groups = make_mime_groups(anchored);
+			static constexpr auto header_read_size = first_read_size(offsets);
+			static constexpr auto read_plan = make_read_plan<count_read_ranges(offsets)>(offsets);
+		};
+
+	} // namespace detail
+
+	// A detector of the #ids formats only, with look-up tables generated at compile time for just their magic numbers: a binary that only cares about a few formats
+	// (e.g. basic_detector<mime_id::png, mime_id::jpeg, mime_id::ktx2, mime_id::gltf_binary>) gets tables of a few cache lines and a handful of candidates per header,
+	// instead of searching the whole registry. A bit set of the first bytes of the magic numbers rules out most headers with one load, and the first bytes are packed together
+	// and scanned before any of the magic numbers is compared in full.
+	// It finds the same types as a signature_set of the same formats, so a file of another type is reported as mime_id::unknown (or as one of the #ids if it also carries one of their magic numbers).
+	template <mime_id... ids>
+	class basic_detector {
+	public:
+		static_assert(sizeof...(ids) != 0, "A detector needs at least one format");
+		static_assert(((detail::count_selected_signatures(magic_signatures, make_mime_set({ ids })) != 0) && ...), "Every format of a detector needs a magic number in the registry");
+
+		static constexpr auto formats = make_mime_set({ ids... });
+
+		// Determine the mime id of a file from its raw in-memory bytes, like file_mime::get_id_deep, with the magic numbers of the #formats only.
+		// Headers that are too small to determine their type get mime_id::unknown, whatever the hint.
+		[[nodiscard]] static auto get_id_deep(const uint8_t* file_bytes, const std::size_t file_size, const mime_id mime_type_hint = mime_id::unknown) noexcept -> mime_id {
+			if (file_size < min_file_header_size) {
+				return mime_id::unknown;
+			}
+
+			// The magic numbers of the hint first, as in all the approaches of get_id_deep. The header is only copied to a padded block once a first byte matches
+			const auto first = file_bytes[0];
+			if (((tables::first_byte_set[first >> 6] >> (first & 63)) & 1) != 0) {
+				const auto header = detail::load_header(file_bytes, file_size);
+				const auto& group = tables::mime_groups[static_cast<std::size_t>(mime_type_hint)];
+				for (auto i = group.first; i < group.last; ++i) {
+					if (detail::matches(tables::anchored[i], header)) {
+						return mime_type_hint;
+					}
+				}
+
+				for (auto i = std::size_t{ 0 }; i < tables::anchored.size(); ++i) {
+					if (tables::first_bytes[i] == first && detail::matches(tables::anchored[i], header)) {
+						return tables::anchored[i].id;
+					}
+				}
+			}
+
+			return detail::get_id_at_offsets(tables::offsets, file_bytes, file_size, 0, tables::offsets.size());
+		}
+
+		// Determine the mime id of a file from its bytes fetched with #read_at, like detail::get_id_deep_at: a single read of the header (along with the magic numbers at an offset that fit it) and one read per range of the read plan of the #formats.
+		template <typename ReadAt>
+		[[nodiscard]] static auto get_id_deep_at(const ReadAt& read_at, const mime_id mime_type_hint) -> mime_id {
+			auto buffer = std::array<uint8_t, detail::max_read_range_size>{};
+			const auto get_id_deep = [](const uint8_t* file_bytes, const std::size_t file_size, const mime_id hint) {
+				return basic_detector::get_id_deep(file_bytes, file_size, hint);
+			};
+			return detail::get_id_deep_at(read_at, mime_type_hint, buffer, get_id_deep, tables::offsets, tables::read_plan, tables::header_read_size);
+		}
+
+		// Determine the mime id of an open file from its magic numbers, like file_mime::get_id_from_file.
+		[[nodiscard]] static auto get_id_from_file(const int fd, const mime_id mime_type_hint = mime_id::unknown) noexcept -> file_id_result {
+			auto error = 0;
+			const auto read = [fd, &error](uint8_t* p, const std::size_t size, const std::uint64_t offset) -> std::ptrdiff_t {
+				const auto result = detail::read_at(fd, p, size, offset);
+				if (result < 0) {
+					error = int(-result);
+				}
+				return result;
+			};
+			const auto id = get_id_deep_at(read, mime_type_hint);
+			if (error != 0) {
+				return file_id_result{ mime_type_hint, error };
+			}
+			return file_id_result{ id, 0, mime_type_hint != mime_id::unknown && id != mime_type_hint };
+		}
+
+		// Determine the mime id of a file from its magic numbers, falling back to its extension if it can't be opened or read, like file_mime::get_id_from_file.
+		[[nodiscard]] static auto get_id_from_file(const std::string_view path_to_file) noexcept -> file_id_result {
+			return detail::get_id_from_path(path_to_file, [](const int fd, const mime_id hint) {
+				return get_id_from_file(fd, hint);
+			});
+		}
+
+	private:
+		using tables = detail::subset_tables<formats>;
+	};
+
+} // inline namespace FILE_MIME_ABI_NAMESPACE
+} // namespace file_mime
+
+#endif // FILE_MIME_BASIC_DETECTOR_H
@@ -0,0 +1,467 @@
+// MIT License
+//
+// Copyright(c) 2023 Lev Faynshteyn
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef FILE_MIME_CLASSIFY_FILES_H
+#define FILE_MIME_CLASSIFY_FILES_H
+
+#include "file_mime/file_mime.h"
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+namespace file_mime {
+inline namespace FILE_MIME_ABI_NAMESPACE {
+
+	struct classify_files_options {
+		std::size_t queue_depth = 256; // the number of files in flight at once with io_uring
+		std::size_t thread_count = 0; // the threads of the pread fallback, 0 uses all the hardware threads
+		bool use_io_uring = true; // use the pread fallback only when false, or when io_uring isn't available
+	};
+
+	namespace detail {
+
+		// Open and classify a single file with positional reads, the same way get_id_from_file does (and counted the same way in the stats). Returns the errno of a failed open/read.
+		inline auto classify_file_pread(const std::string& path, mime_id& id) -> int {
+			const auto result = get_id_from_file(std::string_view(path));
+			id = result.id;
+			return result.error;
+		}
+
+		// The fallback: a pool of threads that take the files one at a time and block on their reads, so the queue depth is the number of threads.
+		inline auto classify_files_pread(const std::string* paths, const std::size_t count, const classify_files_options& options, mime_id* ids, int* errors) -> void {
+			auto next = std::atomic<std::size_t>{ 0 };
+			const auto run = [&]() {
+				for (auto i = next.fetch_add(1, std::memory_order_relaxed); i < count; i = next.fetch_add(1, std::memory_order_relaxed)) {
+					auto id = get_id_shallow(paths[i]);
+					const auto error = classify_file_pread(paths[i], id);
+					ids[i] = id;
+					if (errors != nullptr) {
+						errors[i] = error;
+					}
+				}
+			};
+
+			const auto thread_count = std::min(count, options.thread_count != 0 ? options.thread_count : std::size_t{ std::max(std::thread::hardware_concurrency(), 1u) });
+			auto threads = std::vector<std::thread>{};
+			for (auto i = std::size_t{ 1 }; i < thread_count; ++i) {
+				threads.emplace_back(run);
+			}
+			run();
+			for (auto& thread : threads) {
+				thread.join();
+			}
+		}
+
+#if defined(__linux__)
+		// A minimal io_uring instance driven with the raw syscalls, so that there is no dependency on liburing.
+		// The registered file table holds one direct descriptor per slot, which lets an openat, the reads and the close of a file be linked into a single chain.
+		struct io_ring {
+			int fd = -1;
+			void* ring = MAP_FAILED;
+			std::size_t ring_size = 0;
+			io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+			std::size_t sqes_size = 0;
+
+			unsigned* sq_head = nullptr;
+			unsigned* sq_tail = nullptr;
+			unsigned sq_mask = 0;
+			unsigned sq_entries = 0;
+			unsigned sq_local_tail = 0;
+
+			unsigned* cq_head = nullptr;
+			unsigned* cq_tail = nullptr;
+			unsigned cq_mask = 0;
+			io_uring_cqe* cqes = nullptr;
+
+			io_ring() = default;
+			io_ring(const io_ring&) = delete;
+			auto operator=(const io_ring&) -> io_ring& = delete;
+
+			~io_ring() {
+				if (sqes != MAP_FAILED) {
+					::munmap(sqes, sqes_size);
+				}
+				if (ring != MAP_FAILED) {
+					::munmap(ring, ring_size);
+				}
+				if (fd >= 0) {
+					::close(fd);
+				}
+			}
+
+			// Returns false if io_uring isn't available, or the kernel is too old to resolve the direct descriptors of linked requests at execution time (5.18).
+			[[nodiscard]] auto init(const unsigned entries, const unsigned files) -> bool {
+				auto params = io_uring_params{};
+				fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+				if (fd < 0) {
+					return false;
+				}
+				if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0 || (params.features & IORING_FEAT_LINKED_FILE) == 0) {
+					return false;
+				}
+
+				ring_size = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned), params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+				ring = ::mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+				if (ring == MAP_FAILED) {
+					return false;
+				}
+				sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+				sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+				if (sqes == MAP_FAILED) {
+					return false;
+				}
+
+				auto* bytes = static_cast<char*>(ring);
+				sq_head = reinterpret_cast<unsigned*>(bytes + params.sq_off.head);
+				sq_tail = reinterpret_cast<unsigned*>(bytes + params.sq_off.tail);
+				sq_mask = *reinterpret_cast<unsigned*>(bytes + params.sq_off.ring_mask);
+				sq_entries = params.sq_entries;
+				sq_local_tail = *sq_tail;
+				cq_head = reinterpret_cast<unsigned*>(bytes + params.cq_off.head);
+				cq_tail = reinterpret_cast<unsigned*>(bytes + params.cq_off.tail);
+				cq_mask = *reinterpret_cast<unsigned*>(bytes + params.cq_off.ring_mask);
+				cqes = reinterpret_cast<io_uring_cqe*>(bytes + params.cq_off.cqes);
+
+				// The submission queue entries are used in the ring order, so the index array is the identity
+				auto* array = reinterpret_cast<unsigned*>(bytes + params.sq_off.array);
+				for (auto i = unsigned{ 0 }; i < sq_entries; ++i) {
+					array[i] = i;
+				}
+
+				// A sparse table of direct descriptors, one per slot
+				auto table = std::vector<int>(files, -1);
+				return ::syscall(__NR_io_uring_register, fd, IORING_REGISTER_FILES, table.data(), files) == 0;
+			}
+
+			[[nodiscard]] auto space() const noexcept -> unsigned {
+				return sq_entries - (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE));
+			}
+
+			// The next submission queue entry, zeroed. The caller has to check the #space first.
+			[[nodiscard]] auto next_sqe() noexcept -> io_uring_sqe& {
+				auto& sqe = sqes[sq_local_tail++ & sq_mask];
+				sqe = io_uring_sqe{};
+				return sqe;
+			}
+
+			// Submit the entries prepared so far and wait for at least #wait completions. Returns a negative errno on failure.
+			[[nodiscard]] auto submit(const unsigned wait) noexcept -> int {
+				__atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+				for (;;) {
+					const auto to_submit = sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+					const auto result = ::syscall(__NR_io_uring_enter, fd, to_submit, wait, wait != 0 ? IORING_ENTER_GETEVENTS : 0u, nullptr, 0);
+					if (result >= 0) {
+						return static_cast<int>(result);
+					}
+					if (errno != EINTR) {
+						return -errno;
+					}
+				}
+			}
+
+			// Call #on_completion on the completions posted so far. Returns their number.
+			template <typename OnCompletion>
+			auto reap(OnCompletion&& on_completion) -> unsigned {
+				const auto first = *cq_head;
+				const auto tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+				for (auto head = first; head != tail; ++head) {
+					on_completion(cqes[head & cq_mask]);
+				}
+				__atomic_store_n(cq_head, tail, __ATOMIC_RELEASE);
+				return tail - first;
+			}
+
+			// Take back the entries prepared but not consumed by the kernel yet, calling #on_dropped on each of them: they will never complete.
+			template <typename OnDropped>
+			auto drop_unsubmitted(OnDropped&& on_dropped) -> void {
+				const auto head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+				for (auto i = head; i != sq_local_tail; ++i) {
+					on_dropped(sqes[i & sq_mask]);
+				}
+				sq_local_tail = head;
+				__atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+			}
+		};
+
+		// The state of a file in flight: its header and read plan buffers, and the number of completions still expected for its current chain.
+		struct io_file_slot {
+			std::size_t file = 0;
+			std::uint64_t start = 0; // when the first chain was prepared, and the time spent classifying, only measured with FILE_MIME_STATS
+			std::uint64_t lookup = 0;
+			unsigned pending = 0;
+			bool ranges = false; // the second chain, fetching the read plan ranges
+			int error = 0;
+			std::array<std::ptrdiff_t, read_plan.size() + 1> sizes{};
+			std::array<std::array<uint8_t, max_read_range_size>, read_plan.size() + 1> buffers{};
+		};
+
+		// Classify the files with io_uring, with up to #queue_depth of them in flight. Every file is a chain of hard-linked requests:
+		// an openat into the direct descriptor of its slot, a read of the header and a close, submitted together and completed without any further syscalls.
+		// Only the files whose header doesn't settle their type get a second chain, reading all the ranges of the read plan at once.
+		// The completions are classified as they arrive, and each request is counted in the stats as the system call it stands for.
+		// Returns false, without touching #ids, if io_uring isn't available.
+		inline auto classify_files_io_uring(const std::string* paths, const std::size_t count, const classify_files_options& options, mime_id* ids, int* errors) -> bool {
+			constexpr auto chain_size = unsigned{ 3 + read_plan.size() };
+			constexpr auto op_open = std::uint64_t{ 0 };
+			constexpr auto op_close = std::uint64_t{ 1 };
+			constexpr auto op_read = std::uint64_t{ 2 }; // + the index of the buffer
+			constexpr auto cancel_data = ~std::uint64_t{ 0 };
+			constexpr auto max_retries = 1000u;
+
+			// The buffers the requests read into are declared before the ring, so that they outlive it
+			const auto slot_count = static_cast<unsigned>(std::clamp(std::min(options.queue_depth, count), std::size_t{ 1 }, std::size_t{ 4096 }));
+			auto slots = std::vector<io_file_slot>(slot_count);
+			auto free_slots = std::vector<unsigned>{};
+			for (auto slot = slot_count; slot-- > 0;) {
+				free_slots.push_back(slot);
+			}
+
+			auto ring = io_ring{};
+			if (!ring.init(slot_count * chain_size, slot_count)) {
+				return false;
+			}
+
+			// A hard link keeps the chain going even if a request fails (a short read counts as one), so the close is always issued
+			const auto prepare_open = [&](const unsigned slot) {
+				auto& sqe = ring.next_sqe();
+				sqe.opcode = IORING_OP_OPENAT;
+				sqe.flags = IOSQE_IO_HARDLINK;
+				sqe.fd = AT_FDCWD;
+				sqe.addr = reinterpret_cast<std::uint64_t>(paths[slots[slot].file].c_str());
+				sqe.open_flags = O_RDONLY | O_NOCTTY; // a direct descriptor is never inherited, and O_CLOEXEC is rejected for one
+				sqe.file_index = slot + 1;
+				sqe.user_data = std::uint64_t{ slot } << 8 | op_open;
+			};
+			const auto prepare_read = [&](const unsigned slot, const std::size_t buffer, const std::size_t size, const std::uint64_t offset) {
+				auto& sqe = ring.next_sqe();
+				sqe.opcode = IORING_OP_READ;
+				sqe.flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+				sqe.fd = static_cast<std::int32_t>(slot);
+				sqe.addr = reinterpret_cast<std::uint64_t>(slots[slot].buffers[buffer].data());
+				sqe.len = static_cast<std::uint32_t>(size);
+				sqe.off = offset;
+				sqe.user_data = std::uint64_t{ slot } << 8 | (op_read + buffer);
+			};
+			const auto prepare_close = [&](const unsigned slot) {
+				auto& sqe = ring.next_sqe();
+				sqe.opcode = IORING_OP_CLOSE;
+				sqe.file_index = slot + 1;
+				sqe.user_data = std::uint64_t{ slot } << 8 | op_close;
+			};
+
+			// Once the ring is broken, the completions of the requests still in flight are only waited for
+			auto broken = false;
+
+			const auto finish = [&](const unsigned slot, const mime_id id) {
+				if (!broken) {
+					// The time waited for the completions is the I/O time
+					const auto end = stats_now();
+					count_file(end - slots[slot].start, end - slots[slot].start - slots[slot].lookup);
+				}
+				ids[slots[slot].file] = id;
+				if (errors != nullptr) {
+					errors[slots[slot].file] = slots[slot].error;
+				}
+				free_slots.push_back(slot);
+			};
+
+			// Called once all the requests of the chain of a slot have completed
+			const auto complete = [&](const unsigned slot) {
+				auto& state = slots[slot];
+				const auto lookup_start = stats_now();
+				const auto hint = get_id_shallow(paths[state.file]);
+
+				if (!state.ranges) {
+					const auto header_size = state.sizes[0];
+					if (header_size < std::ptrdiff_t(min_file_header_size)) {
+						finish(slot, hint);
+						return;
+					}
+
+					const auto id = get_id_deep(state.buffers[0].data(), std::size_t(header_size), hint);
+					state.lookup += stats_now() - lookup_start;
+					if (id != mime_id::unknown || std::size_t(header_size) < header_read_size || read_plan.empty()) {
+						finish(slot, id);
+						return;
+					}
+
+					state.ranges = true;
+					state.pending = chain_size - 1;
+					prepare_open(slot);
+					for (auto i = std::size_t{ 0 }; i < read_plan.size(); ++i) {
+						prepare_read(slot, i + 1, read_plan[i].size, read_plan[i].offset);
+					}
+					prepare_close(slot);
+					return;
+				}
+
+				auto id = mime_id::unknown;
+				for (auto i = std::size_t{ 0 }; i < read_plan.size() && id == mime_id::unknown; ++i) {
+					if (state.sizes[i + 1] <= 0) {
+						break;
+					}
+					id = get_id_at_offsets(state.buffers[i + 1].data(), std::size_t(state.sizes[i + 1]), read_plan[i].first, read_plan[i].last, read_plan[i].offset);
+				}
+				state.lookup += stats_now() - lookup_start;
+				finish(slot, id);
+			};
+
+			auto done = std::size_t{ 0 };
+			const auto on_completion = [&](const io_uring_cqe& cqe) {
+				if (cqe.user_data == cancel_data) {
+					return;
+				}
+				const auto slot = static_cast<unsigned>(cqe.user_data >> 8);
+				const auto op = cqe.user_data & 0xFF;
+				auto& state = slots[slot];
+
+				if (op >= op_read) {
+					state.sizes[op - op_read] = cqe.res;
+				}
+				count_syscall(op >= op_read ? cqe.res : 0);
+				// The first failure of the chain is the one to report: the requests after a failed open fail too
+				if (op != op_close && cqe.res < 0 && state.error == 0) {
+					state.error = -cqe.res;
+				}
+
+				if (--state.pending == 0 && !broken) {
+					const auto was_done = free_slots.size();
+					complete(slot);
+					done += free_slots.size() - was_done;
+				}
+			};
+
+			auto next = std::size_t{ 0 };
+			auto retries = 0u;
+			while (done < count) {
+				// Refill the free slots with the next files, the ring always has the space for a chain per slot
+				while (next < count && !free_slots.empty() && ring.space() >= chain_size) {
+					const auto slot = free_slots.back();
+					free_slots.pop_back();
+
+					auto& state = slots[slot];
+					state.file = next++;
+					state.start = stats_now();
+					state.lookup = 0;
+					state.pending = 3;
+					state.ranges = false;
+					state.error = 0;
+					prepare_open(slot);
+					prepare_read(slot, 0, header_read_size, 0);
+					prepare_close(slot);
+				}
+
+				const auto result = ring.submit(1);
+				if (result >= 0) {
+					retries = 0;
+					ring.reap(on_completion);
+					continue;
+				}
+				if ((result == -EAGAIN || result == -EBUSY) && ++retries < max_retries) {
+					// The kernel is short of memory for the requests, or has completions to post first: make room and submit again
+					if (ring.reap(on_completion) == 0) {
+						std::this_thread::yield();
+					}
+					continue;
+				}
+
+				// The ring is broken. The requests in flight still write to the buffers of their slots, so they are cancelled and waited for
+				// (polling the completion queue, which the kernel keeps posting to, if the ring can't even wait anymore)
+				broken = true;
+				ring.drop_unsubmitted([&](const io_uring_sqe& sqe) {
+					--slots[sqe.user_data >> 8].pending;
+				});
+				const auto in_flight = [&]() {
+					return std::any_of(slots.begin(), slots.end(), [](const io_file_slot& state) { return state.pending != 0; });
+				};
+#if defined(IORING_ASYNC_CANCEL_ANY)
+				if (in_flight()) {
+					auto& sqe = ring.next_sqe();
+					sqe.opcode = IORING_OP_ASYNC_CANCEL;
+					sqe.cancel_flags = IORING_ASYNC_CANCEL_ANY;
+					sqe.user_data = cancel_data;
+					[[maybe_unused]] const auto cancelled = ring.submit(0);
+				}
+#endif
+				while (in_flight()) {
+					if (ring.reap(on_completion) == 0 && ring.submit(1) < 0) {
+						std::this_thread::sleep_for(std::chrono::microseconds{ 100 });
+					}
+				}
+
+				// Then the files that were in flight and the remaining ones are classified the blocking way
+				for (auto slot = unsigned{ 0 }; slot < slot_count; ++slot) {
+					if (std::find(free_slots.begin(), free_slots.end(), slot) == free_slots.end()) {
+						auto id = get_id_shallow(paths[slots[slot].file]);
+						slots[slot].error = classify_file_pread(paths[slots[slot].file], id);
+						finish(slot, id);
+					}
+				}
+				classify_files_pread(paths + next, count - next, options, ids + next, errors != nullptr ? errors + next : nullptr);
+				return true;
+			}
+
+			return true;
+		}
+#endif
+
+	} // namespace detail
+
+	// Determine the mime ids of #count files at once: ids[i] is the mime id of the file at paths[i], determined the same way get_id(paths[i], true) does,
+	// and errors[i] (if not null) is the errno of a failed open/read, in which case ids[i] comes from the file extension alone.
+	// On Linux the files are read with io_uring, keeping up to options.queue_depth of them in flight so that the storage sees a deep queue instead of one blocking read at a time,
+	// and a pool of threads issuing blocking reads is used where io_uring isn't available.
+	inline auto classify_files(const std::string* paths, const std::size_t count, const classify_files_options& options, mime_id* ids, int* errors = nullptr) -> void {
+		if (count == 0) {
+			return;
+		}
+#if defined(__linux__)
+		if (options.use_io_uring && detail::classify_files_io_uring(paths, count, options, ids, errors)) {
+			return;
+		}
+#endif
+		detail::classify_files_pread(paths, count, options, ids, errors);
+	}
+
+	[[nodiscard]] inline auto classify_files(const std::vector<std::string>& paths, const classify_files_options& options = {}) -> std::vector<mime_id> {
+		auto ids = std::vector<mime_id>(paths.size());
+		classify_files(paths.data(), paths.size(), options, ids.data());
+		return ids;
+	}
+
+} // inline namespace FILE_MIME_ABI_NAMESPACE
+} // namespace file_mime
+
+#endif // FILE_MIME_CLASSIFY_FILES_H
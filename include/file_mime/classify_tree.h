@@ -0,0 +1,491 @@
+// MIT License
+//
+// Copyright(c) 2023 Lev Faynshteyn
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef FILE_MIME_CLASSIFY_TREE_H
+#define FILE_MIME_CLASSIFY_TREE_H
+
+#include "file_mime/file_mime.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#else
+#include <filesystem>
+#endif
+
+namespace file_mime {
+inline namespace FILE_MIME_ABI_NAMESPACE {
+
+	struct classify_tree_options {
+		std::size_t thread_count = 0; // 0 uses all the hardware threads
+		std::size_t batch_size = 256; // the number of files passed to every callback call
+		bool deep_check = true; // check the magic numbers, or only the file extensions
+	};
+
+	struct classified_file {
+		std::string_view path; // only valid for the duration of the callback
+		mime_id id = mime_id::unknown;
+		int error = 0; // the errno of a failed open/read/stat, in which case #id comes from the file extension alone; a directory that can't be listed is reported with its own path
+	};
+
+	// Called with a batch of the classified files; the calls are never concurrent, but they are made from the worker threads.
+	using classify_tree_callback = std::function<void(const classified_file* files, std::size_t count)>;
+
+	namespace detail {
+
+		// The files of a directory are classified in batches of this many, which the idle workers can steal, so that a single large directory keeps all of them busy.
+		inline constexpr auto tree_file_batch_size = std::size_t{ 64u };
+
+		// The path of the entry #name of the #directory. The separator is only added if the #directory doesn't end with one already, as the root "/" does.
+		[[nodiscard]] inline auto join_path(const std::string& directory, const std::string_view name) -> std::string {
+			auto path = directory;
+			if (path.empty() || path.back() != '/') {
+				path.push_back('/');
+			}
+			path.append(name);
+			return path;
+		}
+
+#if defined(__linux__)
+		// An open directory, closed once its entries are walked and all the batches of its files are classified.
+		struct directory_handle {
+			int fd = -1;
+
+			explicit directory_handle(const int fd) noexcept : fd(fd) {}
+			directory_handle(const directory_handle&) = delete;
+			auto operator=(const directory_handle&) -> directory_handle& = delete;
+
+			~directory_handle() {
+				::close(fd);
+			}
+		};
+#endif
+
+		// A unit of work: a directory to walk, or a batch of #count of its regular files to classify, their null-terminated names stored back to back in #names.
+		struct tree_task {
+			std::string directory;
+			std::vector<char> names{};
+			std::size_t count = 0;
+#if defined(__linux__)
+			std::shared_ptr<const directory_handle> handle{}; // the files of a batch are opened relative to their directory
+#endif
+		};
+
+		// A worker's share of the tasks left: the owner pushes and pops at the back (depth first, so the paths stay hot in the cache),
+		// the idle workers steal from the front (the directories closest to the root, which are likely to hold the most work).
+		struct tree_queue {
+			std::mutex mutex;
+			std::deque<tree_task> tasks;
+		};
+
+		// The per-thread state that is reused for every directory and file: the read buffers and the batch of results not delivered yet.
+		struct tree_worker {
+			std::vector<char> entries;
+			std::array<uint8_t, max_read_range_size> buffer{};
+			std::vector<char> paths;
+			std::vector<classified_file> files;
+			std::vector<std::size_t> path_ends;
+		};
+
+		struct tree_walk {
+			classify_tree_options options;
+			classify_tree_callback callback;
+
+			std::vector<std::unique_ptr<tree_queue>> queues;
+			// The tasks pushed but not done yet, the walk is over once it drops to 0, and the ones still in the queues
+			std::atomic<std::size_t> pending{ 0 };
+			std::atomic<std::size_t> queued{ 0 };
+			std::atomic<bool> stopped{ false };
+
+			// The workers with nothing to steal sleep until a task is pushed or the walk is over
+			std::mutex idle_mutex;
+			std::condition_variable idle;
+			std::atomic<std::size_t> sleepers{ 0 };
+
+			std::mutex callback_mutex;
+			std::exception_ptr exception;
+
+			auto push(const std::size_t worker, tree_task task) -> void {
+				pending.fetch_add(1, std::memory_order_relaxed);
+				{
+					const auto lock = std::lock_guard<std::mutex>{ queues[worker]->mutex };
+					queues[worker]->tasks.push_back(std::move(task));
+				}
+
+				// A sleeper checks #queued after announcing itself, so either it sees this task or it is seen here (and waits on the mutex until it can be notified)
+				queued.fetch_add(1, std::memory_order_seq_cst);
+				if (sleepers.load(std::memory_order_seq_cst) != 0) {
+					{
+						const auto lock = std::lock_guard<std::mutex>{ idle_mutex };
+					}
+					idle.notify_one();
+				}
+			}
+
+			[[nodiscard]] auto pop(const std::size_t worker, tree_task& task) -> bool {
+				{
+					const auto lock = std::lock_guard<std::mutex>{ queues[worker]->mutex };
+					if (!queues[worker]->tasks.empty()) {
+						task = std::move(queues[worker]->tasks.back());
+						queues[worker]->tasks.pop_back();
+						queued.fetch_sub(1, std::memory_order_relaxed);
+						return true;
+					}
+				}
+
+				for (auto i = std::size_t{ 1 }; i < queues.size(); ++i) {
+					auto& victim = *queues[(worker + i) % queues.size()];
+					const auto lock = std::lock_guard<std::mutex>{ victim.mutex };
+					if (!victim.tasks.empty()) {
+						task = std::move(victim.tasks.front());
+						victim.tasks.pop_front();
+						queued.fetch_sub(1, std::memory_order_relaxed);
+						return true;
+					}
+				}
+				return false;
+			}
+
+			auto done() -> void {
+				if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+					{
+						const auto lock = std::lock_guard<std::mutex>{ idle_mutex };
+					}
+					idle.notify_all();
+				}
+			}
+
+			// Sleep until there may be a task to steal. Returns false once the walk is over.
+			[[nodiscard]] auto wait() -> bool {
+				auto lock = std::unique_lock<std::mutex>{ idle_mutex };
+				sleepers.fetch_add(1, std::memory_order_seq_cst);
+				idle.wait(lock, [this]() {
+					return queued.load(std::memory_order_seq_cst) != 0 || pending.load(std::memory_order_acquire) == 0;
+				});
+				sleepers.fetch_sub(1, std::memory_order_relaxed);
+				return pending.load(std::memory_order_acquire) != 0;
+			}
+
+			auto flush(tree_worker& state) -> void {
+				if (state.path_ends.empty()) {
+					return;
+				}
+
+				// The paths are stored back to back, so that the buffer can grow while the batch is being filled
+				auto begin = std::size_t{ 0 };
+				for (auto i = std::size_t{ 0 }; i < state.path_ends.size(); ++i) {
+					state.files[i].path = std::string_view(state.paths.data() + begin, state.path_ends[i] - begin);
+					begin = state.path_ends[i];
+				}
+
+				{
+					const auto lock = std::lock_guard<std::mutex>{ callback_mutex };
+					if (!stopped.load(std::memory_order_relaxed)) {
+						try {
+							callback(state.files.data(), state.files.size());
+						}
+						catch (...) {
+							exception = std::current_exception();
+							stopped.store(true, std::memory_order_relaxed);
+						}
+					}
+				}
+
+				state.paths.clear();
+				state.files.clear();
+				state.path_ends.clear();
+			}
+
+			// Add the file #name of the #directory to the results, or the #directory itself if the #name is empty.
+			auto add_file(tree_worker& state, const std::string& directory, const std::string_view name, const mime_id id, const int error) -> void {
+				state.paths.insert(state.paths.end(), directory.begin(), directory.end());
+				if (!name.empty()) {
+					if (directory.empty() || directory.back() != '/') {
+						state.paths.push_back('/');
+					}
+					state.paths.insert(state.paths.end(), name.begin(), name.end());
+				}
+				state.path_ends.push_back(state.paths.size());
+				state.files.push_back(classified_file{ {}, id, error });
+
+				if (state.files.size() >= options.batch_size) {
+					flush(state);
+				}
+			}
+
+			// Add the file #name to the #batch of files to classify, handing the batch over to the queue (for the idle workers to steal) once it is full.
+			auto add_to_batch(const std::size_t worker, tree_task& batch, const std::string_view name) -> void {
+				batch.names.insert(batch.names.end(), name.begin(), name.end());
+				batch.names.push_back('\0');
+				if (++batch.count == tree_file_batch_size) {
+					auto next = tree_task{ batch.directory };
+#if defined(__linux__)
+					next.handle = batch.handle;
+#endif
+					push(worker, std::exchange(batch, std::move(next)));
+				}
+			}
+
+#if defined(__linux__)
+			// The fixed part of the records returned by getdents64, the (null-terminated) name follows right after #d_type.
+			struct linux_dirent64 {
+				std::uint64_t d_ino;
+				std::int64_t d_off;
+				unsigned short d_reclen;
+				unsigned char d_type;
+			};
+			static constexpr auto dirent_name_offset = offsetof(linux_dirent64, d_type) + 1;
+
+			// Classify a file the same way get_id_from_file does, counted the same way in the stats.
+			auto classify_file(tree_worker& state, const int directory_fd, const char* name, mime_id& id) -> int {
+				auto timing = file_timing{};
+				const auto fd = ::openat(directory_fd, name, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+				const auto open_error = errno;
+				count_syscall();
+				if (fd < 0) {
+					return open_error;
+				}
+				timing.io += stats_now() - timing.start;
+
+				auto error = 0;
+				const auto read = [fd, &error, &timing](uint8_t* buffer, const std::size_t size, const std::uint64_t offset) -> std::ptrdiff_t {
+					const auto read_start = stats_now();
+					const auto result = read_at(fd, buffer, size, offset);
+					timing.io += stats_now() - read_start;
+					count_syscall(result);
+					if (result < 0) {
+						error = int(-result);
+					}
+					return result;
+				};
+				const auto deep_id = get_id_deep_at(read, id, state.buffer);
+				if (error == 0) {
+					id = deep_id;
+				}
+
+				const auto close_start = stats_now();
+				::close(fd);
+				const auto end = stats_now();
+				timing.io += end - close_start;
+				count_syscall();
+				count_file(end - timing.start, timing.io);
+				return error;
+			}
+
+			auto classify_batch(tree_worker& state, const tree_task& batch) -> void {
+				const auto* name = batch.names.data();
+				for (auto i = std::size_t{ 0 }; i < batch.count && !stopped.load(std::memory_order_relaxed); ++i) {
+					auto id = get_id_shallow(name);
+					const auto error = classify_file(state, batch.handle->fd, name, id);
+					add_file(state, batch.directory, name, id, error);
+					name += std::strlen(name) + 1;
+				}
+			}
+
+			// Walk the entries of a directory with raw getdents64 calls, which report the entry types along with the names,
+			// so that the files and the subdirectories can be told apart without a stat call per entry.
+			auto walk_directory(const std::size_t worker, tree_worker& state, const std::string& directory) -> void {
+				const auto directory_fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+				if (directory_fd < 0) {
+					add_file(state, directory, {}, mime_id::unknown, errno);
+					return;
+				}
+
+				auto batch = tree_task{ directory };
+				batch.handle = std::make_shared<const directory_handle>(directory_fd);
+				for (;;) {
+					const auto size = ::syscall(SYS_getdents64, directory_fd, state.entries.data(), state.entries.size());
+					if (size <= 0) {
+						if (size < 0) {
+							add_file(state, directory, {}, mime_id::unknown, errno);
+						}
+						break;
+					}
+
+					for (auto position = long{ 0 }; position < size && !stopped.load(std::memory_order_relaxed);) {
+						auto entry = linux_dirent64{};
+						std::memcpy(&entry, state.entries.data() + position, dirent_name_offset);
+						const auto* name = state.entries.data() + position + dirent_name_offset;
+						position += entry.d_reclen;
+
+						if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+							continue;
+						}
+
+						auto type = entry.d_type;
+						if (type == DT_UNKNOWN) {
+							// Not all the file systems report the entry types
+							struct stat info {};
+							if (::fstatat(directory_fd, name, &info, AT_SYMLINK_NOFOLLOW) != 0) {
+								add_file(state, directory, name, get_id_shallow(name), errno);
+								continue;
+							}
+							type = S_ISDIR(info.st_mode) ? DT_DIR : S_ISREG(info.st_mode) ? DT_REG : DT_UNKNOWN;
+						}
+
+						if (type == DT_DIR) {
+							push(worker, tree_task{ join_path(directory, name) });
+						}
+						else if (type == DT_REG) {
+							if (options.deep_check) {
+								add_to_batch(worker, batch, name);
+							}
+							else {
+								add_file(state, directory, name, get_id_shallow(name), 0);
+							}
+						}
+					}
+				}
+
+				// The last few files are classified right away
+				classify_batch(state, batch);
+			}
+#else
+			auto classify_batch(tree_worker& state, const tree_task& batch) -> void {
+				const auto* name = batch.names.data();
+				for (auto i = std::size_t{ 0 }; i < batch.count && !stopped.load(std::memory_order_relaxed); ++i) {
+					const auto result = get_id_from_file(join_path(batch.directory, name));
+					add_file(state, batch.directory, name, result.id, result.error);
+					name += std::strlen(name) + 1;
+				}
+			}
+
+			auto walk_directory(const std::size_t worker, tree_worker& state, const std::string& directory) -> void {
+				namespace fs = std::filesystem;
+
+				auto batch = tree_task{ directory };
+				auto error = std::error_code{};
+				for (auto it = fs::directory_iterator(fs::u8path(directory), error); !error && it != fs::directory_iterator() && !stopped.load(std::memory_order_relaxed); it.increment(error)) {
+					const auto name = it->path().filename().u8string();
+					auto status_error = std::error_code{};
+					const auto status = it->symlink_status(status_error);
+					if (status_error) {
+						add_file(state, directory, name, get_id_shallow(name), status_error.value());
+					}
+					else if (fs::is_directory(status)) {
+						push(worker, tree_task{ join_path(directory, name) });
+					}
+					else if (fs::is_regular_file(status)) {
+						if (options.deep_check) {
+							add_to_batch(worker, batch, name);
+						}
+						else {
+							add_file(state, directory, name, get_id_shallow(name), 0);
+						}
+					}
+				}
+				if (error) {
+					add_file(state, directory, {}, mime_id::unknown, error.value());
+				}
+
+				// The last few files are classified right away
+				classify_batch(state, batch);
+			}
+#endif
+
+			auto run(const std::size_t worker) -> void {
+				auto state = tree_worker{};
+				state.entries.resize(64 * 1024);
+
+				auto task = tree_task{};
+				for (;;) {
+					if (!pop(worker, task)) {
+						if (!wait()) {
+							break;
+						}
+						continue;
+					}
+
+					if (!stopped.load(std::memory_order_relaxed)) {
+						if (task.count == 0) {
+							walk_directory(worker, state, task.directory);
+						}
+						else {
+							classify_batch(state, task);
+						}
+					}
+					// The directory of a batch is closed along with its last batch
+					task = tree_task{};
+					done();
+				}
+
+				flush(state);
+			}
+		};
+	} // namespace detail
+
+	// Classify all the regular files under the #root directory, walking its subdirectories in parallel, and deliver the results to the #callback in batches.
+	// The files of a large directory are split into batches that the idle workers steal, and the workers with nothing left to steal sleep until there is.
+	// Symbolic links are not followed. The files and directories that can't be read are delivered too, with their errno (including the #root itself).
+	// An exception thrown by the #callback stops the walk and is rethrown once all the workers are done.
+	inline auto classify_tree(const std::string& root, const classify_tree_options& options, const classify_tree_callback& callback) -> void {
+		auto walk = detail::tree_walk{};
+		walk.options = options;
+		walk.options.batch_size = std::max(options.batch_size, std::size_t{ 1 });
+		walk.callback = callback;
+
+		const auto thread_count = options.thread_count != 0 ? options.thread_count : std::max(std::thread::hardware_concurrency(), 1u);
+		for (auto i = std::size_t{ 0 }; i < thread_count; ++i) {
+			walk.queues.push_back(std::make_unique<detail::tree_queue>());
+		}
+
+		auto directory = root;
+		while (directory.size() > 1 && directory.back() == '/') {
+			directory.pop_back();
+		}
+		walk.push(0, detail::tree_task{ std::move(directory) });
+
+		auto threads = std::vector<std::thread>{};
+		for (auto i = std::size_t{ 1 }; i < thread_count; ++i) {
+			threads.emplace_back([&walk, i]() { walk.run(i); });
+		}
+		walk.run(0);
+		for (auto& thread : threads) {
+			thread.join();
+		}
+
+		if (walk.exception) {
+			std::rethrow_exception(walk.exception);
+		}
+	}
+
+} // inline namespace FILE_MIME_ABI_NAMESPACE
+} // namespace file_mime
+
+#endif // FILE_MIME_CLASSIFY_TREE_H
@@ -0,0 +1,558 @@
+// MIT License
+//
+// Copyright(c) 2023 Lev Faynshteyn
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#ifndef FILE_MIME_DETECTOR_H
+#define FILE_MIME_DETECTOR_H
+
+#include "file_mime/file_mime.h"
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+#include <string>
+#include <cstdio>
+
+namespace file_mime {
+inline namespace FILE_MIME_ABI_NAMESPACE {
+
+	// How often each mime type was seen, to order the magic numbers that share a first byte so that the common types are compared first.
+	// A profile learned by an #adaptive_detector can be saved to a text file, one "mime/type hits" line per type, and loaded at startup.
+	class type_profile {
+	public:
+		auto record(const mime_id id, const std::uint64_t hits = 1) noexcept -> void {
+			hits_[static_cast<std::size_t>(id)] += hits;
+		}
+
+		[[nodiscard]] auto hits(const mime_id id) const noexcept -> std::uint64_t {
+			return hits_[static_cast<std::size_t>(id)];
+		}
+
+		// Write the profile to the file at #path, returns 0 or the errno of the failure.
+		[[nodiscard]] auto save(const std::string_view path) const -> int {
+			auto* file = std::fopen(std::string(path).c_str(), "w");
+			if (file == nullptr) {
+				return errno;
+			}
+			auto failed = std::fprintf(file, "%s\n", profile_magic) < 0;
+			for (auto id = std::size_t{ 0 }; id < hits_.size(); ++id) {
+				if (hits_[id] != 0) {
+					const auto type = get_type_from_id(static_cast<mime_id>(id));
+					failed |= std::fprintf(file, "%.*s %llu\n", int(type.size()), type.data(), static_cast<unsigned long long>(hits_[id])) < 0;
+				}
+			}
+			const auto error = failed ? (errno != 0 ? errno : EIO) : 0;
+			if (std::fclose(file) != 0 && error == 0) {
+				return errno;
+			}
+			return error;
+		}
+
+		// Replace the profile with the one saved at #path, returns 0 or the errno of the failure (EINVAL if the file isn't a profile).
+		// The mime types that this build doesn't know are skipped, so that a profile outlives changes to the registry.
+		[[nodiscard]] auto load(const std::string_view path) -> int {
+			auto* file = std::fopen(std::string(path).c_str(), "r");
+			if (file == nullptr) {
+				return errno;
+			}
+			auto loaded = decltype(hits_){};
+			auto line = std::array<char, 256>{};
+			auto error = (std::fgets(line.data(), int(line.size()), file) == nullptr || std::string_view(line.data()) != std::string(profile_magic) + "\n") ? EINVAL : 0;
+			while (error == 0 && std::fgets(line.data(), int(line.size()), file) != nullptr) {
+				auto type = std::array<char, 128>{};
+				auto hits = 0ull;
+				if (std::sscanf(line.data(), "%127s %llu", type.data(), &hits) != 2) {
+					error = EINVAL;
+					break;
+				}
+				const auto id = get_id_from_type(type.data());
+				if (id != mime_id::unknown) {
+					loaded[static_cast<std::size_t>(id)] += hits;
+				}
+			}
+			if (error == 0 && std::ferror(file) != 0) {
+				error = EIO;
+			}
+			std::fclose(file);
+			if (error == 0) {
+				hits_ = loaded;
+			}
+			return error;
+		}
+
+	private:
+		static constexpr auto profile_magic = "file_mime profile 1";
+
+		std::array<std::uint64_t, detail::mime_types.size()> hits_{};
+	};
+
+	// The look-up structures for one set of magic numbers, built at runtime: either a subset of the #magic_signatures registry or a custom list.
+	// The magic numbers at the start of the file are bucketed by their first byte, so a header is only compared against the few that start with its first byte.
+	class signature_set {
+	public:
+		// The magic numbers of the #formats in the registry.
+		explicit signature_set(const mime_set formats = all_mime_types) : signature_set(formats, type_profile{}) {}
+
+		// The magic numbers of the #formats in the registry, the ones of the types most seen in #profile first among those that share a first byte.
+		signature_set(const mime_set formats, const type_profile& profile) {
+			auto signatures = std::vector<magic_signature>{};
+			for (const auto& signature : magic_signatures) {
+				if (contains(formats, signature.id)) {
+					signatures.push_back(signature);
+				}
+			}
+			build(std::move(signatures), profile);
+		}
+
+		// A custom list of magic numbers, held to the same rules as the registry: throws std::invalid_argument if a magic number at the start of the file doesn't start
+		// with #min_file_header_size non-wildcard bytes or doesn't fit the header, if one at an offset doesn't fit a single read, if the mask of the #prefix_size
+		// first bytes has a wildcard (as detail::make_signature would never build), or if two of them at the same offset can match the same file.
+		explicit signature_set(std::vector<magic_signature> signatures, const type_profile& profile = type_profile{}) {
+			for (auto i = std::size_t{ 0 }; i < signatures.size(); ++i) {
+				const auto& signature = signatures[i];
+				const auto anchored = (signature.offset == 0);
+				if (signature.id == mime_id::unknown || signature.size > detail::signature_width || signature.prefix_size > signature.size
+					|| (anchored && (signature.prefix_size < min_file_header_size || signature.size > max_file_header_size))
+					|| (!anchored && (signature.size == 0 || signature.size > detail::max_read_range_size))
+					|| std::any_of(signature.mask.begin(), signature.mask.begin() + signature.prefix_size, [](const std::uint8_t mask) { return mask != 0xFF; })) {
+					throw std::invalid_argument("Invalid magic number signature");
+				}
+				for (auto j = std::size_t{ 0 }; j < i; ++j) {
+					if (signatures[j].offset == signature.offset && detail::overlap(signatures[j], signature)) {
+						throw std::invalid_argument("Two magic number signatures can match the same file");
+					}
+				}
+			}
+			build(std::move(signatures), profile);
+		}
+
+		// Determine the mime id of a file from its raw in-memory bytes, like file_mime::get_id_deep, with the magic numbers of this set only.
+		// Headers that are too small to determine their type get mime_id::unknown, whatever the hint.
+		[[nodiscard]] auto get_id_deep(const uint8_t* file_bytes, const std::size_t file_size, const mime_id mime_type_hint = mime_id::unknown) const noexcept -> mime_id {
+			if (file_size < min_file_header_size) {
+				return mime_id::unknown;
+			}
+
+			const auto header = detail::load_header(file_bytes, file_size);
+
+			// The magic numbers of the hint first, as in all the approaches of get_id_deep
+			const auto hint = static_cast<std::size_t>(mime_type_hint);
+			for (auto i = hint_groups_[hint]; i < hint_groups_[hint + 1]; ++i) {
+				if (detail::matches(anchored_[hint_signatures_[i]], header)) {
+					return mime_type_hint;
+				}
+			}
+
+			const auto first = header.bytes[0];
+			for (auto i = buckets_[first]; i < buckets_[first + 1]; ++i) {
+				if (detail::matches(anchored_[i], header)) {
+					return anchored_[i].id;
+				}
+			}
+
+			return detail::get_id_at_offsets(offsets_, file_bytes, file_size, 0, offsets_.size());
+		}
+
+		// Determine the mime id of a file from its bytes fetched with #read_at, like detail::get_id_deep_at: a single read of the header (along with the magic numbers at an offset that fit it) and one read per range of the read plan of this set.
+		template <typename ReadAt>
+		[[nodiscard]] auto get_id_deep_at(const ReadAt& read_at, const mime_id mime_type_hint) const -> mime_id {
+			auto buffer = std::array<uint8_t, detail::max_read_range_size>{};
+			const auto get_id_deep = [this](const uint8_t* file_bytes, const std::size_t file_size, const mime_id hint) {
+				return this->get_id_deep(file_bytes, file_size, hint);
+			};
+			return detail::get_id_deep_at(read_at, mime_type_hint, buffer, get_id_deep, offsets_, read_plan_, header_read_size_);
+		}
+
+		// The mime types with at least one magic number in this set.
+		[[nodiscard]] auto formats() const noexcept -> mime_set {
+			return formats_;
+		}
+
+	private:
+		auto build(std::vector<magic_signature> signatures, const type_profile& profile) -> void {
+			for (const auto& signature : signatures) {
+				formats_ |= make_mime_set({ signature.id });
+				if (signature.offset == 0) {
+					anchored_.push_back(signature);
+				}
+				else {
+					offsets_.push_back(signature);
+				}
+			}
+
+			// Bucket the magic numbers at the start of the file by their first byte, the most seen types first within a bucket (no two of them can match the same file, so the order
+			// only changes the cost), and check the ones at an offset in the order of their offsets, which the read plan relies on
+			std::stable_sort(anchored_.begin(), anchored_.end(), [&profile](const magic_signature& a, const magic_signature& b) {
+				if (a.pattern[0] != b.pattern[0]) {
+					return a.pattern[0] < b.pattern[0];
+				}
+				return profile.hits(a.id) > profile.hits(b.id);
+			});
+			for (const auto& signature : anchored_) {
+				++buckets_[signature.pattern[0] + 1];
+			}
+			for (auto b = std::size_t{ 0 }; b < 256; ++b) {
+				buckets_[b + 1] += buckets_[b];
+			}
+
+			// The same magic numbers grouped by their mime ids, for the hint
+			for (auto i = std::size_t{ 0 }; i < anchored_.size(); ++i) {
+				hint_signatures_.push_back(std::uint32_t(i));
+				++hint_groups_[static_cast<std::size_t>(anchored_[i].id) + 1];
+			}
+			std::stable_sort(hint_signatures_.begin(), hint_signatures_.end(), [this](const std::uint32_t a, const std::uint32_t b) {
+				return anchored_[a].id < anchored_[b].id;
+			});
+			for (auto id = std::size_t{ 0 }; id < detail::mime_types.size(); ++id) {
+				hint_groups_[id + 1] += hint_groups_[id];
+			}
+			std::stable_sort(offsets_.begin(), offsets_.end(), [](const magic_signature& a, const magic_signature& b) {
+				return a.offset < b.offset;
+			});
+
+			// The same read plan as detail::make_read_plan, for the magic numbers at an offset that don't fit the first read
+			header_read_size_ = detail::first_read_size(offsets_);
+			for (auto i = std::size_t{ 0 }; i < offsets_.size(); ++i) {
+				const auto& signature = offsets_[i];
+				if (signature.offset + signature.size <= header_read_size_) {
+					continue;
+				}
+				if (read_plan_.empty() || signature.offset + signature.size - read_plan_.back().offset > detail::max_read_range_size) {
+					read_plan_.push_back(detail::read_range{ signature.offset, signature.size, i, i + 1 });
+				}
+				else {
+					auto& range = read_plan_.back();
+					range.size = std::max(range.size, std::size_t(signature.offset + signature.size - range.offset));
+					range.last = i + 1;
+				}
+			}
+		}
+
+		std::vector<magic_signature> anchored_;
+		std::array<std::uint32_t, 257> buckets_{}; // anchored_[buckets_[b], buckets_[b + 1]) start with the byte b
+		std::vector<std::uint32_t> hint_signatures_; // the indices of anchored_ sorted by mime id
+		std::array<std::uint32_t, detail::mime_types.size() + 1> hint_groups_{}; // hint_signatures_[hint_groups_[id], hint_groups_[id + 1]) are the ones of the mime id
+		std::vector<magic_signature> offsets_;
+		std::vector<detail::read_range> read_plan_;
+		std::size_t header_read_size_ = max_file_header_size;
+		mime_set formats_ = 0;
+	};
+
+	// A detector that owns its signature set, so that different tenants or pipelines can look for different formats,
+	// and that can be handed a new set with #swap while other threads keep classifying with it.
+	// Readers never lock: a read pins the current set by bumping one of two reader counters, and #swap publishes the new set with a single atomic exchange,
+	// then flips the counter the new readers go to (twice, RCU style) and waits for the readers of each to drain before freeing the old set.
+	// #publish does the same without waiting: the counters are only flipped once drained, and the old set is freed by a later publish or swap.
+	class detector {
+	public:
+		// The current signature set, pinned for as long as the snapshot lives. Hold one across a batch of files to pay for the pinning once.
+		class snapshot {
+		public:
+			snapshot(snapshot&& other) noexcept : readers_(std::exchange(other.readers_, nullptr)), set_(other.set_) {}
+			snapshot(const snapshot&) = delete;
+			auto operator=(const snapshot&) -> snapshot& = delete;
+			auto operator=(snapshot&&) -> snapshot& = delete;
+
+			~snapshot() {
+				if (readers_ != nullptr) {
+					readers_->fetch_sub(1, std::memory_order_release);
+				}
+			}
+
+			[[nodiscard]] auto signatures() const noexcept -> const signature_set& {
+				return *set_;
+			}
+
+			[[nodiscard]] auto get_id_deep(const uint8_t* file_bytes, const std::size_t file_size, const mime_id mime_type_hint = mime_id::unknown) const noexcept -> mime_id {
+				return set_->get_id_deep(file_bytes, file_size, mime_type_hint);
+			}
+
+		private:
+			friend class detector;
+
+			snapshot(std::atomic<std::uint64_t>* readers, const signature_set* set) noexcept : readers_(readers), set_(set) {}
+
+			std::atomic<std::uint64_t>* readers_;
+			const signature_set* set_;
+		};
+
+		// A detector of all the formats in the registry.
+		detector() : detector(signature_set{}) {}
+
+		explicit detector(signature_set signatures) : current_(new signature_set(std::move(signatures))) {}
+
+		detector(const detector&) = delete;
+		auto operator=(const detector&) -> detector& = delete;
+
+		~detector() {
+			delete current_.load(std::memory_order_relaxed);
+		}
+
+		[[nodiscard]] auto pin() const noexcept -> snapshot {
+			// The counter is bumped before the set is loaded, so #swap either waits for this reader or this reader gets the new set
+			auto& readers = readers_[epoch_.load(std::memory_order_seq_cst) & 1].count;
+			readers.fetch_add(1, std::memory_order_seq_cst);
+			return snapshot{ &readers, current_.load(std::memory_order_seq_cst) };
+		}
+
+		[[nodiscard]] auto get_id_deep(const uint8_t* file_bytes, const std::size_t file_size, const mime_id mime_type_hint = mime_id::unknown) const noexcept -> mime_id {
+			return pin().get_id_deep(file_bytes, file_size, mime_type_hint);
+		}
+
+		// Determine the mime id of an open file from its magic numbers, like file_mime::get_id_from_file.
+		[[nodiscard]] auto get_id_from_file(const int fd, const mime_id mime_type_hint = mime_id::unknown) const noexcept -> file_id_result {
+			auto error = 0;
+			const auto read = [fd, &error](uint8_t* p, const std::size_t size, const std::uint64_t offset) -> std::ptrdiff_t {
+				const auto result = detail::read_at(fd, p, size, offset);
+				if (result < 0) {
+					error = int(-result);
+				}
+				return result;
+			};
+			const auto id = pin().signatures().get_id_deep_at(read, mime_type_hint);
+			if (error != 0) {
+				return file_id_result{ mime_type_hint, error };
+			}
+			return file_id_result{ id, 0, mime_type_hint != mime_id::unknown && id != mime_type_hint };
+		}
+
+		// Determine the mime id of a file from its magic numbers, falling back to its extension if it can't be opened or read, like file_mime::get_id_from_file.
+		[[nodiscard]] auto get_id_from_file(const std::string_view path_to_file) const noexcept -> file_id_result {
+			return detail::get_id_from_path(path_to_file, [this](const int fd, const mime_id hint) {
+				return get_id_from_file(fd, hint);
+			});
+		}
+
+		// Publish a new signature set. The readers that pinned the old one keep using it, this call returns once they are all done and the old set is freed
+		// (along with the ones retired by #publish). Concurrent swaps are serialized, the readers are never blocked.
+		// Not to be called from a thread that holds a snapshot of this detector, it would wait for itself.
+		auto swap(signature_set signatures) -> void {
+			auto next = std::make_unique<const signature_set>(std::move(signatures));
+
+			const auto lock = std::lock_guard<std::mutex>{ swap_mutex_ };
+			retire(std::move(next));
+			while (!reclaim()) {
+				std::this_thread::yield();
+			}
+		}
+
+		// Publish a new signature set without ever waiting: the old set is retired rather than freed, and freed by a later publish or swap once its readers are done
+		// (or by the destructor). Safe to call while holding a snapshot. Returns false without publishing if a swap or another publish is in progress.
+		auto publish(signature_set signatures) -> bool {
+			auto next = std::make_unique<const signature_set>(std::move(signatures));
+
+			const auto lock = std::unique_lock<std::mutex>{ swap_mutex_, std::try_to_lock };
+			if (!lock.owns_lock()) {
+				return false;
+			}
+			retire(std::move(next));
+			reclaim();
+			return true;
+		}
+
+	private:
+		// The two reader counters are kept on separate cache lines, the readers of one phase bump only one of them
+		struct alignas(64) reader_count {
+			std::atomic<std::uint64_t> count{ 0 };
+		};
+
+		// A set replaced while the epoch was #epoch, which its readers may still be using.
+		struct retired_set {
+			std::unique_ptr<const signature_set> set;
+			std::uint64_t epoch = 0;
+		};
+
+		// Make #next the current set and retire the previous one. Called with #swap_mutex_ held.
+		auto retire(std::unique_ptr<const signature_set> next) -> void {
+			retired_.reserve(retired_.size() + 1);
+			const auto epoch = epoch_.load(std::memory_order_seq_cst);
+			retired_.push_back(retired_set{ std::unique_ptr<const signature_set>(current_.exchange(next.release(), std::memory_order_seq_cst)), epoch });
+		}
+
+		// Flip the epoch as far as the readers allow and free the retired sets whose readers are all done, without waiting. Returns whether none are left.
+		// The counter of the previous epoch has to drain before the new readers are sent back to it: a reader that read the epoch before a flip may bump
+		// that counter late, so a set retired in epoch e is only free once the readers of epochs e and e + 1 have drained, hence the two flips. Called with #swap_mutex_ held.
+		auto reclaim() noexcept -> bool {
+			while (!retired_.empty()) {
+				const auto epoch = epoch_.load(std::memory_order_seq_cst);
+				if (drained_epochs_ < epoch) {
+					if (readers_[(epoch - 1) & 1].count.load(std::memory_order_acquire) != 0) {
+						return false;
+					}
+					drained_epochs_ = epoch;
+				}
+
+				retired_.erase(std::remove_if(retired_.begin(), retired_.end(), [this](const retired_set& retired) {
+					return retired.epoch + 2 <= drained_epochs_;
+				}), retired_.end());
+				if (!retired_.empty()) {
+					epoch_.fetch_add(1, std::memory_order_seq_cst);
+				}
+			}
+			return true;
+		}
+
+		std::atomic<const signature_set*> current_;
+		mutable std::array<reader_count, 2> readers_{};
+		std::atomic<std::uint64_t> epoch_{ 0 };
+		std::mutex swap_mutex_;
+		std::vector<retired_set> retired_; // the sets replaced by #publish or #swap that may still be pinned
+		std::uint64_t drained_epochs_ = 0; // the readers of the epochs before this one are known to be done
+	};
+
+	// Tuning of an #adaptive_detector.
+	struct adaptive_options {
+		std::uint32_t sample_period = 64; // one lookup in #sample_period is counted in the profile, a power of two (1 counts them all)
+		std::uint64_t retune_period = 4096; // the order is revisited every #retune_period counted lookups, 0 leaves it to #adaptive_detector::retune
+		bool learn = true; // false freezes the order of the starting profile
+	};
+
+	// A detector that learns how often each type is seen and orders the magic numbers that share a first byte accordingly, so that the cost of a hit follows the traffic
+	// instead of the order of the registry. The readers count a sample of their results with relaxed atomics and never lock; every #adaptive_options::retune_period samples,
+	// the reader that completes the period builds the set for the new order and publishes it with detector::publish, which never waits for the other readers
+	// (skipped if the order didn't change, or if another one is at it).
+	// The counts are halved after each retune, so that the order follows a change of traffic. #profile returns the learned profile, to be saved and passed back at startup.
+	class adaptive_detector {
+	public:
+		// Throws std::invalid_argument if #adaptive_options::sample_period isn't a power of two.
+		explicit adaptive_detector(const mime_set formats = all_mime_types, const type_profile& profile = type_profile{}, const adaptive_options options = adaptive_options{})
+			: formats_(formats), options_(options), detector_(signature_set{ formats, profile }) {
+			if (options.sample_period == 0 || (options.sample_period & (options.sample_period - 1)) != 0) {
+				throw std::invalid_argument("The sample period has to be a power of two");
+			}
+			for (auto id = std::size_t{ 0 }; id < hits_.size(); ++id) {
+				hits_[id].store(profile.hits(static_cast<mime_id>(id)), std::memory_order_relaxed);
+			}
+			published_ = rank(profile);
+		}
+
+		[[nodiscard]] auto get_id_deep(const uint8_t* file_bytes, const std::size_t file_size, const mime_id mime_type_hint = mime_id::unknown) noexcept -> mime_id {
+			return learn(detector_.get_id_deep(file_bytes, file_size, mime_type_hint));
+		}
+
+		[[nodiscard]] auto get_id_from_file(const int fd, const mime_id mime_type_hint = mime_id::unknown) noexcept -> file_id_result {
+			const auto result = detector_.get_id_from_file(fd, mime_type_hint);
+			if (result.error == 0) {
+				learn(result.id);
+			}
+			return result;
+		}
+
+		[[nodiscard]] auto get_id_from_file(const std::string_view path_to_file) noexcept -> file_id_result {
+			const auto result = detector_.get_id_from_file(path_to_file);
+			if (result.error == 0) {
+				learn(result.id);
+			}
+			return result;
+		}
+
+		// The counts learned so far, on top of the starting profile.
+		[[nodiscard]] auto profile() const noexcept -> type_profile {
+			auto profile = type_profile{};
+			for (auto id = std::size_t{ 0 }; id < hits_.size(); ++id) {
+				profile.record(static_cast<mime_id>(id), hits_[id].load(std::memory_order_relaxed));
+			}
+			return profile;
+		}
+
+		// Publish the order of the counts learned so far. Returns false if it didn't change, or if another thread is publishing one.
+		// Never waits for the snapshots of this detector, so it can be called while holding one: the previous set is freed by a later retune once they are released.
+		auto retune() -> bool {
+			const auto lock = std::unique_lock<std::mutex>{ retune_mutex_, std::try_to_lock };
+			if (!lock.owns_lock()) {
+				return false;
+			}
+
+			const auto learned = profile();
+			for (auto& hits : hits_) {
+				hits.fetch_sub(hits.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+			}
+			const auto order = rank(learned);
+			if (order == published_) {
+				return false;
+			}
+			if (!detector_.publish(signature_set{ formats_, learned })) {
+				return false;
+			}
+			published_ = order;
+			return true;
+		}
+
+		// The current signature set, pinned for as long as the snapshot lives, like detector::pin. The lookups through it aren't learned from.
+		[[nodiscard]] auto pin() const noexcept -> detector::snapshot {
+			return detector_.pin();
+		}
+
+	private:
+		using type_order = std::array<std::uint8_t, detail::mime_types.size()>;
+
+		auto learn(const mime_id id) noexcept -> mime_id {
+			if (!options_.learn || id == mime_id::unknown) {
+				return id;
+			}
+
+			// The sampling counter is per thread, the shared counts are only touched by the sampled lookups
+			thread_local auto lookups = std::uint32_t{ 0 };
+			if ((++lookups & (options_.sample_period - 1)) != 0) {
+				return id;
+			}
+			hits_[static_cast<std::size_t>(id)].fetch_add(1, std::memory_order_relaxed);
+			const auto samples = samples_.fetch_add(1, std::memory_order_relaxed) + 1;
+			if (options_.retune_period != 0 && samples % options_.retune_period == 0) {
+				try {
+					retune();
+				}
+				catch (...) {
+					// Out of memory for the new set: keep the current order
+				}
+			}
+			return id;
+		}
+
+		// For each mime id, the number of ids seen more often: two profiles with the same ranks compare the same way and give signature sets with the same order
+		[[nodiscard]] static auto rank(const type_profile& profile) noexcept -> type_order {
+			auto order = type_order{};
+			for (auto id = std::size_t{ 0 }; id < order.size(); ++id) {
+				for (auto other = std::size_t{ 0 }; other < order.size(); ++other) {
+					order[id] += std::uint8_t(profile.hits(static_cast<mime_id>(other)) > profile.hits(static_cast<mime_id>(id)));
+				}
+			}
+			return order;
+		}
+
+		mime_set formats_;
+		adaptive_options options_;
+		detector detector_;
+		std::array<std::atomic<std::uint64_t>, detail::mime_types.size()> hits_{};
+		std::atomic<std::uint64_t> samples_{ 0 };
+		std::mutex retune_mutex_;
+		type_order published_{};
+	};
+
+} // inline namespace FILE_MIME_ABI_NAMESPACE
+} // namespace file_mime
+
+#endif // FILE_MIME_DETECTOR_H
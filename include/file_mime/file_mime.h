@@ -25,568 +25,2228 @@
 #define FILE_MIME_H
 
 #include <string>
+#include <string_view>
+#include <array>
 #include <vector>
-#include <unordered_map>
-#include <filesystem>
-#include <fstream>
-#include <numeric>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
 #include <cassert>
+#include <atomic>
+#include <chrono>
+#include <utility>
+#include <cstddef>
+#include <initializer_list>
+
+// The SIMD engine (approach 5) is compiled for all the x86 instruction sets it supports and picks one at runtime,
+// the other architectures use its scalar fallback.
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define FILE_MIME_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define FILE_MIME_TARGET(isa)
+#else
+#define FILE_MIME_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+// The library lives in an inline namespace named after the FILE_MIME_STATS setting: its inline functions are instrumented or not depending on it,
+// so that the translation units built with and without it get distinct symbols instead of violating the ODR (with the linker silently keeping either one).
+#if defined(FILE_MIME_STATS)
+#include <mutex>
+#define FILE_MIME_ABI_NAMESPACE stats_on
+#else
+#define FILE_MIME_ABI_NAMESPACE stats_off
+#endif
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
 
 namespace file_mime {
+inline namespace FILE_MIME_ABI_NAMESPACE {
 
 	inline constexpr auto min_file_header_size = std::size_t{ 2u }; // the header is min 2 bytes in size
 	inline constexpr auto max_file_header_size = std::size_t{ 18u }; // the header is max 18 bytes in size
 
+	// A wildcard magic byte that matches any value, e.g. the file size field of RIFF containers.
+	inline constexpr auto any_byte = std::int16_t{ -1 };
+
 	// File magic numbers sources:
 	// https://en.wikipedia.org/wiki/List_of_file_signatures
 	// https://gist.github.com/leommoore/f9e57ba2aa4bf197ebc5
-	inline const auto gif_bytes_87a = std::vector<std::uint8_t>{ 0x47, 0x49, 0x46, 0x38, 0x37, 0x61 };
-	inline const auto gif_bytes_89a = std::vector<std::uint8_t>{ 0x47, 0x49, 0x46, 0x38, 0x39, 0x61 };
-	inline const auto png_bytes = std::vector<std::uint8_t>{ 0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A };
-	inline const auto bmp_bytes = std::vector<std::uint8_t>{ 0x42, 0x4D };
-	inline const auto pm_bytes = std::vector<std::uint8_t>{ 0x56, 0x49, 0x45, 0x57 };
-	inline const auto jpg_bytes_1 = std::vector<std::uint8_t>{ 0xFF, 0xD8, 0xFF, 0xE0 };
-	inline const auto jpg_bytes_2 = std::vector<std::uint8_t>{ 0xFF, 0xD8, 0xFF, 0xE1 };
-	inline const auto jpg_bytes_3 = std::vector<std::uint8_t>{ 0xFF, 0xD8, 0xFF, 0xE2 }; // Canon
-	inline const auto jpg_bytes_4 = std::vector<std::uint8_t>{ 0xFF, 0xD8, 0xFF, 0xE3 }; // Samsung
-	inline const auto jpg_bytes_5 = std::vector<std::uint8_t>{ 0xFF, 0xD8, 0xFF, 0xE8 }; // SPIFF (Still Picture Interchange File Format)
-	inline const auto jpg_bytes_6 = std::vector<std::uint8_t>{ 0xFF, 0xD8, 0xFF, 0xDB };
-	inline const auto jpg_2000_bytes = std::vector<std::uint8_t>{ 0x00, 0x00, 0x00, 0x0C, 0x6A, 0x50, 0x20, 0x20, 0x0D, 0x0A, 0x87, 0x0A }; // JPEG-2000
-	inline const auto tiff_bytes_mono = std::vector<std::uint8_t>{ 0x0C, 0xED };
-	inline const auto tiff_bytes_intel = std::vector<std::uint8_t>{ 0x49, 0x49, 0x2A, 0x00 };
-	inline const auto tiff_bytes_motorola = std::vector<std::uint8_t>{ 0x4D, 0x4D, 0x00, 0x2A };
-	inline const auto tga_bytes_compressed = std::vector<std::uint8_t>{ 0x0, 0x0, 0xA, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0 };
-	inline const auto tga_bytes_uncompressed = std::vector<std::uint8_t>{ 0x0, 0x0, 0x2, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0 };
-	inline const auto exr_bytes = std::vector<std::uint8_t>{ 0x76, 0x2F, 0x31, 0x01 }; // https://openexr.readthedocs.io/en/latest/OpenEXRFileLayout.html
-	inline const auto hdr_bytes = std::vector<std::uint8_t>{ 0x23, 0x3F, 0x52, 0x41, 0x44, 0x49, 0x41, 0x4E, 0x43, 0x45, 0x0A }; // https://en.wikipedia.org/wiki/RGBE_image_format
-	inline const auto ktx1_bytes = std::vector<std::uint8_t>{ 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A }; // https://registry.khronos.org/KTX/specs/1.0/ktxspec.v1.html
-	inline const auto ktx2_bytes = std::vector<std::uint8_t>{ 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A }; // https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
-	inline const auto webp_bytes = std::vector<std::uint8_t>{ 0x52, 0x49, 0x46, 0x46 };
-	inline const auto bpg_bytes = std::vector<std::uint8_t>{ 0x42, 0x50, 0x47, 0xFB };
-	inline const auto glb_bytes = std::vector<std::uint8_t>{ 0x67, 0x6C, 0x54, 0x46 }; // https://docs.fileformat.com/3d/glb/
-
+	inline constexpr auto gif_bytes_87a = std::array<std::uint8_t, 6>{ 0x47, 0x49, 0x46, 0x38, 0x37, 0x61 };
+	inline constexpr auto gif_bytes_89a = std::array<std::uint8_t, 6>{ 0x47, 0x49, 0x46, 0x38, 0x39, 0x61 };
+	inline constexpr auto png_bytes = std::array<std::uint8_t, 8>{ 0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A };
+	inline constexpr auto bmp_bytes = std::array<std::uint8_t, 2>{ 0x42, 0x4D };
+	inline constexpr auto pm_bytes = std::array<std::uint8_t, 4>{ 0x56, 0x49, 0x45, 0x57 };
+	inline constexpr auto jpg_bytes_1 = std::array<std::uint8_t, 4>{ 0xFF, 0xD8, 0xFF, 0xE0 };
+	inline constexpr auto jpg_bytes_2 = std::array<std::uint8_t, 4>{ 0xFF, 0xD8, 0xFF, 0xE1 };
+	inline constexpr auto jpg_bytes_3 = std::array<std::uint8_t, 4>{ 0xFF, 0xD8, 0xFF, 0xE2 }; // Canon
+	inline constexpr auto jpg_bytes_4 = std::array<std::uint8_t, 4>{ 0xFF, 0xD8, 0xFF, 0xE3 }; // Samsung
+	inline constexpr auto jpg_bytes_5 = std::array<std::uint8_t, 4>{ 0xFF, 0xD8, 0xFF, 0xE8 }; // SPIFF (Still Picture Interchange File Format)
+	inline constexpr auto jpg_bytes_6 = std::array<std::uint8_t, 4>{ 0xFF, 0xD8, 0xFF, 0xDB };
+	inline constexpr auto jpg_2000_bytes = std::array<std::uint8_t, 12>{ 0x00, 0x00, 0x00, 0x0C, 0x6A, 0x50, 0x20, 0x20, 0x0D, 0x0A, 0x87, 0x0A }; // JPEG-2000
+	inline constexpr auto tiff_bytes_mono = std::array<std::uint8_t, 2>{ 0x0C, 0xED };
+	inline constexpr auto tiff_bytes_intel = std::array<std::uint8_t, 4>{ 0x49, 0x49, 0x2A, 0x00 };
+	inline constexpr auto tiff_bytes_motorola = std::array<std::uint8_t, 4>{ 0x4D, 0x4D, 0x00, 0x2A };
+	inline constexpr auto tga_bytes_compressed = std::array<std::uint8_t, 12>{ 0x0, 0x0, 0xA, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0 };
+	inline constexpr auto tga_bytes_uncompressed = std::array<std::uint8_t, 12>{ 0x0, 0x0, 0x2, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0 };
+	inline constexpr auto exr_bytes = std::array<std::uint8_t, 4>{ 0x76, 0x2F, 0x31, 0x01 }; // https://openexr.readthedocs.io/en/latest/OpenEXRFileLayout.html
+	inline constexpr auto hdr_bytes = std::array<std::uint8_t, 11>{ 0x23, 0x3F, 0x52, 0x41, 0x44, 0x49, 0x41, 0x4E, 0x43, 0x45, 0x0A }; // https://en.wikipedia.org/wiki/RGBE_image_format
+	inline constexpr auto ktx1_bytes = std::array<std::uint8_t, 12>{ 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A }; // https://registry.khronos.org/KTX/specs/1.0/ktxspec.v1.html
+	inline constexpr auto ktx2_bytes = std::array<std::uint8_t, 12>{ 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A }; // https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+	inline constexpr auto webp_bytes = std::array<std::int16_t, 12>{ 0x52, 0x49, 0x46, 0x46, any_byte, any_byte, any_byte, any_byte, 0x57, 0x45, 0x42, 0x50 }; // RIFF????WEBP
+	inline constexpr auto bpg_bytes = std::array<std::uint8_t, 4>{ 0x42, 0x50, 0x47, 0xFB };
+	inline constexpr auto glb_bytes = std::array<std::uint8_t, 4>{ 0x67, 0x6C, 0x54, 0x46 }; // https://docs.fileformat.com/3d/glb/
+	inline constexpr auto wav_bytes = std::array<std::int16_t, 12>{ 0x52, 0x49, 0x46, 0x46, any_byte, any_byte, any_byte, any_byte, 0x57, 0x41, 0x56, 0x45 }; // RIFF????WAVE
+	inline constexpr auto avi_bytes = std::array<std::int16_t, 12>{ 0x52, 0x49, 0x46, 0x46, any_byte, any_byte, any_byte, any_byte, 0x41, 0x56, 0x49, 0x20 }; // RIFF????AVI
+	inline constexpr auto aiff_bytes = std::array<std::int16_t, 12>{ 0x46, 0x4F, 0x52, 0x4D, any_byte, any_byte, any_byte, any_byte, 0x41, 0x49, 0x46, 0x46 }; // FORM????AIFF
+
+	// Magic numbers that are not located at the start of the file, the offsets are given in the registry below.
+	inline constexpr auto heic_bytes = std::array<std::uint8_t, 8>{ 0x66, 0x74, 0x79, 0x70, 0x68, 0x65, 0x69, 0x63 }; // ftypheic, https://www.iso.org/standard/68960.html
+	inline constexpr auto heix_bytes = std::array<std::uint8_t, 8>{ 0x66, 0x74, 0x79, 0x70, 0x68, 0x65, 0x69, 0x78 }; // ftypheix
+	inline constexpr auto avif_bytes = std::array<std::uint8_t, 8>{ 0x66, 0x74, 0x79, 0x70, 0x61, 0x76, 0x69, 0x66 }; // ftypavif, https://aomediacodec.github.io/av1-avif/
+	inline constexpr auto avis_bytes = std::array<std::uint8_t, 8>{ 0x66, 0x74, 0x79, 0x70, 0x61, 0x76, 0x69, 0x73 }; // ftypavis
+	inline constexpr auto mp4_bytes_isom = std::array<std::uint8_t, 8>{ 0x66, 0x74, 0x79, 0x70, 0x69, 0x73, 0x6F, 0x6D }; // ftypisom
+	inline constexpr auto mp4_bytes_mp41 = std::array<std::uint8_t, 8>{ 0x66, 0x74, 0x79, 0x70, 0x6D, 0x70, 0x34, 0x31 }; // ftypmp41
+	inline constexpr auto mp4_bytes_mp42 = std::array<std::uint8_t, 8>{ 0x66, 0x74, 0x79, 0x70, 0x6D, 0x70, 0x34, 0x32 }; // ftypmp42
+	inline constexpr auto tar_bytes = std::array<std::uint8_t, 5>{ 0x75, 0x73, 0x74, 0x61, 0x72 }; // ustar, https://www.gnu.org/software/tar/manual/html_node/Standard.html
+	inline constexpr auto iso_bytes = std::array<std::uint8_t, 5>{ 0x43, 0x44, 0x30, 0x30, 0x31 }; // CD001, the primary volume descriptor of ISO 9660
+
+	// A compact identifier of a supported mime type. #unknown is returned whenever the type couldn't be determined.
+	enum class mime_id : std::uint8_t {
+		unknown,
+		gif,
+		png,
+		bmp,
+		pm,
+		jpeg,
+		jp2,
+		tiff,
+		tga,
+		exr,
+		hdr,
+		ktx,
+		ktx2,
+		webp,
+		bpg,
+		gltf_binary,
+		wav,
+		avi,
+		aiff,
+		heic,
+		avif,
+		mp4,
+		tar,
+		iso,
+	};
 
-	// Determine the extension of a file from its mime type.
-	[[nodiscard]] inline auto get_extension_from_type(const std::string& mime_type) -> std::string {
+	namespace detail {
 
-		// An unordered map of mime types to extensions
-		static auto mime_to_ext = std::unordered_map<std::string, std::string>
-		{
-			{ "image/gif",	".gif" },
-			{ "image/png",	".png" },
-			{ "image/jpeg",	".jpg" },
-			{ "image/jp2",	".jp2" },
-			{ "image/bmp",	".bmp" },
-			{ "image/tiff",	".tiff" },
-			{ "image/tga",	".tga" },
-			{ "image/exr",	".exr" },
-			{ "image/hdr",	".hdr" },
-			{ "image/ktx",	".ktx" },
-			{ "image/ktx2",	".ktx2" },
-			{ "image/webp",	".webp" },
-			{ "image/bpg",	".bpg" },
-			{ "model/gltf-binary",	".glb" },
+		// The mime type and the canonical file extension of a mime id.
+		struct mime_type_info {
+			mime_id id;
+			std::string_view mime_type;
+			std::string_view extension;
 		};
 
-		// Transform the mime type to lowercase
-		auto mime_type_lc = mime_type;
-		std::transform(mime_type.begin(), mime_type.end(), mime_type_lc.begin(), [](auto c) { return std::tolower(c); });
+		// Indexed by mime_id, all the strings are in static storage.
+		inline constexpr auto mime_types = std::array{
+			mime_type_info{ mime_id::unknown, "", "" },
+			mime_type_info{ mime_id::gif, "image/gif", ".gif" },
+			mime_type_info{ mime_id::png, "image/png", ".png" },
+			mime_type_info{ mime_id::bmp, "image/bmp", ".bmp" },
+			mime_type_info{ mime_id::pm, "image/pm", ".pm" },
+			mime_type_info{ mime_id::jpeg, "image/jpeg", ".jpg" },
+			mime_type_info{ mime_id::jp2, "image/jp2", ".jp2" },
+			mime_type_info{ mime_id::tiff, "image/tiff", ".tiff" },
+			mime_type_info{ mime_id::tga, "image/tga", ".tga" },
+			mime_type_info{ mime_id::exr, "image/exr", ".exr" },
+			mime_type_info{ mime_id::hdr, "image/hdr", ".hdr" },
+			mime_type_info{ mime_id::ktx, "image/ktx", ".ktx" },
+			mime_type_info{ mime_id::ktx2, "image/ktx2", ".ktx2" },
+			mime_type_info{ mime_id::webp, "image/webp", ".webp" },
+			mime_type_info{ mime_id::bpg, "image/bpg", ".bpg" },
+			mime_type_info{ mime_id::gltf_binary, "model/gltf-binary", ".glb" },
+			mime_type_info{ mime_id::wav, "audio/wav", ".wav" },
+			mime_type_info{ mime_id::avi, "video/x-msvideo", ".avi" },
+			mime_type_info{ mime_id::aiff, "audio/aiff", ".aiff" },
+			mime_type_info{ mime_id::heic, "image/heic", ".heic" },
+			mime_type_info{ mime_id::avif, "image/avif", ".avif" },
+			mime_type_info{ mime_id::mp4, "video/mp4", ".mp4" },
+			mime_type_info{ mime_id::tar, "application/x-tar", ".tar" },
+			mime_type_info{ mime_id::iso, "application/x-iso9660-image", ".iso" },
+		};
 
-		// Find the extension
-		const auto it = mime_to_ext.find(mime_type_lc);
-		if (it != mime_to_ext.end()) {
-			return it->second;
-		}
+		// All the recognized file extensions, including the non-canonical ones.
+		struct extension_info {
+			std::string_view extension;
+			mime_id id;
+		};
 
-		return "";
-	}
+		inline constexpr auto extensions = std::array{
+			extension_info{ ".gif", mime_id::gif },
+			extension_info{ ".png", mime_id::png },
+			extension_info{ ".jpg", mime_id::jpeg },
+			extension_info{ ".jpeg", mime_id::jpeg },
+			extension_info{ ".jp2", mime_id::jp2 },
+			extension_info{ ".jpf", mime_id::jp2 },
+			extension_info{ ".j2c", mime_id::jp2 },
+			extension_info{ ".j2k", mime_id::jp2 },
+			extension_info{ ".bmp", mime_id::bmp },
+			extension_info{ ".pm", mime_id::pm },
+			extension_info{ ".tiff", mime_id::tiff },
+			extension_info{ ".tif", mime_id::tiff },
+			extension_info{ ".tga", mime_id::tga },
+			extension_info{ ".exr", mime_id::exr },
+			extension_info{ ".hdr", mime_id::hdr },
+			extension_info{ ".ktx", mime_id::ktx },
+			extension_info{ ".ktx2", mime_id::ktx2 },
+			extension_info{ ".webp", mime_id::webp },
+			extension_info{ ".bpg", mime_id::bpg },
+			extension_info{ ".glb", mime_id::gltf_binary },
+			extension_info{ ".wav", mime_id::wav },
+			extension_info{ ".avi", mime_id::avi },
+			extension_info{ ".aiff", mime_id::aiff },
+			extension_info{ ".aif", mime_id::aiff },
+			extension_info{ ".heic", mime_id::heic },
+			extension_info{ ".heif", mime_id::heic },
+			extension_info{ ".avif", mime_id::avif },
+			extension_info{ ".mp4", mime_id::mp4 },
+			extension_info{ ".m4v", mime_id::mp4 },
+			extension_info{ ".tar", mime_id::tar },
+			extension_info{ ".iso", mime_id::iso },
+		};
 
+		[[nodiscard]] constexpr auto check_mime_types() noexcept -> bool {
+			for (auto i = std::size_t{ 0 }; i < mime_types.size(); ++i) {
+				if (static_cast<std::size_t>(mime_types[i].id) != i) {
+					return false;
+				}
+			}
+			return true;
+		}
 
-	// Determine the mime type of a file from its extension.
-	[[nodiscard]] inline auto get_type_from_extension(const std::string& extension) -> std::string {
-		// An unordered map of extensions to mime types
-		static auto ext_to_mime = std::unordered_map<std::string, std::string>
-		{
-			{ ".gif",	"image/gif" },
-			{ ".png",	"image/png" },
-			{ ".jpg",	"image/jpeg" },
-			{ ".jpeg",	"image/jpeg" },
-			{ ".jp2",	"image/jp2" },
-			{ ".jpf",	"image/jp2" },
-			{ ".j2c",	"image/jp2" },
-			{ ".j2k",	"image/jp2" },
-			{ ".bmp",	"image/bmp" },
-			{ ".pm",	"image/pm" },
-			{ ".tiff",	"image/tiff" },
-			{ ".tif",	"image/tiff" },
-			{ ".tga",	"image/tga" },
-			{ ".exr",	"image/exr" },
-			{ ".hdr",	"image/hdr" },
-			{ ".ktx",	"image/ktx" },
-			{ ".ktx2",	"image/ktx2" },
-			{ ".webp",	"image/webp" },
-			{ ".bpg",	"image/bpg" },
-			{ ".glb",	"model/gltf-binary" },
-		};
+		static_assert(check_mime_types(), "The mime_types table has to be indexed by mime_id");
 
-		// Transform the extension to lowercase
-		auto extension_lc = extension;
-		std::transform(extension.begin(), extension.end(), extension_lc.begin(), [](auto c) { return std::tolower(c); });
+		[[nodiscard]] constexpr auto to_lower(const char c) noexcept -> char {
+			return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+		}
 
-		// Find the mime type
-		const auto it = ext_to_mime.find(extension_lc);
-		if (it != ext_to_mime.end()) {
-			return it->second;
+		// Case insensitive comparison against an already lowercase string.
+		[[nodiscard]] constexpr auto equals_lowercase(const std::string_view str, const std::string_view lowercase) noexcept -> bool {
+			if (str.size() != lowercase.size()) {
+				return false;
+			}
+			for (auto i = std::size_t{ 0 }; i < str.size(); ++i) {
+				if (to_lower(str[i]) != lowercase[i]) {
+					return false;
+				}
+			}
+			return true;
 		}
 
-		return "";
-	}
+		// The extension of the file name part of the path, with the same semantics as std::filesystem::path::extension().
+		[[nodiscard]] constexpr auto path_extension(const std::string_view path) noexcept -> std::string_view {
+#if defined(_WIN32)
+			const auto separator = path.find_last_of("/\\");
+#else
+			const auto separator = path.find_last_of('/');
+#endif
+			const auto file_name = (separator == std::string_view::npos) ? path : path.substr(separator + 1);
+			if (file_name == "." || file_name == "..") {
+				return {};
+			}
 
+			const auto dot = file_name.find_last_of('.');
+			if (dot == std::string_view::npos || dot == 0) {
+				return {};
+			}
 
-	// Determine the mime type of a file from its file extension.
-	[[nodiscard]] inline auto get_type_shallow(const std::string& path_to_file) -> std::string {
+			return file_name.substr(dot);
+		}
 
-		namespace fs = std::filesystem;
+		// The perfect hashes are keyed on FNV-1a hashes (which can be computed incrementally, a byte at a time) finished with #mix.
+		inline constexpr auto fnv1a_basis = std::uint64_t{ 0xcbf29ce484222325u };
 
-		// Initialize path from path string
-		const auto path = fs::path(path_to_file);
+		[[nodiscard]] constexpr auto fnv1a(const std::uint64_t h, const std::uint8_t byte) noexcept -> std::uint64_t {
+			return (h ^ byte) * std::uint64_t{ 0x100000001b3u };
+		}
 
-		// Get the extension of the file
-		const auto extension = path.extension().string();
+		// The splitmix64 finalizer, so that the bucket and the slot are taken from well mixed bits.
+		[[nodiscard]] constexpr auto mix(std::uint64_t x) noexcept -> std::uint64_t {
+			x = (x ^ (x >> 30)) * std::uint64_t{ 0xbf58476d1ce4e5b9u };
+			x = (x ^ (x >> 27)) * std::uint64_t{ 0x94d049bb133111ebu };
+			return x ^ (x >> 31);
+		}
 
-		// If the extension is empty, return an empty string
-		if (extension.empty()) {
-			return "";
+		// Hash-and-displace: the key picks one of #bucket_count buckets, and the displacement of the bucket (searched for when the table is built)
+		// sends all of its keys to free slots out of #slot_count, so every key gets a slot of its own.
+		[[nodiscard]] constexpr auto hash_bucket(const std::uint64_t key, const std::size_t bucket_count) noexcept -> std::size_t {
+			return static_cast<std::size_t>((key >> 32) % bucket_count);
 		}
 
-		return get_type_from_extension(extension);
-	}
+		[[nodiscard]] constexpr auto hash_slot(const std::uint64_t key, const std::uint32_t displacement, const std::size_t slot_count) noexcept -> std::size_t {
+			return static_cast<std::size_t>(mix(key ^ (displacement * std::uint64_t{ 0x9e3779b97f4a7c15u })) % slot_count);
+		}
 
-	namespace detail {
+		// The key of a case insensitive string, e.g. ".JPEG": the bytes are folded to lowercase as they are hashed, so the string is never copied.
+		[[nodiscard]] constexpr auto folded_key(const std::string_view str) noexcept -> std::uint64_t {
+			auto h = fnv1a_basis;
+			for (const auto c : str) {
+				h = fnv1a(h, static_cast<std::uint8_t>(to_lower(c)));
+			}
+			return mix(h + str.size() * std::uint64_t{ 0x9e3779b97f4a7c15u });
+		}
 
-		enum class deep_alg_version{
-			DEEP_ALG_V0,
-			DEEP_ALG_V1,
-			DEEP_ALG_V2,
-			DEEP_ALG_V3,
+		// A minimal perfect hash of N lowercase strings: #slots holds the index of the string that a key can only be equal to, which is then compared to verify it.
+		template <std::size_t N>
+		struct string_hash_tables {
+			std::array<std::uint32_t, N> displacements{};
+			std::array<std::uint8_t, N> slots{};
+			bool complete = false;
+
+			[[nodiscard]] constexpr auto find(const std::uint64_t key) const noexcept -> std::size_t {
+				return slots[hash_slot(key, displacements[hash_bucket(key, N)], N)];
+			}
 		};
 
-		template <deep_alg_version alg_version>
-		[[nodiscard]] inline auto get_type_deep(const uint8_t* file_bytes, const std::size_t file_size, const std::string& mime_type_hint) -> std::string;
+		template <std::size_t N>
+		[[nodiscard]] constexpr auto make_string_hash(const std::array<std::string_view, N>& strings) -> string_hash_tables<N> {
+			static_assert(N <= 256, "The slots index the strings with a byte");
+			auto tables = string_hash_tables<N>{};
 
-		// Approach 0: linearly searching through all magic numbers and trying to match them with the file bytes
-		template <>
-		[[nodiscard]] inline auto get_type_deep<deep_alg_version::DEEP_ALG_V0>(const uint8_t* file_bytes, const std::size_t file_size, [[maybe_unused]] const std::string& mime_type_hint) -> std::string {
+			auto keys = std::array<std::uint64_t, N>{};
+			auto bucket_sizes = std::array<std::size_t, N>{};
+			for (auto i = std::size_t{ 0 }; i < N; ++i) {
+				keys[i] = folded_key(strings[i]);
+				++bucket_sizes[hash_bucket(keys[i], N)];
+			}
+
+			// The largest buckets are the hardest to place, so they go first
+			auto occupied = std::array<bool, N>{};
+			for (;;) {
+				auto bucket = std::size_t{ 0 };
+				for (auto b = std::size_t{ 1 }; b < N; ++b) {
+					bucket = (bucket_sizes[b] > bucket_sizes[bucket]) ? b : bucket;
+				}
+				if (bucket_sizes[bucket] == 0) {
+					break;
+				}
+
+				auto found = false;
+				for (auto displacement = std::uint32_t{ 0 }; displacement < 0x10000u && !found; ++displacement) {
+					auto taken = occupied;
+					found = true;
+					for (auto k = std::size_t{ 0 }; k < N && found; ++k) {
+						if (hash_bucket(keys[k], N) == bucket) {
+							const auto slot = hash_slot(keys[k], displacement, N);
+							found = !taken[slot];
+							taken[slot] = true;
+						}
+					}
+					if (found) {
+						occupied = taken;
+						tables.displacements[bucket] = displacement;
+						for (auto k = std::size_t{ 0 }; k < N; ++k) {
+							if (hash_bucket(keys[k], N) == bucket) {
+								tables.slots[hash_slot(keys[k], displacement, N)] = static_cast<std::uint8_t>(k);
+							}
+						}
+					}
+				}
+				if (!found) {
+					return tables;
+				}
+				bucket_sizes[bucket] = 0;
+			}
+
+			tables.complete = true;
+			return tables;
+		}
+
+		template <typename T, std::size_t N, typename F>
+		[[nodiscard]] constexpr auto make_string_keys(const std::array<T, N>& infos, const F& key) -> std::array<std::string_view, N> {
+			auto strings = std::array<std::string_view, N>{};
+			for (auto i = std::size_t{ 0 }; i < N; ++i) {
+				strings[i] = key(infos[i]);
+			}
+			return strings;
+		}
+
+		// The perfect hashes of the extensions and of the mime types, so that looking one up is a hash of its bytes, a single probe and a comparison.
+		inline constexpr auto extension_hash = make_string_hash(make_string_keys(extensions, [](const extension_info& info) { return info.extension; }));
+		static_assert(extension_hash.complete, "Couldn't build a perfect hash of the extensions");
+		inline constexpr auto mime_type_hash = make_string_hash(make_string_keys(mime_types, [](const mime_type_info& info) { return info.mime_type; }));
+		static_assert(mime_type_hash.complete, "Couldn't build a perfect hash of the mime types");
+
+	} // namespace detail
 
-			// An unordered map of the mime types and their corresponding magic numbers.
-			static auto mime_to_magic = std::vector<std::pair<std::string, std::vector<uint8_t>>>{
+	// A set of mime types, one bit per mime id.
+	using mime_set = std::uint64_t;
+	static_assert(detail::mime_types.size() <= 64, "mime_set has to have a bit for every mime id");
 
-				{ "image/gif", gif_bytes_87a },
-				{ "image/gif", gif_bytes_89a },
+	inline constexpr auto all_mime_types = ~mime_set{ 0 };
 
-				{ "image/png", png_bytes },
+	[[nodiscard]] constexpr auto make_mime_set(const std::initializer_list<mime_id> ids) noexcept -> mime_set {
+		auto set = mime_set{ 0 };
+		for (const auto id : ids) {
+			set |= mime_set{ 1 } << static_cast<std::size_t>(id);
+		}
+		return set;
+	}
 
-				{ "image/bmp", bmp_bytes },
+	[[nodiscard]] constexpr auto contains(const mime_set set, const mime_id id) noexcept -> bool {
+		return (set >> static_cast<std::size_t>(id) & 1) != 0;
+	}
 
-				{ "image/pm", pm_bytes },
+	// The mime type of a mime id, e.g. "image/png". An empty string for mime_id::unknown.
+	[[nodiscard]] constexpr auto get_type_from_id(const mime_id id) noexcept -> std::string_view {
+		return detail::mime_types[static_cast<std::size_t>(id)].mime_type;
+	}
 
-				{ "image/jpeg", jpg_bytes_1 },
-				{ "image/jpeg", jpg_bytes_2 },
-				{ "image/jpeg", jpg_bytes_3 },
-				{ "image/jpeg", jpg_bytes_4 },
-				{ "image/jpeg", jpg_bytes_5 },
-				{ "image/jpeg", jpg_bytes_6 },
+	// The canonical extension of a mime id, e.g. ".png". An empty string for mime_id::unknown.
+	[[nodiscard]] constexpr auto get_extension_from_id(const mime_id id) noexcept -> std::string_view {
+		return detail::mime_types[static_cast<std::size_t>(id)].extension;
+	}
 
-				{ "image/jp2", jpg_2000_bytes },
+	// Determine the mime id from a (case insensitive) mime type.
+	[[nodiscard]] constexpr auto get_id_from_type(const std::string_view mime_type) noexcept -> mime_id {
+		const auto& info = detail::mime_types[detail::mime_type_hash.find(detail::folded_key(mime_type))];
+		return detail::equals_lowercase(mime_type, info.mime_type) ? info.id : mime_id::unknown;
+	}
 
-				{ "image/tiff", tiff_bytes_mono},
-				{ "image/tiff", tiff_bytes_intel },
-				{ "image/tiff", tiff_bytes_motorola },
+	// Determine the mime id from a (case insensitive) file extension, e.g. ".JPEG".
+	[[nodiscard]] constexpr auto get_id_from_extension(const std::string_view extension) noexcept -> mime_id {
+		const auto& info = detail::extensions[detail::extension_hash.find(detail::folded_key(extension))];
+		return detail::equals_lowercase(extension, info.extension) ? info.id : mime_id::unknown;
+	}
 
-				{ "image/tga", tga_bytes_compressed },
-				{ "image/tga", tga_bytes_uncompressed },
+	// Determine the mime id of a file from its file extension.
+	[[nodiscard]] constexpr auto get_id_shallow(const std::string_view path_to_file) noexcept -> mime_id {
+		return get_id_from_extension(detail::path_extension(path_to_file));
+	}
 
-				{ "image/exr", exr_bytes },
+	namespace detail {
 
-				{ "image/hdr", hdr_bytes },
+		// The fixed width of the signature pattern/mask rows and of the zero-padded header they are compared against.
+		inline constexpr auto signature_width = std::size_t{ 32u };
+		static_assert(signature_width >= max_file_header_size && signature_width % sizeof(std::uint64_t) == 0);
 
-				{ "image/ktx", ktx1_bytes },
-				{ "image/ktx2", ktx2_bytes },
+		// The largest single read issued to check the magic numbers beyond the file header.
+		inline constexpr auto max_read_range_size = std::size_t{ 512u };
 
-				{ "image/webp", webp_bytes },
+	} // namespace detail
 
-				{ "image/bpg", bpg_bytes },
+	// A single magic number signature: the mime type it identifies and the bytes of the file at #offset that identify it,
+	// stored as a pattern/mask pair so that wildcard bytes (with a zero mask) match any value.
+	struct magic_signature {
+		mime_id id = mime_id::unknown;
+		alignas(std::uint64_t) std::array<std::uint8_t, detail::signature_width> pattern{};
+		alignas(std::uint64_t) std::array<std::uint8_t, detail::signature_width> mask{};
+		std::size_t size = 0; // the number of magic bytes, including the wildcards
+		std::size_t prefix_size = 0; // the number of magic bytes before the first wildcard
+		std::uint32_t offset = 0; // the offset of the magic bytes from the start of the file
+	};
 
-				{ "model/gltf-binary", glb_bytes },
-			};
+	namespace detail {
+
+		template <typename T, std::size_t N>
+		[[nodiscard]] constexpr auto make_signature(const mime_id id, const std::array<T, N>& magic_bytes, const std::uint32_t offset = 0) -> magic_signature {
+			static_assert(N >= min_file_header_size && N <= signature_width, "The magic number size has to be within the [min_file_header_size, signature_width] range");
 
-			for (auto it = mime_to_magic.begin(); it != mime_to_magic.end(); ++it) {
-				const auto& magic_bytes = it->second;
-				if (std::equal(magic_bytes.begin(), magic_bytes.end(), file_bytes, file_bytes + std::min(file_size, magic_bytes.size()))) {
-					return it->first;
+			auto signature = magic_signature{ id, {}, {}, N, N, offset };
+			for (auto i = std::size_t{ 0 }; i < N; ++i) {
+				if (magic_bytes[i] == any_byte) {
+					signature.prefix_size = std::min(signature.prefix_size, i);
+				}
+				else {
+					signature.pattern[i] = static_cast<std::uint8_t>(magic_bytes[i]);
+					signature.mask[i] = 0xFF;
 				}
 			}
 
-			return "";
+			return signature;
 		}
 
-		// Approach 1: use a hash map to quickly check the entry associated with the provided hint,
-		// and then binary search through the actual keys that are vectors of raw magic data.
-		template<>
-		[[nodiscard]] inline auto get_type_deep<deep_alg_version::DEEP_ALG_V1>(const uint8_t* file_bytes, const std::size_t file_size, const std::string& mime_type_hint) -> std::string {
+	} // namespace detail
 
-			// An unordered map of the mime types and their corresponding magic numbers.
-			static auto mime_to_magic = std::unordered_map<std::string, std::vector<std::vector<uint8_t>>>{
+	// The registry of all the supported magic numbers and their mime types.
+	// This is the one place a new format has to be added to: the look-up structures of all the 'deep' algorithms are derived from it at compile time.
+	// Magic numbers of the same mime type have to be kept next to each other, and no two magic numbers at the same offset may match the same file.
+	// The magic numbers at the start of the file take precedence over the ones at an offset, which are checked in the order of their offsets.
+	inline constexpr auto magic_signatures = std::array{
 
-				{ "image/gif", {gif_bytes_87a , gif_bytes_89a} },
+		detail::make_signature(mime_id::gif, gif_bytes_87a),
+		detail::make_signature(mime_id::gif, gif_bytes_89a),
 
-				{ "image/png", {png_bytes} },
+		detail::make_signature(mime_id::png, png_bytes),
 
-				{ "image/bmp", {bmp_bytes} },
+		detail::make_signature(mime_id::bmp, bmp_bytes),
 
-				{ "image/pm", {pm_bytes} },
+		detail::make_signature(mime_id::pm, pm_bytes),
 
-				{ "image/jpeg", {jpg_bytes_1, jpg_bytes_2, jpg_bytes_3, jpg_bytes_4, jpg_bytes_5, jpg_bytes_6} },
+		detail::make_signature(mime_id::jpeg, jpg_bytes_1),
+		detail::make_signature(mime_id::jpeg, jpg_bytes_2),
+		detail::make_signature(mime_id::jpeg, jpg_bytes_3),
+		detail::make_signature(mime_id::jpeg, jpg_bytes_4),
+		detail::make_signature(mime_id::jpeg, jpg_bytes_5),
+		detail::make_signature(mime_id::jpeg, jpg_bytes_6),
 
-				{ "image/jp2", { jpg_2000_bytes} },
+		detail::make_signature(mime_id::jp2, jpg_2000_bytes),
 
-				{ "image/tiff", {tiff_bytes_mono, tiff_bytes_intel, tiff_bytes_motorola} },
+		detail::make_signature(mime_id::tiff, tiff_bytes_mono),
+		detail::make_signature(mime_id::tiff, tiff_bytes_intel),
+		detail::make_signature(mime_id::tiff, tiff_bytes_motorola),
 
-				{ "image/tga", {tga_bytes_compressed, tga_bytes_uncompressed} },
+		detail::make_signature(mime_id::tga, tga_bytes_compressed),
+		detail::make_signature(mime_id::tga, tga_bytes_uncompressed),
 
-				{ "image/exr", {exr_bytes} },
+		detail::make_signature(mime_id::exr, exr_bytes),
 
-				{ "image/hdr", {hdr_bytes} },
+		detail::make_signature(mime_id::hdr, hdr_bytes),
 
-				{ "image/ktx", {ktx1_bytes} },
-				{ "image/ktx2", {ktx2_bytes} },
+		detail::make_signature(mime_id::ktx, ktx1_bytes),
+		detail::make_signature(mime_id::ktx2, ktx2_bytes),
 
-				{ "image/webp", {webp_bytes} },
+		detail::make_signature(mime_id::webp, webp_bytes),
 
-				{ "image/bpg", {bpg_bytes} },
+		detail::make_signature(mime_id::bpg, bpg_bytes),
 
-				{ "model/gltf-binary", {glb_bytes} },
-			};
+		detail::make_signature(mime_id::gltf_binary, glb_bytes),
 
-			// If we have the hint mime type (usually from the file extension), then we can use it to narrow down the search.
-			auto it_hint = mime_to_magic.end();
-			if (!mime_type_hint.empty()) {
-				it_hint = mime_to_magic.find(mime_type_hint);
-				if (it_hint != mime_to_magic.end()) {
-					for (const auto& magic : it_hint->second) {
-						if (std::equal(magic.begin(), magic.end(), file_bytes, file_bytes + std::min(file_size, magic.size()))) {
-							return it_hint->first;
-						}
-					}
-				}
-			}
+		detail::make_signature(mime_id::wav, wav_bytes),
 
-			// No hint or it didn't work (due to the magic data mismatch), we try to find the mime type of the file based on the rest of the magic numbers.
-			for (auto it = mime_to_magic.begin(); it != mime_to_magic.end(); ++it) {
-				if (it_hint != it) {
-					for (const auto& magic : it->second) {
-						if (std::equal(magic.begin(), magic.end(), file_bytes, file_bytes + std::min(file_size, magic.size()))) {
-							return it->first;
-						}
-					}
-				}
-			}
+		detail::make_signature(mime_id::avi, avi_bytes),
 
-			return "";
-		}
+		detail::make_signature(mime_id::aiff, aiff_bytes),
 
-		// Approach 2: use a vector of pairs of mime types and their corresponding magic numbers, sort it lexicographically once, and then perform binary search using std::lower_bound.
-		template<>
-		[[nodiscard]] inline auto get_type_deep<deep_alg_version::DEEP_ALG_V2>(const uint8_t* file_bytes, const std::size_t file_size, [[maybe_unused]] const std::string& mime_type_hint) -> std::string {
+		detail::make_signature(mime_id::heic, heic_bytes, 4),
+		detail::make_signature(mime_id::heic, heix_bytes, 4),
 
-			// An unordered map of the mime types and their corresponding magic numbers.
-			static auto mime_to_magic = []() -> std::vector<std::pair<std::string, std::vector<uint8_t>>> {
+		detail::make_signature(mime_id::avif, avif_bytes, 4),
+		detail::make_signature(mime_id::avif, avis_bytes, 4),
 
-				auto m2m = std::vector<std::pair<std::string, std::vector<uint8_t>>>{
+		detail::make_signature(mime_id::mp4, mp4_bytes_isom, 4),
+		detail::make_signature(mime_id::mp4, mp4_bytes_mp41, 4),
+		detail::make_signature(mime_id::mp4, mp4_bytes_mp42, 4),
 
-					{ "image/gif", gif_bytes_87a },
-					{ "image/gif", gif_bytes_89a },
+		detail::make_signature(mime_id::tar, tar_bytes, 257),
 
-					{ "image/png", png_bytes },
+		detail::make_signature(mime_id::iso, iso_bytes, 32769),
+	};
 
-					{ "image/bmp", bmp_bytes },
 
-					{ "image/pm", pm_bytes },
+	// Determine the extension of a file from its mime type.
+	// Only the returned string is allocated, get_extension_from_id(get_id_from_type(mime_type)) returns a view of static storage instead.
+	[[nodiscard]] inline auto get_extension_from_type(const std::string_view mime_type) -> std::string {
+		return std::string(get_extension_from_id(get_id_from_type(mime_type)));
+	}
 
-					{ "image/jpeg", jpg_bytes_1 },
-					{ "image/jpeg", jpg_bytes_2 },
-					{ "image/jpeg", jpg_bytes_3 },
-					{ "image/jpeg", jpg_bytes_4 },
-					{ "image/jpeg", jpg_bytes_5 },
-					{ "image/jpeg", jpg_bytes_6 },
 
-					{ "image/jp2", jpg_2000_bytes },
+	// Determine the mime type of a file from its extension.
+	// Only the returned string is allocated, get_type_from_id(get_id_from_extension(extension)) returns a view of static storage instead.
+	[[nodiscard]] inline auto get_type_from_extension(const std::string_view extension) -> std::string {
+		return std::string(get_type_from_id(get_id_from_extension(extension)));
+	}
 
-					{ "image/tiff", tiff_bytes_mono },
-					{ "image/tiff", tiff_bytes_intel },
-					{ "image/tiff", tiff_bytes_motorola },
 
-					{ "image/tga", tga_bytes_compressed },
-					{ "image/tga", tga_bytes_uncompressed },
+	// Determine the mime type of a file from its file extension.
+	[[nodiscard]] inline auto get_type_shallow(const std::string_view path_to_file) -> std::string {
+		return std::string(get_type_from_id(get_id_shallow(path_to_file)));
+	}
 
-					{ "image/exr", exr_bytes },
+	// The 'deep' engines, one per approach below, for the calls that pick one at runtime: the get_id_deep overload taking one, #set_engine and #autotune.
+	enum class engine {
+		v0, // linear search
+		v1, // linear search, grouped by mime id
+		v2, // binary search of the sorted prefixes
+		v3, // perfect hash of the prefixes
+		v4, // DFA
+		v5, // SIMD
+	};
 
-					{ "image/hdr", hdr_bytes },
+	namespace detail {
 
-					{ "image/ktx", ktx1_bytes },
-					{ "image/ktx2", ktx2_bytes },
+		enum class deep_alg_version{
+			DEEP_ALG_V0,
+			DEEP_ALG_V1,
+			DEEP_ALG_V2,
+			DEEP_ALG_V3,
+			DEEP_ALG_V4,
+			DEEP_ALG_V5,
+		};
 
-					{ "image/webp", webp_bytes },
+		// The file header copied into a zero-padded block of the signature width, so that it can be compared against the pattern/mask rows a word at a time.
+		struct header_block {
+			alignas(std::uint64_t) std::array<std::uint8_t, signature_width> bytes{};
+			std::size_t size = 0;
+		};
 
-					{ "image/bpg", bpg_bytes },
+		[[nodiscard]] inline auto load_header(const uint8_t* file_bytes, const std::size_t file_size) noexcept -> header_block {
+			auto header = header_block{};
+			header.size = std::min(file_size, signature_width);
+			std::memcpy(header.bytes.data(), file_bytes, header.size);
+			return header;
+		}
 
-					{ "model/gltf-binary", glb_bytes },
-				};
+		[[nodiscard]] inline auto load_word(const std::uint8_t* p) noexcept -> std::uint64_t {
+			auto word = std::uint64_t{ 0 };
+			std::memcpy(&word, p, sizeof(word));
+			return word;
+		}
 
-				// Sort the mime_to_magic vector lexicographically once.
-				{
-					auto cmp = [](const auto& a, const auto& b) -> bool {
-						// Compare the magic numbers lexographically (which is the defualt for std::vector).
-						return a.second < b.second;
-						// In the future, a custom comparator can be used with the lexographical search to compare magic numbers that need certain bytes to be skipped over.
-						//auto lex_cmp = [](const uint8_t& magic_byte1, const uint8_t& magic_byte2) -> bool {
-						//	return magic_byte1 < magic_byte2;
-						//};
-						//return std::lexicographical_compare(a.second.begin(), a.second.end(), b.second.begin(), b.second.end(), lex_cmp);
-						};
+		// Check whether the header matches the magic number of the signature: a fixed-width AND/CMP over the whole row rather than a loop over the magic bytes.
+		[[nodiscard]] inline auto matches(const magic_signature& signature, const header_block& header) noexcept -> bool {
+			auto diff = std::uint64_t{ 0 };
+			for (auto i = std::size_t{ 0 }; i < signature_width; i += sizeof(std::uint64_t)) {
+				diff |= (load_word(header.bytes.data() + i) ^ load_word(signature.pattern.data() + i)) & load_word(signature.mask.data() + i);
+			}
+			return (diff == 0) & (header.size >= signature.size);
+		}
 
-					std::sort(m2m.begin(), m2m.end(), cmp);
+		// Check whether two signatures can match the same file header.
+		[[nodiscard]] constexpr auto overlap(const magic_signature& a, const magic_signature& b) noexcept -> bool {
+			for (auto i = std::size_t{ 0 }; i < std::min(a.size, b.size); ++i) {
+				if ((a.mask[i] & b.mask[i]) != 0 && a.pattern[i] != b.pattern[i]) {
+					return false;
 				}
+			}
+			return true;
+		}
 
-				return m2m;
-			}();
-
-			// Perform binary search using std::lower_bound
-			{
-				auto cmp = [&file_size](const auto& magic_bytes, const uint8_t* p_data) -> bool {
-					return std::lexicographical_compare(magic_bytes.begin(), magic_bytes.end(), p_data, p_data + std::min(file_size, magic_bytes.size()));
-					};
-
-				auto it = std::lower_bound(mime_to_magic.begin(), mime_to_magic.end(), file_bytes,
-					[&cmp](const auto& mtm, const uint8_t* p_data) {
-						return cmp(mtm.second, p_data);
-					});
-
-				if (
-					it != mime_to_magic.end()
-					&& std::equal(it->second.begin(), it->second.end(), file_bytes, file_bytes + std::min(file_size, it->second.size()))
-					) {
-					// mime type found
-					return it->first;
+		// Constexpr lexicographical comparison of the signature prefixes (std::lexicographical_compare is not constexpr until C++20).
+		[[nodiscard]] constexpr auto prefix_less(const magic_signature& a, const magic_signature& b) noexcept -> bool {
+			for (auto i = std::size_t{ 0 }; i < a.prefix_size && i < b.prefix_size; ++i) {
+				if (a.pattern[i] != b.pattern[i]) {
+					return a.pattern[i] < b.pattern[i];
 				}
 			}
+			return a.prefix_size < b.prefix_size;
+		}
 
-			return "";
+		[[nodiscard]] constexpr auto same_prefix(const magic_signature& a, const magic_signature& b) noexcept -> bool {
+			return !prefix_less(a, b) && !prefix_less(b, a);
 		}
 
-		template <typename T>
-		inline auto hash_combine(std::size_t& s, const T& v) -> void {
-			auto h = std::hash<T>{};
-			s ^= h(v) + 0x9e3779b9 + (s << 6) + (s >> 2);
+		[[nodiscard]] constexpr auto is_proper_prefix(const magic_signature& a, const magic_signature& b) noexcept -> bool {
+			if (a.prefix_size >= b.prefix_size) {
+				return false;
+			}
+			for (auto i = std::size_t{ 0 }; i < a.prefix_size; ++i) {
+				if (a.pattern[i] != b.pattern[i]) {
+					return false;
+				}
+			}
+			return true;
 		}
 
-		// Approach 3: use an unordered map with a custom magic_number struct & hash function to look up the magic numbers in constant time.
-		// Since you usually don't know the length of the header/magic number in the passed in file bytes, you have to calculate the hash value incrementally and test it against the map.
-		// The hint can't really be used here efficiently, as the same mime type can have multiple magic numbers meaning that several hash values have to be calculated (again, in the incremental fashion as described above).
-		template<>
-		[[nodiscard]] inline auto get_type_deep<deep_alg_version::DEEP_ALG_V3>(const uint8_t* file_bytes, const size_t file_size, [[maybe_unused]] const std::string& mime_type_hint) -> std::string {
+		// The invariants all the algorithms rely on: every signature at the start of the file fits the header and starts with at least #min_file_header_size non-wildcard bytes,
+		// no two signatures at the same offset can match the same file (so that the search order doesn't matter), and no signature prefix is a proper prefix of another one (for the binary search).
+		template <std::size_t N>
+		[[nodiscard]] constexpr auto check_signatures(const std::array<magic_signature, N>& signatures) -> bool {
+			for (auto i = std::size_t{ 0 }; i < N; ++i) {
+				const auto anchored = (signatures[i].offset == 0);
+				if (anchored && (signatures[i].prefix_size < min_file_header_size || signatures[i].size > max_file_header_size)) {
+					return false;
+				}
+				for (auto j = i + 1; j < N; ++j) {
+					if (signatures[i].offset != signatures[j].offset) {
+						continue;
+					}
+					if (overlap(signatures[i], signatures[j])) {
+						return false;
+					}
+					if (anchored && (is_proper_prefix(signatures[i], signatures[j]) || is_proper_prefix(signatures[j], signatures[i]))) {
+						return false;
+					}
+				}
+			}
+			return true;
+		}
 
-			struct magic_number {
-#if defined(_DEBUG)
-				mutable bool flag = false;
-#endif
-				const std::size_t cached_hash_value = 0;
+		template <std::size_t N>
+		[[nodiscard]] constexpr auto count_anchored_signatures(const std::array<magic_signature, N>& signatures) -> std::size_t {
+			auto count = std::size_t{ 0 };
+			for (const auto& signature : signatures) {
+				count += (signature.offset == 0) ? 1 : 0;
+			}
+			return count;
+		}
 
-			public:
-				magic_number() = delete;
-				magic_number(const magic_number&) = default;
-				magic_number(magic_number&&) = default;
-				magic_number& operator=(const magic_number&) = default;
-				magic_number& operator=(magic_number&&) = default;
-				~magic_number() = default;
+		// The signatures at the start of the file, in the registry order. These are the ones the individual algorithms search through.
+		template <std::size_t M, std::size_t N>
+		[[nodiscard]] constexpr auto make_anchored_signatures(const std::array<magic_signature, N>& signatures) -> std::array<magic_signature, M> {
+			auto anchored = std::array<magic_signature, M>{};
+			auto count = std::size_t{ 0 };
+			for (const auto& signature : signatures) {
+				if (signature.offset == 0) {
+					anchored[count++] = signature;
+				}
+			}
+			return anchored;
+		}
 
-				magic_number(const uint8_t* data, const std::size_t size)
-					: cached_hash_value(hash(data, size))
-				{}
+		// The signatures at an offset, stably sorted by their offsets.
+		template <std::size_t M, std::size_t N>
+		[[nodiscard]] constexpr auto make_offset_signatures(const std::array<magic_signature, N>& signatures) -> std::array<magic_signature, M> {
+			auto offset = std::array<magic_signature, M>{};
+			auto count = std::size_t{ 0 };
+			for (const auto& signature : signatures) {
+				if (signature.offset != 0) {
+					auto j = count++;
+					for (; j > 0 && offset[j - 1].offset > signature.offset; --j) {
+						offset[j] = offset[j - 1];
+					}
+					offset[j] = signature;
+				}
+			}
+			return offset;
+		}
 
-				magic_number(const std::size_t cached_hash)
-					: cached_hash_value(cached_hash)
-				{}
+		// A single read issued for the signatures beyond the file header: the byte range [#offset, #offset + #size) of the file
+		// and the range [#first, #last) of the offset signatures it covers.
+		struct read_range {
+			std::uint64_t offset = 0;
+			std::size_t size = 0;
+			std::size_t first = 0;
+			std::size_t last = 0;
+		};
 
-				auto operator==(const magic_number& other) const noexcept -> bool {
-					return (cached_hash_value == other.cached_hash_value);
+		// The size of the first read of a file: the header, and the signatures at an offset that fit a single read along with it (e.g. the ustar magic number at 257),
+		// so that only the signatures far into the file (e.g. ISO 9660 at 32769) need reads of their own.
+		template <typename Signatures>
+		[[nodiscard]] constexpr auto first_read_size(const Signatures& offset_signatures) -> std::size_t {
+			auto size = max_file_header_size;
+			for (const auto& signature : offset_signatures) {
+				if (signature.offset + signature.size <= max_read_range_size) {
+					size = std::max(size, std::size_t(signature.offset + signature.size));
 				}
+			}
+			return size;
+		}
 
-			private:
-				[[nodiscard]] auto hash(const uint8_t* data, const std::size_t size) const noexcept -> std::size_t {
+		// The read plan merges the byte ranges of the (offset sorted) signatures that don't fit the first read as long as the merged range stays within #max_read_range_size.
+		template <std::size_t N>
+		[[nodiscard]] constexpr auto count_read_ranges(const std::array<magic_signature, N>& offset_signatures) -> std::size_t {
+			const auto first_read = first_read_size(offset_signatures);
+			auto count = std::size_t{ 0 };
+			auto range_offset = std::uint64_t{ 0 };
+			for (auto i = std::size_t{ 0 }; i < N; ++i) {
+				const auto& signature = offset_signatures[i];
+				if (signature.offset + signature.size <= first_read) {
+					continue;
+				}
+				if (count == 0 || signature.offset + signature.size - range_offset > max_read_range_size) {
+					++count;
+					range_offset = signature.offset;
+				}
+			}
+			return count;
+		}
 
-#if defined(_DEBUG)
-					assert(!flag && "cached_hash_value has to be initialized only once");
-					flag = true;
-#endif
+		template <std::size_t R, std::size_t N>
+		[[nodiscard]] constexpr auto make_read_plan(const std::array<magic_signature, N>& offset_signatures) -> std::array<read_range, R> {
+			const auto first_read = first_read_size(offset_signatures);
+			auto plan = std::array<read_range, R>{};
+			auto count = std::size_t{ 0 };
+			for (auto i = std::size_t{ 0 }; i < N; ++i) {
+				const auto& signature = offset_signatures[i];
+				if (signature.offset + signature.size <= first_read) {
+					continue;
+				}
+				if (count == 0 || signature.offset + signature.size - plan[count - 1].offset > max_read_range_size) {
+					plan[count++] = read_range{ signature.offset, signature.size, i, i + 1 };
+				}
+				else {
+					auto& range = plan[count - 1];
+					range.size = std::max(range.size, std::size_t(signature.offset + signature.size - range.offset));
+					range.last = i + 1;
+				}
+			}
+			return plan;
+		}
 
-					auto result = std::size_t{ 0 };
+		// A range of the (adjacent) signatures sharing the same mime type.
+		struct mime_group {
+			std::size_t first = 0;
+			std::size_t last = 0;
+		};
 
-					try {
-						result = std::accumulate(data, data + size, std::size_t{ 0u },
-							[&](std::size_t current_hash, const uint8_t value) {
-								hash_combine(current_hash, value);
-								return current_hash;
-							});
-					}
-					catch (...) {
-						// Reading memory beyond the size of a buffer is an undefined behavior.
-						// There's no specific exception type that is guaranteed to be thrown in such a case.
-						// So we catch and suppress any and all here.
-						assert(false && "magic_number::hash() failed");
+		template <std::size_t N>
+		[[nodiscard]] constexpr auto check_mime_groups(const std::array<magic_signature, N>& signatures) -> bool {
+			for (auto i = std::size_t{ 0 }; i < N; ++i) {
+				for (auto j = i + 1; j < N; ++j) {
+					if (signatures[j].id == signatures[i].id && signatures[j - 1].id != signatures[i].id) {
+						return false;
 					}
-
-					return result;
 				}
+			}
+			return true;
+		}
 
-			};
+		// Group the signatures by their mime id, so that the signatures of the hint can be looked up directly.
+		template <std::size_t N>
+		[[nodiscard]] constexpr auto make_mime_groups(const std::array<magic_signature, N>& signatures) -> std::array<mime_group, mime_types.size()> {
+			auto groups = std::array<mime_group, mime_types.size()>{};
+			for (auto i = std::size_t{ 0 }; i < N; ++i) {
+				auto& group = groups[static_cast<std::size_t>(signatures[i].id)];
+				if (group.first == group.last) {
+					group.first = i;
+				}
+				group.last = i + 1;
+			}
+			return groups;
+		}
 
-			struct magic_number_hasher {
-				auto operator()(const magic_number& mn) const -> size_t {
-					return mn.cached_hash_value;
+		// Sort the signatures by their prefixes (the magic bytes before the first wildcard), which keeps the signatures sharing a prefix next to each other.
+		template <std::size_t N>
+		[[nodiscard]] constexpr auto make_sorted_signatures(const std::array<magic_signature, N>& signatures) -> std::array<magic_signature, N> {
+			auto sorted = signatures;
+
+			// Insertion sort, as std::sort is not constexpr until C++20.
+			for (auto i = std::size_t{ 1 }; i < N; ++i) {
+				for (auto j = i; j > 0 && prefix_less(sorted[j], sorted[j - 1]); --j) {
+					const auto tmp = sorted[j];
+					sorted[j] = sorted[j - 1];
+					sorted[j - 1] = tmp;
 				}
-			};
+			}
+			return sorted;
+		}
+
+		// The perfect hash keys on the prefix bytes of the signatures (FNV-1a, which can be computed incrementally over the header) and on the prefix length.
+		[[nodiscard]] constexpr auto prefix_key(const std::uint64_t prefix_hash, const std::size_t length) noexcept -> std::uint64_t {
+			return mix(prefix_hash + length * std::uint64_t{ 0x9e3779b97f4a7c15u });
+		}
+
+		[[nodiscard]] constexpr auto prefix_key(const magic_signature& signature) noexcept -> std::uint64_t {
+			auto h = fnv1a_basis;
+			for (auto i = std::size_t{ 0 }; i < signature.prefix_size; ++i) {
+				h = fnv1a(h, signature.pattern[i]);
+			}
+			return prefix_key(h, signature.prefix_size);
+		}
+
+		// A slot of the perfect hash: the range [#first, #last) of the sorted signatures sharing a prefix of #size bytes.
+		struct prefix_slot {
+			std::uint8_t size = 0;
+			std::uint8_t first = 0;
+			std::uint8_t last = 0;
+		};
+
+		// A minimal perfect hash of the distinct signature prefixes built with hash-and-displace: the key picks a bucket,
+		// and the displacement of the bucket (searched for at compile time) sends all of its keys to free slots, so every prefix gets a slot of its own.
+		// #lengths are the distinct prefix lengths, the only ones that are worth probing.
+		template <std::size_t K, std::size_t L>
+		struct prefix_hash_tables {
+			std::array<std::uint32_t, K> displacements{};
+			std::array<prefix_slot, K> slots{};
+			std::array<std::uint8_t, L> lengths{};
+			bool complete = false;
+
+			[[nodiscard]] static constexpr auto bucket(const std::uint64_t key) noexcept -> std::size_t {
+				return hash_bucket(key, K);
+			}
 
-			static const auto magic_to_mime = std::unordered_map<magic_number, std::string, magic_number_hasher>{
-				{{ gif_bytes_87a.data(), gif_bytes_87a.size() }, "image/gif"},
-				{{ gif_bytes_89a.data(), gif_bytes_89a.size() }, "image/gif"},
+			[[nodiscard]] static constexpr auto slot(const std::uint64_t key, const std::uint32_t displacement) noexcept -> std::size_t {
+				return hash_slot(key, displacement, K);
+			}
 
-				{{ png_bytes.data(), png_bytes.size() }, "image/png"},
+			[[nodiscard]] constexpr auto find(const std::uint64_t key) const noexcept -> const prefix_slot& {
+				return slots[slot(key, displacements[bucket(key)])];
+			}
+		};
 
-				{{ bmp_bytes.data(), bmp_bytes.size() }, "image/bmp"},
+		// The sorted signatures sharing a prefix are adjacent, so counting the distinct prefixes only needs to compare the neighbors.
+		template <std::size_t N>
+		[[nodiscard]] constexpr auto count_prefixes(const std::array<magic_signature, N>& sorted) -> std::size_t {
+			auto count = std::size_t{ 0 };
+			for (auto i = std::size_t{ 0 }; i < N; ++i) {
+				count += (i == 0 || !same_prefix(sorted[i - 1], sorted[i])) ? 1 : 0;
+			}
+			return count;
+		}
 
-				{{ pm_bytes.data(), pm_bytes.size() }, "image/pm"},
+		template <std::size_t N>
+		[[nodiscard]] constexpr auto count_prefix_lengths(const std::array<magic_signature, N>& signatures) -> std::size_t {
+			auto used = std::array<bool, signature_width + 1>{};
+			auto count = std::size_t{ 0 };
+			for (const auto& signature : signatures) {
+				count += used[signature.prefix_size] ? 0 : 1;
+				used[signature.prefix_size] = true;
+			}
+			return count;
+		}
 
-				{{ jpg_bytes_1.data(), jpg_bytes_1.size() }, "image/jpeg"},
-				{{ jpg_bytes_2.data(), jpg_bytes_2.size() }, "image/jpeg"},
-				{{ jpg_bytes_3.data(), jpg_bytes_3.size() }, "image/jpeg"},
-				{{ jpg_bytes_4.data(), jpg_bytes_4.size() }, "image/jpeg"},
-				{{ jpg_bytes_5.data(), jpg_bytes_5.size() }, "image/jpeg"},
-				{{ jpg_bytes_6.data(), jpg_bytes_6.size() }, "image/jpeg"},
+		template <std::size_t K, std::size_t L, std::size_t N>
+		[[nodiscard]] constexpr auto make_prefix_hash(const std::array<magic_signature, N>& sorted) -> prefix_hash_tables<K, L> {
+			using tables_type = prefix_hash_tables<K, L>;
+			auto tables = tables_type{};
+
+			// The distinct prefixes, their keys and their buckets
+			auto prefixes = std::array<prefix_slot, K>{};
+			auto keys = std::array<std::uint64_t, K>{};
+			auto bucket_sizes = std::array<std::size_t, K>{};
+			auto count = std::size_t{ 0 };
+			for (auto i = std::size_t{ 0 }; i < N; ++i) {
+				if (i == 0 || !same_prefix(sorted[i - 1], sorted[i])) {
+					prefixes[count] = prefix_slot{ static_cast<std::uint8_t>(sorted[i].prefix_size), static_cast<std::uint8_t>(i), static_cast<std::uint8_t>(i + 1) };
+					keys[count] = prefix_key(sorted[i]);
+					++bucket_sizes[tables_type::bucket(keys[count])];
+					++count;
+				}
+				else {
+					prefixes[count - 1].last = static_cast<std::uint8_t>(i + 1);
+				}
+			}
 
-				{{ jpg_2000_bytes.data(), jpg_2000_bytes.size() }, "image/jp2"},
+			// The largest buckets are the hardest to place, so they go first
+			auto occupied = std::array<bool, K>{};
+			for (auto placed = std::size_t{ 0 }; placed < K;) {
+				auto bucket = std::size_t{ 0 };
+				for (auto b = std::size_t{ 1 }; b < K; ++b) {
+					bucket = (bucket_sizes[b] > bucket_sizes[bucket]) ? b : bucket;
+				}
+				if (bucket_sizes[bucket] == 0) {
+					break;
+				}
 
-				{{ tiff_bytes_mono.data(), tiff_bytes_mono.size() }, "image/tiff"},
-				{{ tiff_bytes_intel.data(), tiff_bytes_intel.size() }, "image/tiff"},
-				{{ tiff_bytes_motorola.data(), tiff_bytes_motorola.size() }, "image/tiff"},
+				auto found = false;
+				for (auto displacement = std::uint32_t{ 0 }; displacement < 0x10000u && !found; ++displacement) {
+					auto taken = occupied;
+					found = true;
+					for (auto k = std::size_t{ 0 }; k < K && found; ++k) {
+						if (tables_type::bucket(keys[k]) == bucket) {
+							const auto slot = tables_type::slot(keys[k], displacement);
+							found = !taken[slot];
+							taken[slot] = true;
+						}
+					}
+					if (found) {
+						occupied = taken;
+						tables.displacements[bucket] = displacement;
+						for (auto k = std::size_t{ 0 }; k < K; ++k) {
+							if (tables_type::bucket(keys[k]) == bucket) {
+								tables.slots[tables_type::slot(keys[k], displacement)] = prefixes[k];
+							}
+						}
+					}
+				}
+				if (!found) {
+					return tables;
+				}
+				placed += bucket_sizes[bucket];
+				bucket_sizes[bucket] = 0;
+			}
 
-				{{ tga_bytes_compressed.data(), tga_bytes_compressed.size() }, "image/tga"},
-				{{ tga_bytes_uncompressed.data(), tga_bytes_uncompressed.size() }, "image/tga"},
+			// The prefix lengths in ascending order
+			auto count_lengths = std::size_t{ 0 };
+			for (auto length = std::size_t{ 0 }; length <= signature_width; ++length) {
+				for (const auto& prefix : prefixes) {
+					if (prefix.size == length) {
+						tables.lengths[count_lengths++] = static_cast<std::uint8_t>(length);
+						break;
+					}
+				}
+			}
 
-				{{ exr_bytes.data(), exr_bytes.size() }, "image/exr"},
+			tables.complete = true;
+			return tables;
+		}
 
-				{{ hdr_bytes.data(), hdr_bytes.size() }, "image/hdr"},
+		// The DFA transition table entries: 0 is the dead state (no signature can match anymore), entries with the #dfa_accept bit set
+		// hold the mime id of the matched signature, and all the other ones are the indices of the next states.
+		inline constexpr auto dfa_accept = std::uint16_t{ 0x8000u };
+
+		// The byte values are compressed into classes: every distinct non-wildcard magic byte gets its own class, and all the other values share class 0.
+		template <std::size_t N>
+		[[nodiscard]] constexpr auto make_byte_classes(const std::array<magic_signature, N>& signatures) -> std::array<std::uint8_t, 256> {
+			auto used = std::array<bool, 256>{};
+			for (const auto& signature : signatures) {
+				for (auto i = std::size_t{ 0 }; i < signature.size; ++i) {
+					if (signature.mask[i] != 0) {
+						used[signature.pattern[i]] = true;
+					}
+				}
+			}
 
-				{{ ktx1_bytes.data(), ktx1_bytes.size() }, "image/ktx"},
-				{{ ktx2_bytes.data(), ktx2_bytes.size() }, "image/ktx2"},
+			auto classes = std::array<std::uint8_t, 256>{};
+			auto count = std::size_t{ 1 };
+			for (auto b = std::size_t{ 0 }; b < 256; ++b) {
+				if (used[b]) {
+					classes[b] = static_cast<std::uint8_t>(count++);
+				}
+			}
+			return classes;
+		}
 
-				{{ webp_bytes.data(), webp_bytes.size() }, "image/webp"},
+		[[nodiscard]] constexpr auto count_byte_classes(const std::array<std::uint8_t, 256>& classes) -> std::size_t {
+			auto count = std::size_t{ 0 };
+			for (const auto c : classes) {
+				count = std::max(count, std::size_t{ c });
+			}
+			return count + 1;
+		}
 
-				{{ bpg_bytes.data(), bpg_bytes.size() }, "image/bpg"},
+		// A DFA state while it's being built: the depth into the header and the set of signatures still matching the bytes so far.
+		template <std::size_t N>
+		struct dfa_state {
+			std::size_t depth = 0;
+			std::array<std::uint64_t, (N + 63) / 64> alive{};
+		};
 
-				{{ glb_bytes.data(), glb_bytes.size() }, "model/gltf-binary"},
-			};
+		// An upper bound on the number of DFA states while building it: the number of nodes of a trie of N signatures,
+		// doubled to leave some headroom for the extra states the wildcards can introduce.
+		template <std::size_t N>
+		inline constexpr auto dfa_capacity = (N * max_file_header_size + 1) * 2;
+
+		// Build the DFA with a breadth-first subset construction over the (anchored) signatures, reporting every transition to #on_transition.
+		// Returns the number of states, or 0 if #Capacity wasn't enough.
+		template <std::size_t Capacity, std::size_t N, typename OnTransition>
+		[[nodiscard]] constexpr auto explore_dfa(const std::array<magic_signature, N>& signatures, const std::array<std::uint8_t, 256>& classes, const std::size_t class_count, OnTransition&& on_transition) -> std::size_t {
+			// A representative byte value of every class
+			auto class_bytes = std::array<std::uint8_t, 256>{};
+			for (auto b = std::size_t{ 256 }; b-- > 0;) {
+				class_bytes[classes[b]] = static_cast<std::uint8_t>(b);
+			}
 
-			// Compute the hash value of the magic number by hand and use it to initialize a magic number instance,
-			// so that we don't waste time recomputing it for every increment in length of the compared #file_bytes.
-			auto magic_number_hash = std::size_t{ 0 };
+			auto states = std::array<dfa_state<N>, Capacity>{};
+			auto state_count = std::size_t{ 1 };
+			for (auto i = std::size_t{ 0 }; i < N; ++i) {
+				states[0].alive[i / 64] |= std::uint64_t{ 1 } << (i % 64);
+			}
 
-			// Increment a value from #min_file_header_size to #max_file_header_size
-			// and combine the hash value with the current magic_number_hash.
-			// Then look for the hash value in the magic_to_mime map.
-			for (auto i = size_t{ 0 }; i < std::min(file_size, max_file_header_size); ++i) {
-				hash_combine(magic_number_hash, file_bytes[i]);
+			for (auto current = std::size_t{ 0 }; current < state_count; ++current) {
+				const auto depth = states[current].depth;
 
-				if (i < min_file_header_size - 1) {
-					continue;
+				// The classes the alive signatures have a non-wildcard byte of at this depth, all the other ones only match the wildcards and lead to the same state as class 0
+				auto distinct = std::array<bool, 256>{};
+				for (auto i = std::size_t{ 0 }; i < N; ++i) {
+					if ((states[current].alive[i / 64] >> (i % 64) & 1) != 0 && depth < signatures[i].size && signatures[i].mask[depth] != 0) {
+						distinct[classes[signatures[i].pattern[depth]]] = true;
+					}
 				}
 
-				const auto it = magic_to_mime.find(std::move(magic_number{ magic_number_hash }));
-				if (it != magic_to_mime.end()) {
-					return it->second;
+				auto other_transition = std::uint16_t{ 0 };
+				for (auto c = std::size_t{ 0 }; c < class_count; ++c) {
+					if (c != 0 && !distinct[c]) {
+						on_transition(current, c, other_transition);
+						continue;
+					}
+
+					const auto byte = class_bytes[c];
+
+					auto next = dfa_state<N>{ depth + 1, {} };
+					auto any_alive = false;
+					auto accepted = mime_id::unknown;
+					for (auto i = std::size_t{ 0 }; i < N; ++i) {
+						if ((states[current].alive[i / 64] >> (i % 64) & 1) == 0 || depth >= signatures[i].size) {
+							continue;
+						}
+						const auto& signature = signatures[i];
+						if (signature.mask[depth] == 0 || (c != 0 && signature.pattern[depth] == byte)) {
+							next.alive[i / 64] |= std::uint64_t{ 1 } << (i % 64);
+							any_alive = true;
+							if (signature.size == depth + 1) {
+								accepted = signature.id;
+							}
+						}
+					}
+
+					auto transition = std::uint16_t{ 0 };
+					if (accepted != mime_id::unknown) {
+						// No other signature can still be alive here, as no two signatures can match the same header
+						transition = static_cast<std::uint16_t>(dfa_accept | static_cast<std::uint16_t>(accepted));
+					}
+					else if (any_alive) {
+						auto found = std::size_t{ 0 };
+						for (auto s = state_count; s-- > 1 && found == 0 && states[s].depth == next.depth;) {
+							auto same = true;
+							for (auto w = std::size_t{ 0 }; w < next.alive.size() && same; ++w) {
+								same = (states[s].alive[w] == next.alive[w]);
+							}
+							found = same ? s : 0;
+						}
+						if (found == 0) {
+							if (state_count == Capacity) {
+								return 0;
+							}
+							found = state_count;
+							states[state_count++] = next;
+						}
+						transition = static_cast<std::uint16_t>(found);
+					}
+
+					if (c == 0) {
+						other_transition = transition;
+					}
+					on_transition(current, c, transition);
 				}
 			}
 
-			return "";
+			return state_count;
 		}
-	} // namespace detail
 
+		template <std::size_t N>
+		[[nodiscard]] constexpr auto count_dfa_states(const std::array<magic_signature, N>& signatures) -> std::size_t {
+			const auto classes = make_byte_classes(signatures);
+			return explore_dfa<dfa_capacity<N>>(signatures, classes, count_byte_classes(classes), [](std::size_t, std::size_t, std::uint16_t) {});
+		}
 
-	// Determine the mime type of an file from its raw in-memory bytes.
-	[[nodiscard]] inline auto get_type_deep(const uint8_t* file_bytes, const std::size_t file_size, const std::string& mime_type_hint = "") -> std::string {
+		// The flat DFA tables: the byte classes, a dense 256 entry row of the start state (so that the first byte takes a single load)
+		// and the class-compressed transitions of all the states.
+		template <std::size_t S, std::size_t K>
+		struct dfa_tables {
+			std::array<std::uint8_t, 256> byte_classes{};
+			std::array<std::uint16_t, 256> first_transitions{};
+			std::array<std::uint16_t, S * K> transitions{};
+		};
 
-		if (file_size < min_file_header_size) {
-			assert(false && "The file header size in bytes is too small to determine its type.");
-			return "";
-		}
+		template <std::size_t S, std::size_t K, std::size_t N>
+		[[nodiscard]] constexpr auto make_dfa(const std::array<magic_signature, N>& signatures) -> dfa_tables<S, K> {
+			auto dfa = dfa_tables<S, K>{};
+			dfa.byte_classes = make_byte_classes(signatures);
 
-		using namespace detail;
+			auto& transitions = dfa.transitions;
+			[[maybe_unused]] const auto state_count = explore_dfa<S>(signatures, dfa.byte_classes, K, [&transitions](std::size_t state, std::size_t c, std::uint16_t transition) {
+				transitions[state * K + c] = transition;
+			});
 
-#if defined(GET_MIME_TYPE_DEEP_V0)
-		return detail::get_type_deep<deep_alg_version::DEEP_ALG_V0>(file_bytes, file_size, mime_type_hint);
-#elif defined(GET_MIME_TYPE_DEEP_V1)
-		return detail::get_type_deep<deep_alg_version::DEEP_ALG_V1>(file_bytes, file_size, mime_type_hint);
-#elif defined(GET_MIME_TYPE_DEEP_V2)
-		return detail::get_type_deep<deep_alg_version::DEEP_ALG_V2>(file_bytes, file_size, mime_type_hint);
-#else 
-		return detail::get_type_deep<deep_alg_version::DEEP_ALG_V3>(file_bytes, file_size, mime_type_hint);
-#endif
-	}
+			for (auto b = std::size_t{ 0 }; b < 256; ++b) {
+				dfa.first_transitions[b] = dfa.transitions[dfa.byte_classes[b]];
+			}
+			return dfa;
+		}
 
-	[[nodiscard]] inline auto get_type_deep(const std::vector<uint8_t>& file_bytes, const std::string& mime_type_hint = "") -> std::string {
-		return get_type_deep(file_bytes.data(), file_bytes.size(), mime_type_hint);
-	}
+		// The look-up structures of the individual algorithms, all of them computed at compile time from the #magic_signatures registry.
+		static_assert(check_signatures(magic_signatures), "Every magic number has to start with non-wildcard bytes and has to be distinguishable from all the others");
+		static_assert(check_mime_groups(magic_signatures), "Magic numbers of the same mime type have to be kept next to each other in the registry");
+		inline constexpr auto anchored_signatures = make_anchored_signatures<count_anchored_signatures(magic_signatures)>(magic_signatures);
+		inline constexpr auto offset_signatures = make_offset_signatures<magic_signatures.size() - anchored_signatures.size()>(magic_signatures);
+		inline constexpr auto mime_groups = make_mime_groups(anchored_signatures);
+		inline constexpr auto sorted_magic_signatures = make_sorted_signatures(anchored_signatures);
+		static_assert(anchored_signatures.size() < 256, "The perfect hash slots index the signatures with a byte");
+		inline constexpr auto prefix_hash = make_prefix_hash<count_prefixes(sorted_magic_signatures), count_prefix_lengths(sorted_magic_signatures)>(sorted_magic_signatures);
+		static_assert(prefix_hash.complete, "Couldn't build a perfect hash of the magic number prefixes");
+		inline constexpr auto header_read_size = first_read_size(offset_signatures);
+		inline constexpr auto read_plan = make_read_plan<count_read_ranges(offset_signatures)>(offset_signatures);
+		inline constexpr auto dfa_state_count = count_dfa_states(anchored_signatures);
+		static_assert(dfa_state_count != 0 && dfa_state_count < dfa_accept, "The DFA of the magic numbers has too many states");
+		inline constexpr auto dfa = make_dfa<dfa_state_count, count_byte_classes(make_byte_classes(anchored_signatures))>(anchored_signatures);
+
+		template <deep_alg_version alg_version>
+		[[nodiscard]] inline auto get_id_deep(const uint8_t* file_bytes, const std::size_t file_size, const mime_id mime_type_hint) noexcept -> mime_id;
+
+		// The fast path all the approaches take first: the extension is almost always right, so the few magic numbers of the hint are masked-compared before anything else.
+		// The magic numbers at the start of the file can't match the same header (see #check_signatures), so a match settles the type. The hints whose magic numbers are
+		// all at an offset (and mime_id::unknown) have an empty group and cost a single load.
+		[[nodiscard]] inline auto matches_hint(const header_block& header, const mime_id mime_type_hint) noexcept -> bool {
+			const auto& group = mime_groups[static_cast<std::size_t>(mime_type_hint)];
+			for (auto i = group.first; i < group.last; ++i) {
+				if (matches(anchored_signatures[i], header)) {
+					return true;
+				}
+			}
+			return false;
+		}
 
-	[[nodiscard]] inline auto get_type(const std::string& path_to_file, const bool deep_check = false) -> std::string {
+		[[nodiscard]] inline auto matches_hint(const uint8_t* file_bytes, const std::size_t file_size, const mime_id mime_type_hint) noexcept -> bool {
+			const auto& group = mime_groups[static_cast<std::size_t>(mime_type_hint)];
+			return group.first != group.last && matches_hint(load_header(file_bytes, file_size), mime_type_hint);
+		}
 
-		const auto mime_type = get_type_shallow(path_to_file);
+		// Approach 0: linearly searching through all magic numbers and trying to match them with the file bytes
+		template <>
+		[[nodiscard]] inline auto get_id_deep<deep_alg_version::DEEP_ALG_V0>(const uint8_t* file_bytes, const std::size_t file_size, const mime_id mime_type_hint) noexcept -> mime_id {
 
-		if (deep_check) {
-			// Read the file into memory
-			auto file = std::ifstream(path_to_file, std::ios::binary | std::ios::ate);
-			if (!file) {
-				assert(false && "std::ifstream failed");
-				return mime_type;
+			const auto header = load_header(file_bytes, file_size);
+			if (matches_hint(header, mime_type_hint)) {
+				return mime_type_hint;
 			}
 
-			// Determine the file size
-			file.seekg(0, std::ios::end);
-			const auto file_size = file.tellg();
-			if (!file_size) {
-				assert(false && "file_size is 0");
-				return mime_type;
+			for (const auto& signature : anchored_signatures) {
+				if (matches(signature, header)) {
+					return signature.id;
+				}
 			}
-			file.seekg(0, std::ios::beg);
 
-			const auto header_size = std::min(std::streamsize(file_size), std::streamsize(max_file_header_size));
+			return mime_id::unknown;
+		}
 
-			// Create a buffer to store the read data
-			auto buffer = std::vector<char>(header_size);
+		// Approach 1: use a table of the signatures grouped by mime id to directly check the group of magic numbers associated with the provided hint,
+		// and then linearly search through the rest of the groups.
+		template<>
+		[[nodiscard]] inline auto get_id_deep<deep_alg_version::DEEP_ALG_V1>(const uint8_t* file_bytes, const std::size_t file_size, const mime_id mime_type_hint) noexcept -> mime_id {
 
-			// Read the specified number of bytes from the file
-			file.read(buffer.data(), header_size);
+			const auto header = load_header(file_bytes, file_size);
 
-			if (file.fail()) {
-				assert(false && "file.read failed");
-				return mime_type;
+			// If we have the hint mime type (usually from the file extension), then we can use it to narrow down the search.
+			if (matches_hint(header, mime_type_hint)) {
+				return mime_type_hint;
 			}
+			const auto& hint_group = mime_groups[static_cast<std::size_t>(mime_type_hint)];
 
-			return get_type_deep(reinterpret_cast<uint8_t*>(buffer.data()), buffer.size(), mime_type);
-		}
+			// No hint or it didn't work (due to the magic data mismatch), we try to find the mime type of the file based on the rest of the magic numbers.
+			for (auto i = std::size_t{ 0 }; i < hint_group.first; ++i) {
+				if (matches(anchored_signatures[i], header)) {
+					return anchored_signatures[i].id;
+				}
+			}
+			for (auto i = hint_group.last; i < anchored_signatures.size(); ++i) {
+				if (matches(anchored_signatures[i], header)) {
+					return anchored_signatures[i].id;
+				}
+			}
+
+			return mime_id::unknown;
+		}
+
+		// Approach 2: use an array of signatures sorted lexicographically by their prefixes at compile time, and then perform binary search using std::lower_bound.
+		// Since no prefix is a proper prefix of another one, the first signature not less than the header is the only candidate prefix,
+		// and the signatures sharing it (e.g. all the RIFF containers) follow right after and are told apart by the masked comparison.
+		template<>
+		[[nodiscard]] inline auto get_id_deep<deep_alg_version::DEEP_ALG_V2>(const uint8_t* file_bytes, const std::size_t file_size, const mime_id mime_type_hint) noexcept -> mime_id {
+
+			if (matches_hint(file_bytes, file_size, mime_type_hint)) {
+				return mime_type_hint;
+			}
+
+			// Perform binary search using std::lower_bound
+			auto it = std::lower_bound(sorted_magic_signatures.begin(), sorted_magic_signatures.end(), file_bytes,
+				[&file_size](const magic_signature& signature, const uint8_t* p_data) {
+					return std::lexicographical_compare(signature.pattern.begin(), signature.pattern.begin() + signature.prefix_size, p_data, p_data + std::min(file_size, signature.prefix_size));
+				});
+
+			if (it == sorted_magic_signatures.end() || file_size < it->prefix_size || !std::equal(it->pattern.begin(), it->pattern.begin() + it->prefix_size, file_bytes)) {
+				return mime_id::unknown;
+			}
+
+			const auto header = load_header(file_bytes, file_size);
+			for (auto candidate = it; candidate != sorted_magic_signatures.end() && same_prefix(*candidate, *it); ++candidate) {
+				if (matches(*candidate, header)) {
+					// mime type found
+					return candidate->id;
+				}
+			}
+
+			return mime_id::unknown;
+		}
+
+		// Approach 3: look up the magic number prefixes in a minimal perfect hash built at compile time.
+		// The hash of the header is computed incrementally and only probed at the lengths of the prefixes, and a hit is verified against the actual prefix bytes,
+		// so a colliding header can never be reported as a match. Since no prefix is a proper prefix of another one, the first verified prefix is the only candidate,
+		// and the signatures sharing it (e.g. all the RIFF containers) are told apart by the masked comparison.
+		// The hint can't be folded into the hash (the same mime type can have magic numbers of different lengths), so it's checked on its own first.
+		template<>
+		[[nodiscard]] inline auto get_id_deep<deep_alg_version::DEEP_ALG_V3>(const uint8_t* file_bytes, const size_t file_size, const mime_id mime_type_hint) noexcept -> mime_id {
+
+			if (matches_hint(file_bytes, file_size, mime_type_hint)) {
+				return mime_type_hint;
+			}
+
+			auto prefix_hash_value = fnv1a_basis;
+			auto hashed = std::size_t{ 0 };
+
+			for (const auto length : prefix_hash.lengths) {
+				if (length > file_size) {
+					break;
+				}
+
+				// Extend the hash of the header to the next prefix length
+				for (; hashed < length; ++hashed) {
+					prefix_hash_value = fnv1a(prefix_hash_value, file_bytes[hashed]);
+				}
+
+				const auto& slot = prefix_hash.find(prefix_key(prefix_hash_value, length));
+				if (slot.size != length || std::memcmp(file_bytes, sorted_magic_signatures[slot.first].pattern.data(), length) != 0) {
+					continue;
+				}
+
+				const auto header = load_header(file_bytes, file_size);
+				for (auto i = std::size_t{ slot.first }; i < slot.last; ++i) {
+					if (matches(sorted_magic_signatures[i], header)) {
+						return sorted_magic_signatures[i].id;
+					}
+				}
+				return mime_id::unknown;
+			}
+
+			return mime_id::unknown;
+		}
+
+		// Approach 4: walk a DFA built from the magic numbers at compile time, with a single table load per header byte (plus the byte class look-up after the first one).
+		// The walk stops at the first byte that no magic number can continue with, so most of the non-matching headers are rejected after 1-2 bytes,
+		// and the cost doesn't depend on the number of magic numbers, only on the length of the one that matches.
+		template<>
+		[[nodiscard]] inline auto get_id_deep<deep_alg_version::DEEP_ALG_V4>(const uint8_t* file_bytes, const size_t file_size, const mime_id mime_type_hint) noexcept -> mime_id {
+
+			if (matches_hint(file_bytes, file_size, mime_type_hint)) {
+				return mime_type_hint;
+			}
+
+			constexpr auto class_count = dfa.transitions.size() / dfa_state_count;
+
+			const auto size = std::min(file_size, max_file_header_size);
+			auto state = std::uint16_t{ 0 };
+			for (auto i = std::size_t{ 0 }; i < size; ++i) {
+				state = (i == 0) ? dfa.first_transitions[file_bytes[0]] : dfa.transitions[state * class_count + dfa.byte_classes[file_bytes[i]]];
+				if (state == 0) {
+					return mime_id::unknown;
+				}
+				if (state & dfa_accept) {
+					return static_cast<mime_id>(state & ~dfa_accept);
+				}
+			}
+
+			return mime_id::unknown;
+		}
+
+		// Approach 5: compare the header against all the magic numbers at once with SIMD instructions.
+		// The pattern/mask rows are transposed into blocks of #simd_lanes signatures, so that a single header byte (broadcast to all the lanes)
+		// is checked against the same position of 16 (SSE2), 32 (AVX2) or 64 (AVX-512) signatures with one compare,
+		// and the lanes still alive are tracked with movemask-style bit masks. The implementation is picked at runtime from the CPU features.
+		// Only the lanes whose signatures fit the header start alive, and the masks of a signature are zero past its size,
+		// so the positions past #file_size never have to be read (nor copied to a padded block).
+		inline constexpr auto simd_lanes = std::size_t{ 64u };
+
+		template <std::size_t B>
+		struct simd_tables {
+			// [block][position][lane], the patterns are pre-masked
+			std::array<std::array<std::array<std::uint8_t, simd_lanes>, max_file_header_size>, B> patterns{};
+			std::array<std::array<std::array<std::uint8_t, simd_lanes>, max_file_header_size>, B> masks{};
+			// The signature sizes, the unused lanes have a size no header can have, so they never match
+			std::array<std::array<std::uint8_t, simd_lanes>, B> sizes{};
+			std::array<std::array<mime_id, simd_lanes>, B> ids{};
+			// The longest signature in the block, i.e. the number of positions that have to be checked
+			std::array<std::size_t, B> depths{};
+			// The number of used lanes in the block
+			std::array<std::size_t, B> lanes{};
+		};
+
+		template <std::size_t N>
+		[[nodiscard]] constexpr auto make_simd_tables(const std::array<magic_signature, N>& signatures) -> simd_tables<(N + simd_lanes - 1) / simd_lanes> {
+			auto tables = simd_tables<(N + simd_lanes - 1) / simd_lanes>{};
+			for (auto& block : tables.sizes) {
+				for (auto& size : block) {
+					size = 0xFF;
+				}
+			}
+			for (auto i = std::size_t{ 0 }; i < N; ++i) {
+				const auto block = i / simd_lanes;
+				const auto lane = i % simd_lanes;
+				for (auto position = std::size_t{ 0 }; position < signatures[i].size; ++position) {
+					tables.patterns[block][position][lane] = signatures[i].pattern[position] & signatures[i].mask[position];
+					tables.masks[block][position][lane] = signatures[i].mask[position];
+				}
+				tables.sizes[block][lane] = static_cast<std::uint8_t>(signatures[i].size);
+				tables.ids[block][lane] = signatures[i].id;
+				tables.depths[block] = std::max(tables.depths[block], signatures[i].size);
+				tables.lanes[block] = lane + 1;
+			}
+			return tables;
+		}
+
+		inline constexpr auto simd = make_simd_tables(anchored_signatures);
+
+		// Pick the longest of the matching signatures of a block (no two signatures can match the same header, but that's not for this code to rely on).
+		inline auto simd_pick(const std::size_t block, const std::size_t lane_offset, std::uint64_t bits, mime_id& best, std::size_t& best_size) noexcept -> void {
+			for (auto lane = lane_offset; bits != 0; ++lane, bits >>= 1) {
+				if ((bits & 1) != 0 && simd.sizes[block][lane] > best_size) {
+					best = simd.ids[block][lane];
+					best_size = simd.sizes[block][lane];
+				}
+			}
+		}
+
+		// The portable fallback: the fixed-width row comparison of approach 0, keeping the longest match.
+		[[nodiscard]] inline auto simd_match_scalar(const uint8_t* file_bytes, const std::size_t file_size) noexcept -> mime_id {
+			const auto header = load_header(file_bytes, file_size);
+
+			auto best = mime_id::unknown;
+			auto best_size = std::size_t{ 0 };
+			for (const auto& signature : anchored_signatures) {
+				if (matches(signature, header) && signature.size > best_size) {
+					best = signature.id;
+					best_size = signature.size;
+				}
+			}
+			return best;
+		}
+
+#if defined(FILE_MIME_X86)
+		FILE_MIME_TARGET("sse2")
+		[[nodiscard]] inline auto simd_match_sse2(const uint8_t* file_bytes, const std::size_t file_size) noexcept -> mime_id {
+			auto best = mime_id::unknown;
+			auto best_size = std::size_t{ 0 };
+			const auto header_size = _mm_set1_epi8(static_cast<char>(std::min(file_size, std::size_t{ 0xFE })));
+
+			for (auto block = std::size_t{ 0 }; block < simd.sizes.size(); ++block) {
+				const auto depth = std::min(simd.depths[block], file_size);
+				for (auto lane_offset = std::size_t{ 0 }; lane_offset < simd.lanes[block]; lane_offset += 16) {
+					// The lanes whose signatures fit the header: size <= header size
+					const auto sizes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(simd.sizes[block].data() + lane_offset));
+					auto alive = _mm_cmpeq_epi8(_mm_max_epu8(sizes, header_size), header_size);
+
+					for (auto position = std::size_t{ 0 }; position < depth && _mm_movemask_epi8(alive) != 0; ++position) {
+						const auto byte = _mm_set1_epi8(static_cast<char>(file_bytes[position]));
+						const auto mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(simd.masks[block][position].data() + lane_offset));
+						const auto pattern = _mm_loadu_si128(reinterpret_cast<const __m128i*>(simd.patterns[block][position].data() + lane_offset));
+						alive = _mm_and_si128(alive, _mm_cmpeq_epi8(_mm_and_si128(byte, mask), pattern));
+					}
+
+					simd_pick(block, lane_offset, static_cast<std::uint32_t>(_mm_movemask_epi8(alive)), best, best_size);
+				}
+			}
+
+			return best;
+		}
+
+		FILE_MIME_TARGET("avx2")
+		[[nodiscard]] inline auto simd_match_avx2(const uint8_t* file_bytes, const std::size_t file_size) noexcept -> mime_id {
+			auto best = mime_id::unknown;
+			auto best_size = std::size_t{ 0 };
+			const auto header_size = _mm256_set1_epi8(static_cast<char>(std::min(file_size, std::size_t{ 0xFE })));
+
+			for (auto block = std::size_t{ 0 }; block < simd.sizes.size(); ++block) {
+				const auto depth = std::min(simd.depths[block], file_size);
+				for (auto lane_offset = std::size_t{ 0 }; lane_offset < simd.lanes[block]; lane_offset += 32) {
+					const auto sizes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(simd.sizes[block].data() + lane_offset));
+					auto alive = _mm256_cmpeq_epi8(_mm256_max_epu8(sizes, header_size), header_size);
+
+					for (auto position = std::size_t{ 0 }; position < depth && _mm256_movemask_epi8(alive) != 0; ++position) {
+						const auto byte = _mm256_set1_epi8(static_cast<char>(file_bytes[position]));
+						const auto mask = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(simd.masks[block][position].data() + lane_offset));
+						const auto pattern = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(simd.patterns[block][position].data() + lane_offset));
+						alive = _mm256_and_si256(alive, _mm256_cmpeq_epi8(_mm256_and_si256(byte, mask), pattern));
+					}
+
+					simd_pick(block, lane_offset, static_cast<std::uint32_t>(_mm256_movemask_epi8(alive)), best, best_size);
+				}
+			}
+
+			return best;
+		}
+
+		FILE_MIME_TARGET("avx512f,avx512bw")
+		[[nodiscard]] inline auto simd_match_avx512(const uint8_t* file_bytes, const std::size_t file_size) noexcept -> mime_id {
+			auto best = mime_id::unknown;
+			auto best_size = std::size_t{ 0 };
+			const auto header_size = _mm512_set1_epi8(static_cast<char>(std::min(file_size, std::size_t{ 0xFE })));
+
+			for (auto block = std::size_t{ 0 }; block < simd.sizes.size(); ++block) {
+				const auto depth = std::min(simd.depths[block], file_size);
+				const auto sizes = _mm512_loadu_si512(simd.sizes[block].data());
+				auto alive = _mm512_cmple_epu8_mask(sizes, header_size);
+
+				for (auto position = std::size_t{ 0 }; position < depth && alive != 0; ++position) {
+					const auto byte = _mm512_set1_epi8(static_cast<char>(file_bytes[position]));
+					const auto mask = _mm512_loadu_si512(simd.masks[block][position].data());
+					const auto pattern = _mm512_loadu_si512(simd.patterns[block][position].data());
+					alive &= _mm512_cmpeq_epi8_mask(_mm512_and_si512(byte, mask), pattern);
+				}
+
+				simd_pick(block, 0, static_cast<std::uint64_t>(alive), best, best_size);
+			}
+
+			return best;
+		}
+#endif
+
+		enum class simd_level {
+			scalar,
+			sse2,
+			avx2,
+			avx512,
+		};
+
+		// The best SIMD instruction set supported by both the CPU and the OS.
+		[[nodiscard]] inline auto detect_simd_level() noexcept -> simd_level {
+#if defined(FILE_MIME_X86)
+#if defined(_MSC_VER) && !defined(__clang__)
+			auto info = std::array<int, 4>{};
+			__cpuid(info.data(), 0);
+			const auto max_leaf = info[0];
+			__cpuid(info.data(), 1);
+			const auto has_sse2 = (info[3] & (1 << 26)) != 0;
+			const auto has_osxsave = (info[2] & (1 << 27)) != 0;
+			const auto xcr0 = has_osxsave ? _xgetbv(0) : 0;
+			auto has_avx2 = false;
+			auto has_avx512 = false;
+			if (max_leaf >= 7) {
+				__cpuidex(info.data(), 7, 0);
+				has_avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+				has_avx512 = (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0 && (xcr0 & 0xE6) == 0xE6;
+			}
+#else
+			__builtin_cpu_init();
+			const auto has_sse2 = __builtin_cpu_supports("sse2") != 0;
+			const auto has_avx2 = __builtin_cpu_supports("avx2") != 0;
+			const auto has_avx512 = __builtin_cpu_supports("avx512f") != 0 && __builtin_cpu_supports("avx512bw") != 0;
+#endif
+			if (has_avx512) {
+				return simd_level::avx512;
+			}
+			if (has_avx2) {
+				return simd_level::avx2;
+			}
+			if (has_sse2) {
+				return simd_level::sse2;
+			}
+#endif
+			return simd_level::scalar;
+		}
+
+		using simd_match_function = mime_id(*)(const uint8_t*, std::size_t) noexcept;
+
+		[[nodiscard]] inline auto get_simd_match(const simd_level level) noexcept -> simd_match_function {
+			switch (level) {
+#if defined(FILE_MIME_X86)
+			case simd_level::avx512:
+				return &simd_match_avx512;
+			case simd_level::avx2:
+				return &simd_match_avx2;
+			case simd_level::sse2:
+				return &simd_match_sse2;
+#endif
+			default:
+				return &simd_match_scalar;
+			}
+		}
+
+		// The first call detects the CPU features and replaces the function pointer with the best implementation,
+		// so that the hot path is a relaxed load and an indirect call, without any static initialization or guard checks.
+		[[nodiscard]] inline auto simd_match_resolve(const uint8_t* file_bytes, const std::size_t file_size) noexcept -> mime_id;
+		inline auto simd_match = std::atomic<simd_match_function>{ &simd_match_resolve };
+
+		[[nodiscard]] inline auto simd_match_resolve(const uint8_t* file_bytes, const std::size_t file_size) noexcept -> mime_id {
+			const auto match = get_simd_match(detect_simd_level());
+			simd_match.store(match, std::memory_order_relaxed);
+			return match(file_bytes, file_size);
+		}
+
+		template<>
+		[[nodiscard]] inline auto get_id_deep<deep_alg_version::DEEP_ALG_V5>(const uint8_t* file_bytes, const size_t file_size, const mime_id mime_type_hint) noexcept -> mime_id {
+			if (matches_hint(file_bytes, file_size, mime_type_hint)) {
+				return mime_type_hint;
+			}
+			return simd_match.load(std::memory_order_relaxed)(file_bytes, file_size);
+		}
+
+		// Check the signatures [#first, #last) of the (offset sorted) #signatures, an array or a vector, that fit the #file_bytes, which start at #file_offset in the file.
+		template <typename Signatures>
+		[[nodiscard]] inline auto get_id_at_offsets(const Signatures& signatures, const uint8_t* file_bytes, const std::size_t file_size, const std::size_t first, const std::size_t last, const std::uint64_t file_offset = 0) noexcept -> mime_id {
+			for (auto i = first; i < last; ++i) {
+				const auto& signature = signatures[i];
+				if (signature.offset < file_offset || signature.offset + signature.size > file_offset + file_size) {
+					continue;
+				}
+				const auto position = static_cast<std::size_t>(signature.offset - file_offset);
+				// Reject on the first magic byte before copying the bytes to a padded block for the full comparison
+				if (((file_bytes[position] ^ signature.pattern[0]) & signature.mask[0]) != 0) {
+					continue;
+				}
+				if (matches(signature, load_header(file_bytes + position, file_size - position))) {
+					return signature.id;
+				}
+			}
+			return mime_id::unknown;
+		}
+
+		// Check the signatures at an offset of the registry that fit the #file_bytes, which start at #file_offset in the file.
+		[[nodiscard]] inline auto get_id_at_offsets(const uint8_t* file_bytes, const std::size_t file_size, const std::size_t first, const std::size_t last, const std::uint64_t file_offset = 0) noexcept -> mime_id {
+			return get_id_at_offsets(offset_signatures, file_bytes, file_size, first, last, file_offset);
+		}
+
+		// Hint the CPU to start loading the header of an upcoming file while the current ones are being classified.
+		inline auto prefetch([[maybe_unused]] const void* p) noexcept -> void {
+#if !defined(_MSC_VER) || defined(__clang__)
+			__builtin_prefetch(p);
+#elif defined(FILE_MIME_X86)
+			_mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#endif
+		}
+
+		// The number of headers whose first bytes are looked up together by the batch functions, and how far ahead of them the headers are prefetched.
+		inline constexpr auto batch_lanes = std::size_t{ 16u };
+		inline constexpr auto batch_prefetch_distance = 2 * batch_lanes;
+
+		// The smallest header that can hold any of the signatures at an offset.
+		template <std::size_t N>
+		[[nodiscard]] constexpr auto min_offset_signature_end(const std::array<magic_signature, N>& signatures) -> std::size_t {
+			auto end = std::size_t(-1);
+			for (const auto& signature : signatures) {
+				end = std::min(end, std::size_t{ signature.offset } + signature.size);
+			}
+			return end;
+		}
+
+		// Approach 4 over a batch of headers: the first DFA transition of #batch_lanes headers is looked up with independent loads and without any branches,
+		// which is the only one most of the non-matching headers ever take, and only the headers that survive it are walked further one at a time.
+		// #get_header(i) returns the bytes and the size of the i-th header. Like the engines, the group of magic numbers of the hint of a header (if #hints isn't null)
+		// is checked before its DFA walk, so that a header matching both its hint and another type gets its hint.
+		template <typename GetHeader>
+		inline auto get_ids_deep_batch(const GetHeader& get_header, const std::size_t count, mime_id* ids, const mime_id* hints) noexcept -> void {
+
+			constexpr auto class_count = dfa.transitions.size() / dfa_state_count;
+			constexpr auto offsets_end = min_offset_signature_end(offset_signatures);
+
+			// The headers too small to determine their type are looked up through a dummy byte, and their results are thrown away
+			constexpr auto empty_byte = std::uint8_t{ 0 };
+
+			for (auto first = std::size_t{ 0 }; first < count; first += batch_lanes) {
+				const auto lanes = std::min(batch_lanes, count - first);
+
+				for (auto i = first + batch_prefetch_distance; i < std::min(first + batch_prefetch_distance + batch_lanes, count); ++i) {
+					prefetch(get_header(i).first);
+				}
+
+				auto states = std::array<std::uint16_t, batch_lanes>{};
+				for (auto lane = std::size_t{ 0 }; lane < lanes; ++lane) {
+					const auto header = get_header(first + lane);
+					states[lane] = dfa.first_transitions[*(header.second >= min_file_header_size ? header.first : &empty_byte)];
+				}
+
+				for (auto lane = std::size_t{ 0 }; lane < lanes; ++lane) {
+					const auto header = get_header(first + lane);
+					if (hints != nullptr && header.second >= min_file_header_size && matches_hint(header.first, header.second, hints[first + lane])) {
+						ids[first + lane] = hints[first + lane];
+						continue;
+					}
+
+					auto state = states[lane];
+					const auto size = std::min(header.second, max_file_header_size);
+					for (auto i = std::size_t{ 1 }; i < size && state != 0 && (state & dfa_accept) == 0; ++i) {
+						state = dfa.transitions[state * class_count + dfa.byte_classes[header.first[i]]];
+					}
+
+					auto id = (header.second >= min_file_header_size && (state & dfa_accept) != 0) ? static_cast<mime_id>(state & ~dfa_accept) : mime_id::unknown;
+
+					// None of the magic numbers at the start of the file matched, check the ones at an offset that fit the provided bytes.
+					if (id == mime_id::unknown && header.second >= offsets_end) {
+						id = get_id_at_offsets(header.first, header.second, 0, offset_signatures.size());
+					}
+					ids[first + lane] = id;
+				}
+			}
+		}
+
+		inline constexpr auto deep_alg_count = std::size_t{ 6u };
+
+		using get_id_deep_function = mime_id(*)(const uint8_t*, std::size_t, mime_id) noexcept;
+
+		// Every engine, indexed by its version, so that any of them can be picked at runtime.
+		inline constexpr auto engine_functions = std::array<get_id_deep_function, deep_alg_count>{
+			&get_id_deep<deep_alg_version::DEEP_ALG_V0>,
+			&get_id_deep<deep_alg_version::DEEP_ALG_V1>,
+			&get_id_deep<deep_alg_version::DEEP_ALG_V2>,
+			&get_id_deep<deep_alg_version::DEEP_ALG_V3>,
+			&get_id_deep<deep_alg_version::DEEP_ALG_V4>,
+			&get_id_deep<deep_alg_version::DEEP_ALG_V5>,
+		};
+
+		// The engine of the calls that don't pick one. No inline function depends on a macro to pick it, so that translation units built with different settings don't violate the ODR.
+		inline auto selected_engine = std::atomic<engine>{ engine::v3 };
+
+	} // namespace detail
+
+	// The engine of the calls that don't pick one: v3 unless #set_engine or #autotune picked another one.
+	[[nodiscard]] inline auto get_engine() noexcept -> engine {
+		return detail::selected_engine.load(std::memory_order_relaxed);
+	}
+
+	// Select the engine of all the calls that don't pick one, in every thread. The calls made meanwhile finish with the engine they started with.
+	inline auto set_engine(const engine selected) noexcept -> void {
+		detail::selected_engine.store(selected, std::memory_order_relaxed);
+	}
+
+	// The GET_MIME_TYPE_DEEP_V* macros used to pick the engine at compile time. A macro can't pick it at runtime without a side effect in every translation unit
+	// built with it (the last one initialized winning), nor set its initial value without violating the ODR when translation units disagree, so they are rejected.
+#if defined(GET_MIME_TYPE_DEEP_V0) || defined(GET_MIME_TYPE_DEEP_V1) || defined(GET_MIME_TYPE_DEEP_V2) || defined(GET_MIME_TYPE_DEEP_V3) || defined(GET_MIME_TYPE_DEEP_V4) || defined(GET_MIME_TYPE_DEEP_V5)
+#error "The GET_MIME_TYPE_DEEP_V* macros are no longer supported: call file_mime::set_engine (or file_mime::autotune) at startup instead"
+#endif
+
+	// A histogram of latencies in nanoseconds with power of two buckets: counts[i] is the number of latencies in [2^(i-1), 2^i) (and counts[0] the ones under 1 ns).
+	struct latency_histogram {
+		static constexpr auto bucket_count = std::size_t{ 40u };
+
+		std::array<std::uint64_t, bucket_count> counts{};
+		std::uint64_t count = 0;
+		std::uint64_t total_ns = 0;
+	};
+
+	// The counts of all the threads since the start of the process (or the last reset_stats call), see stats().
+	struct statistics {
+		bool enabled = false; // whether the library was compiled with FILE_MIME_STATS, all the counts are 0 otherwise
+		std::array<std::uint64_t, detail::deep_alg_count> engine_calls{}; // the classifications made by each 'deep' algorithm, indexed by its version (0-5)
+		std::uint64_t hint_hits = 0; // the classifications with a hint that turned out to be the type
+		std::uint64_t hint_misses = 0; // ... and the ones whose type turned out to be another one, or none
+		std::array<std::uint64_t, detail::mime_types.size()> results{}; // the classifications by their resulting mime id, the unknown results at mime_id::unknown
+		std::uint64_t files = 0; // the files classified by get_id_from_file (and thus by get_id/get_type with a deep check)
+		std::uint64_t syscalls = 0; // the open, read and close calls they made
+		std::uint64_t bytes_read = 0;
+		latency_histogram io_latency; // the time spent in those calls, per file
+		latency_histogram lookup_latency; // the rest of the time spent classifying each file
+	};
+
+	namespace detail {
+
+#if defined(FILE_MIME_STATS)
+
+		inline constexpr auto stats_enabled = true;
+
+		// The counters of statistics, flattened in the order of its fields.
+		enum stats_counter : std::size_t {
+			engine_calls_counter = 0,
+			hint_hits_counter = engine_calls_counter + deep_alg_count,
+			hint_misses_counter,
+			results_counter,
+			files_counter = results_counter + mime_types.size(),
+			syscalls_counter,
+			bytes_read_counter,
+			io_latency_counter,
+			lookup_latency_counter = io_latency_counter + latency_histogram::bucket_count + 2,
+			stats_counter_count = lookup_latency_counter + latency_histogram::bucket_count + 2,
+		};
+
+		using stats_totals = std::array<std::uint64_t, stats_counter_count>;
+
+		// The counters of a single thread. Only that thread writes them, so a relaxed load and store is enough to add to them (no locked instruction),
+		// and stats() reads them from another thread while they're being written.
+		struct thread_stats {
+			std::array<std::atomic<std::uint64_t>, stats_counter_count> counters{};
+
+			auto add(const std::size_t counter, const std::uint64_t value) noexcept -> void {
+				counters[counter].store(counters[counter].load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+			}
+		};
+
+		// The counters of all the live threads, the totals of the threads that have exited, and the totals at the last reset_stats call.
+		struct stats_registry {
+			std::mutex mutex;
+			std::vector<thread_stats*> threads;
+			stats_totals retired{};
+			stats_totals baseline{};
+		};
+
+		[[nodiscard]] inline auto get_stats_registry() -> stats_registry& {
+			static auto registry = stats_registry{};
+			return registry;
+		}
+
+		// Registers the counters of the thread on its first count, and folds them into the retired totals when the thread exits.
+		struct thread_stats_slot {
+			thread_stats stats;
+
+			thread_stats_slot() {
+				auto& registry = get_stats_registry();
+				const auto lock = std::lock_guard<std::mutex>{ registry.mutex };
+				registry.threads.push_back(&stats);
+			}
+
+			~thread_stats_slot() {
+				auto& registry = get_stats_registry();
+				const auto lock = std::lock_guard<std::mutex>{ registry.mutex };
+				for (auto i = std::size_t{ 0 }; i < stats_counter_count; ++i) {
+					registry.retired[i] += stats.counters[i].load(std::memory_order_relaxed);
+				}
+				registry.threads.erase(std::find(registry.threads.begin(), registry.threads.end(), &stats));
+			}
+		};
+
+		[[nodiscard]] inline auto get_thread_stats() -> thread_stats& {
+			thread_local auto slot = thread_stats_slot{};
+			return slot.stats;
+		}
+
+		[[nodiscard]] inline auto collect_stats() -> stats_totals {
+			auto& registry = get_stats_registry();
+			const auto lock = std::lock_guard<std::mutex>{ registry.mutex };
+			auto totals = registry.retired;
+			for (const auto* stats : registry.threads) {
+				for (auto i = std::size_t{ 0 }; i < stats_counter_count; ++i) {
+					totals[i] += stats->counters[i].load(std::memory_order_relaxed);
+				}
+			}
+			return totals;
+		}
+
+		[[nodiscard]] inline auto stats_now() noexcept -> std::uint64_t {
+			return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+		}
+
+		// Count a classification by #selected of a file with the #mime_type_hint as #id.
+		inline auto count_lookup(const engine selected, const mime_id mime_type_hint, const mime_id id) noexcept -> void {
+			auto& stats = get_thread_stats();
+			stats.add(engine_calls_counter + static_cast<std::size_t>(selected), 1);
+			if (mime_type_hint != mime_id::unknown) {
+				stats.add(id == mime_type_hint ? hint_hits_counter : hint_misses_counter, 1);
+			}
+			stats.add(results_counter + static_cast<std::size_t>(id), 1);
+		}
+
+		// Count a system call, and the bytes it read if it's a read.
+		inline auto count_syscall(const std::ptrdiff_t bytes_read = 0) noexcept -> void {
+			auto& stats = get_thread_stats();
+			stats.add(syscalls_counter, 1);
+			if (bytes_read > 0) {
+				stats.add(bytes_read_counter, std::uint64_t(bytes_read));
+			}
+		}
+
+		inline auto add_latency(thread_stats& stats, const std::size_t histogram, const std::uint64_t ns) noexcept -> void {
+			auto bucket = std::size_t{ 0 };
+			while (bucket + 1 < latency_histogram::bucket_count && (ns >> bucket) != 0) {
+				++bucket;
+			}
+			stats.add(histogram + bucket, 1);
+			stats.add(histogram + latency_histogram::bucket_count, 1);
+			stats.add(histogram + latency_histogram::bucket_count + 1, ns);
+		}
+
+		// Count a classified file that took #total_ns, #io_ns of them in system calls.
+		inline auto count_file(const std::uint64_t total_ns, const std::uint64_t io_ns) noexcept -> void {
+			auto& stats = get_thread_stats();
+			stats.add(files_counter, 1);
+			add_latency(stats, io_latency_counter, io_ns);
+			add_latency(stats, lookup_latency_counter, total_ns - io_ns);
+		}
+
+		// Count the classifications of a batch, all made by approach 4, with their #hints if any.
+		inline auto count_batch(const mime_id* ids, const std::size_t count, const mime_id* hints) noexcept -> void {
+			for (auto i = std::size_t{ 0 }; i < count; ++i) {
+				count_lookup(engine::v4, hints != nullptr ? hints[i] : mime_id::unknown, ids[i]);
+			}
+		}
+
+#else
+
+		// Compiled out, the hooks are empty and the clock always reads 0, so that the compiler throws away the calls and the time arithmetic.
+		inline constexpr auto stats_enabled = false;
+
+		[[nodiscard]] constexpr auto stats_now() noexcept -> std::uint64_t {
+			return 0;
+		}
+
+		constexpr auto count_lookup(const engine, const mime_id, const mime_id) noexcept -> void {}
+		constexpr auto count_syscall(const std::ptrdiff_t = 0) noexcept -> void {}
+		constexpr auto count_file(const std::uint64_t, const std::uint64_t) noexcept -> void {}
+		constexpr auto count_batch(const mime_id*, const std::size_t, const mime_id*) noexcept -> void {}
+
+#endif
+
+		// Determine the mime id of a file from its raw in-memory bytes with the #selected engine, without counting it.
+		[[nodiscard]] inline auto get_id_deep_with(const engine selected, const uint8_t* file_bytes, const std::size_t file_size, const mime_id mime_type_hint) noexcept -> mime_id {
+			const auto id = engine_functions[static_cast<std::size_t>(selected)](file_bytes, file_size, mime_type_hint);
+			if (id != mime_id::unknown) {
+				return id;
+			}
+
+			// None of the magic numbers at the start of the file matched, check the ones at an offset that fit the provided bytes.
+			return get_id_at_offsets(file_bytes, file_size, 0, offset_signatures.size());
+		}
+
+	} // namespace detail
+
+	// The instrumentation counters summed over all the threads, when compiled with FILE_MIME_STATS. Every thread counts into its own counters,
+	// which are only added up here, so counting costs a few plain loads and stores per classification (plus two clock reads per file system call).
+	// Compiled without it (the default), nothing is counted and this returns all zeros.
+	[[nodiscard]] inline auto stats() -> statistics {
+		auto snapshot = statistics{};
+#if defined(FILE_MIME_STATS)
+		using namespace detail;
+		auto totals = collect_stats();
+		{
+			auto& registry = get_stats_registry();
+			const auto lock = std::lock_guard<std::mutex>{ registry.mutex };
+			for (auto i = std::size_t{ 0 }; i < stats_counter_count; ++i) {
+				totals[i] -= registry.baseline[i];
+			}
+		}
+
+		const auto copy_histogram = [&totals](latency_histogram& histogram, const std::size_t first) {
+			std::copy_n(totals.begin() + first, latency_histogram::bucket_count, histogram.counts.begin());
+			histogram.count = totals[first + latency_histogram::bucket_count];
+			histogram.total_ns = totals[first + latency_histogram::bucket_count + 1];
+		};
+
+		snapshot.enabled = true;
+		std::copy_n(totals.begin() + engine_calls_counter, deep_alg_count, snapshot.engine_calls.begin());
+		snapshot.hint_hits = totals[hint_hits_counter];
+		snapshot.hint_misses = totals[hint_misses_counter];
+		std::copy_n(totals.begin() + results_counter, mime_types.size(), snapshot.results.begin());
+		snapshot.files = totals[files_counter];
+		snapshot.syscalls = totals[syscalls_counter];
+		snapshot.bytes_read = totals[bytes_read_counter];
+		copy_histogram(snapshot.io_latency, io_latency_counter);
+		copy_histogram(snapshot.lookup_latency, lookup_latency_counter);
+#endif
+		return snapshot;
+	}
+
+	// Start counting from 0 again. The threads keep writing their own counters, so this only remembers the current totals for stats() to subtract.
+	inline auto reset_stats() -> void {
+#if defined(FILE_MIME_STATS)
+		const auto totals = detail::collect_stats();
+		auto& registry = detail::get_stats_registry();
+		const auto lock = std::lock_guard<std::mutex>{ registry.mutex };
+		registry.baseline = totals;
+#endif
+	}
+
+	// Determine the mime id of a file from its raw in-memory bytes.
+	[[nodiscard]] inline auto get_id_deep(const uint8_t* file_bytes, const std::size_t file_size, const mime_id mime_type_hint = mime_id::unknown) noexcept -> mime_id {
+
+		if (file_size < min_file_header_size) {
+			assert(false && "The file header size in bytes is too small to determine its type.");
+			return mime_id::unknown;
+		}
+
+		const auto selected = get_engine();
+		const auto id = detail::get_id_deep_with(selected, file_bytes, file_size, mime_type_hint);
+		detail::count_lookup(selected, mime_type_hint, id);
+		return id;
+	}
+
+	// Determine the mime id of a file from its raw in-memory bytes with the #selected engine, whatever the one of the other calls.
+	[[nodiscard]] inline auto get_id_deep(const uint8_t* file_bytes, const std::size_t file_size, const engine selected, const mime_id mime_type_hint = mime_id::unknown) noexcept -> mime_id {
+
+		if (file_size < min_file_header_size) {
+			assert(false && "The file header size in bytes is too small to determine its type.");
+			return mime_id::unknown;
+		}
+
+		const auto id = detail::get_id_deep_with(selected, file_bytes, file_size, mime_type_hint);
+		detail::count_lookup(selected, mime_type_hint, id);
+		return id;
+	}
+
+	// Determine the mime type of an file from its raw in-memory bytes.
+	[[nodiscard]] inline auto get_type_deep(const uint8_t* file_bytes, const std::size_t file_size, const std::string_view mime_type_hint = {}) -> std::string {
+		return std::string(get_type_from_id(get_id_deep(file_bytes, file_size, get_id_from_type(mime_type_hint))));
+	}
+
+	[[nodiscard]] inline auto get_type_deep(const std::vector<uint8_t>& file_bytes, const std::string_view mime_type_hint = {}) -> std::string {
+		return get_type_deep(file_bytes.data(), file_bytes.size(), mime_type_hint);
+	}
+
+	// Determine the mime ids of #count files from their raw in-memory bytes: ids[i] is the mime id of the file_sizes[i] bytes at file_bytes[i], checked against hints[i] first
+	// if #hints isn't null. The headers are classified several at a time and the upcoming ones are prefetched, so prefer this over a loop of get_id_deep calls when many
+	// headers are at hand. The batch is always classified by approach 4 (engine::v4), whatever the engine selected with set_engine or autotune, since it's the only one
+	// whose first step can be interleaved across headers; the results are the same as the ones of the other engines.
+	// Headers that are too small to determine their type get mime_id::unknown.
+	inline auto get_id_deep_batch(const uint8_t* const* file_bytes, const std::size_t* file_sizes, const std::size_t count, mime_id* ids, const mime_id* hints = nullptr) noexcept -> void {
+		detail::get_ids_deep_batch([file_bytes, file_sizes](const std::size_t i) {
+			return std::pair<const uint8_t*, std::size_t>{ file_bytes[i], file_sizes[i] };
+		}, count, ids, hints);
+		detail::count_batch(ids, count, hints);
+	}
+
+	// Determine the mime ids of #count headers stored back to back in a single block, one every #stride bytes, the i-th one holding file_sizes[i] bytes.
+	inline auto get_id_deep_batch(const uint8_t* headers, const std::size_t stride, const std::size_t* file_sizes, const std::size_t count, mime_id* ids, const mime_id* hints = nullptr) noexcept -> void {
+		detail::get_ids_deep_batch([headers, stride, file_sizes](const std::size_t i) {
+			return std::pair<const uint8_t*, std::size_t>{ headers + i * stride, file_sizes[i] };
+		}, count, ids, hints);
+		detail::count_batch(ids, count, hints);
+	}
+
+	// Determine the mime ids of #count headers of #stride bytes each, stored back to back in a single block.
+	inline auto get_id_deep_batch(const uint8_t* headers, const std::size_t stride, const std::size_t count, mime_id* ids, const mime_id* hints = nullptr) noexcept -> void {
+		detail::get_ids_deep_batch([headers, stride](const std::size_t i) {
+			return std::pair<const uint8_t*, std::size_t>{ headers + i * stride, stride };
+		}, count, ids, hints);
+		detail::count_batch(ids, count, hints);
+	}
+
+	// What #autotune measured: the engine it selected and the best time of every engine per header of the sample, indexed by engine.
+	struct autotune_result {
+		engine selected = engine::v3;
+		std::array<double, detail::deep_alg_count> ns_per_header{};
+	};
+
+	// Time every engine on a sample of #count headers (with their #hints, e.g. from the file extensions, or none if nullptr) and select the fastest one with #set_engine.
+	// Meant to be called at startup with a sample of the files the process is about to see, as the winner depends on the CPU and on the mix of types and hints.
+	// The engines take turns over #passes passes of the sample (repeated up to a few thousand headers per pass), and only the best pass of each engine counts,
+	// which filters out the passes slowed down by a preemption or a frequency change. The headers too small to determine their type are skipped. Nothing is counted in the stats.
+	inline auto autotune(const uint8_t* const* file_bytes, const std::size_t* file_sizes, const std::size_t count, const mime_id* hints = nullptr, const std::size_t passes = 5) noexcept -> autotune_result {
+		constexpr auto min_pass_size = std::size_t{ 4096u };
+
+		auto result = autotune_result{ get_engine() };
+		if (count == 0 || passes == 0) {
+			return result;
+		}
+
+		const auto repeats = (min_pass_size + count - 1) / count;
+		auto best = std::array<std::chrono::steady_clock::duration, detail::deep_alg_count>{};
+		best.fill(std::chrono::steady_clock::duration::max());
+		auto checksum = std::size_t{ 0 };
+		for (auto pass = std::size_t{ 0 }; pass < passes; ++pass) {
+			for (auto e = std::size_t{ 0 }; e < detail::deep_alg_count; ++e) {
+				const auto function = detail::engine_functions[e];
+				const auto start = std::chrono::steady_clock::now();
+				for (auto r = std::size_t{ 0 }; r < repeats; ++r) {
+					for (auto i = std::size_t{ 0 }; i < count; ++i) {
+						if (file_sizes[i] >= min_file_header_size) {
+							checksum += static_cast<std::size_t>(function(file_bytes[i], file_sizes[i], hints != nullptr ? hints[i] : mime_id::unknown));
+						}
+					}
+				}
+				best[e] = std::min(best[e], std::chrono::steady_clock::now() - start);
+			}
+		}
+
+		// The results are consumed, so that the calls can't be optimized away
+		static auto sink = std::atomic<std::size_t>{ 0 };
+		sink.store(checksum, std::memory_order_relaxed);
+
+		auto fastest = std::size_t{ 0 };
+		for (auto e = std::size_t{ 0 }; e < detail::deep_alg_count; ++e) {
+			result.ns_per_header[e] = double(std::chrono::duration_cast<std::chrono::nanoseconds>(best[e]).count()) / double(repeats * count);
+			if (best[e] < best[fastest]) {
+				fastest = e;
+			}
+		}
+		result.selected = static_cast<engine>(fastest);
+		set_engine(result.selected);
+		return result;
+	}
+
+	namespace detail {
+		// Determine the mime id of a file from its bytes fetched with #read_at(buffer, size, offset), which returns the number of bytes read (fewer at the end of the file)
+		// or a negative value on failure: a single read of the first #header_read_size bytes (see first_read_size) checked with #get_id_deep(bytes, size, hint) and, only if
+		// that doesn't settle it, one read per range of the read #plan checked against the (offset sorted) magic numbers at an offset #offsets.
+		// The registry and the signature sets only differ by these tables. Falls back to the #mime_type_hint if the header can't be read or is too small to determine the type.
+		template <typename ReadAt, typename GetIdDeep, typename Offsets, typename Plan>
+		[[nodiscard]] inline auto get_id_deep_at(const ReadAt& read_at, const mime_id mime_type_hint, std::array<uint8_t, max_read_range_size>& buffer,
+			const GetIdDeep& get_id_deep, const Offsets& offsets, const Plan& plan, const std::size_t header_read_size) -> mime_id {
+
+			const auto header_size = read_at(buffer.data(), header_read_size, std::uint64_t{ 0 });
+			if (header_size < std::ptrdiff_t(min_file_header_size)) {
+				return mime_type_hint;
+			}
+
+			const auto id = get_id_deep(buffer.data(), std::size_t(header_size), mime_type_hint);
+			if (id != mime_id::unknown || std::size_t(header_size) < header_read_size) {
+				// Either settled, or the whole file has been read and checked already
+				return id;
+			}
+
+			for (const auto& range : plan) {
+				const auto range_size = read_at(buffer.data(), range.size, range.offset);
+				if (range_size <= 0) {
+					break;
+				}
+
+				const auto range_id = get_id_at_offsets(offsets, buffer.data(), std::size_t(range_size), range.first, range.last, range.offset);
+				if (range_id != mime_id::unknown) {
+					return range_id;
+				}
+			}
+
+			return mime_id::unknown;
+		}
+
+		// Ditto with the magic numbers of the registry and the selected engine, the lookup being counted in the stats.
+		template <typename ReadAt>
+		[[nodiscard]] inline auto get_id_deep_at(const ReadAt& read_at, const mime_id mime_type_hint, std::array<uint8_t, max_read_range_size>& buffer) -> mime_id {
+			const auto selected = get_engine();
+			auto looked_up = false;
+			const auto get_id_deep = [selected, &looked_up](const uint8_t* file_bytes, const std::size_t file_size, const mime_id hint) {
+				looked_up = true;
+				return get_id_deep_with(selected, file_bytes, file_size, hint);
+			};
+			const auto id = get_id_deep_at(read_at, mime_type_hint, buffer, get_id_deep, offset_signatures, read_plan, header_read_size);
+			if (looked_up) {
+				count_lookup(selected, mime_type_hint, id);
+			}
+			return id;
+		}
+	} // namespace detail
+
+	// The mime id of a file along with the errno of a failed open/read, 0 on success (in which case #id comes from the hint or the file extension alone).
+	// #mismatch flags a file whose content doesn't carry the magic numbers of the hinted type (the type of its extension), e.g. a spoofed upload:
+	// either the content is of another type, which is then the #id, or of no known type at all. Files too small to tell and failed reads are never flagged.
+	struct file_id_result {
+		mime_id id = mime_id::unknown;
+		int error = 0;
+		bool mismatch = false;
+	};
+
+	namespace detail {
+
+		// A positional read that doesn't move the file offset on POSIX, retried if interrupted. Returns the number of bytes read, or -errno.
+		[[nodiscard]] inline auto read_at(const int fd, uint8_t* buffer, const std::size_t size, const std::uint64_t offset) noexcept -> std::ptrdiff_t {
+#if defined(_WIN32)
+			if (::_lseeki64(fd, static_cast<__int64>(offset), SEEK_SET) < 0) {
+				return -errno;
+			}
+			const auto read = ::_read(fd, buffer, static_cast<unsigned>(size));
+			return read < 0 ? -errno : read;
+#else
+			for (;;) {
+				const auto read = ::pread(fd, buffer, size, off_t(offset));
+				if (read >= 0) {
+					return read;
+				}
+				if (errno != EINTR) {
+					return -errno;
+				}
+			}
+#endif
+		}
+
+		// When the classification of a file started and the time spent in its system calls so far, only measured with FILE_MIME_STATS.
+		struct file_timing {
+			std::uint64_t start = stats_now();
+			std::uint64_t io = 0;
+		};
+
+		// Classify an open file with a single read of its header into a stack buffer (plus the read plan ranges, only if the header doesn't settle it),
+		// without seeking or asking for the file size first: a short read tells the size whenever it matters.
+		[[nodiscard]] inline auto get_id_from_fd(const int fd, const mime_id mime_type_hint, file_timing& timing) noexcept -> file_id_result {
+			auto buffer = std::array<uint8_t, max_read_range_size>{};
+			auto error = 0;
+			const auto read = [fd, &error, &timing](uint8_t* p, const std::size_t size, const std::uint64_t offset) -> std::ptrdiff_t {
+				const auto read_start = stats_now();
+				const auto result = read_at(fd, p, size, offset);
+				timing.io += stats_now() - read_start;
+				count_syscall(result);
+				if (result < 0) {
+					error = int(-result);
+				}
+				return result;
+			};
+			const auto id = get_id_deep_at(read, mime_type_hint, buffer);
+			if (error != 0) {
+				return file_id_result{ mime_type_hint, error };
+			}
+			return file_id_result{ id, 0, mime_type_hint != mime_id::unknown && id != mime_type_hint };
+		}
+
+		[[nodiscard]] inline auto get_id_from_fd(const int fd, const mime_id mime_type_hint) noexcept -> file_id_result {
+			auto timing = file_timing{};
+			const auto result = get_id_from_fd(fd, mime_type_hint, timing);
+			count_file(stats_now() - timing.start, timing.io);
+			return result;
+		}
+
+		[[nodiscard]] inline auto open_read_only(const char* path) noexcept -> int {
+#if defined(_WIN32)
+			return ::_open(path, _O_RDONLY | _O_BINARY);
+#else
+			for (;;) {
+				const auto fd = ::open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+				if (fd >= 0 || errno != EINTR) {
+					return fd;
+				}
+			}
+#endif
+		}
+
+		inline auto close_file(const int fd) noexcept -> void {
+#if defined(_WIN32)
+			::_close(fd);
+#else
+			::close(fd);
+#endif
+		}
+
+		// The longest path that is copied to the stack to null-terminate it.
+		inline constexpr auto max_path_size = std::size_t{ 4096u };
+
+		// Open the file at #path_to_file, classify it with #classify_fd(fd, hint), the hint being the type of its extension, and close it.
+		// A path that is too long or can't be opened gets the type of its extension along with the errno, in the result type of #classify_fd.
+		template <typename ClassifyFd>
+		[[nodiscard]] inline auto get_id_from_path(const std::string_view path_to_file, const ClassifyFd& classify_fd) noexcept -> decltype(classify_fd(0, mime_id::unknown)) {
+			using result_type = decltype(classify_fd(0, mime_id::unknown));
+			const auto id = get_id_shallow(path_to_file);
+
+			// The path has to be null-terminated for the open call
+			auto path = std::array<char, max_path_size>{};
+			if (path_to_file.size() >= path.size()) {
+				return result_type{ id, ENAMETOOLONG };
+			}
+			std::memcpy(path.data(), path_to_file.data(), path_to_file.size());
+
+			const auto fd = open_read_only(path.data());
+			const auto open_error = errno;
+			count_syscall();
+			if (fd < 0) {
+				return result_type{ id, open_error };
+			}
+
+			const auto result = classify_fd(fd, id);
+			close_file(fd);
+			count_syscall();
+			return result;
+		}
+
+	} // namespace detail
+
+	// Determine the mime id of an open file from its magic numbers. The file is read at absolute offsets, so its current position doesn't matter (and isn't changed on POSIX).
+	// Nothing is allocated and no file size is queried: the common case is a single pread call.
+	[[nodiscard]] inline auto get_id_from_file(const int fd, const mime_id mime_type_hint = mime_id::unknown) noexcept -> file_id_result {
+		return detail::get_id_from_fd(fd, mime_type_hint);
+	}
+
+	// Ditto for a C stream, whose buffer is bypassed. The stream has to be seekable.
+	[[nodiscard]] inline auto get_id_from_file(std::FILE* file, const mime_id mime_type_hint = mime_id::unknown) noexcept -> file_id_result {
+		if (file == nullptr) {
+			return file_id_result{ mime_type_hint, EBADF };
+		}
+#if defined(_WIN32)
+		return detail::get_id_from_fd(::_fileno(file), mime_type_hint);
+#else
+		return detail::get_id_from_fd(::fileno(file), mime_type_hint);
+#endif
+	}
+
+	// Determine the mime id of a file from its magic numbers, falling back to its extension if it can't be opened or read:
+	// an open, a single pread of the header into a stack buffer and a close, with the failures reported in the result rather than asserted.
+	[[nodiscard]] inline auto get_id_from_file(const std::string_view path_to_file) noexcept -> file_id_result {
+		auto timing = detail::file_timing{};
+		auto close_start = std::uint64_t{ 0 };
+		auto opened = false;
+		const auto result = detail::get_id_from_path(path_to_file, [&timing, &close_start, &opened](const int fd, const mime_id hint) {
+			// The open call is timed from the start of the classification, and the close call until its end
+			timing.io += detail::stats_now() - timing.start;
+			const auto result = detail::get_id_from_fd(fd, hint, timing);
+			close_start = detail::stats_now();
+			opened = true;
+			return result;
+		});
+		if (opened) {
+			const auto end = detail::stats_now();
+			timing.io += end - close_start;
+			detail::count_file(end - timing.start, timing.io);
+		}
+		return result;
+	}
+
+	[[nodiscard]] inline auto get_id(const std::string_view path_to_file, const bool deep_check = false) -> mime_id {
+
+		if (!deep_check) {
+			return get_id_shallow(path_to_file);
+		}
+
+		const auto result = get_id_from_file(path_to_file);
+		assert(result.error == 0 && "Failed to open or read the file");
+		return result.id;
+	}
 
-		return mime_type;
+	[[nodiscard]] inline auto get_type(const std::string_view path_to_file, const bool deep_check = false) -> std::string {
+		return std::string(get_type_from_id(get_id(path_to_file, deep_check)));
 	}
 
+} // inline namespace FILE_MIME_ABI_NAMESPACE
 } // namespace file_mime
 
-#endif // FILE_MIME_H
\ No newline at end of file
+#endif // FILE_MIME_H
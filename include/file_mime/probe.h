@@ -0,0 +1,549 @@
+// MIT License
+//
+// Copyright(c) 2023 Lev Faynshteyn
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#ifndef FILE_MIME_PROBE_H
+#define FILE_MIME_PROBE_H
+
+#include "file_mime/file_mime.h"
+#include "file_mime/validate.h"
+
+namespace file_mime {
+inline namespace FILE_MIME_ABI_NAMESPACE {
+
+	// The mime id of a file and what its header tells about the image in it, without decoding any pixels. The fields a format doesn't store in its header are 0.
+	struct probe_result {
+		mime_id id = mime_id::unknown;
+		int error = 0; // the errno of a failed open/read
+		bool probed = false; // whether the header of the type could be parsed, only the #id is set otherwise
+		std::uint32_t width = 0;
+		std::uint32_t height = 0;
+		std::uint32_t depth = 0; // the depth of a volume texture, 0 for 2D images
+		std::uint32_t channels = 0; // 1 for palette images (the palette index)
+		std::uint32_t bit_depth = 0; // the bits per channel (per index for palette images), 0 when the header doesn't tell, e.g. for block-compressed textures
+		std::uint32_t frames = 0; // the frames of an animation or the layers of a texture array, 1 for a single image, 0 when only the whole file can tell (GIF, animated WebP, multi-page TIFF)
+		std::uint32_t levels = 0; // the mip levels of a texture, 1 for other images
+		std::uint32_t faces = 0; // 6 for a cube map, 1 for other images
+		std::uint64_t json_size = 0; // the size of the JSON chunk of a binary glTF
+	};
+
+	namespace detail {
+
+		// A single image of the given size, the rest is filled in by the caller.
+		[[nodiscard]] inline auto image_info(probe_result& result, const std::uint32_t width, const std::uint32_t height, const std::uint32_t channels, const std::uint32_t bit_depth) noexcept -> bool {
+			result.width = width;
+			result.height = height;
+			result.channels = channels;
+			result.bit_depth = bit_depth;
+			result.frames = 1;
+			result.levels = 1;
+			result.faces = 1;
+			return true;
+		}
+
+		// The size of the null-terminated string at #p, or #max_size if there is no null byte within it.
+		[[nodiscard]] inline auto bounded_string_size(const char* p, const std::size_t max_size) noexcept -> std::size_t {
+			const auto* end = static_cast<const char*>(std::memchr(p, 0, max_size));
+			return end != nullptr ? std::size_t(end - p) : max_size;
+		}
+
+		// The IHDR chunk, and the acTL chunk of an animated PNG if it comes within the first few chunks (it has to come before the image data).
+		template <typename Source>
+		[[nodiscard]] inline auto probe_png(const Source& source, probe_result& result) noexcept -> bool {
+			auto bytes = std::array<uint8_t, 33>{};
+			if (!read_exact(source, 0, bytes.size(), bytes.data()) || std::memcmp(&bytes[12], "IHDR", 4) != 0) {
+				return false;
+			}
+			const auto color = bytes[25];
+			const auto channels = (color == 2) ? 3u : (color == 4) ? 2u : (color == 6) ? 4u : 1u;
+			(void)image_info(result, load_be<std::uint32_t>(&bytes[16]), load_be<std::uint32_t>(&bytes[20]), channels, bytes[24]);
+
+			auto offset = std::uint64_t{ bytes.size() };
+			for (auto chunk = 0; chunk < 8; ++chunk) {
+				auto header = std::array<uint8_t, 12>{};
+				if (!read_exact(source, offset, header.size(), header.data()) || std::memcmp(&header[4], "IDAT", 4) == 0) {
+					break;
+				}
+				if (std::memcmp(&header[4], "acTL", 4) == 0) {
+					result.frames = load_be<std::uint32_t>(&header[8]);
+					break;
+				}
+				offset += 12 + std::uint64_t{ load_be<std::uint32_t>(&header[0]) };
+			}
+			return true;
+		}
+
+		// The first frame header (SOFn), past at most #max_segments markers. Only the large ones (e.g. EXIF) take a read of their own.
+		template <typename Source>
+		[[nodiscard]] inline auto probe_jpeg(const Source& source, probe_result& result) noexcept -> bool {
+			constexpr auto max_segments = 32;
+			auto offset = std::uint64_t{ 2 };
+			for (auto segment = 0; segment < max_segments; ++segment) {
+				auto bytes = std::array<uint8_t, 10>{};
+				if (!read_exact(source, offset, 4, bytes.data()) || bytes[0] != 0xFF) {
+					return false;
+				}
+				const auto marker = bytes[1];
+				if (marker == 0xFF) {
+					offset += 1;
+					continue;
+				}
+				if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+					offset += 2;
+					continue;
+				}
+				if (marker == 0xDA || marker == 0xD9) {
+					return false;
+				}
+				if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+					if (!read_exact(source, offset, bytes.size(), bytes.data())) {
+						return false;
+					}
+					return image_info(result, load_be<std::uint16_t>(&bytes[7]), load_be<std::uint16_t>(&bytes[5]), bytes[9], bytes[4]);
+				}
+				offset += 2 + std::uint64_t{ load_be<std::uint16_t>(&bytes[2]) };
+			}
+			return false;
+		}
+
+		// The logical screen descriptor. The frames are only known by walking the whole file.
+		template <typename Source>
+		[[nodiscard]] inline auto probe_gif(const Source& source, probe_result& result) noexcept -> bool {
+			auto bytes = std::array<uint8_t, 13>{};
+			if (!read_exact(source, 0, bytes.size(), bytes.data())) {
+				return false;
+			}
+			const auto packed = bytes[10];
+			const auto bits = (packed & 0x80) ? (packed & 0x07) + 1u : ((packed >> 4) & 0x07) + 1u;
+			(void)image_info(result, load_le<std::uint16_t>(&bytes[6]), load_le<std::uint16_t>(&bytes[8]), 1, bits);
+			result.frames = 0;
+			return true;
+		}
+
+		// The DIB header, BITMAPCOREHEADER or one of the BITMAPINFOHEADER versions. The height is negative for top-down bitmaps.
+		template <typename Source>
+		[[nodiscard]] inline auto probe_bmp(const Source& source, probe_result& result) noexcept -> bool {
+			auto bytes = std::array<uint8_t, 30>{};
+			if (!read_exact(source, 0, 26, bytes.data())) {
+				return false;
+			}
+			const auto dib_size = load_le<std::uint32_t>(&bytes[14]);
+			auto width = std::uint32_t{ 0 };
+			auto height = std::uint32_t{ 0 };
+			auto bit_count = std::uint32_t{ 0 };
+			if (dib_size == 12) {
+				width = load_le<std::uint16_t>(&bytes[18]);
+				height = load_le<std::uint16_t>(&bytes[20]);
+				bit_count = load_le<std::uint16_t>(&bytes[24]);
+			}
+			else if (dib_size >= 40 && read_exact(source, 26, 4, &bytes[26])) {
+				const auto signed_width = std::int32_t(load_le<std::uint32_t>(&bytes[18]));
+				const auto signed_height = std::int32_t(load_le<std::uint32_t>(&bytes[22]));
+				width = signed_width < 0 ? 0u - std::uint32_t(signed_width) : std::uint32_t(signed_width);
+				height = signed_height < 0 ? 0u - std::uint32_t(signed_height) : std::uint32_t(signed_height);
+				bit_count = load_le<std::uint16_t>(&bytes[28]);
+			}
+			else {
+				return false;
+			}
+			const auto channels = (bit_count <= 8) ? 1u : (bit_count <= 24) ? 3u : 4u;
+			return image_info(result, width, height, channels, bit_count <= 8 ? bit_count : bit_count / channels);
+		}
+
+		template <typename Source>
+		[[nodiscard]] inline auto probe_tga(const Source& source, probe_result& result) noexcept -> bool {
+			auto bytes = std::array<uint8_t, 18>{};
+			if (!read_exact(source, 0, bytes.size(), bytes.data())) {
+				return false;
+			}
+			const auto depth = bytes[16];
+			const auto alpha = (bytes[17] & 0x0F) != 0;
+			const auto channels = (depth == 32 || (depth == 16 && alpha)) ? 4u : (depth > 8) ? 3u : 1u;
+			return image_info(result, load_le<std::uint16_t>(&bytes[12]), load_le<std::uint16_t>(&bytes[14]), channels, (depth == 15 || depth == 16) ? 5u : 8u);
+		}
+
+		// The fields of the first IFD that tell the size and the samples, read a few entries at a time. Another IFD after it is another page (or a thumbnail).
+		template <typename Source>
+		[[nodiscard]] inline auto probe_tiff(const Source& source, probe_result& result) noexcept -> bool {
+			constexpr auto entry_size = std::size_t{ 12u };
+			constexpr auto max_entries = std::size_t{ 256u };
+			auto bytes = std::array<uint8_t, max_read_range_size>{};
+			if (!read_exact(source, 0, 8, bytes.data()) || bytes[0] != bytes[1]) {
+				return false;
+			}
+			const auto big_endian = bytes[0] == 0x4D;
+			const auto ifd = std::uint64_t{ load<std::uint32_t>(&bytes[4], big_endian) };
+			if (!read_exact(source, ifd, 2, bytes.data())) {
+				return false;
+			}
+			const auto count = std::min<std::size_t>(load<std::uint16_t>(bytes.data(), big_endian), max_entries);
+
+			auto width = std::uint32_t{ 0 };
+			auto height = std::uint32_t{ 0 };
+			auto channels = std::uint32_t{ 1 };
+			auto bit_depth = std::uint32_t{ 1 };
+			auto bits_offset = std::uint64_t{ 0 };
+			constexpr auto entries_per_read = max_read_range_size / entry_size;
+			for (auto first = std::size_t{ 0 }; first < count; first += entries_per_read) {
+				const auto entries = std::min(count - first, entries_per_read);
+				if (!read_exact(source, ifd + 2 + first * entry_size, entries * entry_size, bytes.data())) {
+					return false;
+				}
+				for (auto i = std::size_t{ 0 }; i < entries; ++i) {
+					const auto* entry = &bytes[i * entry_size];
+					const auto tag = load<std::uint16_t>(entry, big_endian);
+					const auto type = load<std::uint16_t>(entry + 2, big_endian);
+					const auto values = load<std::uint32_t>(entry + 4, big_endian);
+					// A SHORT or a LONG held in the entry itself
+					const auto value = (type == 3) ? std::uint32_t{ load<std::uint16_t>(entry + 8, big_endian) } : load<std::uint32_t>(entry + 8, big_endian);
+					if (tag == 256) {
+						width = value;
+					}
+					else if (tag == 257) {
+						height = value;
+					}
+					else if (tag == 258) {
+						if (type == 3 && values > 2) {
+							bits_offset = load<std::uint32_t>(entry + 8, big_endian);
+						}
+						else {
+							bit_depth = value;
+						}
+					}
+					else if (tag == 277) {
+						channels = value;
+					}
+				}
+			}
+
+			// The bits of the first sample when there are too many to fit the entry
+			auto bits = std::array<uint8_t, 2>{};
+			if (bits_offset != 0 && read_exact(source, bits_offset, bits.size(), bits.data())) {
+				bit_depth = load<std::uint16_t>(bits.data(), big_endian);
+			}
+
+			auto next = std::array<uint8_t, 4>{};
+			const auto single = read_exact(source, ifd + 2 + count * entry_size, next.size(), next.data()) && load<std::uint32_t>(next.data(), big_endian) == 0;
+			(void)image_info(result, width, height, channels, bit_depth);
+			result.frames = single ? 1 : 0;
+			return width != 0 && height != 0;
+		}
+
+		// The number of channels of an OpenGL base internal format.
+		[[nodiscard]] constexpr auto gl_format_channels(const std::uint32_t format) noexcept -> std::uint32_t {
+			switch (format) {
+			case 0x1902: // GL_DEPTH_COMPONENT
+			case 0x1903: // GL_RED
+			case 0x1906: // GL_ALPHA
+			case 0x1909: // GL_LUMINANCE
+			case 0x1901: // GL_STENCIL_INDEX
+				return 1;
+			case 0x8227: // GL_RG
+			case 0x190A: // GL_LUMINANCE_ALPHA
+			case 0x84F9: // GL_DEPTH_STENCIL
+				return 2;
+			case 0x1907: // GL_RGB
+			case 0x80E0: // GL_BGR
+			case 0x8C40: // GL_SRGB
+				return 3;
+			case 0x1908: // GL_RGBA
+			case 0x80E1: // GL_BGRA
+			case 0x8C42: // GL_SRGB_ALPHA
+				return 4;
+			default:
+				return 0;
+			}
+		}
+
+		template <typename Source>
+		[[nodiscard]] inline auto probe_ktx(const Source& source, probe_result& result) noexcept -> bool {
+			auto bytes = std::array<uint8_t, 64>{};
+			if (!read_exact(source, 0, bytes.size(), bytes.data())) {
+				return false;
+			}
+			// The endianness field reads 0x04030201 in the byte order of the writer
+			const auto big_endian = load_le<std::uint32_t>(&bytes[12]) != 0x04030201u;
+			const auto field = [&bytes, big_endian](const std::size_t offset) {
+				return load<std::uint32_t>(&bytes[offset], big_endian);
+			};
+			const auto type = field(16);
+			const auto type_size = field(20);
+			(void)image_info(result, field(36), std::max(field(40), std::uint32_t{ 1 }), gl_format_channels(field(32)), type != 0 && type_size <= 4 ? type_size * 8 : 0);
+			result.depth = field(44);
+			result.frames = std::max(field(48), std::uint32_t{ 1 });
+			result.faces = field(52);
+			result.levels = std::max(field(56), std::uint32_t{ 1 });
+			return true;
+		}
+
+		// The header, and the basic data format descriptor for the channels: the samples of an uncompressed format, or the channel ids of UASTC and ETC1S.
+		template <typename Source>
+		[[nodiscard]] inline auto probe_ktx2(const Source& source, probe_result& result) noexcept -> bool {
+			constexpr auto model_rgbsda = 1u;
+			constexpr auto model_etc1s = 163u;
+			constexpr auto model_uastc = 166u;
+			constexpr auto sample_size = std::size_t{ 16u };
+			constexpr auto max_samples = std::size_t{ 8u };
+
+			auto bytes = std::array<uint8_t, 80>{};
+			if (!read_exact(source, 0, bytes.size(), bytes.data())) {
+				return false;
+			}
+			(void)image_info(result, load_le<std::uint32_t>(&bytes[20]), std::max(load_le<std::uint32_t>(&bytes[24]), std::uint32_t{ 1 }), 0, 0);
+			result.depth = load_le<std::uint32_t>(&bytes[28]);
+			result.frames = std::max(load_le<std::uint32_t>(&bytes[32]), std::uint32_t{ 1 });
+			result.faces = load_le<std::uint32_t>(&bytes[36]);
+			result.levels = std::max(load_le<std::uint32_t>(&bytes[40]), std::uint32_t{ 1 });
+
+			auto dfd = std::array<uint8_t, 4 + 24 + max_samples * sample_size>{};
+			const auto dfd_offset = std::uint64_t{ load_le<std::uint32_t>(&bytes[48]) };
+			const auto dfd_size = std::min<std::size_t>(load_le<std::uint32_t>(&bytes[52]), dfd.size());
+			if (dfd_size < 4 + 24 || !read_exact(source, dfd_offset, dfd_size, dfd.data())) {
+				return true;
+			}
+			// The descriptor block holds 24 bytes before its samples, a smaller one has none to report
+			const auto block_size = std::size_t{ load_le<std::uint16_t>(&dfd[10]) };
+			if (block_size < 24) {
+				return true;
+			}
+			const auto model = dfd[12];
+			const auto samples = std::min<std::size_t>((std::min<std::size_t>(block_size, dfd_size - 4) - 24) / sample_size, max_samples);
+			if (model == model_rgbsda && samples != 0) {
+				result.channels = std::uint32_t(samples);
+				result.bit_depth = dfd[28 + 2] + 1u;
+			}
+			else if (model == model_uastc && samples == 1) {
+				// RGB, RGBA, RRR, RRRG and RG
+				constexpr auto channels = std::array<std::uint32_t, 7>{ 3, 0, 0, 4, 1, 2, 2 };
+				const auto id = std::size_t{ dfd[28 + 3] } & 0x0F;
+				result.channels = id < channels.size() ? channels[id] : 0;
+				result.bit_depth = 8;
+			}
+			else if (model == model_etc1s && samples != 0) {
+				// RGB or RRR, plus GGG or AAA
+				const auto first = dfd[28 + 3] & 0x0F;
+				result.channels = ((first == 3) ? 1u : 3u) + (samples > 1 ? 1u : 0u);
+				result.bit_depth = 8;
+			}
+			return true;
+		}
+
+		// The dataWindow and the channels attributes among the first #max_attributes attributes of the header.
+		template <typename Source>
+		[[nodiscard]] inline auto probe_exr(const Source& source, probe_result& result) noexcept -> bool {
+			constexpr auto max_attributes = 64;
+			constexpr auto pixel_bits = std::array<std::uint32_t, 3>{ 32, 16, 32 }; // UINT, HALF, FLOAT
+
+			auto offset = std::uint64_t{ 8 };
+			auto found = 0;
+			auto bytes = std::array<uint8_t, max_read_range_size>{};
+			for (auto attribute = 0; attribute < max_attributes && found < 2; ++attribute) {
+				// The name and the type are null-terminated strings of up to 255 bytes each, followed by the value size
+				const auto available = std::min<std::uint64_t>(bytes.size(), source.size() - std::min(offset, source.size()));
+				if (available == 0 || !read_exact(source, offset, std::size_t(available), bytes.data()) || bytes[0] == 0) {
+					break;
+				}
+				const auto* begin = reinterpret_cast<const char*>(bytes.data());
+				const auto name = std::string_view(begin, bounded_string_size(begin, std::size_t(available)));
+				if (name.size() + 1 >= available) {
+					break;
+				}
+				const auto type = std::string_view(begin + name.size() + 1, bounded_string_size(begin + name.size() + 1, std::size_t(available) - name.size() - 1));
+				const auto value_offset = name.size() + type.size() + 2 + 4;
+				if (value_offset > available) {
+					break;
+				}
+				const auto value_size = load_le<std::uint32_t>(&bytes[value_offset - 4]);
+				const auto value_available = std::min<std::size_t>(value_size, std::size_t(available) - value_offset);
+				const auto* value = &bytes[value_offset];
+
+				if (name == "dataWindow" && type == "box2i" && value_available >= 16) {
+					const auto x_min = std::int32_t(load_le<std::uint32_t>(value));
+					const auto y_min = std::int32_t(load_le<std::uint32_t>(value + 4));
+					const auto x_max = std::int32_t(load_le<std::uint32_t>(value + 8));
+					const auto y_max = std::int32_t(load_le<std::uint32_t>(value + 12));
+					result.width = std::uint32_t(std::int64_t{ x_max } - x_min + 1);
+					result.height = std::uint32_t(std::int64_t{ y_max } - y_min + 1);
+					++found;
+				}
+				else if (name == "channels" && type == "chlist") {
+					// Every channel is its name, its pixel type, a flag, 3 reserved bytes and its sampling, the list ends with an empty name
+					auto channels = std::uint32_t{ 0 };
+					auto position = std::size_t{ 0 };
+					while (position < value_available && value[position] != 0) {
+						const auto channel_name_size = bounded_string_size(reinterpret_cast<const char*>(value + position), value_available - position);
+						if (position + channel_name_size + 1 + 4 > value_available) {
+							break;
+						}
+						const auto pixel_type = load_le<std::uint32_t>(value + position + channel_name_size + 1);
+						if (channels == 0 && pixel_type < pixel_bits.size()) {
+							result.bit_depth = pixel_bits[pixel_type];
+						}
+						++channels;
+						position += channel_name_size + 1 + 16;
+					}
+					result.channels = channels;
+					++found;
+				}
+				offset += value_offset + value_size;
+			}
+
+			result.frames = 1;
+			result.levels = 1;
+			result.faces = 1;
+			return found != 0;
+		}
+
+		// The resolution line that follows the empty line ending the header, e.g. "-Y 480 +X 640".
+		template <typename Source>
+		[[nodiscard]] inline auto probe_hdr(const Source& source, probe_result& result) noexcept -> bool {
+			auto bytes = std::array<char, max_read_range_size>{};
+			const auto size = std::size_t(std::min<std::uint64_t>(bytes.size(), source.size()));
+			if (!read_exact(source, 0, size, reinterpret_cast<uint8_t*>(bytes.data()))) {
+				return false;
+			}
+			const auto text = std::string_view(bytes.data(), size);
+			const auto end = text.find("\n\n");
+			if (end == std::string_view::npos) {
+				return false;
+			}
+
+			// Two axes with their signs, one X and one Y in either order (the rotated orientations, e.g. "+X 640 -Y 480", list X first): X is the width, Y the height
+			auto line = text.substr(end + 2);
+			auto sizes = std::array<std::uint32_t, 2>{}; // the X and Y sizes
+			auto axes = std::array<bool, 2>{};
+			for (auto n = 0; n < 2; ++n) {
+				if (line.size() < 3 || (line[0] != '-' && line[0] != '+') || (line[1] != 'X' && line[1] != 'Y') || line[2] != ' ') {
+					return false;
+				}
+				const auto axis = std::size_t(line[1] == 'Y');
+				if (axes[axis]) {
+					return false;
+				}
+				axes[axis] = true;
+				line.remove_prefix(3);
+				auto digits = std::size_t{ 0 };
+				for (; digits < line.size() && line[digits] >= '0' && line[digits] <= '9' && digits < 9; ++digits) {
+					sizes[axis] = sizes[axis] * 10 + std::uint32_t(line[digits] - '0');
+				}
+				if (digits == 0) {
+					return false;
+				}
+				line.remove_prefix(std::min(digits + 1, line.size()));
+			}
+			return image_info(result, sizes[0], sizes[1], 3, 8);
+		}
+
+		// The first chunk of the RIFF container: a lossy (VP8) or a lossless (VP8L) bitstream header, or the extended (VP8X) header with the canvas size.
+		template <typename Source>
+		[[nodiscard]] inline auto probe_webp(const Source& source, probe_result& result) noexcept -> bool {
+			auto bytes = std::array<uint8_t, 30>{};
+			if (!read_exact(source, 0, bytes.size(), bytes.data())) {
+				return false;
+			}
+			if (std::memcmp(&bytes[12], "VP8 ", 4) == 0 && bytes[23] == 0x9D && bytes[24] == 0x01 && bytes[25] == 0x2A) {
+				return image_info(result, load_le<std::uint16_t>(&bytes[26]) & 0x3FFFu, load_le<std::uint16_t>(&bytes[28]) & 0x3FFFu, 3, 8);
+			}
+			if (std::memcmp(&bytes[12], "VP8L", 4) == 0 && bytes[20] == 0x2F) {
+				const auto bits = load_le<std::uint32_t>(&bytes[21]);
+				return image_info(result, (bits & 0x3FFFu) + 1, ((bits >> 14) & 0x3FFFu) + 1, (bits >> 28 & 1) ? 4 : 3, 8);
+			}
+			if (std::memcmp(&bytes[12], "VP8X", 4) == 0) {
+				const auto flags = bytes[20];
+				const auto width = (std::uint32_t{ bytes[24] } | std::uint32_t{ bytes[25] } << 8 | std::uint32_t{ bytes[26] } << 16) + 1;
+				const auto height = (std::uint32_t{ bytes[27] } | std::uint32_t{ bytes[28] } << 8 | std::uint32_t{ bytes[29] } << 16) + 1;
+				(void)image_info(result, width, height, (flags & 0x10) ? 4 : 3, 8);
+				// The frames of an animation are ANMF chunks all over the file
+				result.frames = (flags & 0x02) ? 0 : 1;
+				return true;
+			}
+			return false;
+		}
+
+		template <typename Source>
+		[[nodiscard]] inline auto probe_glb(const Source& source, probe_result& result) noexcept -> bool {
+			auto bytes = std::array<uint8_t, 20>{};
+			if (!read_exact(source, 0, bytes.size(), bytes.data()) || load_le<std::uint32_t>(&bytes[4]) != 2 || load_le<std::uint32_t>(&bytes[16]) != 0x4E4F534Au) {
+				return false;
+			}
+			result.json_size = load_le<std::uint32_t>(&bytes[12]);
+			return true;
+		}
+
+		template <typename Source>
+		[[nodiscard]] inline auto probe(const Source& source, const mime_id id) noexcept -> probe_result {
+			auto result = probe_result{ id };
+			switch (id) {
+			case mime_id::png: result.probed = probe_png(source, result); break;
+			case mime_id::jpeg: result.probed = probe_jpeg(source, result); break;
+			case mime_id::gif: result.probed = probe_gif(source, result); break;
+			case mime_id::bmp: result.probed = probe_bmp(source, result); break;
+			case mime_id::tga: result.probed = probe_tga(source, result); break;
+			case mime_id::tiff: result.probed = probe_tiff(source, result); break;
+			case mime_id::ktx: result.probed = probe_ktx(source, result); break;
+			case mime_id::ktx2: result.probed = probe_ktx2(source, result); break;
+			case mime_id::exr: result.probed = probe_exr(source, result); break;
+			case mime_id::hdr: result.probed = probe_hdr(source, result); break;
+			case mime_id::webp: result.probed = probe_webp(source, result); break;
+			case mime_id::gltf_binary: result.probed = probe_glb(source, result); break;
+			default: break;
+			}
+			if (!result.probed) {
+				result = probe_result{ id };
+			}
+			return result;
+		}
+
+	} // namespace detail
+
+	// Determine the mime id of the whole #file_size bytes of a file at #file_bytes and read the image properties from its header (see probe_result).
+	[[nodiscard]] inline auto probe(const uint8_t* file_bytes, const std::size_t file_size) noexcept -> probe_result {
+		const auto source = detail::memory_source{ file_bytes, file_size };
+		return detail::probe(source, file_size < min_file_header_size ? mime_id::unknown : get_id_deep(file_bytes, file_size));
+	}
+
+	// Ditto for an open file. The first 512 bytes are read at once and hold the whole header of most files, so a probe usually takes that read and an fstat call,
+	// plus a small read for the JPEG frame header past a large EXIF block, or for a long TIFF IFD. Nothing is allocated.
+	[[nodiscard]] inline auto probe(const int fd, const mime_id mime_type_hint = mime_id::unknown) noexcept -> probe_result {
+		const auto source = detail::fd_source{ fd };
+		if (source.error() != 0) {
+			return probe_result{ mime_type_hint, source.error() };
+		}
+		const auto result = detail::get_id_from_source(source, mime_type_hint);
+		if (result.error != 0) {
+			return probe_result{ result.id, result.error };
+		}
+		return detail::probe(source, result.id);
+	}
+
+	// Ditto for a file path, falling back to the type of its extension if it can't be opened or read.
+	[[nodiscard]] inline auto probe(const std::string_view path_to_file) noexcept -> probe_result {
+		return detail::get_id_from_path(path_to_file, [](const int fd, const mime_id hint) {
+			return probe(fd, hint);
+		});
+	}
+
+} // inline namespace FILE_MIME_ABI_NAMESPACE
+} // namespace file_mime
+
+#endif // FILE_MIME_PROBE_H
@@ -0,0 +1,455 @@
+// MIT License
+//
+// Copyright(c) 2023 Lev Faynshteyn
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#ifndef FILE_MIME_RESULT_CACHE_H
+#define FILE_MIME_RESULT_CACHE_H
+
+#include "file_mime/file_mime.h"
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <optional>
+#include <atomic>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#endif
+
+namespace file_mime {
+inline namespace FILE_MIME_ABI_NAMESPACE {
+
+	// The identity of the content of a file as far as the file system can tell: the same key means the same bytes, unless the file was rewritten in place within the
+	// resolution of its modification time (and with the same size).
+	struct file_key {
+		std::uint64_t device = 0;
+		std::uint64_t inode = 0;
+		std::uint64_t size = 0;
+		std::uint64_t mtime_ns = 0;
+	};
+
+	[[nodiscard]] constexpr auto operator==(const file_key& lhs, const file_key& rhs) noexcept -> bool {
+		return lhs.device == rhs.device && lhs.inode == rhs.inode && lhs.size == rhs.size && lhs.mtime_ns == rhs.mtime_ns;
+	}
+
+	namespace detail {
+
+		// The number of entries of every bucket of the cache, the key of a file can only be cached in the bucket its hash picks.
+		inline constexpr auto cache_ways = std::size_t{ 8u };
+
+		inline constexpr auto cache_magic = std::array<char, 8>{ 'F', 'M', 'I', 'M', 'E', 'C', 'A', 'C' };
+		inline constexpr auto cache_version = std::uint32_t{ 1u };
+		inline constexpr auto cache_byte_order = std::uint32_t{ 0x01020304u };
+
+		// The value word of a cache entry: the mime id in the low byte, and the valid and the referenced (CLOCK) bits.
+		inline constexpr auto cache_valid = std::uint64_t{ 1u } << 8;
+		inline constexpr auto cache_referenced = std::uint64_t{ 1u } << 9;
+
+		// The words of the entries are atomics so that the readers can look them up while a writer replaces them (the bucket version tells them to retry),
+		// and they are lock-free so that they can live in a file mapped by several processes.
+		static_assert(std::atomic<std::uint64_t>::is_always_lock_free && sizeof(std::atomic<std::uint64_t>) == sizeof(std::uint64_t));
+		static_assert(std::atomic<std::uint32_t>::is_always_lock_free && sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t));
+
+		struct cache_entry {
+			std::array<std::atomic<std::uint64_t>, 4> key{};
+			std::atomic<std::uint64_t> value{ 0 };
+		};
+
+		// A sequence lock guards every bucket: a writer makes the #version odd for the time it writes, and a reader that sees it odd or changed treats it as a miss.
+		// The #hand is the position of the CLOCK hand among the entries.
+		struct alignas(64) cache_bucket {
+			std::atomic<std::uint32_t> version{ 0 };
+			std::atomic<std::uint32_t> hand{ 0 };
+			std::array<cache_entry, cache_ways> entries{};
+		};
+
+		// The header of a persisted cache, followed by the buckets. The fingerprint of the registry keeps the ids cached by another version of the library from being used.
+		struct alignas(64) cache_header {
+			std::array<char, 8> magic{};
+			std::uint32_t version = 0;
+			std::uint32_t byte_order = 0;
+			std::uint64_t fingerprint = 0;
+			std::uint64_t bucket_count = 0;
+		};
+
+		// A hash of the mime types and the magic numbers of the registry, which the cached ids depend on.
+		[[nodiscard]] constexpr auto registry_fingerprint() noexcept -> std::uint64_t {
+			auto h = fnv1a_basis;
+			for (const auto& info : mime_types) {
+				for (const auto c : info.mime_type) {
+					h = fnv1a(h, static_cast<std::uint8_t>(c));
+				}
+				h = fnv1a(h, 0);
+			}
+			for (const auto& signature : magic_signatures) {
+				h = fnv1a(h, static_cast<std::uint8_t>(signature.id));
+				for (auto i = 0; i < 4; ++i) {
+					h = fnv1a(h, static_cast<std::uint8_t>(signature.offset >> (8 * i)));
+				}
+				for (auto i = std::size_t{ 0 }; i < signature.size; ++i) {
+					h = fnv1a(h, signature.pattern[i] & signature.mask[i]);
+					h = fnv1a(h, signature.mask[i]);
+				}
+			}
+			return mix(h);
+		}
+
+		inline constexpr auto cache_fingerprint = registry_fingerprint();
+
+		[[nodiscard]] inline auto cache_hash(const file_key& key) noexcept -> std::uint64_t {
+			return mix(mix(mix(mix(key.inode) ^ key.device) ^ key.size) ^ key.mtime_ns);
+		}
+
+		[[nodiscard]] inline auto cache_key_matches(const cache_entry& entry, const file_key& key) noexcept -> bool {
+			return entry.key[0].load(std::memory_order_relaxed) == key.inode && entry.key[1].load(std::memory_order_relaxed) == key.device
+				&& entry.key[2].load(std::memory_order_relaxed) == key.size && entry.key[3].load(std::memory_order_relaxed) == key.mtime_ns;
+		}
+
+#if !defined(_WIN32)
+		[[nodiscard]] inline auto get_file_key(const struct stat& info) noexcept -> file_key {
+#if defined(__APPLE__)
+			const auto& mtime = info.st_mtimespec;
+#else
+			const auto& mtime = info.st_mtim;
+#endif
+			return file_key{ std::uint64_t(info.st_dev), std::uint64_t(info.st_ino), std::uint64_t(info.st_size), std::uint64_t(mtime.tv_sec) * 1000000000u + std::uint64_t(mtime.tv_nsec) };
+		}
+#endif
+
+	} // namespace detail
+
+	// A cache of the mime ids of files keyed on their file_key, so that classifying a file seen before takes a single fstatat call and no open or read.
+	// The memory is bounded: the key picks a bucket of a few entries, and a full bucket evicts the first entry not used since the CLOCK hand last went past it.
+	// The lookups take no locks, and the inserts only lock the one bucket they write to. Optionally the cache lives in a memory-mapped file,
+	// so that a restarted process (or several processes at once) start with the results of the previous ones.
+	class result_cache {
+	public:
+		static constexpr auto default_capacity = std::size_t{ 1u } << 16;
+
+		// An in-memory cache of about #capacity entries (rounded up to a power of two number of buckets).
+		explicit result_cache(const std::size_t capacity = default_capacity) {
+			allocate(capacity);
+		}
+
+		// A cache persisted in the file at #path, created with about #capacity entries if it doesn't exist or was written by another version of the library
+		// (when no other process has it open). A valid file keeps the capacity it was created with, remove it to change it. The cache works in memory if the file can't be used, with the reason in error().
+		result_cache(const std::string& path, const std::size_t capacity) {
+#if defined(_WIN32)
+			(void)path;
+			error_ = ENOTSUP;
+			allocate(capacity);
+#else
+			error_ = map(path, bucket_count_for(capacity));
+			if (error_ != 0) {
+				allocate(capacity);
+			}
+#endif
+		}
+
+		result_cache(const result_cache&) = delete;
+		auto operator=(const result_cache&) -> result_cache& = delete;
+
+		~result_cache() {
+#if !defined(_WIN32)
+			if (mapping_ != nullptr) {
+				::munmap(mapping_, mapping_size_);
+				detail::close_file(fd_);
+			}
+#endif
+		}
+
+		// The errno of the failure to map the persisted cache, 0 if it's mapped or in-memory by choice.
+		[[nodiscard]] auto error() const noexcept -> int {
+			return error_;
+		}
+
+		[[nodiscard]] auto persistent() const noexcept -> bool {
+			return mapping_ != nullptr;
+		}
+
+		[[nodiscard]] auto capacity() const noexcept -> std::size_t {
+			return bucket_count_ * detail::cache_ways;
+		}
+
+		// The cached mime id of the file with the #key, if any. A lookup racing with an insert into the same bucket may miss.
+		[[nodiscard]] auto find(const file_key& key) const noexcept -> std::optional<mime_id> {
+			auto& bucket = buckets_[bucket_index(key)];
+			const auto version = bucket.version.load(std::memory_order_acquire);
+			if ((version & 1) != 0) {
+				return std::nullopt;
+			}
+
+			auto found = std::uint64_t{ 0 };
+			auto* found_entry = static_cast<detail::cache_entry*>(nullptr);
+			for (auto& entry : bucket.entries) {
+				const auto value = entry.value.load(std::memory_order_relaxed);
+				if ((value & detail::cache_valid) != 0 && detail::cache_key_matches(entry, key)) {
+					found = value;
+					found_entry = &entry;
+					break;
+				}
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (found_entry == nullptr || bucket.version.load(std::memory_order_relaxed) != version) {
+				return std::nullopt;
+			}
+
+			// Only write the shared line the first time the entry is used since the CLOCK hand went past it
+			if ((found & detail::cache_referenced) == 0) {
+				found_entry->value.fetch_or(detail::cache_referenced, std::memory_order_relaxed);
+			}
+			return static_cast<mime_id>(found & 0xFF);
+		}
+
+		// Cache the mime #id of the file with the #key, replacing the cached id of the same key or evicting an entry of the bucket.
+		// The insert is skipped if the bucket stays locked, e.g. by a process that died halfway through an insert into the persisted cache.
+		auto insert(const file_key& key, const mime_id id) noexcept -> void {
+			auto& bucket = buckets_[bucket_index(key)];
+			auto version = std::uint32_t{ 0 };
+			if (!try_lock(bucket, version)) {
+				return;
+			}
+
+			auto* target = static_cast<detail::cache_entry*>(nullptr);
+			for (auto& entry : bucket.entries) {
+				const auto value = entry.value.load(std::memory_order_relaxed);
+				if ((value & detail::cache_valid) == 0) {
+					target = (target != nullptr) ? target : &entry;
+				}
+				else if (detail::cache_key_matches(entry, key)) {
+					target = &entry;
+					break;
+				}
+			}
+
+			if (target == nullptr) {
+				// CLOCK: give the entries used since the last pass a second chance, and evict the first one that wasn't
+				auto hand = bucket.hand.load(std::memory_order_relaxed);
+				for (;; hand = (hand + 1) % detail::cache_ways) {
+					auto& entry = bucket.entries[hand];
+					const auto value = entry.value.load(std::memory_order_relaxed);
+					if ((value & detail::cache_referenced) == 0) {
+						target = &entry;
+						break;
+					}
+					entry.value.store(value & ~detail::cache_referenced, std::memory_order_relaxed);
+				}
+				bucket.hand.store((hand + 1) % detail::cache_ways, std::memory_order_relaxed);
+			}
+
+			target->key[0].store(key.inode, std::memory_order_relaxed);
+			target->key[1].store(key.device, std::memory_order_relaxed);
+			target->key[2].store(key.size, std::memory_order_relaxed);
+			target->key[3].store(key.mtime_ns, std::memory_order_relaxed);
+			target->value.store(detail::cache_valid | static_cast<std::uint64_t>(id), std::memory_order_relaxed);
+
+			bucket.version.store(version + 2, std::memory_order_release);
+		}
+
+		auto clear() noexcept -> void {
+			for (auto i = std::size_t{ 0 }; i < bucket_count_; ++i) {
+				auto& bucket = buckets_[i];
+				auto version = std::uint32_t{ 0 };
+				if (!try_lock(bucket, version)) {
+					// Its lookups miss already
+					continue;
+				}
+				for (auto& entry : bucket.entries) {
+					entry.value.store(0, std::memory_order_relaxed);
+				}
+				bucket.version.store(version + 2, std::memory_order_release);
+			}
+		}
+
+		// Determine the mime id of a file like file_mime::get_id_from_file, from the cache if the file hasn't changed since it was last classified:
+		// a hit takes a single fstatat call. Only regular files are cached, and the files too small to have a magic number aren't even opened.
+		// The cached id doesn't depend on the extension, so a hard link with another extension gets the right #mismatch flag too.
+		[[nodiscard]] auto get_id_from_file(const std::string_view path_to_file) noexcept -> file_id_result {
+#if defined(_WIN32)
+			// No inode numbers to key on
+			return file_mime::get_id_from_file(path_to_file);
+#else
+			const auto hint = get_id_shallow(path_to_file);
+
+			auto path = std::array<char, detail::max_path_size>{};
+			if (path_to_file.size() >= path.size()) {
+				return file_id_result{ hint, ENAMETOOLONG };
+			}
+			std::memcpy(path.data(), path_to_file.data(), path_to_file.size());
+
+			struct stat info {};
+			const auto stat_result = ::fstatat(AT_FDCWD, path.data(), &info, 0);
+			const auto stat_error = errno;
+			detail::count_syscall();
+			if (stat_result != 0) {
+				return file_id_result{ hint, stat_error };
+			}
+			if (S_ISREG(info.st_mode)) {
+				if (std::uint64_t(info.st_size) < min_file_header_size) {
+					return file_id_result{ hint, 0 };
+				}
+				if (const auto id = find(detail::get_file_key(info))) {
+					return file_id_result{ *id, 0, hint != mime_id::unknown && *id != hint };
+				}
+			}
+
+			return detail::get_id_from_path(path_to_file, [this, &info](const int fd, const mime_id hint) {
+				// The key of the bytes actually read, in case the file was replaced since the fstatat call
+				const auto result = detail::get_id_from_fd(fd, hint);
+				if (result.error == 0) {
+					const auto fstat_result = ::fstat(fd, &info);
+					detail::count_syscall();
+					if (fstat_result == 0 && S_ISREG(info.st_mode) && std::uint64_t(info.st_size) >= min_file_header_size) {
+						insert(detail::get_file_key(info), result.id);
+					}
+				}
+				return result;
+			});
+#endif
+		}
+
+	private:
+		[[nodiscard]] static auto bucket_count_for(const std::size_t capacity) noexcept -> std::size_t {
+			auto count = std::size_t{ 1 };
+			while (count * detail::cache_ways < capacity) {
+				count *= 2;
+			}
+			return count;
+		}
+
+		[[nodiscard]] auto bucket_index(const file_key& key) const noexcept -> std::size_t {
+			return static_cast<std::size_t>(detail::cache_hash(key)) & (bucket_count_ - 1);
+		}
+
+		// Spin until the version of the #bucket is made odd by this thread, with the even #version it had, or give up after #max_lock_spins tries.
+		// A writer holds the lock for a few stores, so a bucket that stays locked that long belongs to a process that died halfway through an insert:
+		// its lookups miss until the next process that maps the file alone clears it.
+		[[nodiscard]] static auto try_lock(detail::cache_bucket& bucket, std::uint32_t& version) noexcept -> bool {
+			for (auto spin = 0; spin < max_lock_spins; ++spin) {
+				version = bucket.version.load(std::memory_order_relaxed);
+				if ((version & 1) == 0 && bucket.version.compare_exchange_weak(version, version + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+					std::atomic_thread_fence(std::memory_order_release);
+					return true;
+				}
+				std::this_thread::yield();
+			}
+			return false;
+		}
+
+		static constexpr auto max_lock_spins = 4096;
+
+		auto allocate(const std::size_t capacity) -> void {
+			bucket_count_ = bucket_count_for(capacity);
+			storage_ = std::make_unique<detail::cache_bucket[]>(bucket_count_);
+			buckets_ = storage_.get();
+		}
+
+#if !defined(_WIN32)
+		// Map the cache file, holding a shared lock on it for as long as it's mapped. The header is only (re)written and the buckets of the writers that died halfway
+		// through an insert are only cleared while no other process has the file open, that is when an exclusive lock can be taken. flock doesn't downgrade
+		// the exclusive lock atomically, so another process may take it in between: a file with a valid header is never resized, which keeps the mappings valid.
+		[[nodiscard]] auto map(const std::string& path, const std::size_t bucket_count) noexcept -> int {
+			const auto fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+			if (fd < 0) {
+				return errno;
+			}
+
+			const auto fail = [fd](const int error) {
+				detail::close_file(fd);
+				return error;
+			};
+
+			const auto exclusive = ::flock(fd, LOCK_EX | LOCK_NB) == 0;
+			if (!exclusive && ::flock(fd, LOCK_SH) != 0) {
+				return fail(errno);
+			}
+
+			auto header = detail::cache_header{};
+			const auto header_read = detail::read_at(fd, reinterpret_cast<uint8_t*>(&header), sizeof(header), 0);
+			auto valid = header_read == std::ptrdiff_t(sizeof(header)) && header.magic == detail::cache_magic && header.version == detail::cache_version
+				&& header.byte_order == detail::cache_byte_order && header.fingerprint == detail::cache_fingerprint
+				&& header.bucket_count != 0 && (header.bucket_count & (header.bucket_count - 1)) == 0;
+			if (valid) {
+				struct stat info {};
+				valid = ::fstat(fd, &info) == 0 && std::uint64_t(info.st_size) == sizeof(header) + header.bucket_count * sizeof(detail::cache_bucket);
+			}
+
+			if (!valid) {
+				if (!exclusive) {
+					return fail(EBUSY);
+				}
+				header = detail::cache_header{ detail::cache_magic, detail::cache_version, detail::cache_byte_order, detail::cache_fingerprint, bucket_count };
+				if (::ftruncate(fd, 0) != 0 || ::ftruncate(fd, off_t(sizeof(header) + bucket_count * sizeof(detail::cache_bucket))) != 0
+					|| ::pwrite(fd, &header, sizeof(header), 0) != std::ptrdiff_t(sizeof(header))) {
+					return fail(errno);
+				}
+			}
+
+			const auto size = sizeof(header) + std::size_t(header.bucket_count) * sizeof(detail::cache_bucket);
+			auto* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (mapping == MAP_FAILED) {
+				return fail(errno);
+			}
+
+			mapping_ = mapping;
+			mapping_size_ = size;
+			fd_ = fd;
+			bucket_count_ = std::size_t(header.bucket_count);
+			buckets_ = reinterpret_cast<detail::cache_bucket*>(static_cast<std::uint8_t*>(mapping) + sizeof(header));
+
+			if (exclusive) {
+				for (auto i = std::size_t{ 0 }; i < bucket_count_; ++i) {
+					auto& bucket = buckets_[i];
+					if ((bucket.version.load(std::memory_order_relaxed) & 1) != 0) {
+						for (auto& entry : bucket.entries) {
+							entry.value.store(0, std::memory_order_relaxed);
+						}
+						bucket.version.store(0, std::memory_order_relaxed);
+					}
+				}
+				::flock(fd, LOCK_SH);
+			}
+			return 0;
+		}
+#endif
+
+		detail::cache_bucket* buckets_ = nullptr;
+		std::size_t bucket_count_ = 0;
+		std::unique_ptr<detail::cache_bucket[]> storage_;
+		void* mapping_ = nullptr;
+		std::size_t mapping_size_ = 0;
+		int fd_ = -1;
+		int error_ = 0;
+	};
+
+} // inline namespace FILE_MIME_ABI_NAMESPACE
+} // namespace file_mime
+
+#endif // FILE_MIME_RESULT_CACHE_H
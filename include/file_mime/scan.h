@@ -0,0 +1,424 @@
+// MIT License
+//
+// Copyright(c) 2023 Lev Faynshteyn
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef FILE_MIME_SCAN_H
+#define FILE_MIME_SCAN_H
+
+#include "file_mime/file_mime.h"
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace file_mime {
+inline namespace FILE_MIME_ABI_NAMESPACE {
+
+	struct scan_options {
+		mime_set formats = all_mime_types; // the types to look for, the short magic numbers (e.g. BMP, TGA) match all over most binary blobs
+		std::size_t thread_count = 1; // 0 uses all the hardware threads
+		std::size_t chunk_size = std::size_t{ 4u } << 20; // the blob is split into chunks of this many bytes, which are scanned in parallel
+	};
+
+	// Called for every embedded file found: the offset of its start within the blob and its mime id.
+	// The calls are never concurrent and are made in the order of the positions of the magic numbers.
+	using scan_callback = std::function<void(std::uint64_t offset, mime_id id)>;
+
+	namespace detail {
+
+		// The maximum number of distinct first magic bytes the SSE2 prefilter compares every block against, a longer list falls back to the byte pair table.
+		// The AVX2 prefilter looks the bytes up in a table instead, so it takes any number of them.
+		inline constexpr auto scan_prefilter_bytes = std::size_t{ 8u };
+
+		// A set of bytes laid out for a lookup with byte shuffles: the byte #b is in the set if bit (b >> 4) % 8 of low_half[b & 15] (for b < 128)
+		// or of high_half[b & 15] (for b >= 128) is set. The shuffle zeroes the lanes whose index has its top bit set, which picks the half.
+		struct scan_byte_set {
+			alignas(16) std::array<std::uint8_t, 16> low_half{};
+			alignas(16) std::array<std::uint8_t, 16> high_half{};
+
+			auto insert(const std::uint8_t byte) noexcept -> void {
+				auto& half = byte < 128 ? low_half : high_half;
+				half[byte & 15] |= std::uint8_t(1u << (byte >> 4) % 8);
+			}
+		};
+
+		// The matcher keys on the first two magic bytes, so they can't be wildcards.
+		template <std::size_t N>
+		[[nodiscard]] constexpr auto check_scan_signatures(const std::array<magic_signature, N>& signatures) -> bool {
+			for (const auto& signature : signatures) {
+				if (signature.prefix_size < 2) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		static_assert(check_scan_signatures(magic_signatures), "Every magic number has to start with at least 2 non-wildcard bytes to be scanned for");
+
+		[[nodiscard]] inline auto count_trailing_zeros(const std::uint64_t bits) noexcept -> std::size_t {
+#if defined(_MSC_VER) && !defined(__clang__) && defined(_M_X64)
+			auto index = unsigned long{ 0 };
+			_BitScanForward64(&index, bits);
+			return index;
+#elif defined(_MSC_VER) && !defined(__clang__)
+			auto bit = std::size_t{ 0 };
+			while ((bits >> bit & 1) == 0) {
+				++bit;
+			}
+			return bit;
+#else
+			return static_cast<std::size_t>(__builtin_ctzll(bits));
+#endif
+		}
+
+		// The multi-pattern matcher over the selected magic numbers (both the ones at the start of the file and the ones at an offset):
+		// a 64K-bit table of the first two magic bytes rules out almost every position with a single load, and the positions left are verified with the masked comparison.
+		// Whole blocks are ruled out at once with SIMD first: with AVX2 by looking up the first and the second byte of every position in the sets of the first and
+		// the second magic bytes, whatever their number, and with SSE2 by comparing against the first magic bytes when there's only a handful of them.
+		struct scan_matcher {
+			std::array<magic_signature, magic_signatures.size()> signatures{};
+			std::size_t signature_count = 0;
+			std::array<std::uint64_t, 65536 / 64> pairs{};
+			std::array<std::uint8_t, scan_prefilter_bytes> first_bytes{};
+			std::size_t first_byte_count = 0;
+			scan_byte_set first_byte_set;
+			scan_byte_set second_byte_set;
+
+			explicit scan_matcher(const mime_set formats) noexcept {
+				for (const auto& signature : magic_signatures) {
+					if (!contains(formats, signature.id)) {
+						continue;
+					}
+					signatures[signature_count++] = signature;
+
+					const auto pair = std::size_t{ signature.pattern[0] } | std::size_t{ signature.pattern[1] } << 8;
+					pairs[pair / 64] |= std::uint64_t{ 1 } << (pair % 64);
+					first_byte_set.insert(signature.pattern[0]);
+					second_byte_set.insert(signature.pattern[1]);
+
+					const auto first_byte = signature.pattern[0];
+					if (std::find(first_bytes.begin(), first_bytes.begin() + std::min(first_byte_count, scan_prefilter_bytes), first_byte) == first_bytes.begin() + std::min(first_byte_count, scan_prefilter_bytes)) {
+						if (first_byte_count < scan_prefilter_bytes) {
+							first_bytes[first_byte_count] = first_byte;
+						}
+						++first_byte_count;
+					}
+				}
+			}
+
+			[[nodiscard]] auto candidate(const uint8_t* p) const noexcept -> bool {
+				const auto pair = std::size_t{ p[0] } | std::size_t{ p[1] } << 8;
+				return (pairs[pair / 64] >> (pair % 64) & 1) != 0;
+			}
+
+			// Report the magic numbers found at #position of the blob, the ones at an offset as files starting that many bytes earlier.
+			template <typename OnHit>
+			auto verify(const uint8_t* data, const std::size_t size, const std::size_t position, OnHit&& on_hit) const -> void {
+				for (auto i = std::size_t{ 0 }; i < signature_count; ++i) {
+					const auto& signature = signatures[i];
+					if (data[position] != signature.pattern[0] || data[position + 1] != signature.pattern[1]) {
+						continue;
+					}
+					if (position < signature.offset || signature.size > size - position) {
+						continue;
+					}
+					if (matches(signature, load_header(data + position, size - position))) {
+						on_hit(std::uint64_t{ position - signature.offset }, signature.id);
+					}
+				}
+			}
+		};
+
+#if defined(FILE_MIME_X86)
+		// The bit mask of the positions of the 64 byte block at #p holding any of the first magic bytes.
+		FILE_MIME_TARGET("sse2")
+		[[nodiscard]] inline auto scan_block_sse2(const uint8_t* p, const scan_matcher& matcher) noexcept -> std::uint64_t {
+			auto bits = std::uint64_t{ 0 };
+			for (auto offset = std::size_t{ 0 }; offset < 64; offset += 16) {
+				const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + offset));
+				auto any = _mm_setzero_si128();
+				for (auto i = std::size_t{ 0 }; i < matcher.first_byte_count; ++i) {
+					any = _mm_or_si128(any, _mm_cmpeq_epi8(bytes, _mm_set1_epi8(static_cast<char>(matcher.first_bytes[i]))));
+				}
+				bits |= std::uint64_t{ static_cast<std::uint32_t>(_mm_movemask_epi8(any)) } << offset;
+			}
+			return bits;
+		}
+
+		// The bit mask of the 32 bytes at #p in the #set, see scan_byte_set.
+		FILE_MIME_TARGET("avx2")
+		[[nodiscard]] inline auto scan_lookup_avx2(const uint8_t* p, const scan_byte_set& set) noexcept -> std::uint32_t {
+			const auto high_bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+			const auto low_half = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(set.low_half.data())));
+			const auto high_half = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(set.high_half.data())));
+
+			const auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+			const auto high_nibbles = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), _mm256_set1_epi8(0x0f));
+			const auto rows = _mm256_or_si256(_mm256_shuffle_epi8(low_half, bytes), _mm256_shuffle_epi8(high_half, _mm256_xor_si256(bytes, _mm256_set1_epi8(-128))));
+			const auto hits = _mm256_and_si256(rows, _mm256_shuffle_epi8(high_bits, high_nibbles));
+			return ~static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hits, _mm256_setzero_si256())));
+		}
+
+		// The bit mask of the positions of the 64 byte block at #p whose byte is a first magic byte and whose next one (up to p[64]) a second magic byte.
+		FILE_MIME_TARGET("avx2")
+		[[nodiscard]] inline auto scan_block_avx2(const uint8_t* p, const scan_matcher& matcher) noexcept -> std::uint64_t {
+			auto bits = std::uint64_t{ 0 };
+			for (auto offset = std::size_t{ 0 }; offset < 64; offset += 32) {
+				const auto first = scan_lookup_avx2(p + offset, matcher.first_byte_set);
+				const auto second = scan_lookup_avx2(p + offset + 1, matcher.second_byte_set);
+				bits |= std::uint64_t{ first & second } << offset;
+			}
+			return bits;
+		}
+#endif
+
+		using scan_block_function = std::uint64_t(*)(const uint8_t*, const scan_matcher&) noexcept;
+
+		// The SIMD prefilter of the #matcher at the #level, or null if there's none and every position goes through the byte pair table.
+		[[nodiscard]] inline auto get_scan_block(const simd_level level, [[maybe_unused]] const scan_matcher& matcher) noexcept -> scan_block_function {
+			switch (level) {
+#if defined(FILE_MIME_X86)
+			case simd_level::avx512:
+			case simd_level::avx2:
+				return &scan_block_avx2;
+			case simd_level::sse2:
+				return matcher.first_byte_count <= scan_prefilter_bytes ? &scan_block_sse2 : nullptr;
+#endif
+			default:
+				return nullptr;
+			}
+		}
+
+		// Scan the magic number positions [#first, #last) of the blob. The magic numbers starting in the range are verified against the whole blob,
+		// so the ones straddling the end of the range are found by the chunk they start in, and only by that one.
+		template <typename OnHit>
+		inline auto scan_range(const scan_matcher& matcher, const scan_block_function scan_block, const uint8_t* data, const std::size_t size, const std::size_t first, std::size_t last, OnHit&& on_hit) -> void {
+			// A magic number takes at least 2 bytes, so there is nothing to find at the last byte (and a block can read the byte after it)
+			last = std::min(last, size - 1);
+			auto position = first;
+
+			if (scan_block != nullptr) {
+				for (; position + 64 <= last; position += 64) {
+					for (auto bits = scan_block(data + position, matcher); bits != 0; bits &= bits - 1) {
+						const auto bit = count_trailing_zeros(bits);
+						if (matcher.candidate(data + position + bit)) {
+							matcher.verify(data, size, position + bit, on_hit);
+						}
+					}
+				}
+			}
+
+			for (; position < last; ++position) {
+				if (matcher.candidate(data + position)) {
+					matcher.verify(data, size, position, on_hit);
+				}
+			}
+		}
+
+		// A read-only memory mapping of a whole file.
+		struct mapped_file {
+			const uint8_t* data = nullptr;
+			std::size_t size = 0;
+			int error = 0;
+#if defined(_WIN32)
+			HANDLE file = INVALID_HANDLE_VALUE;
+			HANDLE mapping = nullptr;
+#endif
+
+			explicit mapped_file(const std::string& path) noexcept {
+#if defined(_WIN32)
+				file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+				auto file_size = LARGE_INTEGER{};
+				if (file == INVALID_HANDLE_VALUE || !::GetFileSizeEx(file, &file_size)) {
+					error = EIO;
+					return;
+				}
+				size = static_cast<std::size_t>(file_size.QuadPart);
+				if (size == 0) {
+					return;
+				}
+				mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				data = mapping != nullptr ? static_cast<const uint8_t*>(::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+				if (data == nullptr) {
+					size = 0;
+					error = EIO;
+				}
+#else
+				const auto fd = detail::open_read_only(path.c_str());
+				if (fd < 0) {
+					error = errno;
+					return;
+				}
+				struct stat info {};
+				if (::fstat(fd, &info) != 0) {
+					error = errno;
+				}
+				else if (info.st_size > 0) {
+					auto* mapping = ::mmap(nullptr, std::size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+					if (mapping == MAP_FAILED) {
+						error = errno;
+					}
+					else {
+						data = static_cast<const uint8_t*>(mapping);
+						size = std::size_t(info.st_size);
+						::madvise(mapping, size, MADV_SEQUENTIAL);
+					}
+				}
+				detail::close_file(fd);
+#endif
+			}
+
+			mapped_file(const mapped_file&) = delete;
+			auto operator=(const mapped_file&) -> mapped_file& = delete;
+
+			~mapped_file() {
+#if defined(_WIN32)
+				if (data != nullptr) {
+					::UnmapViewOfFile(data);
+				}
+				if (mapping != nullptr) {
+					::CloseHandle(mapping);
+				}
+				if (file != INVALID_HANDLE_VALUE) {
+					::CloseHandle(file);
+				}
+#else
+				if (data != nullptr) {
+					::munmap(const_cast<uint8_t*>(data), size);
+				}
+#endif
+			}
+		};
+
+	} // namespace detail
+
+	// Find the files embedded anywhere in the #size bytes at #data (e.g. a disk image or a pack file) from their magic numbers, and report them to the #callback.
+	// Every position of the blob is a candidate start of a file, so this is meant for carving, not for classifying a file (use get_id_deep for that).
+	// With more than one thread the blob is scanned in chunks in parallel, and the hits of every chunk are delivered in the chunk order.
+	// An exception thrown by the #callback stops the scan and is rethrown.
+	inline auto scan_embedded(const uint8_t* data, const std::size_t size, const scan_options& options, const scan_callback& callback) -> void {
+		if (size < min_file_header_size) {
+			return;
+		}
+
+		const auto matcher = detail::scan_matcher(options.formats);
+		if (matcher.signature_count == 0) {
+			return;
+		}
+		const auto scan_block = detail::get_scan_block(detail::detect_simd_level(), matcher);
+
+		const auto chunk_size = std::max(options.chunk_size, std::size_t{ 64u });
+		const auto chunk_count = (size + chunk_size - 1) / chunk_size;
+		const auto thread_count = std::min(chunk_count, options.thread_count != 0 ? options.thread_count : std::size_t{ std::max(std::thread::hardware_concurrency(), 1u) });
+
+		if (thread_count <= 1) {
+			detail::scan_range(matcher, scan_block, data, size, 0, size, [&callback](const std::uint64_t offset, const mime_id id) {
+				callback(offset, id);
+			});
+			return;
+		}
+
+		// The hits of the chunks scanned ahead of the ones still being delivered wait in #chunks, whoever finishes the next chunk to deliver delivers all the ready ones
+		using hits = std::vector<std::pair<std::uint64_t, mime_id>>;
+		auto chunks = std::vector<hits>(chunk_count);
+		auto ready = std::vector<bool>(chunk_count);
+		auto next_chunk = std::atomic<std::size_t>{ 0 };
+		auto next_delivery = std::size_t{ 0 };
+		auto stopped = std::atomic<bool>{ false };
+		auto mutex = std::mutex{};
+		auto exception = std::exception_ptr{};
+
+		const auto run = [&]() {
+			for (auto chunk = next_chunk.fetch_add(1, std::memory_order_relaxed); chunk < chunk_count && !stopped.load(std::memory_order_relaxed); chunk = next_chunk.fetch_add(1, std::memory_order_relaxed)) {
+				auto found = hits{};
+				detail::scan_range(matcher, scan_block, data, size, chunk * chunk_size, std::min(size, (chunk + 1) * chunk_size), [&found](const std::uint64_t offset, const mime_id id) {
+					found.emplace_back(offset, id);
+				});
+
+				const auto lock = std::lock_guard<std::mutex>{ mutex };
+				chunks[chunk] = std::move(found);
+				ready[chunk] = true;
+				for (; next_delivery < chunk_count && ready[next_delivery] && !stopped.load(std::memory_order_relaxed); ++next_delivery) {
+					try {
+						for (const auto& hit : chunks[next_delivery]) {
+							callback(hit.first, hit.second);
+						}
+					}
+					catch (...) {
+						exception = std::current_exception();
+						stopped.store(true, std::memory_order_relaxed);
+					}
+					chunks[next_delivery] = hits{};
+				}
+			}
+		};
+
+		auto threads = std::vector<std::thread>{};
+		for (auto i = std::size_t{ 1 }; i < thread_count; ++i) {
+			threads.emplace_back(run);
+		}
+		run();
+		for (auto& thread : threads) {
+			thread.join();
+		}
+
+		if (exception) {
+			std::rethrow_exception(exception);
+		}
+	}
+
+	inline auto scan_embedded(const uint8_t* data, const std::size_t size, const scan_callback& callback) -> void {
+		scan_embedded(data, size, scan_options{}, callback);
+	}
+
+	// Ditto for the whole file at #path, which is memory-mapped rather than read. Returns the errno of a failed open/map, 0 on success.
+	inline auto scan_file(const std::string& path, const scan_options& options, const scan_callback& callback) -> int {
+		const auto file = detail::mapped_file(path);
+		if (file.error != 0) {
+			return file.error;
+		}
+		scan_embedded(file.data, file.size, options, callback);
+		return 0;
+	}
+
+	inline auto scan_file(const std::string& path, const scan_callback& callback) -> int {
+		return scan_file(path, scan_options{}, callback);
+	}
+
+} // inline namespace FILE_MIME_ABI_NAMESPACE
+} // namespace file_mime
+
+#endif // FILE_MIME_SCAN_H
@@ -0,0 +1,827 @@
+// MIT License
+//
+// Copyright(c) 2023 Lev Faynshteyn
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#ifndef FILE_MIME_SIGNATURE_COMPILER_H
+#define FILE_MIME_SIGNATURE_COMPILER_H
+
+#include "file_mime/signature_index.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+
+namespace file_mime {
+inline namespace FILE_MIME_ABI_NAMESPACE {
+
+	// One test of a pattern: the #value bytes have to be found at any offset within [#first_offset, #last_offset] of the file,
+	// compared under the #mask bytes if there are any (a zero mask byte matches any value).
+	struct signature_test {
+		std::uint32_t first_offset = 0;
+		std::uint32_t last_offset = 0;
+		std::vector<std::uint8_t> value;
+		std::vector<std::uint8_t> mask;
+	};
+
+	// A file matches a pattern if it passes all of its tests. When several patterns match, the one with the highest #priority
+	// (and then the one that comes first in the database) decides, as with the magic priorities of shared-mime-info.
+	struct signature_pattern {
+		std::uint32_t priority = 50;
+		std::vector<signature_test> tests;
+	};
+
+	// A type of a signature database: its mime type, its (lowercase) extensions, the first one being the canonical one, and its patterns.
+	struct signature_type {
+		std::string mime_type;
+		std::vector<std::string> extensions;
+		std::vector<signature_pattern> patterns;
+	};
+
+	using signature_database = std::vector<signature_type>;
+
+	namespace detail {
+
+		[[nodiscard]] inline auto find_or_add_type(signature_database& database, const std::string_view mime_type) -> signature_type& {
+			for (auto& type : database) {
+				if (type.mime_type == mime_type) {
+					return type;
+				}
+			}
+			database.push_back(signature_type{ std::string(mime_type), {}, {} });
+			return database.back();
+		}
+
+		inline auto add_extension(signature_type& type, const std::string_view extension) -> void {
+			if (extension.empty()) {
+				return;
+			}
+			auto lowercase = std::string(extension.size() + (extension[0] != '.' ? 1 : 0), '.');
+			std::transform(extension.begin(), extension.end(), lowercase.end() - std::ptrdiff_t(extension.size()), to_lower);
+			if (std::find(type.extensions.begin(), type.extensions.end(), lowercase) == type.extensions.end()) {
+				type.extensions.push_back(std::move(lowercase));
+			}
+		}
+
+		[[nodiscard]] inline auto hex_digit(const char c) noexcept -> int {
+			return (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+		}
+
+		// An unsigned number of the digits in #base, the whole string has to be a number.
+		[[nodiscard]] inline auto parse_digits(const std::string_view digits, const int base, std::uint64_t& number) noexcept -> bool {
+			if (digits.empty()) {
+				return false;
+			}
+			number = 0;
+			for (const auto c : digits) {
+				const auto digit = hex_digit(c);
+				if (digit < 0 || digit >= base || number > (std::uint64_t(-1) - std::uint64_t(digit)) / std::uint64_t(base)) {
+					return false;
+				}
+				number = number * std::uint64_t(base) + std::uint64_t(digit);
+			}
+			return true;
+		}
+
+		// An unsigned number in C notation (decimal, 0x hexadecimal or 0 octal).
+		[[nodiscard]] inline auto parse_number(const std::string_view text, std::uint64_t& number) noexcept -> bool {
+			if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+				return parse_digits(text.substr(2), 16, number);
+			}
+			if (text.size() > 1 && text[0] == '0') {
+				return parse_digits(text.substr(1), 8, number);
+			}
+			return parse_digits(text, 10, number);
+		}
+
+		// An offset "N" or an offset range "N:M" (shared-mime-info) / "N-M" (the text format).
+		[[nodiscard]] inline auto parse_offsets(const std::string_view text, const char range_separator, signature_test& test) noexcept -> bool {
+			const auto separator = text.find(range_separator);
+			auto first = std::uint64_t{ 0 };
+			auto last = std::uint64_t{ 0 };
+			if (!parse_number(text.substr(0, separator), first)) {
+				return false;
+			}
+			last = first;
+			if (separator != std::string_view::npos && !parse_number(text.substr(separator + 1), last)) {
+				return false;
+			}
+			if (first > last || last > std::uint32_t(-1)) {
+				return false;
+			}
+			test.first_offset = std::uint32_t(first);
+			test.last_offset = std::uint32_t(last);
+			return true;
+		}
+
+		[[nodiscard]] inline auto database_error(const std::size_t line, const std::string_view message) -> std::invalid_argument {
+			return std::invalid_argument("line " + std::to_string(line) + ": " + std::string(message));
+		}
+
+	} // namespace detail
+
+	// Parse the simple text format, one type per line (the lines of the same mime type are merged):
+	//
+	//     # comment
+	//     <mime type> <extensions, comma separated, or -> [<pattern> ...]
+	//     image/png .png 0:89504E470D0A1A0A
+	//     image/webp .webp 0:52494646????????57454250
+	//     video/mp4 .mp4,.m4v 4:6674797069736F6D 4:667479706D703431
+	//     application/x-foo - 80@0:464F4F&16-64:424152
+	//
+	// A pattern is an optional priority followed by '@' and the tests that all have to pass joined by '&'. A test is an offset (or an offset range "first-last")
+	// followed by ':' and the hexadecimal bytes to look for, with "??" for the bytes that may have any value. Throws std::invalid_argument on a malformed line.
+	[[nodiscard]] inline auto parse_signature_text(const std::string_view text) -> signature_database {
+		auto database = signature_database{};
+		auto line_number = std::size_t{ 0 };
+		for (auto position = std::size_t{ 0 }; position < text.size();) {
+			const auto end = std::min(text.find('\n', position), text.size());
+			auto line = text.substr(position, end - position);
+			position = end + 1;
+			++line_number;
+
+			line = line.substr(0, line.find('#'));
+			auto tokens = std::vector<std::string_view>{};
+			for (auto i = std::size_t{ 0 }; i < line.size();) {
+				const auto first = line.find_first_not_of(" \t\r", i);
+				if (first == std::string_view::npos) {
+					break;
+				}
+				const auto last = std::min(line.find_first_of(" \t\r", first), line.size());
+				tokens.push_back(line.substr(first, last - first));
+				i = last;
+			}
+			if (tokens.empty()) {
+				continue;
+			}
+			if (tokens.size() < 2) {
+				throw detail::database_error(line_number, "expected a mime type followed by its extensions");
+			}
+
+			auto& type = detail::find_or_add_type(database, tokens[0]);
+			if (tokens[1] != "-") {
+				for (auto i = std::size_t{ 0 }; i < tokens[1].size();) {
+					const auto comma = std::min(tokens[1].find(',', i), tokens[1].size());
+					if (comma == i) {
+						throw detail::database_error(line_number, "empty extension");
+					}
+					detail::add_extension(type, tokens[1].substr(i, comma - i));
+					i = comma + 1;
+				}
+			}
+
+			for (auto t = std::size_t{ 2 }; t < tokens.size(); ++t) {
+				auto pattern_text = tokens[t];
+				auto pattern = signature_pattern{};
+				const auto at = pattern_text.find('@');
+				if (at != std::string_view::npos) {
+					auto priority = std::uint64_t{ 0 };
+					if (!detail::parse_number(pattern_text.substr(0, at), priority) || priority > std::uint32_t(-1)) {
+						throw detail::database_error(line_number, "invalid priority");
+					}
+					pattern.priority = std::uint32_t(priority);
+					pattern_text.remove_prefix(at + 1);
+				}
+
+				for (auto i = std::size_t{ 0 }; i <= pattern_text.size();) {
+					const auto ampersand = std::min(pattern_text.find('&', i), pattern_text.size());
+					const auto test_text = pattern_text.substr(i, ampersand - i);
+					i = ampersand + 1;
+
+					auto test = signature_test{};
+					const auto colon = test_text.find(':');
+					if (colon == std::string_view::npos || !detail::parse_offsets(test_text.substr(0, colon), '-', test)) {
+						throw detail::database_error(line_number, "expected a test of the form offset:hex bytes");
+					}
+					const auto bytes = test_text.substr(colon + 1);
+					if (bytes.empty() || bytes.size() % 2 != 0) {
+						throw detail::database_error(line_number, "the bytes of a test have to be pairs of hexadecimal digits");
+					}
+					auto wildcards = false;
+					for (auto b = std::size_t{ 0 }; b < bytes.size(); b += 2) {
+						if (bytes[b] == '?' && bytes[b + 1] == '?') {
+							test.value.push_back(0);
+							test.mask.push_back(0);
+							wildcards = true;
+							continue;
+						}
+						const auto high = detail::hex_digit(bytes[b]);
+						const auto low = detail::hex_digit(bytes[b + 1]);
+						if (high < 0 || low < 0) {
+							throw detail::database_error(line_number, "the bytes of a test have to be pairs of hexadecimal digits");
+						}
+						test.value.push_back(std::uint8_t(high << 4 | low));
+						test.mask.push_back(0xFF);
+					}
+					if (!wildcards) {
+						test.mask.clear();
+					}
+					pattern.tests.push_back(std::move(test));
+				}
+				type.patterns.push_back(std::move(pattern));
+			}
+		}
+		return database;
+	}
+
+	namespace detail {
+
+		// A start, end or empty element tag of an XML document, with its attributes (the entities decoded).
+		struct xml_tag {
+			std::string_view name;
+			std::vector<std::pair<std::string_view, std::string>> attributes;
+			bool closing = false;
+			bool empty = false;
+
+			[[nodiscard]] auto attribute(const std::string_view attribute_name) const noexcept -> const std::string* {
+				for (const auto& attribute : attributes) {
+					if (attribute.first == attribute_name) {
+						return &attribute.second;
+					}
+				}
+				return nullptr;
+			}
+		};
+
+		inline auto append_utf8(std::string& text, const std::uint64_t code_point) -> void {
+			if (code_point < 0x80) {
+				text += char(code_point);
+			}
+			else if (code_point < 0x800) {
+				text += char(0xC0 | code_point >> 6);
+				text += char(0x80 | (code_point & 0x3F));
+			}
+			else if (code_point < 0x10000) {
+				text += char(0xE0 | code_point >> 12);
+				text += char(0x80 | (code_point >> 6 & 0x3F));
+				text += char(0x80 | (code_point & 0x3F));
+			}
+			else {
+				text += char(0xF0 | (code_point >> 18 & 0x07));
+				text += char(0x80 | (code_point >> 12 & 0x3F));
+				text += char(0x80 | (code_point >> 6 & 0x3F));
+				text += char(0x80 | (code_point & 0x3F));
+			}
+		}
+
+		// The code point of a character reference, e.g. "#x89" or "#137" without the '#'.
+		[[nodiscard]] inline auto code_point_valid(const std::string_view reference, std::uint64_t& code_point) noexcept -> bool {
+			const auto valid = (reference[0] == 'x' || reference[0] == 'X') ? parse_digits(reference.substr(1), 16, code_point) : parse_digits(reference, 10, code_point);
+			return valid && code_point <= 0x10FFFF;
+		}
+
+		[[nodiscard]] inline auto decode_xml_entities(const std::string_view text) -> std::string {
+			auto decoded = std::string{};
+			for (auto i = std::size_t{ 0 }; i < text.size(); ++i) {
+				const auto semicolon = text[i] == '&' ? text.find(';', i) : std::string_view::npos;
+				if (semicolon == std::string_view::npos) {
+					decoded += text[i];
+					continue;
+				}
+				const auto entity = text.substr(i + 1, semicolon - i - 1);
+				auto code_point = std::uint64_t{ 0 };
+				if (entity == "lt") {
+					decoded += '<';
+				}
+				else if (entity == "gt") {
+					decoded += '>';
+				}
+				else if (entity == "amp") {
+					decoded += '&';
+				}
+				else if (entity == "quot") {
+					decoded += '"';
+				}
+				else if (entity == "apos") {
+					decoded += '\'';
+				}
+				else if (entity.size() > 1 && entity[0] == '#' && code_point_valid(entity.substr(1), code_point)) {
+					append_utf8(decoded, code_point);
+				}
+				else {
+					decoded += text[i];
+					continue;
+				}
+				i = semicolon;
+			}
+			return decoded;
+		}
+
+		// A minimal pull reader of the element tags of an XML document: the text, the comments, the processing instructions and the declarations are skipped.
+		class xml_reader {
+		public:
+			explicit xml_reader(const std::string_view text) noexcept : text_(text) {}
+
+			// The next tag, or false at the end of the document. Throws std::invalid_argument on a malformed tag.
+			auto next(xml_tag& tag) -> bool {
+				for (;;) {
+					const auto open = text_.find('<', position_);
+					if (open == std::string_view::npos) {
+						return false;
+					}
+					position_ = open;
+					if (skip("<!--", "-->") || skip("<![CDATA[", "]]>") || skip("<?", "?>") || skip("<!", ">")) {
+						continue;
+					}
+					break;
+				}
+
+				const auto close = text_.find('>', position_);
+				if (close == std::string_view::npos) {
+					throw database_error(line(), "unterminated tag");
+				}
+				auto body = text_.substr(position_ + 1, close - position_ - 1);
+				const auto tag_position = position_;
+				position_ = close + 1;
+
+				tag = xml_tag{};
+				tag.closing = !body.empty() && body.front() == '/';
+				tag.empty = !body.empty() && body.back() == '/';
+				body = body.substr(tag.closing ? 1 : 0, body.size() - (tag.closing ? 1 : 0) - (tag.empty ? 1 : 0));
+
+				const auto name_end = std::min(body.find_first_of(" \t\r\n"), body.size());
+				tag.name = body.substr(0, name_end);
+				for (auto i = name_end; i < body.size();) {
+					const auto name_first = body.find_first_not_of(" \t\r\n", i);
+					if (name_first == std::string_view::npos) {
+						break;
+					}
+					const auto equals = body.find('=', name_first);
+					const auto quote_first = (equals == std::string_view::npos) ? std::string_view::npos : body.find_first_of("\"'", equals);
+					const auto quote_last = (quote_first == std::string_view::npos) ? std::string_view::npos : body.find(body[quote_first], quote_first + 1);
+					if (quote_last == std::string_view::npos) {
+						throw database_error(line(tag_position), "malformed attribute");
+					}
+					auto name = body.substr(name_first, equals - name_first);
+					name = name.substr(0, name.find_last_not_of(" \t\r\n") + 1);
+					tag.attributes.emplace_back(name, decode_xml_entities(body.substr(quote_first + 1, quote_last - quote_first - 1)));
+					i = quote_last + 1;
+				}
+				return true;
+			}
+
+			// The line of the current position, for the error messages.
+			[[nodiscard]] auto line() const noexcept -> std::size_t {
+				return line(position_);
+			}
+
+		private:
+			[[nodiscard]] auto line(const std::size_t position) const noexcept -> std::size_t {
+				return std::size_t(std::count(text_.begin(), text_.begin() + std::ptrdiff_t(position), '\n')) + 1;
+			}
+
+			auto skip(const std::string_view open, const std::string_view close) -> bool {
+				if (text_.substr(position_, open.size()) != open) {
+					return false;
+				}
+				const auto end = text_.find(close, position_ + open.size());
+				if (end == std::string_view::npos) {
+					throw database_error(line(), "unterminated markup");
+				}
+				position_ = end + close.size();
+				return true;
+			}
+
+			std::string_view text_;
+			std::size_t position_ = 0;
+		};
+
+		// The bytes of a string value of shared-mime-info, with its C style escapes.
+		[[nodiscard]] inline auto unescape_string(const std::string_view text, std::vector<std::uint8_t>& bytes) noexcept -> bool {
+			for (auto i = std::size_t{ 0 }; i < text.size(); ++i) {
+				if (text[i] != '\\') {
+					bytes.push_back(std::uint8_t(text[i]));
+					continue;
+				}
+				if (++i == text.size()) {
+					return false;
+				}
+				const auto c = text[i];
+				if (c == 'x') {
+					auto value = 0;
+					auto digits = 0;
+					for (; digits < 2 && i + 1 < text.size() && hex_digit(text[i + 1]) >= 0; ++digits) {
+						value = value * 16 + hex_digit(text[++i]);
+					}
+					if (digits == 0) {
+						return false;
+					}
+					bytes.push_back(std::uint8_t(value));
+				}
+				else if (c >= '0' && c <= '7') {
+					auto value = c - '0';
+					for (auto digits = 1; digits < 3 && i + 1 < text.size() && text[i + 1] >= '0' && text[i + 1] <= '7'; ++digits) {
+						value = value * 8 + (text[++i] - '0');
+					}
+					bytes.push_back(std::uint8_t(value));
+				}
+				else {
+					bytes.push_back(std::uint8_t(c == 'n' ? '\n' : c == 'r' ? '\r' : c == 't' ? '\t' : c));
+				}
+			}
+			return !bytes.empty();
+		}
+
+		// The bytes of a number of #size bytes in big or little endian order.
+		[[nodiscard]] inline auto number_bytes(const std::uint64_t number, const std::size_t size, const bool big_endian) -> std::vector<std::uint8_t> {
+			auto bytes = std::vector<std::uint8_t>(size);
+			for (auto i = std::size_t{ 0 }; i < size; ++i) {
+				bytes[big_endian ? size - 1 - i : i] = std::uint8_t(number >> (8 * i));
+			}
+			return bytes;
+		}
+
+		// The test of a shared-mime-info match element, or false for the types of match that aren't supported.
+		[[nodiscard]] inline auto parse_match(const xml_tag& tag, signature_test& test) -> bool {
+			const auto* type = tag.attribute("type");
+			const auto* value = tag.attribute("value");
+			const auto* offset = tag.attribute("offset");
+			const auto* mask = tag.attribute("mask");
+			if (type == nullptr || value == nullptr || offset == nullptr || !parse_offsets(*offset, ':', test)) {
+				return false;
+			}
+
+			if (*type == "string") {
+				if (!unescape_string(*value, test.value)) {
+					return false;
+				}
+				if (mask != nullptr) {
+					// A hexadecimal string of the mask bytes
+					auto digits = std::string_view(*mask);
+					if (digits.size() < 2 || digits[0] != '0' || (digits[1] != 'x' && digits[1] != 'X') || digits.size() % 2 != 0 || (digits.size() - 2) / 2 != test.value.size()) {
+						return false;
+					}
+					for (auto i = std::size_t{ 2 }; i < digits.size(); i += 2) {
+						const auto high = hex_digit(digits[i]);
+						const auto low = hex_digit(digits[i + 1]);
+						if (high < 0 || low < 0) {
+							return false;
+						}
+						test.mask.push_back(std::uint8_t(high << 4 | low));
+					}
+				}
+				return true;
+			}
+
+			auto size = std::size_t{ 0 };
+			auto big_endian = false;
+			if (*type == "byte") {
+				size = 1;
+			}
+			else if (*type == "big16" || *type == "little16" || *type == "host16") {
+				size = 2;
+				big_endian = (*type == "big16");
+			}
+			else if (*type == "big32" || *type == "little32" || *type == "host32") {
+				size = 4;
+				big_endian = (*type == "big32");
+			}
+			else {
+				return false;
+			}
+
+			// The host order matches are taken as little endian, the order of all the common hosts
+			auto number = std::uint64_t{ 0 };
+			if (!parse_number(*value, number) || (size < 8 && number >> (8 * size) != 0)) {
+				return false;
+			}
+			test.value = number_bytes(number, size, big_endian);
+			if (mask != nullptr) {
+				auto mask_number = std::uint64_t{ 0 };
+				if (!parse_number(*mask, mask_number)) {
+					return false;
+				}
+				test.mask = number_bytes(mask_number, size, big_endian);
+			}
+			return true;
+		}
+
+	} // namespace detail
+
+	// Parse a freedesktop.org shared-mime-info database (e.g. /usr/share/mime/packages/freedesktop.org.xml): the mime-type elements with their "*.ext" globs and magic matches.
+	// A match with nested matches is taken as the alternatives of the match followed by one of its children, as in shared-mime-info, so every path from a top level match
+	// to a match without children becomes a pattern. The matches of an unsupported type (and the matches nested in them) are left out, along with the globs that aren't a plain extension.
+	// Throws std::invalid_argument on malformed XML.
+	[[nodiscard]] inline auto parse_shared_mime_info(const std::string_view xml) -> signature_database {
+		auto database = signature_database{};
+		auto reader = detail::xml_reader{ xml };
+		auto tag = detail::xml_tag{};
+
+		auto* type = static_cast<signature_type*>(nullptr);
+		auto priority = std::uint32_t{ 50 };
+		// The matches enclosing the current one, whether each of them has children and how many of them are unsupported
+		auto matches = std::vector<signature_test>{};
+		auto has_children = std::vector<bool>{};
+		auto unsupported = std::size_t{ 0 };
+
+		while (reader.next(tag)) {
+			if (tag.name == "mime-type") {
+				if (tag.closing) {
+					type = nullptr;
+					continue;
+				}
+				const auto* name = tag.attribute("type");
+				if (name == nullptr || name->empty()) {
+					throw detail::database_error(reader.line(), "mime-type without a type");
+				}
+				// The pointer is valid until the end of the element, no other type is added meanwhile
+				type = &detail::find_or_add_type(database, *name);
+			}
+			else if (type == nullptr) {
+				continue;
+			}
+			else if (tag.name == "glob" && !tag.closing) {
+				const auto* pattern = tag.attribute("pattern");
+				if (pattern != nullptr && pattern->size() > 2 && pattern->compare(0, 2, "*.") == 0 && pattern->find_first_of("*?[", 1) == std::string::npos) {
+					detail::add_extension(*type, std::string_view(*pattern).substr(1));
+				}
+			}
+			else if (tag.name == "magic" && !tag.closing) {
+				const auto* value = tag.attribute("priority");
+				auto number = std::uint64_t{ 50 };
+				if (value != nullptr && (!detail::parse_number(*value, number) || number > std::uint32_t(-1))) {
+					throw detail::database_error(reader.line(), "invalid magic priority");
+				}
+				priority = std::uint32_t(number);
+			}
+			else if (tag.name == "match") {
+				if (!tag.closing) {
+					if (!has_children.empty()) {
+						has_children.back() = true;
+					}
+					auto test = signature_test{};
+					if (unsupported != 0 || !detail::parse_match(tag, test)) {
+						++unsupported;
+						test = signature_test{};
+					}
+					matches.push_back(std::move(test));
+					has_children.push_back(false);
+					if (!tag.empty) {
+						continue;
+					}
+				}
+				if (matches.empty()) {
+					throw detail::database_error(reader.line(), "unbalanced match element");
+				}
+				// The end of a match: the matches without children end a pattern
+				if (matches.back().value.empty()) {
+					--unsupported;
+				}
+				else if (!has_children.back() && unsupported == 0) {
+					type->patterns.push_back(signature_pattern{ priority, matches });
+				}
+				matches.pop_back();
+				has_children.pop_back();
+			}
+		}
+		return database;
+	}
+
+	// The database of the #magic_signatures registry and the extensions of the built-in mime types, which compiles into an index that classifies like get_id_deep.
+	// The magic numbers at the start of the file get a higher priority than the ones at an offset, which keep the order of their offsets.
+	[[nodiscard]] inline auto builtin_signature_database() -> signature_database {
+		auto database = signature_database{};
+		for (const auto& info : detail::mime_types) {
+			if (info.id == mime_id::unknown) {
+				continue;
+			}
+			auto& type = detail::find_or_add_type(database, info.mime_type);
+			detail::add_extension(type, info.extension);
+			for (const auto& extension : detail::extensions) {
+				if (extension.id == info.id) {
+					detail::add_extension(type, extension.extension);
+				}
+			}
+		}
+
+		auto patterns = std::vector<std::pair<mime_id, signature_pattern>>{};
+		const auto add = [&patterns](const magic_signature& signature, const std::uint32_t priority) {
+			auto test = signature_test{ signature.offset, signature.offset, {}, {} };
+			test.value.assign(signature.pattern.begin(), signature.pattern.begin() + std::ptrdiff_t(signature.size));
+			if (signature.prefix_size != signature.size) {
+				test.mask.assign(signature.mask.begin(), signature.mask.begin() + std::ptrdiff_t(signature.size));
+			}
+			patterns.emplace_back(signature.id, signature_pattern{ priority, { std::move(test) } });
+		};
+		for (const auto& signature : detail::anchored_signatures) {
+			add(signature, 60);
+		}
+		for (auto i = std::size_t{ 0 }; i < detail::offset_signatures.size(); ++i) {
+			add(detail::offset_signatures[i], std::uint32_t(50 - std::min<std::size_t>(i, 49)));
+		}
+		for (auto& pattern : patterns) {
+			detail::find_or_add_type(database, get_type_from_id(pattern.first)).patterns.push_back(std::move(pattern.second));
+		}
+		return database;
+	}
+
+	// Compile a signature database into the binary index read by file_mime::signature_index. Throws std::invalid_argument if a test is empty,
+	// if its mask doesn't have one byte per value byte, or if the index would outgrow the 32 bit offsets.
+	[[nodiscard]] inline auto compile_signature_index(const signature_database& database) -> std::vector<std::uint8_t> {
+		auto strings = std::vector<std::uint8_t>{};
+		const auto add_string = [&strings](const void* data, const std::size_t size) {
+			const auto offset = strings.size();
+			strings.insert(strings.end(), static_cast<const std::uint8_t*>(data), static_cast<const std::uint8_t*>(data) + size);
+			return std::uint32_t(offset);
+		};
+
+		auto types = std::vector<detail::index_type_entry>{};
+		for (const auto& type : database) {
+			const auto& extension = type.extensions.empty() ? std::string{} : type.extensions.front();
+			types.push_back(detail::index_type_entry{ add_string(type.mime_type.data(), type.mime_type.size()), std::uint32_t(type.mime_type.size()), add_string(extension.data(), extension.size()), std::uint32_t(extension.size()) });
+		}
+
+		// The patterns ranked by their priority and then by their order in the database
+		struct pattern_ref {
+			index_type type;
+			const signature_pattern* pattern;
+			std::uint32_t rank;
+			int first_byte; // the first byte of a test at offset 0 that is compared in full, -1 if there is none
+		};
+		auto patterns = std::vector<pattern_ref>{};
+		for (auto t = std::size_t{ 0 }; t < database.size(); ++t) {
+			for (const auto& pattern : database[t].patterns) {
+				auto first_byte = -1;
+				for (const auto& test : pattern.tests) {
+					if (test.value.empty() || test.value.size() > 0xFFFF || (!test.mask.empty() && test.mask.size() != test.value.size()) || test.first_offset > test.last_offset) {
+						throw std::invalid_argument("Invalid test of a " + database[t].mime_type + " pattern");
+					}
+					if (first_byte < 0 && test.last_offset == 0 && (test.mask.empty() || test.mask[0] == 0xFF)) {
+						first_byte = test.value[0];
+					}
+				}
+				if (pattern.tests.empty()) {
+					throw std::invalid_argument("A " + database[t].mime_type + " pattern without tests");
+				}
+				patterns.push_back(pattern_ref{ index_type(t), &pattern, 0, first_byte });
+			}
+		}
+		std::stable_sort(patterns.begin(), patterns.end(), [](const pattern_ref& a, const pattern_ref& b) {
+			return a.pattern->priority > b.pattern->priority;
+		});
+		for (auto i = std::size_t{ 0 }; i < patterns.size(); ++i) {
+			patterns[i].rank = std::uint32_t(i);
+		}
+
+		// The anchored rows bucketed by their first byte go first, the rest follow in rank order
+		std::stable_sort(patterns.begin(), patterns.end(), [](const pattern_ref& a, const pattern_ref& b) {
+			return (a.first_byte < 0 ? 256 : a.first_byte) < (b.first_byte < 0 ? 256 : b.first_byte);
+		});
+		auto rows = std::vector<detail::index_row>{};
+		auto tests = std::vector<detail::index_test>{};
+		auto buckets = std::vector<std::uint32_t>(257);
+		auto anchored_row_count = std::uint32_t{ 0 };
+		auto max_read_size = std::uint64_t{ 0 };
+		for (const auto& pattern : patterns) {
+			rows.push_back(detail::index_row{ pattern.type, pattern.rank, std::uint32_t(tests.size()), std::uint32_t(pattern.pattern->tests.size()) });
+			if (pattern.first_byte >= 0) {
+				++buckets[std::size_t(pattern.first_byte) + 1];
+				++anchored_row_count;
+			}
+
+			// The anchored test goes first, it is the cheapest to reject
+			const auto& pattern_tests = pattern.pattern->tests;
+			const auto anchored = std::find_if(pattern_tests.begin(), pattern_tests.end(), [](const signature_test& test) {
+				return test.last_offset == 0 && (test.mask.empty() || test.mask[0] == 0xFF);
+			});
+			const auto first_test = tests.size();
+			for (const auto& test : pattern_tests) {
+				const auto value = add_string(test.value.data(), test.value.size());
+				if (!test.mask.empty()) {
+					add_string(test.mask.data(), test.mask.size());
+				}
+				tests.push_back(detail::index_test{ test.first_offset, test.last_offset, value, std::uint16_t(test.value.size()), std::uint16_t(test.mask.empty() ? 0 : 1) });
+				max_read_size = std::max(max_read_size, std::uint64_t{ test.last_offset } + test.value.size());
+			}
+			if (pattern.first_byte >= 0) {
+				std::swap(tests[first_test], tests[first_test + std::size_t(anchored - pattern_tests.begin())]);
+			}
+		}
+		for (auto b = std::size_t{ 0 }; b < 256; ++b) {
+			buckets[b + 1] += buckets[b];
+		}
+
+		// The extension perfect hash, an extension claimed by several types goes to the first one
+		auto keys = std::vector<std::pair<std::string, index_type>>{};
+		for (auto t = std::size_t{ 0 }; t < database.size(); ++t) {
+			for (const auto& extension : database[t].extensions) {
+				auto lowercase = extension;
+				std::transform(lowercase.begin(), lowercase.end(), lowercase.begin(), detail::to_lower);
+				if (std::find_if(keys.begin(), keys.end(), [&lowercase](const auto& key) { return key.first == lowercase; }) == keys.end()) {
+					keys.emplace_back(std::move(lowercase), index_type(t));
+				}
+			}
+		}
+		const auto slot_count = keys.size();
+		auto displacements = std::vector<std::uint32_t>(slot_count);
+		auto extensions = std::vector<detail::index_extension>(slot_count);
+		if (slot_count != 0) {
+			auto bucket_keys = std::vector<std::vector<std::size_t>>(slot_count);
+			for (auto k = std::size_t{ 0 }; k < keys.size(); ++k) {
+				bucket_keys[detail::hash_bucket(detail::folded_key(keys[k].first), slot_count)].push_back(k);
+			}
+			auto order = std::vector<std::size_t>(slot_count);
+			for (auto b = std::size_t{ 0 }; b < slot_count; ++b) {
+				order[b] = b;
+			}
+			// The largest buckets are the hardest to place, so they go first
+			std::stable_sort(order.begin(), order.end(), [&bucket_keys](const std::size_t a, const std::size_t b) {
+				return bucket_keys[a].size() > bucket_keys[b].size();
+			});
+			auto occupied = std::vector<bool>(slot_count);
+			auto taken = std::vector<std::size_t>{};
+			for (const auto bucket : order) {
+				if (bucket_keys[bucket].empty()) {
+					break;
+				}
+				auto displacement = std::uint32_t{ 0 };
+				for (;; ++displacement) {
+					if (displacement == std::uint32_t(-1)) {
+						throw std::invalid_argument("Couldn't build a perfect hash of the extensions");
+					}
+					taken.clear();
+					for (const auto k : bucket_keys[bucket]) {
+						const auto slot = detail::hash_slot(detail::folded_key(keys[k].first), displacement, slot_count);
+						if (occupied[slot] || std::find(taken.begin(), taken.end(), slot) != taken.end()) {
+							break;
+						}
+						taken.push_back(slot);
+					}
+					if (taken.size() == bucket_keys[bucket].size()) {
+						break;
+					}
+				}
+				displacements[bucket] = displacement;
+				for (auto i = std::size_t{ 0 }; i < taken.size(); ++i) {
+					const auto& key = keys[bucket_keys[bucket][i]];
+					occupied[taken[i]] = true;
+					extensions[taken[i]] = detail::index_extension{ add_string(key.first.data(), key.first.size()), std::uint32_t(key.first.size()), key.second };
+				}
+			}
+		}
+
+		// The sections, each one 4 byte aligned, after the header
+		auto header = detail::index_header{};
+		auto size = std::uint64_t{ sizeof(detail::index_header) };
+		const auto place = [&size](detail::index_section& section, const std::size_t count, const std::size_t element_size) {
+			size = (size + 3) & ~std::uint64_t{ 3 };
+			section = detail::index_section{ std::uint32_t(size), std::uint32_t(count) };
+			size += std::uint64_t{ count } * element_size;
+		};
+		place(header.types, types.size(), sizeof(detail::index_type_entry));
+		place(header.rows, rows.size(), sizeof(detail::index_row));
+		place(header.tests, tests.size(), sizeof(detail::index_test));
+		place(header.buckets, buckets.size(), sizeof(std::uint32_t));
+		place(header.displacements, displacements.size(), sizeof(std::uint32_t));
+		place(header.extensions, extensions.size(), sizeof(detail::index_extension));
+		place(header.strings, strings.size(), 1);
+		size = (size + 3) & ~std::uint64_t{ 3 };
+		if (size > std::uint32_t(-1) || max_read_size > std::uint32_t(-1)) {
+			throw std::invalid_argument("The signature index doesn't fit 32 bit offsets");
+		}
+		header.file_size = std::uint32_t(size);
+		header.max_read_size = std::uint32_t(max_read_size);
+		header.anchored_row_count = anchored_row_count;
+
+		auto index = std::vector<std::uint8_t>(std::size_t(size));
+		const auto write = [&index](const detail::index_section& section, const void* data, const std::size_t bytes) {
+			if (bytes != 0) {
+				std::memcpy(index.data() + section.offset, data, bytes);
+			}
+		};
+		std::memcpy(index.data(), &header, sizeof(header));
+		write(header.types, types.data(), types.size() * sizeof(detail::index_type_entry));
+		write(header.rows, rows.data(), rows.size() * sizeof(detail::index_row));
+		write(header.tests, tests.data(), tests.size() * sizeof(detail::index_test));
+		write(header.buckets, buckets.data(), buckets.size() * sizeof(std::uint32_t));
+		write(header.displacements, displacements.data(), displacements.size() * sizeof(std::uint32_t));
+		write(header.extensions, extensions.data(), extensions.size() * sizeof(detail::index_extension));
+		write(header.strings, strings.data(), strings.size());
+		return index;
+	}
+
+} // inline namespace FILE_MIME_ABI_NAMESPACE
+} // namespace file_mime
+
+#endif // FILE_MIME_SIGNATURE_COMPILER_H
@@ -0,0 +1,338 @@
+// MIT License
+//
+// Copyright(c) 2023 Lev Faynshteyn
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#ifndef FILE_MIME_SIGNATURE_INDEX_H
+#define FILE_MIME_SIGNATURE_INDEX_H
+
+#include "file_mime/file_mime.h"
+#include "file_mime/scan.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+
+namespace file_mime {
+inline namespace FILE_MIME_ABI_NAMESPACE {
+
+	// A type of a signature index: the position of its mime type in the index, or #no_index_type.
+	using index_type = std::uint32_t;
+
+	inline constexpr auto no_index_type = ~index_type{ 0 };
+
+	// The type of a file classified with a signature index along with the errno of a failed open/read, 0 on success.
+	struct index_file_result {
+		index_type type = no_index_type;
+		int error = 0;
+	};
+
+	namespace detail {
+
+		// The binary layout of a signature index, as written by file_mime::compile_signature_index (see signature_compiler.h).
+		// All the fields are 32 bit (or 16 bit) integers in the byte order of the machine that wrote the index, and every section is 4 byte aligned,
+		// so the mapped file is used as is: the sections are arrays of the structs below at the offsets given by the header.
+		inline constexpr auto index_magic = std::array<char, 8>{ 'F', 'M', 'I', 'M', 'E', 'I', 'D', 'X' };
+		inline constexpr auto index_version = std::uint32_t{ 1u };
+		inline constexpr auto index_byte_order = std::uint32_t{ 0x01020304u };
+
+		// #count elements starting #offset bytes into the index.
+		struct index_section {
+			std::uint32_t offset = 0;
+			std::uint32_t count = 0;
+		};
+
+		struct index_header {
+			std::array<char, 8> magic = index_magic;
+			std::uint32_t version = index_version;
+			std::uint32_t byte_order = index_byte_order;
+			std::uint32_t file_size = 0;
+			std::uint32_t max_read_size = 0; // the most bytes from the start of a file any pattern looks at
+			std::uint32_t anchored_row_count = 0; // the rows before it are bucketed by their first byte, the ones after it are checked in rank order
+			std::uint32_t reserved = 0;
+			index_section types; // index_type_entry, indexed by index_type
+			index_section rows; // index_row
+			index_section tests; // index_test
+			index_section buckets; // 257 uint32: rows[buckets[b], buckets[b + 1]) are the anchored rows whose first byte is b, in rank order
+			index_section displacements; // uint32 per bucket of the extension perfect hash
+			index_section extensions; // index_extension slots of the extension perfect hash
+			index_section strings; // the mime types, the extensions and the pattern bytes
+		};
+
+		// The mime type and the canonical extension of a type, as offsets into the strings.
+		struct index_type_entry {
+			std::uint32_t name = 0;
+			std::uint32_t name_size = 0;
+			std::uint32_t extension = 0;
+			std::uint32_t extension_size = 0;
+		};
+
+		// A pattern: the type of a file whose bytes pass all of the tests[#first_test, #first_test + #test_count).
+		// The pattern with the lowest #rank that matches decides, the ranks order the patterns by their priority and then by their order in the database.
+		struct index_row {
+			std::uint32_t type = 0;
+			std::uint32_t rank = 0;
+			std::uint32_t first_test = 0;
+			std::uint32_t test_count = 0;
+		};
+
+		// The #size bytes at #value in the strings have to be found at any offset within [#first_offset, #last_offset] of the file,
+		// compared under the #size bytes of mask right after them if #has_mask.
+		struct index_test {
+			std::uint32_t first_offset = 0;
+			std::uint32_t last_offset = 0;
+			std::uint32_t value = 0;
+			std::uint16_t size = 0;
+			std::uint16_t has_mask = 0;
+		};
+
+		struct index_extension {
+			std::uint32_t key = 0;
+			std::uint32_t key_size = 0;
+			index_type type = no_index_type;
+		};
+
+		// Check that the #count elements of #element_size bytes of a section lie within the #size bytes of the index.
+		[[nodiscard]] inline auto section_fits(const index_section& section, const std::size_t element_size, const std::size_t size) noexcept -> bool {
+			return section.offset % alignof(std::uint32_t) == 0 && section.offset <= size && std::uint64_t{ section.count } * element_size <= size - section.offset;
+		}
+
+	} // namespace detail
+
+	// A signature database compiled into a binary index (with file_mime::compile_signature_index or the file_mime_compile tool), classified from directly:
+	// opening an index is a single mmap plus a check of its header, and the pages are shared by all the processes that map the same file.
+	// The index is trusted to come from the compiler: only the header and the section bounds are checked when it is opened.
+	class signature_index {
+	public:
+		// Map the index file at #path, check #error afterwards.
+		explicit signature_index(const std::string& path) : file_(std::make_unique<detail::mapped_file>(path)) {
+			if (file_->error != 0) {
+				error_ = file_->error;
+				return;
+			}
+			attach(file_->data, file_->size);
+		}
+
+		// Use an index already in memory, which has to outlive this object and be 4 byte aligned.
+		signature_index(const uint8_t* data, const std::size_t size) {
+			attach(data, size);
+		}
+
+		// 0 once the index is usable, or the errno of the failed mapping (EINVAL if the file isn't a valid index).
+		[[nodiscard]] auto error() const noexcept -> int {
+			return error_;
+		}
+
+		[[nodiscard]] auto type_count() const noexcept -> std::size_t {
+			return header_ != nullptr ? header_->types.count : 0;
+		}
+
+		// The mime type and the canonical extension of a type, empty for #no_index_type.
+		[[nodiscard]] auto mime_type(const index_type type) const noexcept -> std::string_view {
+			return type < type_count() ? string(types_[type].name, types_[type].name_size) : std::string_view{};
+		}
+
+		[[nodiscard]] auto extension(const index_type type) const noexcept -> std::string_view {
+			return type < type_count() ? string(types_[type].extension, types_[type].extension_size) : std::string_view{};
+		}
+
+		// The type of a mime type, e.g. "image/png", or #no_index_type. A linear search, meant for setting up rather than for the hot path.
+		[[nodiscard]] auto find_type(const std::string_view mime_type) const noexcept -> index_type {
+			for (auto type = index_type{ 0 }; type < type_count(); ++type) {
+				if (this->mime_type(type) == mime_type) {
+					return type;
+				}
+			}
+			return no_index_type;
+		}
+
+		// The type of a (case insensitive) file extension, e.g. ".JPEG": a single probe of the perfect hash and a comparison.
+		[[nodiscard]] auto get_type_from_extension(const std::string_view extension) const noexcept -> index_type {
+			const auto bucket_count = header_ != nullptr ? header_->displacements.count : 0;
+			if (bucket_count == 0) {
+				return no_index_type;
+			}
+			const auto key = detail::folded_key(extension);
+			const auto& slot = extensions_[detail::hash_slot(key, displacements_[detail::hash_bucket(key, bucket_count)], header_->extensions.count)];
+			return detail::equals_lowercase(extension, string(slot.key, slot.key_size)) ? slot.type : no_index_type;
+		}
+
+		[[nodiscard]] auto get_type_shallow(const std::string_view path_to_file) const noexcept -> index_type {
+			return get_type_from_extension(detail::path_extension(path_to_file));
+		}
+
+		// The type of a file from its raw in-memory bytes, or #no_index_type. The bytes beyond #max_read_size are never looked at.
+		[[nodiscard]] auto get_type_deep(const uint8_t* file_bytes, const std::size_t file_size) const noexcept -> index_type {
+			if (header_ == nullptr || file_size == 0) {
+				return no_index_type;
+			}
+
+			auto best = static_cast<const detail::index_row*>(nullptr);
+			for (auto i = buckets_[file_bytes[0]]; i < buckets_[file_bytes[0] + 1]; ++i) {
+				if (row_matches(rows_[i], file_bytes, file_size)) {
+					best = &rows_[i];
+					break;
+				}
+			}
+
+			// The rest of the rows are in rank order, only the ones ranked before the anchored match can beat it
+			for (auto i = header_->anchored_row_count; i < header_->rows.count; ++i) {
+				const auto& row = rows_[i];
+				if (best != nullptr && row.rank > best->rank) {
+					break;
+				}
+				if (row_matches(row, file_bytes, file_size)) {
+					best = &row;
+					break;
+				}
+			}
+
+			return best != nullptr ? best->type : no_index_type;
+		}
+
+		// The most bytes from the start of a file that #get_type_deep looks at.
+		[[nodiscard]] auto max_read_size() const noexcept -> std::size_t {
+			return header_ != nullptr ? header_->max_read_size : 0;
+		}
+
+		// The type of a file from its content, falling back to its extension if it can't be opened or read or has no known pattern.
+		// The first #max_read_size bytes (but no more than #max_file_read_size) are read with a single read into #buffer, which is kept for the next calls.
+		[[nodiscard]] auto get_type_from_file(const std::string_view path_to_file, std::vector<uint8_t>& buffer) const -> index_file_result {
+			const auto type = get_type_shallow(path_to_file);
+
+			auto path = std::array<char, detail::max_path_size>{};
+			if (path_to_file.size() >= path.size()) {
+				return index_file_result{ type, ENAMETOOLONG };
+			}
+			std::memcpy(path.data(), path_to_file.data(), path_to_file.size());
+
+			auto timing = detail::file_timing{};
+			const auto fd = detail::open_read_only(path.data());
+			const auto open_error = errno;
+			detail::count_syscall();
+			if (fd < 0) {
+				return index_file_result{ type, open_error };
+			}
+
+			buffer.resize(std::min(max_read_size(), max_file_read_size));
+			const auto read = detail::read_at(fd, buffer.data(), buffer.size(), 0);
+			detail::count_syscall(read);
+			detail::close_file(fd);
+			detail::count_syscall();
+			timing.io = detail::stats_now() - timing.start;
+			if (read < 0) {
+				return index_file_result{ type, int(-read) };
+			}
+
+			const auto content_type = get_type_deep(buffer.data(), std::size_t(read));
+			detail::count_file(detail::stats_now() - timing.start, timing.io);
+			return index_file_result{ content_type != no_index_type ? content_type : type, 0 };
+		}
+
+		// The cap on the bytes read by #get_type_from_file, the patterns that look further are only checked against the bytes passed to #get_type_deep.
+		static constexpr auto max_file_read_size = std::size_t{ 1u } << 16;
+
+	private:
+		auto attach(const uint8_t* data, const std::size_t size) noexcept -> void {
+			error_ = EINVAL;
+			if (data == nullptr || size < sizeof(detail::index_header) || reinterpret_cast<std::uintptr_t>(data) % alignof(detail::index_header) != 0) {
+				return;
+			}
+			const auto* header = reinterpret_cast<const detail::index_header*>(data);
+			if (header->magic != detail::index_magic || header->version != detail::index_version || header->byte_order != detail::index_byte_order || header->file_size != size) {
+				return;
+			}
+			if (!detail::section_fits(header->types, sizeof(detail::index_type_entry), size) || !detail::section_fits(header->rows, sizeof(detail::index_row), size)
+				|| !detail::section_fits(header->tests, sizeof(detail::index_test), size) || !detail::section_fits(header->buckets, sizeof(std::uint32_t), size)
+				|| !detail::section_fits(header->displacements, sizeof(std::uint32_t), size) || !detail::section_fits(header->extensions, sizeof(detail::index_extension), size)
+				|| !detail::section_fits(header->strings, 1, size) || header->buckets.count != 257 || header->anchored_row_count > header->rows.count
+				|| (header->displacements.count != 0 && header->extensions.count == 0)) {
+				return;
+			}
+
+			header_ = header;
+			types_ = reinterpret_cast<const detail::index_type_entry*>(data + header->types.offset);
+			rows_ = reinterpret_cast<const detail::index_row*>(data + header->rows.offset);
+			tests_ = reinterpret_cast<const detail::index_test*>(data + header->tests.offset);
+			buckets_ = reinterpret_cast<const std::uint32_t*>(data + header->buckets.offset);
+			displacements_ = reinterpret_cast<const std::uint32_t*>(data + header->displacements.offset);
+			extensions_ = reinterpret_cast<const detail::index_extension*>(data + header->extensions.offset);
+			strings_ = reinterpret_cast<const char*>(data + header->strings.offset);
+			error_ = 0;
+		}
+
+		[[nodiscard]] auto string(const std::uint32_t offset, const std::uint32_t size) const noexcept -> std::string_view {
+			return std::string_view(strings_ + offset, size);
+		}
+
+		[[nodiscard]] auto test_matches(const detail::index_test& test, const uint8_t* file_bytes, const std::size_t file_size) const noexcept -> bool {
+			const auto* value = reinterpret_cast<const uint8_t*>(strings_ + test.value);
+			if (test.size > file_size || test.first_offset > file_size - test.size) {
+				return false;
+			}
+			const auto last_offset = std::min<std::size_t>(test.last_offset, file_size - test.size);
+			for (auto offset = std::size_t{ test.first_offset }; offset <= last_offset; ++offset) {
+				const auto* bytes = file_bytes + offset;
+				if (!test.has_mask) {
+					if (bytes[0] == value[0] && std::memcmp(bytes, value, test.size) == 0) {
+						return true;
+					}
+					continue;
+				}
+				const auto* mask = value + test.size;
+				auto i = std::size_t{ 0 };
+				while (i < test.size && ((bytes[i] ^ value[i]) & mask[i]) == 0) {
+					++i;
+				}
+				if (i == test.size) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		[[nodiscard]] auto row_matches(const detail::index_row& row, const uint8_t* file_bytes, const std::size_t file_size) const noexcept -> bool {
+			for (auto i = row.first_test; i < row.first_test + row.test_count; ++i) {
+				if (!test_matches(tests_[i], file_bytes, file_size)) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		std::unique_ptr<detail::mapped_file> file_;
+		int error_ = 0;
+		const detail::index_header* header_ = nullptr;
+		const detail::index_type_entry* types_ = nullptr;
+		const detail::index_row* rows_ = nullptr;
+		const detail::index_test* tests_ = nullptr;
+		const std::uint32_t* buckets_ = nullptr;
+		const std::uint32_t* displacements_ = nullptr;
+		const detail::index_extension* extensions_ = nullptr;
+		const char* strings_ = nullptr;
+	};
+
+} // inline namespace FILE_MIME_ABI_NAMESPACE
+} // namespace file_mime
+
+#endif // FILE_MIME_SIGNATURE_INDEX_H
@@ -0,0 +1,221 @@
+// MIT License
+//
+// Copyright(c) 2023 Lev Faynshteyn
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef FILE_MIME_STREAM_CLASSIFIER_H
+#define FILE_MIME_STREAM_CLASSIFIER_H
+
+#include "file_mime/file_mime.h"
+
+namespace file_mime {
+inline namespace FILE_MIME_ABI_NAMESPACE {
+
+	enum class stream_status : std::uint8_t {
+		need_more, // undecided, and no magic number can match before #stream_result::needed more bytes
+		matched, // #stream_result::id is the mime type, the rest of the stream doesn't matter
+		no_match, // no magic number can match anymore
+	};
+
+	struct stream_result {
+		stream_status status = stream_status::need_more;
+		mime_id id = mime_id::unknown;
+		std::uint64_t needed = 0;
+	};
+
+	namespace detail {
+
+		// The fewest bytes it takes to get from every DFA state to a match. The transitions always lead to the states added later (the DFA is built breadth first),
+		// so walking the states backwards sees the distances of all the successors first.
+		template <std::size_t S, std::size_t K>
+		[[nodiscard]] constexpr auto make_dfa_distances(const dfa_tables<S, K>& tables) -> std::array<std::uint8_t, S> {
+			auto distances = std::array<std::uint8_t, S>{};
+			for (auto state = S; state-- > 0;) {
+				auto distance = std::size_t{ 0xFF };
+				for (auto c = std::size_t{ 0 }; c < K; ++c) {
+					const auto transition = tables.transitions[state * K + c];
+					if (transition & dfa_accept) {
+						distance = 1;
+					}
+					else if (transition != 0 && transition > state) {
+						distance = std::min(distance, std::size_t{ distances[transition] } + 1);
+					}
+				}
+				distances[state] = static_cast<std::uint8_t>(distance);
+			}
+			return distances;
+		}
+
+		inline constexpr auto dfa_distances = make_dfa_distances(dfa);
+
+		static_assert(offset_signatures.size() <= 32, "stream_classifier tracks the magic numbers at an offset in a 32 bit mask");
+
+	} // namespace detail
+
+	// Classifies a stream that arrives in pieces (e.g. the packets of an upload) as soon as its type is known, usually from the first piece.
+	// The bytes are walked through the DFA of approach 4 as they are fed, and the magic numbers at an offset are compared a byte at a time as their ranges go by,
+	// so no fed byte is ever copied or looked at twice, and the whole state fits in 24 bytes. The result is the one get_id_deep would give on all the bytes fed.
+	class stream_classifier {
+	public:
+		// Feed the next #size bytes of the stream. Once the result is matched or no_match, the bytes fed afterwards are ignored.
+		auto feed(const uint8_t* bytes, const std::size_t size) noexcept -> stream_result {
+			using namespace detail;
+			constexpr auto class_count = dfa.transitions.size() / dfa_state_count;
+
+			if (status_ != stream_status::need_more) {
+				return result();
+			}
+
+			const auto end = position_ + size;
+			while (position_ < end) {
+				const auto byte = bytes[position_ + size - end];
+
+				if (dfa_alive()) {
+					const auto transition = (position_ == 0) ? dfa.first_transitions[byte] : dfa.transitions[dfa_state_ * class_count + dfa.byte_classes[byte]];
+					if (transition & dfa_accept) {
+						return decide(stream_status::matched, static_cast<mime_id>(transition & ~dfa_accept));
+					}
+					dfa_state_ = transition;
+					dfa_dead_ = (transition == 0) || position_ + 1 >= max_file_header_size;
+				}
+
+				for (auto bits = offset_alive_; bits != 0; bits &= bits - 1) {
+					const auto i = lowest_bit(bits);
+					const auto& signature = offset_signatures[i];
+					if (position_ < signature.offset) {
+						continue;
+					}
+					const auto index = static_cast<std::size_t>(position_ - signature.offset);
+					if (((byte ^ signature.pattern[index]) & signature.mask[index]) != 0) {
+						offset_alive_ &= ~(std::uint32_t{ 1 } << i);
+					}
+					else if (index + 1 == signature.size) {
+						offset_alive_ &= ~(std::uint32_t{ 1 } << i);
+						offset_matched_ |= std::uint32_t{ 1 } << i;
+					}
+				}
+				++position_;
+
+				if (dfa_dead_) {
+					const auto settled = settle();
+					if (settled.status != stream_status::need_more) {
+						return settled;
+					}
+
+					// Nothing to look at until the next magic number at an offset starts
+					position_ = std::min(end, std::max(position_, next_offset()));
+				}
+			}
+
+			return result();
+		}
+
+		// The stream has ended: decide from the bytes fed so far.
+		auto finish() noexcept -> stream_result {
+			if (status_ == stream_status::need_more) {
+				dfa_dead_ = true;
+				offset_alive_ = 0;
+				const auto settled = settle();
+				return settled.status != stream_status::need_more ? settled : decide(stream_status::no_match, mime_id::unknown);
+			}
+			return result();
+		}
+
+		// The result so far.
+		[[nodiscard]] auto result() const noexcept -> stream_result {
+			if (status_ != stream_status::need_more) {
+				return stream_result{ status_, id_, 0 };
+			}
+
+			// The fewest bytes before any of the magic numbers still alive could match
+			auto needed = dfa_alive() ? std::uint64_t{ detail::dfa_distances[dfa_state_] } : std::uint64_t(-1);
+			for (auto bits = offset_alive_; bits != 0; bits &= bits - 1) {
+				const auto& signature = detail::offset_signatures[lowest_bit(bits)];
+				needed = std::min(needed, signature.offset + signature.size - position_);
+			}
+			return stream_result{ status_, id_, needed };
+		}
+
+		auto reset() noexcept -> void {
+			*this = stream_classifier{};
+		}
+
+		// The number of bytes of the stream consumed so far, the bytes fed after the decision are not counted.
+		[[nodiscard]] auto position() const noexcept -> std::uint64_t {
+			return position_;
+		}
+
+	private:
+		[[nodiscard]] static auto lowest_bit(const std::uint32_t bits) noexcept -> std::size_t {
+			auto bit = std::size_t{ 0 };
+			while ((bits >> bit & 1) == 0) {
+				++bit;
+			}
+			return bit;
+		}
+
+		[[nodiscard]] auto dfa_alive() const noexcept -> bool {
+			return !dfa_dead_;
+		}
+
+		auto decide(const stream_status status, const mime_id id) noexcept -> stream_result {
+			status_ = status;
+			id_ = id;
+			return result();
+		}
+
+		// With no magic number at the start of the file left, the magic numbers at an offset decide in the order of their offsets:
+		// the first one still alive or matched has to have matched already.
+		auto settle() noexcept -> stream_result {
+			const auto candidates = offset_alive_ | offset_matched_;
+			if (candidates == 0) {
+				return decide(stream_status::no_match, mime_id::unknown);
+			}
+			const auto first = lowest_bit(candidates);
+			if ((offset_matched_ >> first & 1) != 0) {
+				return decide(stream_status::matched, detail::offset_signatures[first].id);
+			}
+			return result();
+		}
+
+		[[nodiscard]] auto next_offset() const noexcept -> std::uint64_t {
+			auto next = std::uint64_t(-1);
+			for (auto bits = offset_alive_; bits != 0; bits &= bits - 1) {
+				next = std::min(next, std::uint64_t{ detail::offset_signatures[lowest_bit(bits)].offset });
+			}
+			return next;
+		}
+
+		std::uint64_t position_ = 0;
+		std::uint32_t offset_alive_ = (detail::offset_signatures.size() == 32) ? ~std::uint32_t{ 0 } : (std::uint32_t{ 1 } << detail::offset_signatures.size()) - 1;
+		std::uint32_t offset_matched_ = 0;
+		std::uint16_t dfa_state_ = 0;
+		bool dfa_dead_ = false;
+		stream_status status_ = stream_status::need_more;
+		mime_id id_ = mime_id::unknown;
+	};
+
+	static_assert(sizeof(stream_classifier) <= 24);
+
+} // inline namespace FILE_MIME_ABI_NAMESPACE
+} // namespace file_mime
+
+#endif // FILE_MIME_STREAM_CLASSIFIER_H
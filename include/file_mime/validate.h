@@ -0,0 +1,502 @@
+// MIT License
+//
+// Copyright(c) 2023 Lev Faynshteyn
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and /or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#ifndef FILE_MIME_VALIDATE_H
+#define FILE_MIME_VALIDATE_H
+
+#include "file_mime/file_mime.h"
+
+#include <sys/stat.h>
+
+namespace file_mime {
+inline namespace FILE_MIME_ABI_NAMESPACE {
+
+	// The outcome of the structural checks of a file whose magic number matched.
+	enum class validation : std::uint8_t {
+		unchecked, // there are no structural checks for the type (or the type is unknown)
+		valid, // the structure checks out as far as the checks go
+		invalid, // the magic number matched, but the structure around it is broken: a truncated file, or one that only happens to start with the magic number
+	};
+
+	// The mime id of a file as get_id_from_file determines it, along with the outcome of its structural checks.
+	struct validated_id_result {
+		mime_id id = mime_id::unknown;
+		int error = 0;
+		bool mismatch = false;
+		validation status = validation::unchecked;
+	};
+
+	namespace detail {
+
+		template <typename T>
+		[[nodiscard]] constexpr auto load_le(const uint8_t* p) noexcept -> T {
+			auto value = T{ 0 };
+			for (auto i = sizeof(T); i-- > 0;) {
+				value = T(value << 8 | p[i]);
+			}
+			return value;
+		}
+
+		template <typename T>
+		[[nodiscard]] constexpr auto load_be(const uint8_t* p) noexcept -> T {
+			auto value = T{ 0 };
+			for (auto i = std::size_t{ 0 }; i < sizeof(T); ++i) {
+				value = T(value << 8 | p[i]);
+			}
+			return value;
+		}
+
+		template <typename T>
+		[[nodiscard]] constexpr auto load(const uint8_t* p, const bool big_endian) noexcept -> T {
+			return big_endian ? load_be<T>(p) : load_le<T>(p);
+		}
+
+		// The bytes of a whole file in memory.
+		struct memory_source {
+			const uint8_t* bytes = nullptr;
+			std::size_t file_size = 0;
+
+			[[nodiscard]] auto size() const noexcept -> std::uint64_t {
+				return file_size;
+			}
+
+			[[nodiscard]] auto read_at(uint8_t* p, const std::size_t size, const std::uint64_t offset) const noexcept -> std::ptrdiff_t {
+				if (offset >= file_size) {
+					return 0;
+				}
+				const auto count = std::min(size, std::size_t(file_size - offset));
+				std::memcpy(p, bytes + offset, count);
+				return std::ptrdiff_t(count);
+			}
+		};
+
+		// The bytes of an open file: the first #max_read_range_size of them are read at once, which covers the magic numbers at the start of the file and most of
+		// the structural checks, and the rest are read only when asked for. The file size is only queried if the first read doesn't reach the end of the file.
+		class fd_source {
+		public:
+			explicit fd_source(const int fd) noexcept : fd_(fd) {
+				const auto read = detail::read_at(fd, prefix_.data(), prefix_.size(), 0);
+				count_syscall(read);
+				if (read < 0) {
+					error_ = int(-read);
+					return;
+				}
+				prefix_size_ = std::size_t(read);
+				if (prefix_size_ < prefix_.size()) {
+					file_size_ = prefix_size_;
+					return;
+				}
+#if defined(_WIN32)
+				struct _stat64 info {};
+				const auto stat_result = ::_fstat64(fd, &info);
+#else
+				struct stat info {};
+				const auto stat_result = ::fstat(fd, &info);
+#endif
+				count_syscall();
+				// Not a regular file (e.g. a pipe), so there is no telling the size: pretend it ends after the first read
+				file_size_ = (stat_result == 0 && info.st_size > 0) ? std::max(std::uint64_t(info.st_size), std::uint64_t{ prefix_size_ }) : prefix_size_;
+			}
+
+			[[nodiscard]] auto error() const noexcept -> int {
+				return error_;
+			}
+
+			[[nodiscard]] auto size() const noexcept -> std::uint64_t {
+				return file_size_;
+			}
+
+			[[nodiscard]] auto read_at(uint8_t* p, const std::size_t size, const std::uint64_t offset) const noexcept -> std::ptrdiff_t {
+				if (offset >= file_size_) {
+					return 0;
+				}
+				if (offset + size <= prefix_size_ || file_size_ == prefix_size_) {
+					const auto count = offset < prefix_size_ ? std::min(size, std::size_t(prefix_size_ - offset)) : std::size_t{ 0 };
+					std::memcpy(p, prefix_.data() + offset, count);
+					return std::ptrdiff_t(count);
+				}
+				const auto read = detail::read_at(fd_, p, size, offset);
+				count_syscall(read);
+				return read;
+			}
+
+		private:
+			std::array<uint8_t, max_read_range_size> prefix_{};
+			std::size_t prefix_size_ = 0;
+			std::uint64_t file_size_ = 0;
+			int fd_ = -1;
+			int error_ = 0;
+		};
+
+		// Read exactly #size bytes at #offset, false if they go past the end of the file or can't be read.
+		template <typename Source>
+		[[nodiscard]] inline auto read_exact(const Source& source, const std::uint64_t offset, const std::size_t size, uint8_t* p) noexcept -> bool {
+			return offset <= source.size() && size <= source.size() - offset && source.read_at(p, size, offset) == std::ptrdiff_t(size);
+		}
+
+		[[nodiscard]] constexpr auto to_validation(const bool valid) noexcept -> validation {
+			return valid ? validation::valid : validation::invalid;
+		}
+
+		[[nodiscard]] constexpr auto make_crc32_table() noexcept -> std::array<std::uint32_t, 256> {
+			auto table = std::array<std::uint32_t, 256>{};
+			for (auto n = std::uint32_t{ 0 }; n < 256; ++n) {
+				auto c = n;
+				for (auto k = 0; k < 8; ++k) {
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				}
+				table[n] = c;
+			}
+			return table;
+		}
+
+		inline constexpr auto crc32_table = make_crc32_table();
+
+		[[nodiscard]] constexpr auto crc32(const uint8_t* p, const std::size_t size) noexcept -> std::uint32_t {
+			auto c = ~std::uint32_t{ 0 };
+			for (auto i = std::size_t{ 0 }; i < size; ++i) {
+				c = crc32_table[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+			}
+			return ~c;
+		}
+
+		// The IHDR chunk (its length, CRC and field values) and the IEND chunk at the very end of the file, which a truncated file lacks.
+		template <typename Source>
+		[[nodiscard]] inline auto validate_png(const Source& source) noexcept -> validation {
+			static constexpr auto iend = std::array<uint8_t, 12>{ 0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4E, 0x44, 0xAE, 0x42, 0x60, 0x82 };
+			auto bytes = std::array<uint8_t, 33>{};
+			auto end = std::array<uint8_t, 12>{};
+			if (!read_exact(source, 0, bytes.size(), bytes.data()) || source.size() < bytes.size() + end.size() || !read_exact(source, source.size() - end.size(), end.size(), end.data())) {
+				return validation::invalid;
+			}
+
+			const auto width = load_be<std::uint32_t>(&bytes[16]);
+			const auto height = load_be<std::uint32_t>(&bytes[20]);
+			const auto depth = bytes[24];
+			const auto color = bytes[25];
+			const auto depth_bit = 1u << (depth < 32 ? depth : 0);
+			// The bit depths allowed for each color type, as bits
+			const auto depths = (color == 0) ? 0x10116u : (color == 3) ? 0x116u : (color == 2 || color == 4 || color == 6) ? 0x10100u : 0u;
+			return to_validation(load_be<std::uint32_t>(&bytes[8]) == 13 && std::memcmp(&bytes[12], "IHDR", 4) == 0
+				&& width != 0 && height != 0 && width <= 0x7FFFFFFFu && height <= 0x7FFFFFFFu && (depths & depth_bit) != 0
+				&& bytes[26] == 0 && bytes[27] == 0 && bytes[28] <= 1
+				&& crc32(&bytes[12], 17) == load_be<std::uint32_t>(&bytes[29]) && end == iend);
+		}
+
+		// The markers up to the first frame header (checked too) or the start of the scan, at most #max_segments of them, each of which has to fit the file.
+		template <typename Source>
+		[[nodiscard]] inline auto validate_jpeg(const Source& source) noexcept -> validation {
+			constexpr auto max_segments = 16;
+			auto offset = std::uint64_t{ 2 };
+			for (auto segment = 0; segment < max_segments; ++segment) {
+				auto bytes = std::array<uint8_t, 10>{};
+				if (!read_exact(source, offset, 4, bytes.data()) || bytes[0] != 0xFF) {
+					return validation::invalid;
+				}
+
+				const auto marker = bytes[1];
+				if (marker == 0xFF) {
+					// Fill byte
+					offset += 1;
+					continue;
+				}
+				if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+					// No payload
+					offset += 2;
+					continue;
+				}
+				if (marker == 0x00 || marker == 0xD8 || marker == 0xD9) {
+					// A stuffed zero, a second start of image, or the end of the image before any scan
+					return validation::invalid;
+				}
+
+				const auto length = load_be<std::uint16_t>(&bytes[2]);
+				if (length < 2 || offset + 2 + length > source.size()) {
+					return validation::invalid;
+				}
+				if (marker == 0xDA) {
+					return validation::valid;
+				}
+				if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+					if (!read_exact(source, offset, bytes.size(), bytes.data())) {
+						return validation::invalid;
+					}
+					const auto precision = bytes[4];
+					const auto width = load_be<std::uint16_t>(&bytes[7]);
+					const auto components = bytes[9];
+					return to_validation((precision == 8 || precision == 12 || precision == 16) && width != 0 && components >= 1 && components <= 4 && length == 8 + 3 * components);
+				}
+				offset += 2 + length;
+			}
+			return validation::valid;
+		}
+
+		// The header of a GIF: the size of the global color table has to fit the file, and a block has to start after it.
+		template <typename Source>
+		[[nodiscard]] inline auto validate_gif(const Source& source) noexcept -> validation {
+			auto bytes = std::array<uint8_t, 13>{};
+			if (!read_exact(source, 0, bytes.size(), bytes.data())) {
+				return validation::invalid;
+			}
+			const auto table_size = (bytes[10] & 0x80) ? 3u << ((bytes[10] & 0x07) + 1) : 0u;
+			auto next = uint8_t{ 0 };
+			return to_validation(load_le<std::uint16_t>(&bytes[6]) != 0 && load_le<std::uint16_t>(&bytes[8]) != 0
+				&& read_exact(source, bytes.size() + table_size, 1, &next) && (next == 0x2C || next == 0x21 || next == 0x3B));
+		}
+
+		// The file header of a BMP: the file size it declares can't be beyond the end of the file, the DIB header has to be of a known size and the pixels have to start after it.
+		template <typename Source>
+		[[nodiscard]] inline auto validate_bmp(const Source& source) noexcept -> validation {
+			auto bytes = std::array<uint8_t, 30>{};
+			if (!read_exact(source, 0, 18, bytes.data())) {
+				return validation::invalid;
+			}
+			const auto file_size = load_le<std::uint32_t>(&bytes[2]);
+			const auto pixels = load_le<std::uint32_t>(&bytes[10]);
+			const auto dib_size = load_le<std::uint32_t>(&bytes[14]);
+			const auto known_dib = dib_size == 12 || dib_size == 16 || dib_size == 40 || dib_size == 52 || dib_size == 56 || dib_size == 64 || dib_size == 108 || dib_size == 124;
+			if (!known_dib || file_size > source.size() || pixels < 14 + dib_size || pixels > source.size()) {
+				return validation::invalid;
+			}
+			if (dib_size >= 40) {
+				if (!read_exact(source, 18, 12, &bytes[18])) {
+					return validation::invalid;
+				}
+				const auto planes = load_le<std::uint16_t>(&bytes[26]);
+				const auto bit_count = load_le<std::uint16_t>(&bytes[28]);
+				return to_validation(load_le<std::uint32_t>(&bytes[18]) != 0 && planes == 1
+					&& (bit_count == 0 || bit_count == 1 || bit_count == 2 || bit_count == 4 || bit_count == 8 || bit_count == 16 || bit_count == 24 || bit_count == 32 || bit_count == 64));
+			}
+			return validation::valid;
+		}
+
+		// The rest of the TGA header after its magic number: the image size and the pixel depth, and the pixels of an uncompressed image have to fit the file.
+		template <typename Source>
+		[[nodiscard]] inline auto validate_tga(const Source& source) noexcept -> validation {
+			auto bytes = std::array<uint8_t, 18>{};
+			if (!read_exact(source, 0, bytes.size(), bytes.data())) {
+				return validation::invalid;
+			}
+			const auto width = load_le<std::uint16_t>(&bytes[12]);
+			const auto height = load_le<std::uint16_t>(&bytes[14]);
+			const auto depth = bytes[16];
+			const auto alpha_bits = bytes[17] & 0x0F;
+			if (width == 0 || height == 0 || (depth != 8 && depth != 15 && depth != 16 && depth != 24 && depth != 32) || alpha_bits > depth || (bytes[17] & 0xC0) != 0) {
+				return validation::invalid;
+			}
+			const auto pixels_size = std::uint64_t{ width } * height * ((depth + 7u) / 8u);
+			return to_validation(bytes[2] != 2 || bytes.size() + pixels_size <= source.size());
+		}
+
+		// The first IFD of a TIFF: it has to start after the header, have entries, fit the file and start with a known field type.
+		template <typename Source>
+		[[nodiscard]] inline auto validate_tiff(const Source& source) noexcept -> validation {
+			auto bytes = std::array<uint8_t, 8>{};
+			if (!read_exact(source, 0, 2, bytes.data())) {
+				return validation::invalid;
+			}
+			if (bytes[0] != bytes[1]) {
+				// No structure known past the magic number of the other TIFF flavor
+				return validation::unchecked;
+			}
+			if (!read_exact(source, 2, 6, &bytes[2])) {
+				return validation::invalid;
+			}
+			const auto big_endian = bytes[0] == 0x4D;
+			const auto ifd = load<std::uint32_t>(&bytes[4], big_endian);
+			auto entry = std::array<uint8_t, 6>{};
+			if (ifd < 8 || !read_exact(source, ifd, entry.size(), entry.data())) {
+				return validation::invalid;
+			}
+			const auto count = load<std::uint16_t>(&entry[0], big_endian);
+			const auto type = load<std::uint16_t>(&entry[4], big_endian);
+			return to_validation(count != 0 && std::uint64_t{ ifd } + 2 + 12u * count + 4 <= source.size() && type >= 1 && type <= 18);
+		}
+
+		// The RIFF (little-endian) or the FORM (big-endian) container: the size it declares can't go past the end of the file, and its first chunk has to fit in it.
+		template <typename Source>
+		[[nodiscard]] inline auto validate_riff(const Source& source, const bool big_endian) noexcept -> validation {
+			auto bytes = std::array<uint8_t, 20>{};
+			if (!read_exact(source, 0, bytes.size(), bytes.data())) {
+				return validation::invalid;
+			}
+			const auto size = std::uint64_t{ load<std::uint32_t>(&bytes[4], big_endian) };
+			const auto chunk_size = std::uint64_t{ load<std::uint32_t>(&bytes[16], big_endian) };
+			const auto printable = std::all_of(&bytes[12], &bytes[16], [](const uint8_t c) { return c >= 0x20 && c < 0x7F; });
+			return to_validation(size >= 12 && size + 8 <= source.size() && printable && 20 + chunk_size <= size + 8);
+		}
+
+		// The binary glTF header: the length it declares has to be the file size, and the JSON chunk has to come first and fit in it.
+		template <typename Source>
+		[[nodiscard]] inline auto validate_glb(const Source& source) noexcept -> validation {
+			auto bytes = std::array<uint8_t, 20>{};
+			if (!read_exact(source, 0, 12, bytes.data())) {
+				return validation::invalid;
+			}
+			const auto version = load_le<std::uint32_t>(&bytes[4]);
+			const auto length = std::uint64_t{ load_le<std::uint32_t>(&bytes[8]) };
+			if (length != source.size() || (version != 1 && version != 2)) {
+				return validation::invalid;
+			}
+			if (version == 1) {
+				return validation::valid;
+			}
+			if (!read_exact(source, 12, 8, &bytes[12])) {
+				return validation::invalid;
+			}
+			const auto chunk_length = std::uint64_t{ load_le<std::uint32_t>(&bytes[12]) };
+			return to_validation(load_le<std::uint32_t>(&bytes[16]) == 0x4E4F534Au && chunk_length % 4 == 0 && 20 + chunk_length <= length);
+		}
+
+		// The KTX2 header and its index: the image size, the face and the level counts have to be consistent, and the data format descriptor, the key/value data,
+		// the supercompression global data and every level have to lie past the index and within the file.
+		template <typename Source>
+		[[nodiscard]] inline auto validate_ktx2(const Source& source) noexcept -> validation {
+			constexpr auto header_size = std::size_t{ 80u };
+			constexpr auto level_size = std::size_t{ 24u };
+			auto bytes = std::array<uint8_t, max_read_range_size>{};
+			if (!read_exact(source, 0, header_size, bytes.data())) {
+				return validation::invalid;
+			}
+
+			const auto width = load_le<std::uint32_t>(&bytes[20]);
+			const auto height = load_le<std::uint32_t>(&bytes[24]);
+			const auto faces = load_le<std::uint32_t>(&bytes[36]);
+			const auto levels = std::max(load_le<std::uint32_t>(&bytes[40]), std::uint32_t{ 1 });
+			const auto supercompression = load_le<std::uint32_t>(&bytes[44]);
+			auto max_levels = std::uint32_t{ 1 };
+			while (max_levels < 32 && (std::max(width, height) >> max_levels) != 0) {
+				++max_levels;
+			}
+			if (width == 0 || (faces != 1 && faces != 6) || (faces == 6 && width != height) || levels > max_levels || (supercompression > 3 && supercompression < 0x10000)) {
+				return validation::invalid;
+			}
+
+			const auto index_end = std::uint64_t{ header_size } + std::uint64_t{ levels } * level_size;
+			const auto fits = [&source, index_end](const std::uint64_t offset, const std::uint64_t size) {
+				return size == 0 || (offset >= index_end && offset <= source.size() && size <= source.size() - offset);
+			};
+			if (load_le<std::uint32_t>(&bytes[52]) == 0 || !fits(load_le<std::uint32_t>(&bytes[48]), load_le<std::uint32_t>(&bytes[52]))
+				|| !fits(load_le<std::uint32_t>(&bytes[56]), load_le<std::uint32_t>(&bytes[60])) || !fits(load_le<std::uint64_t>(&bytes[64]), load_le<std::uint64_t>(&bytes[72]))) {
+				return validation::invalid;
+			}
+
+			// The level index, a few levels per read
+			constexpr auto levels_per_read = max_read_range_size / level_size;
+			for (auto first = std::uint32_t{ 0 }; first < levels; first += levels_per_read) {
+				const auto count = std::min<std::uint32_t>(levels - first, levels_per_read);
+				if (!read_exact(source, header_size + first * level_size, count * level_size, bytes.data())) {
+					return validation::invalid;
+				}
+				for (auto i = std::size_t{ 0 }; i < count; ++i) {
+					const auto* level = &bytes[i * level_size];
+					const auto length = load_le<std::uint64_t>(level + 8);
+					if (length == 0 || !fits(load_le<std::uint64_t>(level), length) || (supercompression == 0 && load_le<std::uint64_t>(level + 16) != length)) {
+						return validation::invalid;
+					}
+				}
+			}
+			return validation::valid;
+		}
+
+		template <typename Source>
+		[[nodiscard]] inline auto validate(const Source& source, const mime_id id) noexcept -> validation {
+			switch (id) {
+			case mime_id::png: return validate_png(source);
+			case mime_id::jpeg: return validate_jpeg(source);
+			case mime_id::gif: return validate_gif(source);
+			case mime_id::bmp: return validate_bmp(source);
+			case mime_id::tga: return validate_tga(source);
+			case mime_id::tiff: return validate_tiff(source);
+			case mime_id::webp:
+			case mime_id::wav:
+			case mime_id::avi: return validate_riff(source, false);
+			case mime_id::aiff: return validate_riff(source, true);
+			case mime_id::gltf_binary: return validate_glb(source);
+			case mime_id::ktx2: return validate_ktx2(source);
+			default: return validation::unchecked;
+			}
+		}
+
+		// Determine the mime id of the file behind the #source like get_id_from_file, with the reads served by the source.
+		template <typename Source>
+		[[nodiscard]] inline auto get_id_from_source(const Source& source, const mime_id mime_type_hint) noexcept -> file_id_result {
+			auto buffer = std::array<uint8_t, max_read_range_size>{};
+			auto error = 0;
+			const auto read = [&source, &error](uint8_t* p, const std::size_t size, const std::uint64_t offset) -> std::ptrdiff_t {
+				const auto result = source.read_at(p, size, offset);
+				if (result < 0) {
+					error = int(-result);
+				}
+				return result;
+			};
+			const auto id = get_id_deep_at(read, mime_type_hint, buffer);
+			if (error != 0) {
+				return file_id_result{ mime_type_hint, error };
+			}
+			return file_id_result{ id, 0, mime_type_hint != mime_id::unknown && id != mime_type_hint };
+		}
+
+		[[nodiscard]] inline auto get_id_from_fd_validated(const int fd, const mime_id mime_type_hint) noexcept -> validated_id_result {
+			const auto source = fd_source{ fd };
+			if (source.error() != 0) {
+				return validated_id_result{ mime_type_hint, source.error() };
+			}
+
+			const auto result = get_id_from_source(source, mime_type_hint);
+			if (result.error != 0) {
+				return validated_id_result{ result.id, result.error };
+			}
+			// A file too small to have a magic number gets the hint, whose structure isn't there to check
+			const auto status = source.size() < min_file_header_size ? validation::unchecked : validate(source, result.id);
+			return validated_id_result{ result.id, 0, result.mismatch, status };
+		}
+
+	} // namespace detail
+
+	// Check the structure of the whole #file_size bytes of a file at #file_bytes as a file of the mime type #id (usually determined by get_id_deep):
+	// the few fields that a broken file gets wrong, e.g. the PNG IHDR chunk length and CRC, the JPEG markers up to the frame header, the length in the glTF header,
+	// the KTX2 level index or the file size in the BMP header. Only a small fixed number of bytes is looked at, so this is cheap enough to run before a decoder
+	// to drop the truncated files and the ones that merely start with a magic number (e.g. a text file starting with "BM").
+	[[nodiscard]] inline auto validate(const uint8_t* file_bytes, const std::size_t file_size, const mime_id id) noexcept -> validation {
+		return detail::validate(detail::memory_source{ file_bytes, file_size }, id);
+	}
+
+	// Determine the mime id of an open file like get_id_from_file and check its structure like validate. The first 512 bytes are read at once for both,
+	// so a file is usually classified and checked with that read and an fstat call, plus a read or two for the checks at the end of the file or past the first bytes.
+	[[nodiscard]] inline auto get_id_from_file_validated(const int fd, const mime_id mime_type_hint = mime_id::unknown) noexcept -> validated_id_result {
+		return detail::get_id_from_fd_validated(fd, mime_type_hint);
+	}
+
+	// Ditto for a file path, falling back to its extension (unchecked) if it can't be opened or read.
+	[[nodiscard]] inline auto get_id_from_file_validated(const std::string_view path_to_file) noexcept -> validated_id_result {
+		return detail::get_id_from_path(path_to_file, [](const int fd, const mime_id hint) {
+			return detail::get_id_from_fd_validated(fd, hint);
+		});
+	}
+
+} // inline namespace FILE_MIME_ABI_NAMESPACE
+} // namespace file_mime
+
+#endif // FILE_MIME_VALIDATE_H
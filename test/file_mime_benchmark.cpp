@@ -0,0 +1,338 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <random>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <cctype>
+
+#include <benchmark/benchmark.h>
+
+#include "file_mime/file_mime.h"
+#include "file_mime/basic_detector.h"
+#include "file_mime/detector.h"
+
+// Every 'deep' engine side by side on the same headers, so that one can be picked from data:
+//
+//     file_mime_benchmark [--corpus=<directory>] [google benchmark flags]
+//
+// The synthetic scenarios run the engines on headers that carry a magic number with the right hint, a wrong hint and no hint, and on a realistic mix of types.
+// With --corpus, the headers and the extension hints of the files under the directory are added as a scenario of their own, and the I/O benchmarks read its files.
+// The results are written to file_mime_benchmark.json unless --benchmark_out says otherwise.
+
+#ifndef FILE_MIME_TEST_FILES_DIR
+#define FILE_MIME_TEST_FILES_DIR "../test/test_files"
+#endif
+
+using namespace file_mime;
+
+namespace {
+
+	using detail::deep_alg_version;
+
+	// A header along with the hint passed with it.
+	struct hinted_header {
+		std::vector<std::uint8_t> bytes;
+		mime_id hint = mime_id::unknown;
+	};
+
+	using corpus = std::vector<hinted_header>;
+
+	// The files of the corpus directory (only set with --corpus) and their headers.
+	auto corpus_paths = std::vector<std::string>{};
+	auto corpus_headers = corpus{};
+
+	[[nodiscard]] auto random_bytes(std::mt19937& gen, const std::size_t size) -> std::vector<std::uint8_t> {
+		auto bytes_dis = std::uniform_int_distribution<>{ 0, 255 };
+		auto bytes = std::vector<std::uint8_t>(size);
+		std::generate(bytes.begin(), bytes.end(), [&]() { return std::uint8_t(bytes_dis(gen)); });
+		return bytes;
+	}
+
+	// A full header carrying the magic number, with random wildcard and trailing bytes.
+	[[nodiscard]] auto make_header(std::mt19937& gen, const magic_signature& signature) -> std::vector<std::uint8_t> {
+		auto bytes = random_bytes(gen, max_file_header_size);
+		for (auto i = std::size_t{ 0 }; i < signature.size; ++i) {
+			if (signature.mask[i] != 0) {
+				bytes[i] = signature.pattern[i];
+			}
+		}
+		return bytes;
+	}
+
+	enum class scenario {
+		hint_hit, // every header carries the magic number of its hint
+		hint_miss, // every header carries a magic number of another type than its hint
+		no_hint, // every header carries a magic number, no hint
+		mix, // the types of a typical asset store, some text and other unknown files among them, hinted by extension (with a few wrong extensions)
+	};
+
+	[[nodiscard]] auto make_corpus(const scenario kind, const std::size_t count) -> corpus {
+		auto gen = std::mt19937{ 42 };
+		const auto& signatures = detail::anchored_signatures;
+		auto headers = corpus{};
+		headers.reserve(count);
+
+		if (kind != scenario::mix) {
+			for (auto i = std::size_t{ 0 }; i < count; ++i) {
+				const auto& signature = signatures[i % signatures.size()];
+				auto hint = mime_id::unknown;
+				if (kind == scenario::hint_hit) {
+					hint = signature.id;
+				}
+				else if (kind == scenario::hint_miss) {
+					hint = static_cast<mime_id>(static_cast<std::size_t>(signature.id) % (detail::mime_types.size() - 1) + 1);
+				}
+				headers.push_back(hinted_header{ make_header(gen, signature), hint });
+			}
+			std::shuffle(headers.begin(), headers.end(), gen);
+			return headers;
+		}
+
+		// The share of every type in percent, the rest are files of no known type
+		const auto shares = std::vector<std::pair<mime_id, int>>{
+			{ mime_id::jpeg, 40 }, { mime_id::png, 25 }, { mime_id::webp, 6 }, { mime_id::gif, 4 }, { mime_id::ktx2, 4 }, { mime_id::gltf_binary, 3 },
+			{ mime_id::tiff, 2 }, { mime_id::bmp, 1 }, { mime_id::tga, 1 }, { mime_id::exr, 1 }, { mime_id::hdr, 1 }, { mime_id::wav, 1 },
+		};
+		auto percent_dis = std::uniform_int_distribution<>{ 0, 99 };
+		for (auto i = std::size_t{ 0 }; i < count; ++i) {
+			auto roll = percent_dis(gen);
+			auto id = mime_id::unknown;
+			for (const auto& share : shares) {
+				if (roll < share.second) {
+					id = share.first;
+					break;
+				}
+				roll -= share.second;
+			}
+
+			if (id == mime_id::unknown) {
+				// Text files and the like
+				auto bytes = random_bytes(gen, max_file_header_size);
+				std::transform(bytes.begin(), bytes.end(), bytes.begin(), [](const std::uint8_t byte) { return std::uint8_t(' ' + byte % 95); });
+				headers.push_back(hinted_header{ std::move(bytes), mime_id::unknown });
+				continue;
+			}
+
+			const auto& group = detail::mime_groups[static_cast<std::size_t>(id)];
+			const auto& signature = signatures[group.first + std::size_t(percent_dis(gen)) % (group.last - group.first)];
+			// One in 50 has the wrong extension
+			const auto hint = (percent_dis(gen) < 2) ? mime_id::png : id;
+			headers.push_back(hinted_header{ make_header(gen, signature), hint });
+		}
+		return headers;
+	}
+
+	template <deep_alg_version alg_version>
+	void engine_benchmark(benchmark::State& state, const corpus* headers) {
+		for (auto _ : state) {
+			for (const auto& header : *headers) {
+				const auto id = detail::get_id_deep<alg_version>(header.bytes.data(), header.bytes.size(), header.hint);
+				benchmark::DoNotOptimize(id);
+			}
+		}
+		state.SetItemsProcessed(std::int64_t(state.iterations()) * std::int64_t(headers->size()));
+	}
+
+	template <deep_alg_version alg_version>
+	auto register_engine(const std::string& name, const std::string& scenario_name, const corpus* headers) -> void {
+		benchmark::RegisterBenchmark(("engine/" + name + "/" + scenario_name).c_str(), engine_benchmark<alg_version>, headers);
+	}
+
+	auto register_engines(const std::string& scenario_name, const corpus* headers) -> void {
+		register_engine<deep_alg_version::DEEP_ALG_V0>("v0", scenario_name, headers);
+		register_engine<deep_alg_version::DEEP_ALG_V1>("v1", scenario_name, headers);
+		register_engine<deep_alg_version::DEEP_ALG_V2>("v2", scenario_name, headers);
+		register_engine<deep_alg_version::DEEP_ALG_V3>("v3", scenario_name, headers);
+		register_engine<deep_alg_version::DEEP_ALG_V4>("v4", scenario_name, headers);
+		register_engine<deep_alg_version::DEEP_ALG_V5>("v5", scenario_name, headers);
+	}
+
+	// A binary that only cares about a few formats: the compile-time subset against the runtime one (#Detector is a basic_detector or a signature_set).
+	using image_detector = basic_detector<mime_id::png, mime_id::jpeg, mime_id::ktx2, mime_id::gltf_binary>;
+
+	template <typename Detector>
+	void subset_benchmark(benchmark::State& state, const Detector* detector, const corpus* headers) {
+		for (auto _ : state) {
+			for (const auto& header : *headers) {
+				const auto id = detector->get_id_deep(header.bytes.data(), header.bytes.size(), header.hint);
+				benchmark::DoNotOptimize(id);
+			}
+		}
+		state.SetItemsProcessed(std::int64_t(state.iterations()) * std::int64_t(headers->size()));
+	}
+
+	// The extensions of the mix, in upper case now and then, and a few unknown ones.
+	[[nodiscard]] auto make_extensions(const std::size_t count) -> std::vector<std::string> {
+		auto gen = std::mt19937{ 7 };
+		auto extensions = std::vector<std::string>{};
+		const auto others = std::vector<std::string>{ ".txt", ".json", ".gltf", ".bin", ".cpp" };
+		auto dis = std::uniform_int_distribution<std::size_t>{ 0, detail::extensions.size() + others.size() - 1 };
+		for (auto i = std::size_t{ 0 }; i < count; ++i) {
+			const auto pick = dis(gen);
+			auto extension = pick < detail::extensions.size() ? std::string(detail::extensions[pick].extension) : others[pick - detail::extensions.size()];
+			if (i % 5 == 0) {
+				std::transform(extension.begin(), extension.end(), extension.begin(), [](const char c) { return char(std::toupper(c)); });
+			}
+			extensions.push_back(std::move(extension));
+		}
+		return extensions;
+	}
+
+	void get_type_from_extension_benchmark(benchmark::State& state, const std::vector<std::string>* extensions) {
+		for (auto _ : state) {
+			for (const auto& extension : *extensions) {
+				auto type = get_type_from_extension(extension);
+				benchmark::DoNotOptimize(type);
+			}
+		}
+		state.SetItemsProcessed(std::int64_t(state.iterations()) * std::int64_t(extensions->size()));
+	}
+
+	void get_id_from_extension_benchmark(benchmark::State& state, const std::vector<std::string>* extensions) {
+		for (auto _ : state) {
+			for (const auto& extension : *extensions) {
+				const auto id = get_id_from_extension(extension);
+				benchmark::DoNotOptimize(id);
+			}
+		}
+		state.SetItemsProcessed(std::int64_t(state.iterations()) * std::int64_t(extensions->size()));
+	}
+
+	// The whole I/O path: open, read, classify and close every file (warm page cache).
+	void get_type_path_benchmark(benchmark::State& state, const std::vector<std::string>* paths) {
+		for (auto _ : state) {
+			for (const auto& path : *paths) {
+				auto type = get_type(path, true);
+				benchmark::DoNotOptimize(type);
+			}
+		}
+		state.SetItemsProcessed(std::int64_t(state.iterations()) * std::int64_t(paths->size()));
+	}
+
+	void get_id_from_file_benchmark(benchmark::State& state, const std::vector<std::string>* paths) {
+		for (auto _ : state) {
+			for (const auto& path : *paths) {
+				const auto result = get_id_from_file(std::string_view(path));
+				benchmark::DoNotOptimize(result);
+			}
+		}
+		state.SetItemsProcessed(std::int64_t(state.iterations()) * std::int64_t(paths->size()));
+	}
+
+	// The regular files under #directory (up to #max_files of them) and their headers, hinted by their extensions.
+	auto load_corpus(const std::string& directory, const std::size_t max_files) -> void {
+		namespace fs = std::filesystem;
+		auto error = std::error_code{};
+		for (auto it = fs::recursive_directory_iterator(directory, fs::directory_options::skip_permission_denied, error); !error && it != fs::recursive_directory_iterator(); it.increment(error)) {
+			if (corpus_paths.size() >= max_files) {
+				break;
+			}
+			if (!it->is_regular_file(error)) {
+				continue;
+			}
+			auto path = it->path().string();
+			auto file = std::ifstream(path, std::ios::binary);
+			auto bytes = std::vector<std::uint8_t>(max_file_header_size);
+			file.read(reinterpret_cast<char*>(bytes.data()), std::streamsize(bytes.size()));
+			bytes.resize(std::size_t(file.gcount()));
+			if (bytes.size() < min_file_header_size) {
+				continue;
+			}
+			corpus_headers.push_back(hinted_header{ std::move(bytes), get_id_shallow(path) });
+			corpus_paths.push_back(std::move(path));
+		}
+		if (error) {
+			std::cerr << "file_mime_benchmark: " << directory << ": " << error.message() << "\n";
+		}
+	}
+
+} // namespace
+
+int main(int argc, char** argv) {
+
+	std::cout << "file_mime v" << FILE_MIME_VERSION << " benchmarks\n\n";
+
+	// Our own flags are taken out before google benchmark sees the rest, and the JSON output is on by default
+	auto args = std::vector<char*>{ argv[0] };
+	auto corpus_directory = std::string{};
+	auto has_out = false;
+	for (auto i = 1; i < argc; ++i) {
+		const auto arg = std::string_view(argv[i]);
+		if (arg.substr(0, 9) == "--corpus=") {
+			corpus_directory = std::string(arg.substr(9));
+			continue;
+		}
+		has_out = has_out || arg.substr(0, 16) == "--benchmark_out=";
+		args.push_back(argv[i]);
+	}
+	auto out = std::string("--benchmark_out=file_mime_benchmark.json");
+	auto out_format = std::string("--benchmark_out_format=json");
+	if (!has_out) {
+		args.push_back(out.data());
+		args.push_back(out_format.data());
+	}
+	auto arg_count = int(args.size());
+	::benchmark::Initialize(&arg_count, args.data());
+	if (::benchmark::ReportUnrecognizedArguments(arg_count, args.data())) {
+		return 1;
+	}
+
+	static constexpr auto header_count = std::size_t{ 100000u };
+	static const auto hint_hit = make_corpus(scenario::hint_hit, header_count);
+	static const auto hint_miss = make_corpus(scenario::hint_miss, header_count);
+	static const auto no_hint = make_corpus(scenario::no_hint, header_count);
+	static const auto mix = make_corpus(scenario::mix, header_count);
+	register_engines("hint_hit", &hint_hit);
+	register_engines("hint_miss", &hint_miss);
+	register_engines("no_hint", &no_hint);
+	register_engines("mix", &mix);
+	static const auto images = image_detector{};
+	static const auto image_set = signature_set{ image_detector::formats };
+	benchmark::RegisterBenchmark("subset/basic_detector/mix", subset_benchmark<image_detector>, &images, &mix);
+	benchmark::RegisterBenchmark("subset/signature_set/mix", subset_benchmark<signature_set>, &image_set, &mix);
+	benchmark::RegisterBenchmark("subset/basic_detector/no_hint", subset_benchmark<image_detector>, &images, &no_hint);
+	benchmark::RegisterBenchmark("subset/signature_set/no_hint", subset_benchmark<signature_set>, &image_set, &no_hint);
+
+	// What autotune would pick on this machine for the mix. Autotune selects the engine it picks, the previous one is restored
+	// so that the benchmarks that don't pick one (e.g. the I/O ones) measure the same engine on every run and machine
+	{
+		const auto previous = get_engine();
+		auto sample = std::vector<const std::uint8_t*>{};
+		auto sizes = std::vector<std::size_t>{};
+		auto hints = std::vector<mime_id>{};
+		for (auto i = std::size_t{ 0 }; i < 10000; ++i) {
+			sample.push_back(mix[i].bytes.data());
+			sizes.push_back(mix[i].bytes.size());
+			hints.push_back(mix[i].hint);
+		}
+		const auto tuned = autotune(sample.data(), sizes.data(), sample.size(), hints.data());
+		std::cout << "autotune on the mix: v" << static_cast<int>(tuned.selected) << " (";
+		for (auto e = std::size_t{ 0 }; e < tuned.ns_per_header.size(); ++e) {
+			std::cout << (e == 0 ? "" : ", ") << "v" << e << " " << tuned.ns_per_header[e] << " ns";
+		}
+		std::cout << " per header)\n\n";
+		set_engine(previous);
+	}
+
+	static const auto extensions = make_extensions(header_count);
+	benchmark::RegisterBenchmark("extension/get_type_from_extension", get_type_from_extension_benchmark, &extensions);
+	benchmark::RegisterBenchmark("extension/get_id_from_extension", get_id_from_extension_benchmark, &extensions);
+
+	if (!corpus_directory.empty()) {
+		load_corpus(corpus_directory, 100000);
+		std::cout << "corpus: " << corpus_paths.size() << " files from " << corpus_directory << "\n";
+		register_engines("corpus", &corpus_headers);
+	}
+	else {
+		load_corpus(FILE_MIME_TEST_FILES_DIR, 100000);
+	}
+	benchmark::RegisterBenchmark("io/get_type_deep_path", get_type_path_benchmark, &corpus_paths);
+	benchmark::RegisterBenchmark("io/get_id_from_file", get_id_from_file_benchmark, &corpus_paths);
+
+	::benchmark::RunSpecifiedBenchmarks();
+	::benchmark::Shutdown();
+	return 0;
+}
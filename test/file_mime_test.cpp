@@ -1,14 +1,55 @@
 #include <iostream>
 #include <vector>
 #include <random>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <thread>
 
 #include <gtest/gtest.h>
 #include <benchmark/benchmark.h>
 
 #include "file_mime/file_mime.h"
+#include "file_mime/classify_tree.h"
+#include "file_mime/classify_files.h"
+#include "file_mime/scan.h"
+#include "file_mime/stream_classifier.h"
+#include "file_mime/detector.h"
+#include "file_mime/basic_detector.h"
+#include "file_mime/result_cache.h"
+#include "file_mime/validate.h"
+#include "file_mime/probe.h"
+#include "file_mime/signature_compiler.h"
 using namespace file_mime;
 
 namespace {
+	// Random bytes for the test headers.
+	auto random_bytes(std::mt19937& gen, const std::size_t size) -> std::vector<std::uint8_t> {
+		auto bytes_dis = std::uniform_int_distribution<>{ 0, 255 };
+		auto bytes = std::vector<std::uint8_t>(size);
+		std::generate(bytes.begin(), bytes.end(), [&]() { return std::uint8_t(bytes_dis(gen)); });
+		return bytes;
+	}
+
+	// Stamp the magic bytes of #signature over the #size bytes at #bytes, as many of them as fit (the wildcards keep their random values).
+	auto stamp_signature(const magic_signature& signature, std::uint8_t* bytes, const std::size_t size) -> void {
+		for (auto i = std::size_t{ 0 }; i < signature.size && signature.offset + i < size; ++i) {
+			if (signature.mask[i] != 0) {
+				bytes[signature.offset + i] = signature.pattern[i];
+			}
+		}
+	}
+
+	// The #n-th random header of a test: #n % 8 bytes longer than #signature needs, and carrying its magic number except for every fourth one, so that the misses are covered too.
+	auto make_header(std::mt19937& gen, const magic_signature& signature, const int n) -> std::vector<std::uint8_t> {
+		auto bytes = random_bytes(gen, std::max<std::size_t>(signature.offset + signature.size, min_file_header_size) + std::size_t(n % 8));
+		if (n % 4 != 0) {
+			stamp_signature(signature, bytes.data(), bytes.size());
+		}
+		return bytes;
+	}
+
 	// Helper functions tests
 	TEST(FileMime, TestsHelpers) {
 		{
@@ -234,45 +275,1485 @@ namespace {
 			EXPECT_EQ(mime_type, "");
 		}
 	}
+
+	// Tests every 'deep' algorithm against every magic number in the registry
+	TEST(FileMime, TestsAlgorithms) {
+		using detail::deep_alg_version;
+
+		for (const auto& signature : detail::anchored_signatures) {
+			auto bytes = std::vector<std::uint8_t>(signature.pattern.begin(), signature.pattern.begin() + signature.size);
+			const auto id = signature.id;
+
+			EXPECT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V0>(bytes.data(), bytes.size(), mime_id::unknown)), id);
+			EXPECT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V1>(bytes.data(), bytes.size(), mime_id::unknown)), id);
+			EXPECT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V1>(bytes.data(), bytes.size(), id)), id);
+			EXPECT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V1>(bytes.data(), bytes.size(), mime_id::gltf_binary)), id);
+			EXPECT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V2>(bytes.data(), bytes.size(), mime_id::unknown)), id);
+			EXPECT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V3>(bytes.data(), bytes.size(), mime_id::unknown)), id);
+			EXPECT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V4>(bytes.data(), bytes.size(), mime_id::unknown)), id);
+			EXPECT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V5>(bytes.data(), bytes.size(), mime_id::unknown)), id);
+
+			// A truncated magic number must not match
+			bytes.pop_back();
+			if (bytes.size() >= min_file_header_size) {
+				EXPECT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V0>(bytes.data(), bytes.size(), mime_id::unknown)), mime_id::unknown);
+				EXPECT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V1>(bytes.data(), bytes.size(), id)), mime_id::unknown);
+				EXPECT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V2>(bytes.data(), bytes.size(), mime_id::unknown)), mime_id::unknown);
+				EXPECT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V3>(bytes.data(), bytes.size(), mime_id::unknown)), mime_id::unknown);
+				EXPECT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V4>(bytes.data(), bytes.size(), mime_id::unknown)), mime_id::unknown);
+				EXPECT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V5>(bytes.data(), bytes.size(), mime_id::unknown)), mime_id::unknown);
+			}
+		}
+	}
+
+	// Tests that all the 'deep' algorithms agree on random headers, and on random headers that start with (parts of) the magic numbers
+	TEST(FileMime, TestsAlgorithmsAgree) {
+		using detail::deep_alg_version;
+
+		auto gen = std::mt19937{ 42 };
+		auto length_dis = std::uniform_int_distribution<std::size_t>{ min_file_header_size, max_file_header_size };
+		auto signature_dis = std::uniform_int_distribution<std::size_t>{ 0, detail::anchored_signatures.size() - 1 };
+
+		const auto max_simd_level = detail::detect_simd_level();
+
+		for (auto n = 0; n < 100000; ++n) {
+			auto bytes = random_bytes(gen, length_dis(gen));
+
+			// Every other header starts with a random prefix of a magic number
+			if (n % 2 == 0) {
+				const auto& signature = detail::anchored_signatures[signature_dis(gen)];
+				const auto prefix_size = std::min(bytes.size(), std::uniform_int_distribution<std::size_t>{ 1, signature.size }(gen));
+				for (auto i = std::size_t{ 0 }; i < prefix_size; ++i) {
+					if (signature.mask[i] != 0) {
+						bytes[i] = signature.pattern[i];
+					}
+				}
+			}
+
+			const auto id = detail::get_id_deep<deep_alg_version::DEEP_ALG_V0>(bytes.data(), bytes.size(), mime_id::unknown);
+
+			// The hint only ever makes the answer come sooner: the right one (taking the fast path), a wrong one or none at all
+			const auto wrong_hint = static_cast<mime_id>(std::size_t(n) % detail::mime_types.size());
+			for (const auto hint : { mime_id::unknown, id, wrong_hint }) {
+				ASSERT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V0>(bytes.data(), bytes.size(), hint)), id);
+				ASSERT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V1>(bytes.data(), bytes.size(), hint)), id);
+				ASSERT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V2>(bytes.data(), bytes.size(), hint)), id);
+				ASSERT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V3>(bytes.data(), bytes.size(), hint)), id);
+				ASSERT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V4>(bytes.data(), bytes.size(), hint)), id);
+				ASSERT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V5>(bytes.data(), bytes.size(), hint)), id);
+			}
+
+			// Every SIMD implementation the CPU supports, not only the one picked by the dispatch
+			for (auto level = detail::simd_level::scalar; level <= max_simd_level; level = detail::simd_level(int(level) + 1)) {
+				ASSERT_EQ(detail::get_simd_match(level)(bytes.data(), bytes.size()), id);
+			}
+		}
+	}
+
+	// Tests that every engine can be picked at runtime, and that autotune picks one of them from a sample
+	TEST(FileMime, TestsEngines) {
+		EXPECT_EQ(get_engine(), engine::v3);
+		const auto previous = get_engine();
+
+		auto gen = std::mt19937{ 12 };
+		auto signature_dis = std::uniform_int_distribution<std::size_t>{ 0, magic_signatures.size() - 1 };
+		auto headers = std::vector<std::vector<std::uint8_t>>{};
+		auto hints = std::vector<mime_id>{};
+		for (auto n = 0; n < 2000; ++n) {
+			const auto& signature = magic_signatures[signature_dis(gen)];
+			auto bytes = make_header(gen, signature, n);
+			hints.push_back(n % 3 == 0 ? signature.id : mime_id::unknown);
+			headers.push_back(std::move(bytes));
+		}
+
+		const auto engines = { engine::v0, engine::v1, engine::v2, engine::v3, engine::v4, engine::v5 };
+		for (auto i = std::size_t{ 0 }; i < headers.size(); ++i) {
+			const auto& bytes = headers[i];
+			const auto id = get_id_deep(bytes.data(), bytes.size(), hints[i]);
+			for (const auto selected : engines) {
+				ASSERT_EQ(get_id_deep(bytes.data(), bytes.size(), selected, hints[i]), id);
+			}
+		}
+
+		// The engine of the calls that don't pick one is the same for every thread
+		for (const auto selected : engines) {
+			set_engine(selected);
+			auto thread = std::thread([selected]() {
+				EXPECT_EQ(get_engine(), selected);
+				EXPECT_EQ(get_id_deep(png_bytes.data(), png_bytes.size()), mime_id::png);
+			});
+			thread.join();
+			EXPECT_EQ(get_id_from_file(std::string_view("../test/test_files/Image_1.jpg")).id, mime_id::jpeg);
+		}
+
+		auto sample = std::vector<const std::uint8_t*>{};
+		auto sizes = std::vector<std::size_t>{};
+		for (const auto& bytes : headers) {
+			sample.push_back(bytes.data());
+			sizes.push_back(bytes.size());
+		}
+		const auto result = autotune(sample.data(), sizes.data(), sample.size(), hints.data(), 2);
+		EXPECT_EQ(get_engine(), result.selected);
+		for (const auto ns : result.ns_per_header) {
+			EXPECT_GT(ns, 0.0);
+			EXPECT_GE(ns, result.ns_per_header[static_cast<std::size_t>(result.selected)]);
+		}
+
+		// An empty sample keeps the current engine
+		set_engine(engine::v1);
+		EXPECT_EQ(autotune(nullptr, nullptr, 0).selected, engine::v1);
+		EXPECT_EQ(get_engine(), engine::v1);
+
+		set_engine(previous);
+	}
+
+	// Tests that the perfect hash of approach 3 gives every magic number prefix a slot of its own, and only probes the prefix lengths in use
+	TEST(FileMime, TestsPerfectHash) {
+		using detail::deep_alg_version;
+
+		auto slots = std::vector<bool>(detail::prefix_hash.slots.size());
+		for (const auto& signature : detail::sorted_magic_signatures) {
+			const auto& slot = detail::prefix_hash.find(detail::prefix_key(signature));
+			EXPECT_EQ(slot.size, signature.prefix_size);
+			EXPECT_TRUE(detail::same_prefix(detail::sorted_magic_signatures[slot.first], signature));
+			slots[std::size_t(&slot - detail::prefix_hash.slots.data())] = true;
+		}
+		EXPECT_EQ(std::count(slots.begin(), slots.end(), true), std::ptrdiff_t(slots.size()));
+		EXPECT_TRUE(std::is_sorted(detail::prefix_hash.lengths.begin(), detail::prefix_hash.lengths.end()));
+		EXPECT_LT(detail::prefix_hash.lengths.size(), max_file_header_size - min_file_header_size);
+
+		// A header that lands on the slot of a prefix without having its bytes is not a match
+		auto gen = std::mt19937{ 3 };
+		for (auto n = 0; n < 100000; ++n) {
+			const auto bytes = random_bytes(gen, max_file_header_size);
+			ASSERT_EQ((detail::get_id_deep<deep_alg_version::DEEP_ALG_V3>(bytes.data(), bytes.size(), mime_id::unknown)),
+				(detail::get_id_deep<deep_alg_version::DEEP_ALG_V0>(bytes.data(), bytes.size(), mime_id::unknown)));
+		}
+	}
+
+	// Tests the magic numbers with wildcard bytes
+	TEST(FileMime, TestsMasks) {
+		using detail::deep_alg_version;
+
+		const auto get_ids = [](const std::vector<std::uint8_t>& bytes) {
+			return std::vector<mime_id>{
+				detail::get_id_deep<deep_alg_version::DEEP_ALG_V0>(bytes.data(), bytes.size(), mime_id::unknown),
+				detail::get_id_deep<deep_alg_version::DEEP_ALG_V1>(bytes.data(), bytes.size(), mime_id::webp),
+				detail::get_id_deep<deep_alg_version::DEEP_ALG_V2>(bytes.data(), bytes.size(), mime_id::unknown),
+				detail::get_id_deep<deep_alg_version::DEEP_ALG_V3>(bytes.data(), bytes.size(), mime_id::unknown),
+				detail::get_id_deep<deep_alg_version::DEEP_ALG_V4>(bytes.data(), bytes.size(), mime_id::unknown),
+				detail::get_id_deep<deep_alg_version::DEEP_ALG_V5>(bytes.data(), bytes.size(), mime_id::unknown),
+			};
+		};
+
+		const auto webp = std::vector<std::uint8_t>{ 'R', 'I', 'F', 'F', 0x12, 0x34, 0x56, 0x78, 'W', 'E', 'B', 'P', 'V', 'P', '8', ' ' };
+		const auto wav = std::vector<std::uint8_t>{ 'R', 'I', 'F', 'F', 0xFF, 0x00, 0xFF, 0x00, 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' };
+		const auto avi = std::vector<std::uint8_t>{ 'R', 'I', 'F', 'F', 0x01, 0x02, 0x03, 0x04, 'A', 'V', 'I', ' ' };
+		const auto aiff = std::vector<std::uint8_t>{ 'F', 'O', 'R', 'M', 0x00, 0x00, 0x10, 0x00, 'A', 'I', 'F', 'F' };
+		const auto riff_unknown = std::vector<std::uint8_t>{ 'R', 'I', 'F', 'F', 0x12, 0x34, 0x56, 0x78, 'A', 'C', 'O', 'N' };
+		const auto riff_truncated = std::vector<std::uint8_t>{ 'R', 'I', 'F', 'F', 0x12, 0x34, 0x56, 0x78, 'W', 'E', 'B' };
+
+		for (const auto id : get_ids(webp)) {
+			EXPECT_EQ(id, mime_id::webp);
+		}
+		for (const auto id : get_ids(wav)) {
+			EXPECT_EQ(id, mime_id::wav);
+		}
+		for (const auto id : get_ids(avi)) {
+			EXPECT_EQ(id, mime_id::avi);
+		}
+		for (const auto id : get_ids(aiff)) {
+			EXPECT_EQ(id, mime_id::aiff);
+		}
+		for (const auto id : get_ids(riff_unknown)) {
+			EXPECT_EQ(id, mime_id::unknown);
+		}
+		for (const auto id : get_ids(riff_truncated)) {
+			EXPECT_EQ(id, mime_id::unknown);
+		}
+	}
+
+	// Tests the magic numbers at an offset from the start of the file
+	TEST(FileMime, TestsOffsets) {
+		namespace fs = std::filesystem;
+
+		const auto heic = std::vector<std::uint8_t>{ 0x00, 0x00, 0x00, 0x18, 'f', 't', 'y', 'p', 'h', 'e', 'i', 'c', 0x00, 0x00, 0x00, 0x00 };
+		const auto avif = std::vector<std::uint8_t>{ 0x00, 0x00, 0x00, 0x20, 'f', 't', 'y', 'p', 'a', 'v', 'i', 'f' };
+		const auto mp4 = std::vector<std::uint8_t>{ 0x00, 0x00, 0x00, 0x1C, 'f', 't', 'y', 'p', 'i', 's', 'o', 'm', 0x00, 0x00, 0x02, 0x00 };
+		const auto ftyp_unknown = std::vector<std::uint8_t>{ 0x00, 0x00, 0x00, 0x1C, 'f', 't', 'y', 'p', 'q', 't', ' ', ' ' };
+
+		EXPECT_EQ(get_id_deep(heic.data(), heic.size()), mime_id::heic);
+		EXPECT_EQ(get_id_deep(avif.data(), avif.size(), mime_id::avif), mime_id::avif);
+		EXPECT_EQ(get_id_deep(mp4.data(), mp4.size()), mime_id::mp4);
+		EXPECT_EQ(get_id_deep(ftyp_unknown.data(), ftyp_unknown.size()), mime_id::unknown);
+		EXPECT_EQ(get_id_deep(mp4.data(), 11), mime_id::unknown);
+
+		auto tar = std::vector<std::uint8_t>(1024, 0);
+		std::copy_n("file.txt", 8, tar.begin());
+		std::copy_n("ustar", 5, tar.begin() + 257);
+		auto iso = std::vector<std::uint8_t>(32768 + 2048, 0);
+		std::copy_n("\x01" "CD001", 6, iso.begin() + 32768);
+
+		EXPECT_EQ(get_id_deep(tar.data(), tar.size()), mime_id::tar);
+		EXPECT_EQ(get_id_deep(tar.data(), 261), mime_id::unknown);
+		EXPECT_EQ(get_id_deep(iso.data(), iso.size()), mime_id::iso);
+
+		// The magic numbers within the first 512 bytes are folded into the first read, only the ones beyond take an extra read each, so that an ISO image doesn't have to be read in full.
+		static_assert(detail::header_read_size == 257 + 5);
+		static_assert(detail::read_plan.size() == 1);
+		EXPECT_EQ(detail::read_plan[0].offset, 32769u);
+
+		// The same through the file I/O path, which only reads the planned byte ranges
+		const auto write_file = [](const fs::path& path, const std::vector<std::uint8_t>& bytes) {
+			auto file = std::ofstream(path, std::ios::binary);
+			file.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+		};
+
+		const auto tar_path = fs::temp_directory_path() / "file_mime_test.tar.bin";
+		const auto iso_path = fs::temp_directory_path() / "file_mime_test.iso.bin";
+		const auto heic_path = fs::temp_directory_path() / "file_mime_test.heic.bin";
+		write_file(tar_path, tar);
+		write_file(iso_path, iso);
+		write_file(heic_path, heic);
+
+		EXPECT_EQ(get_id(tar_path.string(), true), mime_id::tar);
+		EXPECT_EQ(get_id(iso_path.string(), true), mime_id::iso);
+		EXPECT_EQ(get_id(heic_path.string(), true), mime_id::heic);
+
+		fs::remove(tar_path);
+		fs::remove(iso_path);
+		fs::remove(heic_path);
+	}
+
+	// Tests the mime id API
+	TEST(FileMime, TestsIds) {
+		EXPECT_EQ(get_type_from_id(mime_id::png), "image/png");
+		EXPECT_EQ(get_extension_from_id(mime_id::jpeg), ".jpg");
+		EXPECT_EQ(get_type_from_id(mime_id::unknown), "");
+		EXPECT_EQ(get_extension_from_id(mime_id::unknown), "");
+
+		EXPECT_EQ(get_id_from_type("Model/glTF-Binary"), mime_id::gltf_binary);
+		EXPECT_EQ(get_id_from_type(""), mime_id::unknown);
+		EXPECT_EQ(get_id_from_type("image/unknown_mime_type"), mime_id::unknown);
+
+		EXPECT_EQ(get_id_from_extension(".JPEG"), mime_id::jpeg);
+		EXPECT_EQ(get_id_from_extension(".tif"), mime_id::tiff);
+		EXPECT_EQ(get_id_from_extension(""), mime_id::unknown);
+		static_assert(get_id_from_extension(".Jpg") == mime_id::jpeg && get_id_shallow("a/b.c.WEBP") == mime_id::webp);
+
+		// The perfect hash probes a single slot, the strings that hash there without being equal to its key are rejected
+		const auto linear_search = [](const std::string_view extension) {
+			for (const auto& info : detail::extensions) {
+				if (detail::equals_lowercase(extension, info.extension)) {
+					return info.id;
+				}
+			}
+			return mime_id::unknown;
+		};
+		for (const auto& info : detail::extensions) {
+			for (const auto& near_miss : { std::string(info.extension.substr(1)), std::string(info.extension) + "x", std::string(info.extension.substr(0, info.extension.size() - 1)) }) {
+				EXPECT_EQ(get_id_from_extension(near_miss), linear_search(near_miss)) << near_miss;
+			}
+		}
+		EXPECT_EQ(get_type_from_extension(std::string_view(".GIF")), "image/gif");
+		EXPECT_EQ(get_extension_from_type(std::string_view("IMAGE/PNG")), ".png");
+
+		EXPECT_EQ(get_id_shallow("../test/test_files/Image_4.png"), mime_id::png);
+		EXPECT_EQ(get_id_shallow("archive.tar.KTX2"), mime_id::ktx2);
+		EXPECT_EQ(get_id_shallow("../test/.png"), mime_id::unknown);
+		EXPECT_EQ(get_id_shallow("../test.png/file"), mime_id::unknown);
+		EXPECT_EQ(get_id_shallow(".."), mime_id::unknown);
+
+		EXPECT_EQ(get_id_deep(png_bytes.data(), png_bytes.size()), mime_id::png);
+		EXPECT_EQ(get_id_deep(png_bytes.data(), png_bytes.size(), mime_id::jpeg), mime_id::png);
+		EXPECT_EQ(get_id("../test/test_files/Image_2 - jpeg with wrong extension.png"), mime_id::png);
+		EXPECT_EQ(get_id("../test/test_files/Image_2 - jpeg with wrong extension.png", true), mime_id::jpeg);
+
+		// Every mime id round-trips through its type and extension
+		for (auto i = std::size_t{ 1 }; i < detail::mime_types.size(); ++i) {
+			const auto id = static_cast<mime_id>(i);
+			EXPECT_EQ(get_id_from_type(get_type_from_id(id)), id);
+			EXPECT_EQ(get_id_from_extension(get_extension_from_id(id)), id);
+		}
+	}
+
+	// Tests the allocation-free file classification, which reports the failures instead of asserting
+	TEST(FileMime, TestsFileIds) {
+		namespace fs = std::filesystem;
+
+		auto result = get_id_from_file(std::string_view("../test/test_files/Image_2 - jpeg with wrong extension.png"));
+		EXPECT_EQ(result.id, mime_id::jpeg);
+		EXPECT_EQ(result.error, 0);
+		EXPECT_TRUE(result.mismatch);
+		EXPECT_FALSE(get_id_from_file(std::string_view("../test/test_files/Image_2.jpeg")).mismatch);
+		EXPECT_FALSE(get_id_from_file(std::string_view("../test/test_files/Image_4.png")).mismatch);
+		EXPECT_FALSE(detector{}.get_id_from_file("../test/test_files/Image_4.png").mismatch);
+		EXPECT_FALSE(detector{}.get_id_from_file("../test/test_files/Model_1 - glb with wrong extension.gltf").mismatch); // .gltf isn't a type of its own
+
+		result = get_id_from_file(std::string_view("../non_existing_path/Image_0.png"));
+		EXPECT_EQ(result.id, mime_id::png);
+		EXPECT_EQ(result.error, ENOENT);
+
+		result = get_id_from_file(std::string_view(std::string(detail::max_path_size, 'a')));
+		EXPECT_EQ(result.error, ENAMETOOLONG);
+
+		// The path doesn't have to be null-terminated
+		const auto paths = std::string_view("../test/test_files/Image_4.png../test/test_files/Image_6.gif");
+		EXPECT_EQ(get_id_from_file(paths.substr(0, 30)).id, mime_id::png);
+
+		// The stream position is irrelevant, and the magic numbers beyond the header are still found
+		auto tar = std::vector<std::uint8_t>(1024, 0);
+		std::copy_n("ustar", 5, tar.begin() + 257);
+		const auto tar_path = fs::temp_directory_path() / "file_mime_test_fd.bin";
+		{
+			auto file = std::ofstream(tar_path, std::ios::binary);
+			file.write(reinterpret_cast<const char*>(tar.data()), std::streamsize(tar.size()));
+		}
+
+		auto* file = std::fopen(tar_path.string().c_str(), "rb");
+		ASSERT_NE(file, nullptr);
+		std::fseek(file, 100, SEEK_SET);
+		result = get_id_from_file(file, mime_id::png);
+		EXPECT_EQ(result.id, mime_id::tar);
+		EXPECT_EQ(result.error, 0);
+		EXPECT_TRUE(result.mismatch);
+		EXPECT_FALSE(get_id_from_file(file, mime_id::tar).mismatch);
+		EXPECT_EQ(get_id_from_file(file).id, mime_id::tar);
+		std::fclose(file);
+
+		EXPECT_EQ(get_id_from_file(static_cast<std::FILE*>(nullptr), mime_id::gif).id, mime_id::gif);
+		EXPECT_EQ(get_id_from_file(-1, mime_id::gif).id, mime_id::gif);
+		EXPECT_EQ(get_id_from_file(-1, mime_id::gif).error, EBADF);
+
+		fs::remove(tar_path);
+	}
+
+	// Tests the instrumentation counters, summed over the threads that did the counting (including the ones that have exited)
+	TEST(FileMime, TestsStats) {
+		EXPECT_EQ(stats().enabled, detail::stats_enabled);
+		// The builds with and without the counters don't share any symbol
+#if defined(FILE_MIME_STATS)
+		static_assert(std::is_same_v<decltype(file_mime::stats_on::stats()), statistics>);
+#else
+		static_assert(std::is_same_v<decltype(file_mime::stats_off::stats()), statistics>);
+#endif
+		reset_stats();
+		if (!detail::stats_enabled) {
+			EXPECT_EQ(get_id_from_file(std::string_view("../test/test_files/Image_4.png")).id, mime_id::png);
+			EXPECT_EQ(stats().files, 0u);
+			return;
+		}
+
+		// A hint hit, a hint miss and a file that can't be opened
+		EXPECT_EQ(get_id_from_file(std::string_view("../test/test_files/Image_4.png")).id, mime_id::png);
+		EXPECT_EQ(get_id_from_file(std::string_view("../test/test_files/Image_2 - jpeg with wrong extension.png")).id, mime_id::jpeg);
+		EXPECT_EQ(get_id_from_file(std::string_view("../non_existing_path/Image_0.png")).error, ENOENT);
+		auto thread = std::thread([]() {
+			EXPECT_EQ(get_id_deep(gif_bytes_87a.data(), gif_bytes_87a.size()), mime_id::gif);
+			EXPECT_EQ(get_id_deep(gif_bytes_87a.data(), gif_bytes_87a.size(), mime_id::gif), mime_id::gif);
+		});
+		thread.join();
+		const auto text = std::array<std::uint8_t, 4>{ 't', 'e', 'x', 't' };
+		auto ids = std::array<mime_id, 1>{};
+		get_id_deep_batch(text.data(), text.size(), 1, ids.data());
+		// A hinted batch, with a hit and a miss
+		const auto gifs = std::array<const std::uint8_t*, 2>{ gif_bytes_87a.data(), gif_bytes_87a.data() };
+		const auto gif_sizes = std::array<std::size_t, 2>{ gif_bytes_87a.size(), gif_bytes_87a.size() };
+		const auto hints = std::array<mime_id, 2>{ mime_id::gif, mime_id::png };
+		auto hinted_ids = std::array<mime_id, 2>{};
+		get_id_deep_batch(gifs.data(), gif_sizes.data(), 2, hinted_ids.data(), hints.data());
+		EXPECT_EQ(hinted_ids[0], mime_id::gif);
+		EXPECT_EQ(hinted_ids[1], mime_id::gif);
+
+		const auto counts = stats();
+		// The batches are always classified by approach 4
+		auto engine_calls = std::array<std::uint64_t, detail::deep_alg_count>{};
+		engine_calls[static_cast<std::size_t>(get_engine())] += 4;
+		engine_calls[static_cast<std::size_t>(engine::v4)] += 3;
+		EXPECT_EQ(counts.engine_calls, engine_calls);
+		EXPECT_EQ(counts.hint_hits, 3u);
+		EXPECT_EQ(counts.hint_misses, 2u);
+		EXPECT_EQ(counts.results[static_cast<std::size_t>(mime_id::png)], 1u);
+		EXPECT_EQ(counts.results[static_cast<std::size_t>(mime_id::jpeg)], 1u);
+		EXPECT_EQ(counts.results[static_cast<std::size_t>(mime_id::gif)], 4u);
+		EXPECT_EQ(counts.results[static_cast<std::size_t>(mime_id::unknown)], 1u);
+
+		// An open, a read and a close for each of the files, and the failed open
+		EXPECT_EQ(counts.files, 2u);
+		EXPECT_EQ(counts.syscalls, 7u);
+		EXPECT_EQ(counts.bytes_read, 2 * detail::header_read_size);
+		for (const auto* histogram : { &counts.io_latency, &counts.lookup_latency }) {
+			EXPECT_EQ(histogram->count, 2u);
+			EXPECT_EQ(std::accumulate(histogram->counts.begin(), histogram->counts.end(), std::uint64_t{ 0 }), 2u);
+		}
+		EXPECT_GT(counts.io_latency.total_ns, 0u);
+
+		reset_stats();
+		EXPECT_EQ(stats().files, 0u);
+		EXPECT_EQ(stats().hint_hits, 0u);
+	}
+
+	// Tests that the structural checks pass the test files, and catch truncated files and the files that merely start with a magic number
+	TEST(FileMime, TestsValidate) {
+		namespace fs = std::filesystem;
+
+		for (const auto& entry : fs::directory_iterator("../test/test_files")) {
+			const auto result = get_id_from_file_validated(entry.path().string());
+			EXPECT_EQ(result.error, 0);
+			EXPECT_EQ(result.id, get_id_from_file(entry.path().string()).id);
+			const auto checked = result.id != mime_id::jp2 && result.id != mime_id::unknown;
+			EXPECT_EQ(result.status, checked ? validation::valid : validation::unchecked) << entry.path();
+
+			auto file = std::ifstream(entry.path(), std::ios::binary);
+			const auto bytes = std::vector<std::uint8_t>(std::istreambuf_iterator<char>(file), {});
+			EXPECT_EQ(validate(bytes.data(), bytes.size(), result.id), result.status);
+
+			// Every truncation is looked at without reading past its end (for the sanitizers), and the ones that cut the file in half are caught where the structure tells
+			for (auto size = std::size_t{ 0 }; size < std::min<std::size_t>(bytes.size(), 2048); ++size) {
+				(void)validate(bytes.data(), size, result.id);
+			}
+			const auto half = validate(bytes.data(), bytes.size() / 2, result.id);
+			if (contains(make_mime_set({ mime_id::png, mime_id::bmp, mime_id::gltf_binary, mime_id::ktx2, mime_id::webp, mime_id::tga }), result.id)) {
+				EXPECT_EQ(half, validation::invalid) << entry.path();
+			}
+		}
+
+		// Files that only start with a magic number
+		const auto text = std::string_view("BM is a text file, not a bitmap");
+		const auto text_bytes = reinterpret_cast<const std::uint8_t*>(text.data());
+		EXPECT_EQ(get_id_deep(text_bytes, text.size()), mime_id::bmp);
+		EXPECT_EQ(validate(text_bytes, text.size(), mime_id::bmp), validation::invalid);
+		const auto riff = std::string_view("RIFF\x10\x00\x00\x00WEBPgarbage, or a truncated file");
+		EXPECT_EQ(validate(reinterpret_cast<const std::uint8_t*>(riff.data()), riff.size(), mime_id::webp), validation::invalid);
+		auto tga = std::vector<std::uint8_t>(tga_bytes_uncompressed.begin(), tga_bytes_uncompressed.end());
+		tga.resize(64);
+		EXPECT_EQ(validate(tga.data(), tga.size(), mime_id::tga), validation::invalid);
+		EXPECT_EQ(validate(tiff_bytes_mono.data(), tiff_bytes_mono.size(), mime_id::tiff), validation::unchecked);
+
+		// A single corrupted byte in the PNG header fails its CRC
+		auto file = std::ifstream("../test/test_files/Image_4.png", std::ios::binary);
+		auto png = std::vector<std::uint8_t>(std::istreambuf_iterator<char>(file), {});
+		png[20] ^= 1;
+		EXPECT_EQ(validate(png.data(), png.size(), mime_id::png), validation::invalid);
+
+		// The hint stays unchecked when the file can't be read
+		const auto missing = get_id_from_file_validated("../test/test_files/non_existing.png");
+		EXPECT_EQ(missing.id, mime_id::png);
+		EXPECT_EQ(missing.error, ENOENT);
+		EXPECT_EQ(missing.status, validation::unchecked);
+	}
+
+	// Tests that the image properties are read from the headers of the test files and of a few hand-made headers
+	TEST(FileMime, TestsProbe) {
+		struct expected_info {
+			std::string_view file;
+			mime_id id;
+			std::uint32_t width;
+			std::uint32_t height;
+			std::uint32_t channels;
+			std::uint32_t bit_depth;
+			std::uint32_t frames;
+			std::uint32_t levels;
+		};
+
+		const auto files = std::array{
+			expected_info{ "Image_1.jpg", mime_id::jpeg, 123, 128, 3, 8, 1, 1 },
+			expected_info{ "Image_2.jpeg", mime_id::jpeg, 64, 512, 3, 8, 1, 1 },
+			expected_info{ "Image_3.tga", mime_id::tga, 640, 426, 3, 8, 1, 1 },
+			expected_info{ "Image_4.png", mime_id::png, 32, 32, 4, 8, 1, 1 },
+			expected_info{ "Image_5.bmp", mime_id::bmp, 16, 16, 1, 4, 1, 1 },
+			expected_info{ "Image_6.gif", mime_id::gif, 1, 1, 1, 1, 0, 1 },
+			expected_info{ "Image_7.ktx2", mime_id::ktx2, 1024, 1024, 3, 8, 1, 11 },
+			expected_info{ "Image_8.webp", mime_id::webp, 320, 214, 3, 8, 1, 1 },
+			expected_info{ "Image_9.tif", mime_id::tiff, 123, 128, 3, 8, 1, 1 },
+		};
+		for (const auto& expected : files) {
+			const auto path = std::string("../test/test_files/") + std::string(expected.file);
+			const auto result = probe(path);
+			EXPECT_EQ(result.error, 0);
+			EXPECT_TRUE(result.probed) << path;
+			EXPECT_EQ(result.id, expected.id);
+			EXPECT_EQ(result.width, expected.width) << path;
+			EXPECT_EQ(result.height, expected.height) << path;
+			EXPECT_EQ(result.channels, expected.channels) << path;
+			EXPECT_EQ(result.bit_depth, expected.bit_depth) << path;
+			EXPECT_EQ(result.frames, expected.frames) << path;
+			EXPECT_EQ(result.levels, expected.levels) << path;
+			EXPECT_EQ(result.faces, 1u) << path;
+
+			// The same from the bytes in memory
+			auto file = std::ifstream(path, std::ios::binary);
+			const auto bytes = std::vector<std::uint8_t>(std::istreambuf_iterator<char>(file), {});
+			const auto in_memory = probe(bytes.data(), bytes.size());
+			EXPECT_EQ(in_memory.width, expected.width);
+			EXPECT_EQ(in_memory.channels, expected.channels);
+
+			// Truncated headers are never read past their end (for the sanitizers)
+			for (auto size = std::size_t{ 0 }; size < std::min<std::size_t>(bytes.size(), 1024); ++size) {
+				(void)probe(bytes.data(), size);
+			}
+		}
+
+		// A KTX2 data format descriptor block too small to hold any sample reports no channels
+		{
+			auto file = std::ifstream("../test/test_files/Image_7.ktx2", std::ios::binary);
+			auto bytes = std::vector<std::uint8_t>(std::istreambuf_iterator<char>(file), {});
+			const auto dfd_offset = std::size_t{ detail::load_le<std::uint32_t>(&bytes[48]) };
+			bytes[dfd_offset + 10] = 8;
+			bytes[dfd_offset + 11] = 0;
+			const auto result = probe(bytes.data(), bytes.size());
+			EXPECT_TRUE(result.probed);
+			EXPECT_EQ(result.width, 1024u);
+			EXPECT_EQ(result.channels, 0u);
+		}
+
+		const auto glb = probe("../test/test_files/Model_1.glb");
+		EXPECT_TRUE(glb.probed);
+		EXPECT_EQ(glb.json_size, 956u);
+		EXPECT_FALSE(probe("../test/test_files/Nonimage_1.pdf").probed);
+		EXPECT_EQ(probe("../test/test_files/non_existing.png").error, ENOENT);
+
+		const auto append = [](std::vector<std::uint8_t>& bytes, const std::string_view text) {
+			bytes.insert(bytes.end(), text.begin(), text.end());
+		};
+		const auto append_le32 = [](std::vector<std::uint8_t>& bytes, const std::uint32_t value) {
+			for (auto i = 0; i < 4; ++i) {
+				bytes.push_back(std::uint8_t(value >> (8 * i)));
+			}
+		};
+
+		// An OpenEXR header with 3 half channels and a 100x50 data window
+		auto exr = std::vector<std::uint8_t>(exr_bytes.begin(), exr_bytes.end());
+		append_le32(exr, 2);
+		append(exr, std::string_view("channels\0chlist\0", 16));
+		append_le32(exr, 3 * 18 + 1);
+		for (const auto channel : { "B", "G", "R" }) {
+			append(exr, std::string_view(channel, 2));
+			append_le32(exr, 1);
+			append_le32(exr, 0);
+			append_le32(exr, 1);
+			append_le32(exr, 1);
+		}
+		exr.push_back(0);
+		append(exr, std::string_view("dataWindow\0box2i\0", 17));
+		append_le32(exr, 16);
+		for (const auto value : { 0, 0, 99, 49 }) {
+			append_le32(exr, std::uint32_t(value));
+		}
+		exr.push_back(0);
+		auto result = probe(exr.data(), exr.size());
+		EXPECT_EQ(result.id, mime_id::exr);
+		EXPECT_EQ(result.width, 100u);
+		EXPECT_EQ(result.height, 50u);
+		EXPECT_EQ(result.channels, 3u);
+		EXPECT_EQ(result.bit_depth, 16u);
+
+		// A Radiance HDR resolution line
+		const auto hdr = std::string_view("#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y 480 +X 640\n");
+		result = probe(reinterpret_cast<const std::uint8_t*>(hdr.data()), hdr.size());
+		EXPECT_EQ(result.id, mime_id::hdr);
+		EXPECT_EQ(result.width, 640u);
+		EXPECT_EQ(result.height, 480u);
+		// The rotated orientations list X first, and an axis given twice is rejected
+		for (const auto line : { "+X 640 -Y 480\n", "-X 640 +Y 480\n", "+Y 480 -X 640\n" }) {
+			const auto rotated = std::string("#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n") + line;
+			result = probe(reinterpret_cast<const std::uint8_t*>(rotated.data()), rotated.size());
+			EXPECT_EQ(result.width, 640u) << line;
+			EXPECT_EQ(result.height, 480u) << line;
+		}
+		const auto twice = std::string_view("#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y 480 +Y 640\n");
+		EXPECT_EQ(probe(reinterpret_cast<const std::uint8_t*>(twice.data()), twice.size()).width, 0u);
+
+		// A KTX 1 header of an RGBA8 texture array with a full mip chain
+		auto ktx = std::vector<std::uint8_t>(ktx1_bytes.begin(), ktx1_bytes.end());
+		for (const auto value : { 0x04030201u, 0x1401u, 1u, 0x1908u, 0x8058u, 0x1908u, 256u, 128u, 0u, 4u, 1u, 9u, 0u }) {
+			append_le32(ktx, value);
+		}
+		result = probe(ktx.data(), ktx.size());
+		EXPECT_EQ(result.id, mime_id::ktx);
+		EXPECT_EQ(result.width, 256u);
+		EXPECT_EQ(result.height, 128u);
+		EXPECT_EQ(result.channels, 4u);
+		EXPECT_EQ(result.bit_depth, 8u);
+		EXPECT_EQ(result.frames, 4u);
+		EXPECT_EQ(result.levels, 9u);
+
+		// An extended WebP header of an animation with alpha
+		auto webp = std::vector<std::uint8_t>{};
+		append(webp, "RIFF");
+		append_le32(webp, 22);
+		append(webp, "WEBPVP8X");
+		append_le32(webp, 10);
+		for (const auto byte : { 0x12, 0, 0, 0, 0x8F, 0x01, 0, 0x2B, 0x01, 0 }) {
+			webp.push_back(std::uint8_t(byte));
+		}
+		result = probe(webp.data(), webp.size());
+		EXPECT_EQ(result.id, mime_id::webp);
+		EXPECT_EQ(result.width, 400u);
+		EXPECT_EQ(result.height, 300u);
+		EXPECT_EQ(result.channels, 4u);
+		EXPECT_EQ(result.frames, 0u);
+	}
+
+	// Tests that the batch classification agrees with get_id_deep, for the array of pointers and for the fixed-stride block
+	TEST(FileMime, TestsBatch) {
+		auto gen = std::mt19937{ 7 };
+		auto length_dis = std::uniform_int_distribution<std::size_t>{ 0, max_file_header_size };
+		auto signature_dis = std::uniform_int_distribution<std::size_t>{ 0, detail::anchored_signatures.size() - 1 };
+
+		// Not a multiple of the batch size, and some headers are too small to determine their type
+		constexpr auto count = std::size_t{ 1001 };
+		constexpr auto stride = max_file_header_size;
+		auto block = std::vector<std::uint8_t>(count * stride);
+		auto headers = std::vector<const std::uint8_t*>(count);
+		auto sizes = std::vector<std::size_t>(count);
+		for (auto i = std::size_t{ 0 }; i < count; ++i) {
+			headers[i] = block.data() + i * stride;
+			sizes[i] = length_dis(gen);
+			const auto bytes = random_bytes(gen, stride);
+			std::copy(bytes.begin(), bytes.end(), block.begin() + i * stride);
+
+			if (i % 2 == 0) {
+				stamp_signature(detail::anchored_signatures[signature_dis(gen)], block.data() + i * stride, stride);
+			}
+		}
+
+		auto ids = std::vector<mime_id>(count);
+		get_id_deep_batch(headers.data(), sizes.data(), count, ids.data());
+		auto strided_ids = std::vector<mime_id>(count);
+		get_id_deep_batch(block.data(), stride, sizes.data(), count, strided_ids.data());
+		auto full_ids = std::vector<mime_id>(count);
+		get_id_deep_batch(block.data(), stride, count, full_ids.data());
+
+		// Half of the headers get a random hint, which is checked before their DFA walk like in get_id_deep (most of them miss)
+		auto hints = std::vector<mime_id>(count);
+		for (auto i = std::size_t{ 0 }; i < count; i += 2) {
+			hints[i] = detail::anchored_signatures[signature_dis(gen)].id;
+		}
+		auto hinted_ids = std::vector<mime_id>(count);
+		get_id_deep_batch(headers.data(), sizes.data(), count, hinted_ids.data(), hints.data());
+		auto hinted_full_ids = std::vector<mime_id>(count);
+		get_id_deep_batch(block.data(), stride, count, hinted_full_ids.data(), hints.data());
+
+		for (auto i = std::size_t{ 0 }; i < count; ++i) {
+			const auto id = sizes[i] < min_file_header_size ? mime_id::unknown : get_id_deep(headers[i], sizes[i]);
+			EXPECT_EQ(ids[i], id);
+			EXPECT_EQ(strided_ids[i], id);
+			EXPECT_EQ(full_ids[i], get_id_deep(headers[i], stride));
+			EXPECT_EQ(hinted_ids[i], sizes[i] < min_file_header_size ? mime_id::unknown : get_id_deep(headers[i], sizes[i], hints[i]));
+			EXPECT_EQ(hinted_full_ids[i], get_id_deep(headers[i], stride, hints[i]));
+		}
+	}
+
+	// Tests the parallel classification of a directory tree
+	TEST(FileMime, TestsClassifyTree) {
+		namespace fs = std::filesystem;
+
+		const auto root = fs::temp_directory_path() / "file_mime_test_tree";
+		fs::remove_all(root);
+
+		const auto png = std::vector<std::uint8_t>{ 0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A, 0x00, 0x00 };
+		const auto gif = std::vector<std::uint8_t>{ 0x47, 0x49, 0x46, 0x38, 0x39, 0x61, 0x01, 0x00 };
+		auto tar = std::vector<std::uint8_t>(1024, 0);
+		std::copy_n("ustar", 5, tar.begin() + 257);
+
+		// A few levels of directories with the magic numbers and the extensions not always agreeing
+		auto expected_deep = std::map<std::string, mime_id>{};
+		auto expected_shallow = std::map<std::string, mime_id>{};
+		const auto write_file = [&](const fs::path& path, const std::vector<std::uint8_t>& bytes, const mime_id deep_id) {
+			fs::create_directories(path.parent_path());
+			auto file = std::ofstream(path, std::ios::binary);
+			file.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+			expected_deep[path.generic_string()] = deep_id;
+			expected_shallow[path.generic_string()] = get_id_shallow(path.string());
+		};
+
+		for (auto i = 0; i < 8; ++i) {
+			const auto directory = root / ("dir_" + std::to_string(i)) / ("sub_" + std::to_string(i % 3));
+			for (auto j = 0; j < 10; ++j) {
+				const auto name = "file_" + std::to_string(j);
+				write_file(directory / (name + ".png"), png, mime_id::png);
+				write_file(directory / (name + ".png.gif"), png, mime_id::png);
+				write_file(directory / (name + ".jpg"), gif, mime_id::gif);
+				write_file(directory / (name + ".tar"), tar, mime_id::tar);
+			}
+		}
+		// A directory large enough to be split into batches of files
+		for (auto j = 0; j < 300; ++j) {
+			write_file(root / "large" / ("file_" + std::to_string(j) + (j % 2 == 0 ? ".png" : ".gif")), j % 3 == 0 ? gif : png, j % 3 == 0 ? mime_id::gif : mime_id::png);
+		}
+		write_file(root / "empty.png", {}, mime_id::png);
+		fs::create_directories(root / "empty_dir");
+
+		for (const auto deep_check : { true, false }) {
+			auto options = classify_tree_options{};
+			options.thread_count = 4;
+			options.batch_size = 7;
+			options.deep_check = deep_check;
+
+			auto classified = std::map<std::string, mime_id>{};
+			auto duplicates = 0;
+			reset_stats();
+			classify_tree(root.string(), options, [&](const classified_file* files, const std::size_t count) {
+				EXPECT_LE(count, options.batch_size);
+				for (auto i = std::size_t{ 0 }; i < count; ++i) {
+					EXPECT_EQ(files[i].error, 0);
+					duplicates += classified.count(fs::path(files[i].path).generic_string()) ? 1 : 0;
+					classified[fs::path(files[i].path).generic_string()] = files[i].id;
+				}
+			});
+
+			EXPECT_EQ(duplicates, 0);
+			EXPECT_EQ(classified, deep_check ? expected_deep : expected_shallow);
+			// Every file is counted like get_id_from_file counts it: an open, a read at least and a close
+			EXPECT_EQ(stats().files, deep_check ? expected_deep.size() : 0u);
+			EXPECT_GE(stats().syscalls, deep_check ? 3 * expected_deep.size() : 0u);
+		}
+
+		// An exception thrown by the callback stops the walk and is passed on
+		EXPECT_THROW(classify_tree(root.string(), classify_tree_options{}, [](const classified_file*, std::size_t) { throw std::runtime_error("stop"); }), std::runtime_error);
+
+		// A directory that can't be listed is reported with its errno
+		auto missing = std::vector<std::pair<std::string, int>>{};
+		classify_tree((root / "missing").string(), classify_tree_options{}, [&](const classified_file* files, const std::size_t count) {
+			for (auto i = std::size_t{ 0 }; i < count; ++i) {
+				missing.emplace_back(std::string(files[i].path), files[i].error);
+			}
+		});
+		ASSERT_EQ(missing.size(), 1u);
+		EXPECT_EQ(missing[0], std::make_pair((root / "missing").string(), ENOENT));
+
+		// The paths under the root "/" start with a single separator (the walk is stopped at the first file)
+		EXPECT_EQ(detail::join_path("/", "usr"), "/usr");
+		EXPECT_EQ(detail::join_path("/usr", "lib"), "/usr/lib");
+		auto first_path = std::string{};
+		auto options = classify_tree_options{};
+		options.thread_count = 1;
+		options.batch_size = 1;
+		options.deep_check = false;
+		EXPECT_THROW(classify_tree("/", options, [&first_path](const classified_file* files, std::size_t) {
+			first_path = std::string(files[0].path);
+			throw std::runtime_error("stop");
+		}), std::runtime_error);
+		ASSERT_FALSE(first_path.empty());
+		EXPECT_EQ(first_path[0], '/');
+		EXPECT_NE(first_path.compare(0, 2, "//"), 0) << first_path;
+
+		fs::remove_all(root);
+	}
+
+	// Tests the bulk classification of a list of files, with io_uring and with the pread fallback
+	TEST(FileMime, TestsClassifyFiles) {
+		namespace fs = std::filesystem;
+
+		const auto root = fs::temp_directory_path() / "file_mime_test_files";
+		fs::remove_all(root);
+		fs::create_directories(root);
+
+		const auto png = std::vector<std::uint8_t>{ 0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A, 0x00, 0x00 };
+		const auto gif = std::vector<std::uint8_t>{ 0x47, 0x49, 0x46, 0x38, 0x39, 0x61, 0x01, 0x00 };
+		auto tar = std::vector<std::uint8_t>(1024, 0);
+		std::copy_n("ustar", 5, tar.begin() + 257);
+		auto iso = std::vector<std::uint8_t>(32768 + 2048, 0);
+		std::copy_n("\x01" "CD001", 6, iso.begin() + 32768);
+		const auto unknown = std::vector<std::uint8_t>(100, 0x20);
+
+		auto paths = std::vector<std::string>{};
+		auto expected = std::vector<mime_id>{};
+		const auto write_file = [&](const std::string& name, const std::vector<std::uint8_t>& bytes, const mime_id id) {
+			paths.push_back((root / name).string());
+			expected.push_back(id);
+			auto file = std::ofstream(paths.back(), std::ios::binary);
+			file.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+		};
+
+		// More files than the queue depth, so that the slots get reused
+		for (auto i = 0; i < 40; ++i) {
+			const auto name = "file_" + std::to_string(i);
+			write_file(name + ".png", png, mime_id::png);
+			write_file(name + ".png.jpg", gif, mime_id::gif);
+			write_file(name + ".tar", tar, mime_id::tar);
+			write_file(name + ".bin", unknown, mime_id::unknown);
+		}
+		write_file("image.iso", iso, mime_id::iso);
+		write_file("empty.png", {}, mime_id::png);
+		write_file("tiny.gif", { 0x47 }, mime_id::gif);
+		paths.push_back((root / "missing.jpg").string());
+		expected.push_back(mime_id::jpeg);
+
+		auto options = classify_files_options{};
+		options.queue_depth = 16;
+		options.thread_count = 4;
+
+		const auto check = [&](const std::vector<mime_id>& ids, const std::vector<int>& errors) {
+			EXPECT_EQ(ids, expected);
+			for (auto i = std::size_t{ 0 }; i + 1 < paths.size(); ++i) {
+				EXPECT_EQ(errors[i], 0);
+			}
+			EXPECT_EQ(errors.back(), ENOENT);
+		};
+
+		auto ids = std::vector<mime_id>(paths.size());
+		auto errors = std::vector<int>(paths.size(), -1);
+		reset_stats();
+		detail::classify_files_pread(paths.data(), paths.size(), options, ids.data(), errors.data());
+		check(ids, errors);
+		EXPECT_EQ(stats().files, paths.size() - 1);
+		EXPECT_GE(stats().syscalls, 3 * paths.size() - 2);
+
+		// io_uring may not be available (e.g. an old kernel or a seccomp filter), in which case there is nothing else to check
+		ids.assign(paths.size(), mime_id::unknown);
+		errors.assign(paths.size(), -1);
+		reset_stats();
+		if (detail::classify_files_io_uring(paths.data(), paths.size(), options, ids.data(), errors.data())) {
+			check(ids, errors);
+
+			// Every request is counted as the system call it stands for: an open, a read and a close per file, plus the chains of the read plan
+			EXPECT_EQ(stats().files, paths.size());
+			EXPECT_GT(stats().syscalls, 3 * paths.size());
+			EXPECT_GT(stats().bytes_read, (paths.size() - 3) * min_file_header_size);
+		}
+
+		EXPECT_EQ(classify_files(paths, options), expected);
+
+		fs::remove_all(root);
+	}
+
+	// Tests the scan for embedded files against a brute force search, with the magic numbers straddling the chunk boundaries
+	TEST(FileMime, TestsScan) {
+		namespace fs = std::filesystem;
+
+		auto gen = std::mt19937{ 11 };
+		auto bytes_dis = std::uniform_int_distribution<>{ 0, 255 };
+		auto position_dis = std::uniform_int_distribution<std::size_t>{ 0, 64 * 1024 - 1 };
+
+		auto blob = std::vector<std::uint8_t>(64 * 1024);
+		std::generate(blob.begin(), blob.end(), [&]() { return std::uint8_t(bytes_dis(gen)); });
+		const auto place = [&blob](const magic_signature& signature, const std::size_t position) {
+			for (auto i = std::size_t{ 0 }; i < signature.size && position + i < blob.size(); ++i) {
+				if (signature.mask[i] != 0) {
+					blob[position + i] = signature.pattern[i];
+				}
+			}
+		};
+		for (auto i = 0; i < 200; ++i) {
+			place(magic_signatures[std::size_t(i) % magic_signatures.size()], position_dis(gen));
+		}
+		constexpr auto chunk_size = std::size_t{ 4096 };
+		place(magic_signatures[2], chunk_size - 3); // PNG
+		place(magic_signatures[20], 3 * chunk_size - 1); // KTX2
+		place(magic_signatures[2], blob.size() - 4); // a truncated PNG at the end
+
+		for (const auto formats : { all_mime_types, make_mime_set({ mime_id::png, mime_id::jpeg, mime_id::ktx2, mime_id::gltf_binary, mime_id::mp4 }) }) {
+			auto expected = std::vector<std::pair<std::uint64_t, mime_id>>{};
+			for (auto position = std::size_t{ 0 }; position < blob.size(); ++position) {
+				for (const auto& signature : magic_signatures) {
+					if (contains(formats, signature.id) && position >= signature.offset && position + signature.size <= blob.size()
+						&& detail::matches(signature, detail::load_header(blob.data() + position, blob.size() - position))) {
+						expected.emplace_back(position - signature.offset, signature.id);
+					}
+				}
+			}
+			ASSERT_FALSE(expected.empty());
+
+			for (const auto thread_count : { 1, 4 }) {
+				auto options = scan_options{};
+				options.formats = formats;
+				options.thread_count = std::size_t(thread_count);
+				options.chunk_size = chunk_size;
+
+				auto found = std::vector<std::pair<std::uint64_t, mime_id>>{};
+				scan_embedded(blob.data(), blob.size(), options, [&found](const std::uint64_t offset, const mime_id id) {
+					found.emplace_back(offset, id);
+				});
+				EXPECT_EQ(found, expected);
+			}
+
+			// Every SIMD prefilter the CPU supports, including the AVX2 one over all the magic numbers and the SSE2 one, which only takes a few first bytes
+			const auto matcher = detail::scan_matcher(formats);
+			for (const auto level : { detail::simd_level::scalar, detail::simd_level::sse2, detail::simd_level::avx2 }) {
+				if (level > detail::detect_simd_level()) {
+					continue;
+				}
+				auto found = std::vector<std::pair<std::uint64_t, mime_id>>{};
+				detail::scan_range(matcher, detail::get_scan_block(level, matcher), blob.data(), blob.size(), 0, blob.size(), [&found](const std::uint64_t offset, const mime_id id) {
+					found.emplace_back(offset, id);
+				});
+				EXPECT_EQ(found, expected) << static_cast<int>(level);
+			}
+		}
+
+		// The same through the memory-mapped file
+		const auto path = fs::temp_directory_path() / "file_mime_test_scan.bin";
+		{
+			auto file = std::ofstream(path, std::ios::binary);
+			file.write(reinterpret_cast<const char*>(blob.data()), std::streamsize(blob.size()));
+		}
+		auto count = std::size_t{ 0 };
+		auto direct_count = std::size_t{ 0 };
+		EXPECT_EQ(scan_file(path.string(), [&count](std::uint64_t, mime_id) { ++count; }), 0);
+		scan_embedded(blob.data(), blob.size(), [&direct_count](std::uint64_t, mime_id) { ++direct_count; });
+		EXPECT_EQ(count, direct_count);
+		EXPECT_EQ(scan_file((fs::temp_directory_path() / "file_mime_non_existing.bin").string(), [](std::uint64_t, mime_id) {}), ENOENT);
+		fs::remove(path);
+	}
+
+	// Tests that the stream classifier fed in random pieces agrees with get_id_deep, and decides as early as it can
+	TEST(FileMime, TestsStreamClassifier) {
+		auto gen = std::mt19937{ 5 };
+		auto signature_dis = std::uniform_int_distribution<std::size_t>{ 0, magic_signatures.size() - 1 };
+
+		for (auto n = 0; n < 20000; ++n) {
+			const auto& signature = magic_signatures[signature_dis(gen)];
+			const auto min_size = std::size_t{ min_file_header_size };
+			const auto max_size = std::max<std::size_t>(signature.offset + signature.size + 8, min_size);
+			auto bytes = random_bytes(gen, std::uniform_int_distribution<std::size_t>{ min_size, max_size }(gen));
+
+			// Most of the streams carry a (possibly truncated) magic number
+			if (n % 4 != 0) {
+				stamp_signature(signature, bytes.data(), bytes.size());
+			}
+			const auto id = get_id_deep(bytes.data(), bytes.size());
+
+			auto classifier = stream_classifier{};
+			auto result = stream_result{};
+			for (auto position = std::size_t{ 0 }; position < bytes.size() && result.status == stream_status::need_more;) {
+				const auto size = std::min(bytes.size() - position, std::uniform_int_distribution<std::size_t>{ 1, 64 }(gen));
+				result = classifier.feed(bytes.data() + position, size);
+				position += size;
+			}
+			result = classifier.finish();
+			ASSERT_EQ(result.id, id);
+			ASSERT_EQ(result.status, id != mime_id::unknown ? stream_status::matched : stream_status::no_match);
+		}
+
+		// Decided by the first piece, and the bytes needed to decide are reported
+		auto classifier = stream_classifier{};
+		auto result = classifier.feed(png_bytes.data(), 3);
+		EXPECT_EQ(result.status, stream_status::need_more);
+		EXPECT_EQ(result.needed, 5u);
+		result = classifier.feed(png_bytes.data() + 3, 5);
+		EXPECT_EQ(result.status, stream_status::matched);
+		EXPECT_EQ(result.id, mime_id::png);
+
+		const auto pdf = std::string_view("%PDF-1.7");
+		classifier.reset();
+		result = classifier.feed(reinterpret_cast<const std::uint8_t*>(pdf.data()), pdf.size());
+		EXPECT_EQ(result.status, stream_status::need_more); // ustar at 257 and CD001 at 32769 are still possible
+		EXPECT_EQ(result.needed, 257u + 5u - pdf.size());
+
+		// A tar header only decides once the ustar magic has gone by
+		auto tar = std::vector<std::uint8_t>(512, 0);
+		std::copy_n("file.txt", 8, tar.begin());
+		std::copy_n("ustar", 5, tar.begin() + 257);
+		classifier.reset();
+		EXPECT_EQ(classifier.feed(tar.data(), 261).status, stream_status::need_more);
+		result = classifier.feed(tar.data() + 261, 1);
+		EXPECT_EQ(result.status, stream_status::matched);
+		EXPECT_EQ(result.id, mime_id::tar);
+		EXPECT_EQ(classifier.position(), 262u);
+	}
+
+	// Tests that detectors agree with get_id_deep on the formats they look for, and keep classifying while their signature set is swapped
+	TEST(FileMime, TestsDetector) {
+		auto gen = std::mt19937{ 6 };
+		auto signature_dis = std::uniform_int_distribution<std::size_t>{ 0, magic_signatures.size() - 1 };
+
+		const auto full = detector{};
+		const auto images = make_mime_set({ mime_id::png, mime_id::jpeg, mime_id::ktx2, mime_id::gltf_binary, mime_id::tar });
+		const auto subset = detector{ signature_set{ images } };
+		for (auto n = 0; n < 20000; ++n) {
+			const auto& signature = magic_signatures[signature_dis(gen)];
+			auto bytes = make_header(gen, signature, n);
+			const auto id = get_id_deep(bytes.data(), bytes.size());
+			ASSERT_EQ(full.get_id_deep(bytes.data(), bytes.size()), id);
+
+			const auto subset_id = subset.get_id_deep(bytes.data(), bytes.size());
+			if (contains(images, id)) {
+				ASSERT_EQ(subset_id, id);
+			}
+			else {
+				ASSERT_TRUE(subset_id == mime_id::unknown || contains(images, subset_id));
+			}
+		}
+		EXPECT_EQ(subset.get_id_deep(gif_bytes_89a.data(), gif_bytes_89a.size()), mime_id::unknown);
+		EXPECT_EQ(full.get_id_from_file("../test/test_files/Image_4.png").id, mime_id::png);
+		EXPECT_EQ(subset.get_id_from_file("../test/test_files/Image_1.jpg").id, mime_id::jpeg);
+		EXPECT_EQ(full.get_id_from_file("../test/test_files/non_existing.png").error, ENOENT);
+
+		// Custom signature sets are checked like the registry
+		EXPECT_THROW(signature_set(std::vector<magic_signature>{ magic_signatures[0], magic_signatures[0] }), std::invalid_argument);
+		EXPECT_THROW(signature_set(std::vector<magic_signature>{ magic_signature{ mime_id::png } }), std::invalid_argument);
+		auto wildcard_first = detail::make_signature(mime_id::png, std::array<std::int16_t, 4>{ 'A', 'B', 'C', 'D' });
+		wildcard_first.mask[0] = 0;
+		EXPECT_THROW(signature_set(std::vector<magic_signature>{ wildcard_first }), std::invalid_argument);
+		auto inflated_prefix = detail::make_signature(mime_id::png, std::array<std::int16_t, 4>{ 'A', 'B', any_byte, 'D' });
+		inflated_prefix.prefix_size = 4;
+		EXPECT_THROW(signature_set(std::vector<magic_signature>{ inflated_prefix }), std::invalid_argument);
+
+		// A header too small to determine its type is unknown whatever its hint, like in get_id_deep
+		EXPECT_EQ(subset.get_id_deep(png_bytes.data(), 1, mime_id::png), mime_id::unknown);
+		EXPECT_EQ(subset.get_id_deep(png_bytes.data(), 0, mime_id::png), mime_id::unknown);
+		const auto custom = signature_set{ std::vector<magic_signature>{ detail::make_signature(mime_id::png, std::array<std::int16_t, 4>{ 'A', 'B', any_byte, 'D' }) } };
+		const auto abcd = std::array<std::uint8_t, 4>{ 'A', 'B', 'X', 'D' };
+		EXPECT_EQ(custom.get_id_deep(abcd.data(), abcd.size()), mime_id::png);
+		EXPECT_EQ(custom.formats(), make_mime_set({ mime_id::png }));
+
+		// The readers see either the old or the new set while the sets are swapped under them
+		auto swapped = detector{ signature_set{ make_mime_set({ mime_id::png }) } };
+		auto done = std::atomic<bool>{ false };
+		auto readers = std::vector<std::thread>{};
+		auto results = std::vector<std::array<std::size_t, 2>>(3);
+		for (auto t = std::size_t{ 0 }; t < results.size(); ++t) {
+			readers.emplace_back([&swapped, &done, &result = results[t]]() {
+				while (!done.load()) {
+					const auto id = swapped.get_id_deep(png_bytes.data(), png_bytes.size());
+					++result[id == mime_id::png ? 0 : 1];
+					const auto snapshot = swapped.pin();
+					ASSERT_EQ(snapshot.get_id_deep(png_bytes.data(), png_bytes.size()), contains(snapshot.signatures().formats(), mime_id::png) ? mime_id::png : mime_id::unknown);
+				}
+			});
+		}
+		for (auto n = 0; n < 1000; ++n) {
+			swapped.swap(signature_set{ make_mime_set({ n % 2 == 0 ? mime_id::jpeg : mime_id::png }) });
+		}
+		done = true;
+		for (auto& reader : readers) {
+			reader.join();
+		}
+		EXPECT_EQ(swapped.get_id_deep(png_bytes.data(), png_bytes.size()), mime_id::png);
+	}
+
+	// Checks a compile-time subset against the full detector on random headers carrying the magic numbers of the registry, and against a signature_set of the same formats
+	template <typename Detector>
+	auto check_basic_detector(const unsigned seed) -> void {
+		auto gen = std::mt19937{ seed };
+		auto signature_dis = std::uniform_int_distribution<std::size_t>{ 0, magic_signatures.size() - 1 };
+		auto hint_dis = std::uniform_int_distribution<std::size_t>{ 0, detail::mime_types.size() - 1 };
+
+		const auto set = signature_set{ Detector::formats };
+		for (auto n = 0; n < 5000; ++n) {
+			const auto& signature = magic_signatures[signature_dis(gen)];
+			auto bytes = make_header(gen, signature, n);
+			const auto hint = (n % 3 == 0) ? static_cast<mime_id>(hint_dis(gen)) : mime_id::unknown;
+			const auto id = get_id_deep(bytes.data(), bytes.size(), hint);
+			const auto subset_id = Detector::get_id_deep(bytes.data(), bytes.size(), hint);
+			ASSERT_EQ(subset_id, set.get_id_deep(bytes.data(), bytes.size(), hint));
+			if (contains(Detector::formats, id)) {
+				ASSERT_EQ(subset_id, id);
+			}
+			else {
+				ASSERT_TRUE(subset_id == mime_id::unknown || subset_id == hint || contains(Detector::formats, subset_id));
+			}
+
+			// The same through the reads of a file, including the read plan of the magic numbers at an offset
+			const auto source = detail::memory_source{ bytes.data(), bytes.size() };
+			const auto read = [&source](uint8_t* p, const std::size_t size, const std::uint64_t offset) {
+				return source.read_at(p, size, offset);
+			};
+			ASSERT_EQ(Detector::get_id_deep_at(read, mime_id::unknown), set.get_id_deep_at(read, mime_id::unknown));
+		}
+
+		// The headers too small to determine their type are unknown whatever their hint, like in get_id_deep
+		for (const auto size : { std::size_t{ 0 }, std::size_t{ 1 } }) {
+			for (auto id = std::size_t{ 0 }; id < detail::mime_types.size(); ++id) {
+				const auto hint = static_cast<mime_id>(id);
+				ASSERT_EQ(Detector::get_id_deep(png_bytes.data(), size, hint), mime_id::unknown);
+				ASSERT_EQ(set.get_id_deep(png_bytes.data(), size, hint), mime_id::unknown);
+			}
+		}
+	}
+
+	// Tests that the compile-time subsets of the registry agree with the full detector on the formats they include
+	TEST(FileMime, TestsBasicDetector) {
+		using images = basic_detector<mime_id::png, mime_id::jpeg, mime_id::ktx2, mime_id::gltf_binary>;
+		check_basic_detector<images>(8);
+		check_basic_detector<basic_detector<mime_id::jpeg>>(9);
+		check_basic_detector<basic_detector<mime_id::webp, mime_id::wav, mime_id::avi, mime_id::tga, mime_id::jp2>>(10);
+		check_basic_detector<basic_detector<mime_id::tar, mime_id::iso, mime_id::heic, mime_id::mp4, mime_id::png>>(11);
+
+		// Only the tables of the selected formats are generated, shared by the detectors of the same set
+		static_assert(detail::subset_tables<images::formats>::anchored.size() == 9);
+		static_assert(detail::subset_tables<images::formats>::offsets.empty());
+		static_assert(basic_detector<mime_id::jpeg, mime_id::png>::formats == basic_detector<mime_id::png, mime_id::jpeg>::formats);
+
+		EXPECT_EQ(images::get_id_deep(gif_bytes_89a.data(), gif_bytes_89a.size()), mime_id::unknown);
+		EXPECT_EQ(images::get_id_deep(png_bytes.data(), png_bytes.size(), mime_id::gif), mime_id::png);
+		EXPECT_EQ(images::get_id_from_file("../test/test_files/Image_4.png").id, mime_id::png);
+		EXPECT_EQ(images::get_id_from_file("../test/test_files/Image_1.jpg").id, mime_id::jpeg);
+		EXPECT_EQ(images::get_id_from_file("../test/test_files/non_existing.png").error, ENOENT);
+	}
+
+	// Tests that the adaptive detector agrees with the registry whatever the order it learns, republishes only when the order changes and round-trips its profile
+	TEST(FileMime, TestsAdaptiveDetector) {
+		namespace fs = std::filesystem;
+
+		auto gen = std::mt19937{ 7 };
+		auto signature_dis = std::uniform_int_distribution<std::size_t>{ 0, magic_signatures.size() - 1 };
+		auto headers = std::vector<std::vector<std::uint8_t>>{};
+		for (auto n = 0; n < 4000; ++n) {
+			const auto& signature = magic_signatures[signature_dis(gen)];
+			headers.push_back(make_header(gen, signature, n));
+		}
+
+		// The rare types first: the order changes the cost only
+		auto reversed = type_profile{};
+		for (auto id = std::size_t{ 1 }; id < detail::mime_types.size(); ++id) {
+			reversed.record(static_cast<mime_id>(id), id);
+		}
+		const auto tuned = signature_set{ all_mime_types, reversed };
+		for (const auto& header : headers) {
+			ASSERT_EQ(tuned.get_id_deep(header.data(), header.size()), get_id_deep(header.data(), header.size()));
+		}
+
+		// The order is republished once JPEG dominates, and not again while it does
+		auto manual = adaptive_detector{ all_mime_types, type_profile{}, adaptive_options{ 1, 0 } };
+		for (auto n = 0; n < 100; ++n) {
+			EXPECT_EQ(manual.get_id_deep(jpg_bytes_2.data(), jpg_bytes_2.size()), mime_id::jpeg);
+		}
+		EXPECT_EQ(manual.get_id_deep(png_bytes.data(), png_bytes.size()), mime_id::png);
+		EXPECT_EQ(manual.profile().hits(mime_id::jpeg), 100u);
+		EXPECT_EQ(manual.profile().hits(mime_id::png), 1u);
+		EXPECT_TRUE(manual.retune());
+		EXPECT_EQ(manual.profile().hits(mime_id::jpeg), 50u);
+		EXPECT_FALSE(manual.retune());
+
+		// A lookup that completes a retune period publishes without waiting, even for a snapshot held by its own thread
+		auto pinned = adaptive_detector{ all_mime_types, type_profile{}, adaptive_options{ 1, 16 } };
+		{
+			const auto snapshot = pinned.pin();
+			for (auto n = 0; n < 64; ++n) {
+				EXPECT_EQ(pinned.get_id_deep(n % 8 == 0 ? png_bytes.data() : jpg_bytes_2.data(), n % 8 == 0 ? png_bytes.size() : jpg_bytes_2.size()), n % 8 == 0 ? mime_id::png : mime_id::jpeg);
+			}
+			EXPECT_NE(&pinned.pin().signatures(), &snapshot.signatures());
+			EXPECT_EQ(snapshot.get_id_deep(jpg_bytes_2.data(), jpg_bytes_2.size()), mime_id::jpeg);
+		}
+		for (auto n = 0; n < 64; ++n) {
+			EXPECT_EQ(pinned.get_id_deep(png_bytes.data(), png_bytes.size()), mime_id::png);
+		}
+
+		// A detector's publish doesn't wait for its snapshots either, and a swap frees the sets it retired once they are released
+		auto published = detector{ signature_set{ make_mime_set({ mime_id::png }) } };
+		{
+			const auto snapshot = published.pin();
+			EXPECT_TRUE(published.publish(signature_set{ make_mime_set({ mime_id::jpeg }) }));
+			EXPECT_TRUE(published.publish(signature_set{ make_mime_set({ mime_id::gif }) }));
+			EXPECT_EQ(snapshot.get_id_deep(png_bytes.data(), png_bytes.size()), mime_id::png);
+			EXPECT_EQ(published.get_id_deep(png_bytes.data(), png_bytes.size()), mime_id::unknown);
+		}
+		published.swap(signature_set{ make_mime_set({ mime_id::png }) });
+		EXPECT_EQ(published.get_id_deep(png_bytes.data(), png_bytes.size()), mime_id::png);
+
+		auto frozen = adaptive_detector{ all_mime_types, manual.profile(), adaptive_options{ 1, 0, false } };
+		EXPECT_EQ(frozen.get_id_deep(png_bytes.data(), png_bytes.size()), mime_id::png);
+		EXPECT_EQ(frozen.profile().hits(mime_id::png), manual.profile().hits(mime_id::png));
+		EXPECT_THROW(adaptive_detector(all_mime_types, type_profile{}, adaptive_options{ 0 }), std::invalid_argument);
+		EXPECT_THROW(adaptive_detector(all_mime_types, type_profile{}, adaptive_options{ 48 }), std::invalid_argument);
+
+		// Readers keep agreeing with the registry while one of them republishes the order every few samples
+		auto adaptive = adaptive_detector{ all_mime_types, type_profile{}, adaptive_options{ 1, 64 } };
+		auto readers = std::vector<std::thread>{};
+		for (auto t = std::size_t{ 0 }; t < 3; ++t) {
+			readers.emplace_back([&adaptive, &headers, t]() {
+				for (auto n = t; n < headers.size(); n += 3) {
+					// Each thread sees a different mix, so that the order keeps changing
+					const auto& header = headers[(n % 2 == 0 || t == 0) ? n : (n * 7919) % headers.size()];
+					ASSERT_EQ(adaptive.get_id_deep(header.data(), header.size()), get_id_deep(header.data(), header.size()));
+				}
+			});
+		}
+		for (auto& reader : readers) {
+			reader.join();
+		}
+		EXPECT_EQ(adaptive.get_id_from_file("../test/test_files/Image_4.png").id, mime_id::png);
+
+		// A learned profile is frozen to a file and loaded back, the files that aren't profiles are rejected
+		const auto profile_path = (fs::temp_directory_path() / "file_mime_test.profile").string();
+		const auto learned = manual.profile();
+		ASSERT_EQ(learned.save(profile_path), 0);
+		auto loaded = type_profile{};
+		ASSERT_EQ(loaded.load(profile_path), 0);
+		for (auto id = std::size_t{ 0 }; id < detail::mime_types.size(); ++id) {
+			EXPECT_EQ(loaded.hits(static_cast<mime_id>(id)), learned.hits(static_cast<mime_id>(id)));
+		}
+		std::ofstream(profile_path) << "image/png 12\n";
+		EXPECT_EQ(loaded.load(profile_path), EINVAL);
+		EXPECT_EQ(loaded.hits(mime_id::jpeg), learned.hits(mime_id::jpeg));
+		std::ofstream(profile_path) << "file_mime profile 1\nimage/unheard-of 3\nimage/png 12\n";
+		EXPECT_EQ(loaded.load(profile_path), 0);
+		EXPECT_EQ(loaded.hits(mime_id::png), 12u);
+		EXPECT_EQ(loaded.hits(mime_id::jpeg), 0u);
+		fs::remove(profile_path);
+		EXPECT_EQ(loaded.load(profile_path), ENOENT);
+	}
+
+	// Tests that the result cache stays within its capacity, evicts the entries not used lately, is safe to share between threads and is persisted
+	TEST(FileMime, TestsResultCache) {
+		namespace fs = std::filesystem;
+
+		// A single bucket: the entries used since the hand last went past them get a second chance
+		auto small = result_cache{ detail::cache_ways };
+		EXPECT_EQ(small.capacity(), detail::cache_ways);
+		EXPECT_FALSE(small.persistent());
+		for (auto i = std::uint64_t{ 0 }; i < detail::cache_ways; ++i) {
+			small.insert(file_key{ 1, i, 100, 7 }, mime_id::png);
+		}
+		EXPECT_EQ(small.find(file_key{ 1, 0, 100, 7 }), mime_id::png);
+		EXPECT_FALSE(small.find(file_key{ 1, 0, 100, 8 }).has_value());
+		small.insert(file_key{ 1, 100, 100, 7 }, mime_id::unknown);
+		EXPECT_EQ(small.find(file_key{ 1, 100, 100, 7 }), mime_id::unknown);
+		EXPECT_EQ(small.find(file_key{ 1, 0, 100, 7 }), mime_id::png);
+		EXPECT_FALSE(small.find(file_key{ 1, 1, 100, 7 }).has_value());
+		small.clear();
+		EXPECT_FALSE(small.find(file_key{ 1, 0, 100, 7 }).has_value());
+
+		// The readers never see the id of another key while the writers evict entries under them
+		auto shared = result_cache{ 256 };
+		auto threads = std::vector<std::thread>{};
+		for (auto t = std::uint64_t{ 0 }; t < 4; ++t) {
+			threads.emplace_back([&shared, t]() {
+				auto gen = std::mt19937_64{ t };
+				for (auto n = 0; n < 20000; ++n) {
+					const auto inode = gen() % 1024;
+					const auto key = file_key{ 3, inode, inode * 7, inode * 13 };
+					const auto id = static_cast<mime_id>(inode % detail::mime_types.size());
+					if (const auto cached = shared.find(key)) {
+						ASSERT_EQ(*cached, id);
+					}
+					else {
+						shared.insert(key, id);
+					}
+				}
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+
+		// A hit takes a single fstatat call, and a rewritten file is classified again
+		const auto cache_path = fs::temp_directory_path() / "file_mime_test_cache.bin";
+		const auto file_path = (fs::temp_directory_path() / "file_mime_test_cached.png").string();
+		fs::remove(cache_path);
+		fs::copy_file("../test/test_files/Image_4.png", file_path, fs::copy_options::overwrite_existing);
+		{
+			auto cache = result_cache{ cache_path.string(), 1000 };
+			EXPECT_EQ(cache.error(), 0);
+			EXPECT_EQ(cache.capacity(), 1024u);
+			EXPECT_EQ(cache.get_id_from_file(file_path).id, mime_id::png);
+			reset_stats();
+			const auto result = cache.get_id_from_file(file_path);
+			EXPECT_EQ(result.id, mime_id::png);
+			EXPECT_FALSE(result.mismatch);
+			if (detail::stats_enabled) {
+				EXPECT_EQ(stats().syscalls, 1u);
+			}
+			EXPECT_EQ(cache.get_id_from_file("../test/test_files/Image_2 - jpeg with wrong extension.png").id, mime_id::jpeg);
+			EXPECT_TRUE(cache.get_id_from_file("../test/test_files/Image_2 - jpeg with wrong extension.png").mismatch);
+			EXPECT_EQ(cache.get_id_from_file("../test/test_files/non_existing.png").error, ENOENT);
+		}
+
+		// A restarted process starts with the results of the previous one
+		{
+			auto cache = result_cache{ cache_path.string(), 1000 };
+			EXPECT_TRUE(cache.persistent());
+			reset_stats();
+			EXPECT_EQ(cache.get_id_from_file(file_path).id, mime_id::png);
+			if (detail::stats_enabled) {
+				EXPECT_EQ(stats().syscalls, 1u);
+			}
+
+			auto file = std::ofstream(file_path, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(gif_bytes_89a.data()), std::streamsize(gif_bytes_89a.size()));
+			file.close();
+			fs::last_write_time(file_path, fs::last_write_time(file_path) + std::chrono::seconds(1));
+			const auto result = cache.get_id_from_file(file_path);
+			EXPECT_EQ(result.id, mime_id::gif);
+			EXPECT_TRUE(result.mismatch);
+		}
+
+		// A valid cache keeps its capacity, so that it's never resized under the mapping of another process
+		{
+			auto cache = result_cache{ cache_path.string(), 100 };
+			EXPECT_EQ(cache.capacity(), 1024u);
+			EXPECT_EQ(cache.get_id_from_file(file_path).id, mime_id::gif);
+		}
+		fs::remove(cache_path);
+
+		// A bucket left locked by a process that died halfway through an insert is skipped, and cleared by the next process that maps the file alone
+		const auto key = file_key{ 1, 2, 3, 4 };
+		{
+			auto cache = result_cache{ cache_path.string(), detail::cache_ways };
+			ASSERT_TRUE(cache.persistent());
+			const auto odd = std::uint32_t{ 7 };
+			auto file = std::fstream(cache_path, std::ios::in | std::ios::out | std::ios::binary);
+			file.seekp(sizeof(detail::cache_header));
+			file.write(reinterpret_cast<const char*>(&odd), sizeof(odd));
+			file.close();
+			cache.insert(key, mime_id::png);
+			EXPECT_FALSE(cache.find(key).has_value());
+			cache.clear();
+		}
+		{
+			auto cache = result_cache{ cache_path.string(), detail::cache_ways };
+			cache.insert(key, mime_id::png);
+			EXPECT_EQ(cache.find(key), mime_id::png);
+		}
+
+		fs::remove(cache_path);
+		fs::remove(file_path);
+	}
+
+	// Tests that the index compiled from the built-in registry classifies like get_id_deep, and that the databases are parsed as documented
+	TEST(FileMime, TestsSignatureIndex) {
+		namespace fs = std::filesystem;
+
+		// Written to a file and mapped, as the index is meant to be used
+		const auto builtin = compile_signature_index(builtin_signature_database());
+		const auto path = fs::temp_directory_path() / "file_mime_builtin.idx";
+		{
+			auto file = std::ofstream(path, std::ios::binary);
+			file.write(reinterpret_cast<const char*>(builtin.data()), std::streamsize(builtin.size()));
+		}
+		const auto index = signature_index{ path.string() };
+		ASSERT_EQ(index.error(), 0);
+		ASSERT_EQ(index.type_count(), detail::mime_types.size() - 1);
+		EXPECT_EQ(index.max_read_size(), 32769u + 5u);
+
+		auto gen = std::mt19937{ 7 };
+		auto signature_dis = std::uniform_int_distribution<std::size_t>{ 0, magic_signatures.size() - 1 };
+		for (auto n = 0; n < 20000; ++n) {
+			const auto& signature = magic_signatures[signature_dis(gen)];
+			auto bytes = make_header(gen, signature, n);
+			const auto id = get_id_deep(bytes.data(), bytes.size());
+			ASSERT_EQ(index.mime_type(index.get_type_deep(bytes.data(), bytes.size())), get_type_from_id(id));
+		}
+
+		for (const auto& info : detail::extensions) {
+			auto upper = std::string(info.extension);
+			std::transform(upper.begin(), upper.end(), upper.begin(), [](const char c) { return char(std::toupper(c)); });
+			EXPECT_EQ(index.mime_type(index.get_type_from_extension(upper)), get_type_from_id(info.id));
+		}
+		EXPECT_EQ(index.get_type_from_extension(".txt"), no_index_type);
+		EXPECT_EQ(index.extension(index.find_type("image/jpeg")), ".jpg");
+		auto buffer = std::vector<std::uint8_t>{};
+		reset_stats();
+		EXPECT_EQ(index.mime_type(index.get_type_from_file("../test/test_files/Image_2 - jpeg with wrong extension.png", buffer).type), "image/jpeg");
+		EXPECT_EQ(index.get_type_from_file("../test/test_files/non_existing.png", buffer).error, ENOENT);
+		EXPECT_EQ(stats().files, 1u);
+		EXPECT_EQ(stats().syscalls, 4u);
+
+		// A truncated index is rejected
+		EXPECT_EQ(signature_index(builtin.data(), builtin.size() - 4).error(), EINVAL);
+		EXPECT_EQ(signature_index((fs::temp_directory_path() / "file_mime_non_existing.idx").string()).error(), ENOENT);
+		fs::remove(path);
+
+		// The text format: priorities, offset ranges, wildcards and the tests that all have to pass
+		const auto text = compile_signature_index(parse_signature_text(
+			"# comment\n"
+			"application/x-low .Low,.lo 0:4142\n"
+			"application/x-high - 80@0:41??43&8-16:5A5A # beats x-low\n"
+			"application/x-low - 2-4:FFFE\n"));
+		const auto text_index = signature_index{ text.data(), text.size() };
+		ASSERT_EQ(text_index.error(), 0);
+		const auto classify = [&text_index](const std::string_view bytes) {
+			return text_index.mime_type(text_index.get_type_deep(reinterpret_cast<const std::uint8_t*>(bytes.data()), bytes.size()));
+		};
+		EXPECT_EQ(classify("ABC_____"), "application/x-low");
+		EXPECT_EQ(classify("ABC_____ZZ"), "application/x-high");
+		EXPECT_EQ(classify("AXC___________ZZ"), "application/x-high");
+		EXPECT_EQ(classify("AXC______________ZZ"), ""); // the ZZ range ends at offset 16
+		EXPECT_EQ(classify("___\xFF\xFE"), "application/x-low");
+		EXPECT_EQ(classify("_____\xFF\xFE"), "");
+		EXPECT_EQ(text_index.mime_type(text_index.get_type_shallow("dir.x/file.LOW")), "application/x-low");
+		EXPECT_THROW(static_cast<void>(parse_signature_text("application/x-bad .bad 0:4")), std::invalid_argument);
+
+		// shared-mime-info: nested matches, the numeric types, masks, escapes and entities
+		const auto xml = compile_signature_index(parse_shared_mime_info(R"(<?xml version="1.0" encoding="UTF-8"?>
+			<!-- comment <mime-type type="ignored"/> -->
+			<mime-info xmlns="http://www.freedesktop.org/standards/shared-mime-info">
+				<mime-type type="application/x-nested">
+					<comment>Nested &amp; escaped</comment>
+					<glob pattern="*.nest"/>
+					<glob pattern="README*"/>
+					<magic priority="60">
+						<match type="string" value="NEST\x00" offset="0">
+							<match type="big16" value="0x0102" offset="5"/>
+							<match type="little32" value="0x01020304" offset="5:6"/>
+						</match>
+					</magic>
+				</mime-type>
+				<mime-type type="application/x-masked">
+					<magic priority="50">
+						<match type="string" value="M&lt;&#x41;" mask="0xFFFFDF" offset="0"/>
+						<match type="regex" value="a.*b" offset="0"><match type="byte" value="1" offset="1"/></match>
+					</magic>
+				</mime-type>
+			</mime-info>)"));
+		const auto xml_index = signature_index{ xml.data(), xml.size() };
+		ASSERT_EQ(xml_index.error(), 0);
+		const auto xml_classify = [&xml_index](const std::string_view bytes) {
+			return xml_index.mime_type(xml_index.get_type_deep(reinterpret_cast<const std::uint8_t*>(bytes.data()), bytes.size()));
+		};
+		EXPECT_EQ(xml_classify(std::string_view("NEST\0\x01\x02", 7)), "application/x-nested");
+		EXPECT_EQ(xml_classify(std::string_view("NEST\0_\x04\x03\x02\x01", 10)), "application/x-nested");
+		EXPECT_EQ(xml_classify(std::string_view("NEST\0\x02\x01", 7)), "");
+		EXPECT_EQ(xml_classify("M<a"), "application/x-masked");
+		EXPECT_EQ(xml_classify("M<b"), "");
+		EXPECT_EQ(xml_index.mime_type(xml_index.get_type_from_extension(".NEST")), "application/x-nested");
+		EXPECT_EQ(xml_index.get_type_from_extension(".readme"), no_index_type);
+		EXPECT_THROW(static_cast<void>(parse_shared_mime_info("<mime-type type=\"a/b\"><match type=\"byte\" value=\"1\" offset=\"0\"")), std::invalid_argument);
+	}
 } // namespace
 
 namespace {
 
+	// The wildcard magic bytes are set to 0
+	template <typename T, std::size_t N>
+	[[nodiscard]] auto to_vector(const std::array<T, N>& magic_bytes) {
+		auto bytes = std::vector<std::uint8_t>{};
+		for (const auto magic_byte : magic_bytes) {
+			bytes.push_back(magic_byte == any_byte ? std::uint8_t{ 0 } : static_cast<std::uint8_t>(magic_byte));
+		}
+		return bytes;
+	}
+
 	static const auto known_mime_types_bytes = std::vector< std::pair<std::vector<std::uint8_t>, std::string> >{
-		{ gif_bytes_87a, "image/gif"},
-		{ gif_bytes_89a, "image/gif" },
+		{ to_vector(gif_bytes_87a), "image/gif"},
+		{ to_vector(gif_bytes_89a), "image/gif" },
 
-		{ png_bytes, "image/png" },
+		{ to_vector(png_bytes), "image/png" },
 
-		{ bmp_bytes, "image/bmp" },
+		{ to_vector(bmp_bytes), "image/bmp" },
 
-		{ pm_bytes, "image/pm" },
+		{ to_vector(pm_bytes), "image/pm" },
 
-		{ jpg_bytes_1, "image/jpeg" },
-		{ jpg_bytes_2, "image/jpeg" },
-		{ jpg_bytes_3, "image/jpeg" },
+		{ to_vector(jpg_bytes_1), "image/jpeg" },
+		{ to_vector(jpg_bytes_2), "image/jpeg" },
+		{ to_vector(jpg_bytes_3), "image/jpeg" },
 		
-		{ jpg_2000_bytes, "image/jp2" },
+		{ to_vector(jpg_2000_bytes), "image/jp2" },
+
+		{ to_vector(tiff_bytes_mono), "image/tiff" },
+		{ to_vector(tiff_bytes_intel), "image/tiff" },
+		{ to_vector(tiff_bytes_motorola), "image/tiff" },
 
-		{ tiff_bytes_mono, "image/tiff" },
-		{ tiff_bytes_intel, "image/tiff" },
-		{ tiff_bytes_motorola, "image/tiff" },
+		{ to_vector(tga_bytes_compressed), "image/tga" },
+		{ to_vector(tga_bytes_uncompressed), "image/tga" },
 
-		{ tga_bytes_compressed, "image/tga" },
-		{ tga_bytes_uncompressed, "image/tga" },
+		{ to_vector(exr_bytes), "image/exr" },
 
-		{ exr_bytes, "image/exr" },
+		{ to_vector(hdr_bytes), "image/hdr" },
 
-		{ hdr_bytes, "image/hdr" },
+		{ to_vector(ktx1_bytes), "image/ktx" },
+		{ to_vector(ktx2_bytes), "image/ktx2" },
 
-		{ ktx1_bytes, "image/ktx" },
-		{ ktx2_bytes, "image/ktx2" },
+		{ to_vector(webp_bytes), "image/webp" },
 
-		{ webp_bytes, "image/webp" },
+		{ to_vector(bpg_bytes), "image/bpg" },
 
-		{ bpg_bytes, "image/bpg" },
+		{ to_vector(glb_bytes), "model/gltf-binary" },
 
-		{ glb_bytes, "model/gltf-binary" },
+		{ to_vector(wav_bytes), "audio/wav" },
 	};
 
 	// Generates random bytes of random length (within the [#file_mime::min_image_header_size, #file_mime::max_image_header_size] range) the specified number of times
@@ -317,6 +1798,28 @@ namespace {
 		}
 	}
 
+	void image_mime_batch_benchmark(benchmark::State& state) {
+
+		std::cout << "# of headers: " << state.range(0) << "\n";
+		std::cout << "dice number: " << state.range(1) << "\n";
+		const auto random_file_header_bytes = setup_fixture(state.range(0), int(state.range(1)));
+
+		// The batch API takes the headers as a structure of arrays
+		auto headers = std::vector<const std::uint8_t*>{};
+		auto sizes = std::vector<std::size_t>{};
+		for (const auto& bytes : random_file_header_bytes) {
+			headers.push_back(bytes.first.data());
+			sizes.push_back(bytes.first.size());
+		}
+		auto ids = std::vector<mime_id>(headers.size());
+
+		for (auto _ : state) {
+			get_id_deep_batch(headers.data(), sizes.data(), headers.size(), ids.data());
+			benchmark::DoNotOptimize(ids.data());
+			benchmark::ClobberMemory();
+		}
+	}
+
 	void CustomArguments(benchmark::internal::Benchmark* b) {
 		static constexpr auto number_of_headers = size_t{ 10000000U };
 		static constexpr auto dice_number = int{ 10 };
@@ -324,6 +1827,7 @@ namespace {
 	}
 
 	BENCHMARK(image_mime_benchmark)->Apply(CustomArguments)->Iterations(100);
+	BENCHMARK(image_mime_batch_benchmark)->Apply(CustomArguments)->Iterations(100);
 
 } // namespace
 
@@ -0,0 +1,59 @@
+// Compiles a signature database into the binary index read by file_mime::signature_index:
+//
+//     file_mime_compile freedesktop.org.xml mime.idx     shared-mime-info XML (by the .xml extension)
+//     file_mime_compile signatures.txt mime.idx          the text format of file_mime::parse_signature_text
+//     file_mime_compile --builtin mime.idx               the built-in registry
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "file_mime/signature_compiler.h"
+
+int main(int argc, char* argv[]) {
+	if (argc != 3) {
+		std::cerr << "usage: file_mime_compile <database.xml|database.txt|--builtin> <index>\n";
+		return 2;
+	}
+
+	const auto input = std::string_view(argv[1]);
+	const auto output = std::string(argv[2]);
+	try {
+		auto database = file_mime::signature_database{};
+		if (input == "--builtin") {
+			database = file_mime::builtin_signature_database();
+		}
+		else {
+			auto file = std::ifstream(std::string(input), std::ios::binary);
+			if (!file) {
+				std::cerr << "file_mime_compile: can't open " << input << "\n";
+				return 1;
+			}
+			auto text = std::ostringstream{};
+			text << file.rdbuf();
+			const auto is_xml = input.size() >= 4 && file_mime::detail::equals_lowercase(input.substr(input.size() - 4), ".xml");
+			database = is_xml ? file_mime::parse_shared_mime_info(text.str()) : file_mime::parse_signature_text(text.str());
+		}
+
+		const auto index = file_mime::compile_signature_index(database);
+		auto file = std::ofstream(output, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(index.data()), std::streamsize(index.size()));
+		if (!file.flush()) {
+			std::cerr << "file_mime_compile: can't write " << output << "\n";
+			return 1;
+		}
+
+		auto pattern_count = std::size_t{ 0 };
+		for (const auto& type : database) {
+			pattern_count += type.patterns.size();
+		}
+		std::cout << output << ": " << database.size() << " types, " << pattern_count << " patterns, " << index.size() << " bytes\n";
+	}
+	catch (const std::exception& e) {
+		std::cerr << "file_mime_compile: " << input << ": " << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}